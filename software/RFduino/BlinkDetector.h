@@ -0,0 +1,525 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BLINK_DETECTOR_H
+#define BLINK_DETECTOR_H
+
+#include <stdint.h>
+
+// Real time eye blink detection core.
+// The detector only depends on <stdint.h>, so the same header is used by the sketch
+// (RTBlinkDetection.ino) and by host programs which replay recorded data or compare
+// several configurations side by side:
+//
+//   BlinkDetector<sample_t, accum_t, 16, 200> detector;   // configuration of the sketch
+//   BlinkDetector<float, double, 8, 256> other;           // any other configuration
+//
+// Template parameters:
+//   Sample        type of a filtered sample, the thresholds and the extreme values
+//   Accum         type of the proximity values and the moving average sum
+//   MaDepth       depth of the moving average filter
+//   HistoryLength number of filtered samples kept (max. blink duration in samples)
+// If MaDepth / HistoryLength are powers of two the ring buffer indices are wrapped with a
+// bit mask, otherwise with a compare. Both cases are resolved at compile time.
+//
+// Integer samples are analysed as the moving average sum itself (MaDepth times the filtered
+// value) and the thresholds are scaled up instead. Dividing the sum would truncate small
+// sums of either sign to 0, which the zero crossing detection sees as crossings the float
+// build never sees. With the unscaled sum both builds make the same decisions for the same
+// Q15.16 input (tools/fixedbench.cpp).
+
+
+/**
+ * Blink profile parameters (can be set via computer app).
+ */
+template<typename Sample>
+struct BlinkParameters {
+  Sample edgePosThresh;   // pos threshold for blink detection
+  Sample edgeNegThresh;   // neg threshold for blink detection
+  Sample hyst;            // not applied to zero crossing intentionally (doesn't cross all the way all the time).
+  Sample max_max;         // everything bigger than this as maximum is ignored
+  Sample min_min;         // everything smaller than this as minimum is ignored.
+  uint8_t t_fall[2];      // min and max samples allowed for falling edge
+  uint8_t t_rise[2];      // min and max samples allowed for rising edge
+  uint16_t t_total[2];    // min and max samples allowed for total blink duration
+  uint8_t allowedZeros;   // allowed sample number the eye is closed during an eye blink
+};
+
+
+template<typename Sample, typename Accum, int MaDepth, int HistoryLength>
+class BlinkDetector {
+public:
+  BlinkParameters<Sample> params;
+
+  BlinkDetector() {
+    reset();
+  }
+
+  /**
+   * Set the default parameters and clear all buffers and detection states.
+   * The default values need a look at the actual data!
+   */
+  void reset() {
+    params.edgePosThresh = fromMM(0.0025);
+    params.edgeNegThresh = fromMM(-0.003);
+    params.hyst = fromMM(0.0002);
+    params.max_max = fromMM(0.02);
+    params.min_min = fromMM(-0.02);
+    params.t_fall[0] = 4;
+    params.t_fall[1] = 30;
+    params.t_rise[0] = 6;
+    params.t_rise[1] = 35;
+    params.t_total[0] = 30;
+    params.t_total[1] = 105;
+    params.allowedZeros = 4;
+
+    for (int i = 0; i < HistoryLength; ++i) {
+      proxFilteredBuffer[i] = 0;
+    }
+    for (int i = 0; i < MaDepth; ++i) {
+      maBuffer[i] = 0;
+    }
+    maSum = 0;
+    lastProximity = 0;
+    iMa = 0;
+    iP = 0;
+
+    iZero = 0;
+    iZeroPrev = 0;
+    zeroCount = 0;
+    iEdgeRisingPos = 0;
+    iEdgeFallingPos = 0;
+    iEdgeRisingNeg = 0;
+    iEdgeFallingNeg = 0;
+    iMax = 0;
+    iMin = 0;
+    maxVal = 0;
+    minVal = 0;
+    runMaxVal = 0;
+    runMinVal = 0;
+    iFirstMax = 0;
+    iLastMax = -1;
+    iFirstMin = 0;
+    iLastMin = -1;
+    edgeType = 0;
+
+    lessZero = false;
+    abovePos = false;
+    belowNeg = false;
+
+    blinkLevel = 0;
+    iBlinkLevel = 0;
+    lengths[0] = lengths[1] = lengths[2] = 0;
+  }
+
+  /**
+   * Process a new proximity value.
+   * 1. Get the differential value to remove DC offset.
+   * 2. Apply a moving average filter on the differential values
+   *    Through try and error: a moving average filter with a depth of 16 seemed to work best.
+   * 3. - 5. see updateFiltered()
+   * Returns true if an eye blink was just detected.
+   */
+  bool update(Accum proximity) {
+    // 1. Get the differential value to remove DC offset.
+    Accum diff_prox = -lastProximity + proximity;
+    // store current 'raw' proximity value for next execution.
+    lastProximity = proximity;
+
+    // 2. Apply a moving average filter on the differential values
+    maSum -= maBuffer[iMa];
+    maBuffer[iMa] = diff_prox;
+    maSum += maBuffer[iMa];
+    iMa = next<MaDepth>(iMa);
+
+    // Integer samples keep the unscaled sum (see analysisScale()).
+    if (analysisScale() == 1) {
+      return analyse(maSum / MaDepth);
+    }
+    return analyse(maSum);
+  }
+
+  /**
+   * Process a new filtered sample (output of the moving average filter).
+   * Used directly when replaying recordings of filtered values.
+   * 3. Find zero crossings
+   *    Analyse the values compared to the one before to detect a zero crossing.
+   * 4. Find rising and falling edges
+   * 5. Evaluate current edge and zero crossing situation
+   * Returns true if an eye blink was just detected.
+   */
+  bool updateFiltered(Sample value) {
+    return analyse(value * analysisScale());
+  }
+
+  /**
+   * Returns the last filtered value.
+   */
+  Sample filtered() const {
+    return proxFilteredBuffer[iP == 0 ? HistoryLength - 1 : iP - 1] / analysisScale();
+  }
+
+  /**
+   * Returns the current blink level (0 nothing, 1 falling part found, 2 blink detected).
+   */
+  uint8_t level() const {
+    return blinkLevel;
+  }
+
+  /**
+   * Returns the edge type of the last sample (-1 negative, 0 none, 1 positive).
+   */
+  int8_t edge() const {
+    return edgeType;
+  }
+
+  /**
+   * Converts a value in mm into the sample type / the accumulator type.
+   * Integer types are Q15.16 fixed point values (see FixedPoint.h).
+   */
+  static Sample fromMM(double mm) {
+    return convertMM<Sample>(mm);
+  }
+
+  static Accum accumFromMM(double mm) {
+    return convertMM<Accum>(mm);
+  }
+
+  /**
+   * Factor between the analysed values and the filtered values: MaDepth for integer samples
+   * (the moving average sum is not divided), 1 for floating point samples.
+   */
+  static Sample analysisScale() {
+    return (Sample)0.5 == 0 ? (Sample)MaDepth : (Sample)1;
+  }
+
+private:
+  // Compile time checks of the template parameters (array size turns negative on failure).
+  typedef char checkMaDepth[MaDepth > 0 && MaDepth < HistoryLength ? 1 : -1];
+  typedef char checkHistoryLength[HistoryLength > 1 && HistoryLength <= 0x7FFF ? 1 : -1];
+
+  /**
+   * Analyses a new value, the filtered sample times analysisScale().
+   */
+  bool analyse(Sample value) {
+    bool justBlinked = false;
+
+    // store value in analysing buffer.
+    proxFilteredBuffer[iP] = value;
+
+    // 3. Find zero crossings
+    detectZeroCrossing(value);
+
+    // 4. Find rising and falling edges
+    performEdgeDetectionAndExtremeValueDetermination(value);
+
+    // 5. Evaluate current edge and zero crossing situation
+    // Three step blink validation...
+    if (blinkLevel != 0 && distance(iBlinkLevel, iP) > params.t_total[1]) {
+      // last blink fragment detect event is more than max blink duration ago.
+      // reset current blink detection progress.
+      blinkLevel = 0;
+    }
+
+    if (edgeType == -1 && blinkLevel == 0) {
+      // Is the first step condition met?
+      // Rising negative edge after falling negative edge detected and min value meets conditions.
+      if (iZero == iP) {
+        lengths[0] = distance(iZeroPrev, iMin);
+      } else {
+        lengths[0] = distance(iZero, iMin);
+      }
+      if (lengths[0] >= params.t_fall[0] && lengths[0] <= params.t_fall[1]) {
+        // the min part of the curve has the correct length.
+        blinkLevel = 1;
+        zeroCount = 0;
+        iBlinkLevel = iP;
+      } else {
+        // reset current blink detection progress.
+        blinkLevel = 0;
+      }
+    } else if (edgeType == 1 && blinkLevel == 1) {
+      // is the second step condition met?
+      // Falling positive edge after rising positive edge detected and max value meets conditions.
+      // In current version the blink detection is finished here, otherwise the eye is fully open and one would see the blurry screen after opening the eyes.
+      lengths[1] = distance(iMin, iMax);
+      if (lengths[1] >= params.t_rise[0] && lengths[1] <= params.t_rise[1] && zeroCount < params.allowedZeros) {
+        blinkLevel = 2;
+        iBlinkLevel = iP;
+        justBlinked = true;
+      } else {
+        blinkLevel = 0;
+      }
+    } else if (iZero == iP && blinkLevel == 2) {
+      // Final zero crossing detected (eye is fully open)
+      // does the overall blink meet the requiremnts?
+      lengths[2] = distance(iMax, iP);
+      int sum = lengths[0] + lengths[1] + lengths[2];
+      if (sum >= params.t_total[0] && sum <= params.t_total[1] && maxVal <= params.max_max * analysisScale() && minVal >= params.min_min * analysisScale()) {
+        blinkLevel = 0;
+//        justBlinked = true;
+      } else {
+        blinkLevel = 0;
+      }
+    }
+
+    // Some cleanup and preparation for next round.
+
+    // increase proximity buffer index
+    iP = next<HistoryLength>(iP);
+
+    // make sure that old indexes are removed if outdated.
+    // (required for min max detection and other stuff)
+    if (iP == iMin) {
+      iMin = -1;
+    }
+    if (iP == iMax) {
+      iMax = -1;
+    }
+    if (iP == iBlinkLevel) {
+      blinkLevel = 0;
+      iBlinkLevel = iP;
+    }
+    if (iP == iEdgeRisingPos) {
+      iEdgeRisingPos = -1;
+    }
+    if (iP == iEdgeFallingPos) {
+      iEdgeFallingPos = -1;
+    }
+    if (iP == iEdgeRisingNeg) {
+      iEdgeRisingNeg = -1;
+    }
+    if (iP == iEdgeFallingNeg) {
+      iEdgeFallingNeg = -1;
+    }
+    return justBlinked;
+  }
+
+  template<typename T>
+  static T convertMM(double mm) {
+    if ((T)0.5 == 0) {
+      return (T)(mm * 65536.0 + (mm < 0 ? -0.5 : 0.5));
+    }
+    return (T)mm;
+  }
+
+  /**
+   * Returns the ring buffer index following i.
+   * Power of two sizes use a bit mask, all other sizes a compare instead of the modulo.
+   */
+  template<int Size>
+  static int next(int i) {
+    if ((Size & (Size - 1)) == 0) {
+      return (i + 1) & (Size - 1);
+    }
+    return i + 1 == Size ? 0 : i + 1;
+  }
+
+  /**
+   * Returns the number of samples from index 'from' to index 'to' in the history ring buffer.
+   * An outdated index (-1) is treated like the index before 0.
+   */
+  static int distance(int from, int to) {
+    if ((HistoryLength & (HistoryLength - 1)) == 0) {
+      return (to - from) & (HistoryLength - 1);
+    }
+    return to < from ? to + HistoryLength - from : to - from;
+  }
+
+  /**
+   * Returns the index in the middle of the first and the last occurence of an extreme value.
+   * iLast is -1 if the extreme value occured only once.
+   * Takes care of an iP overflow inbetween both indices.
+   */
+  static int centerIndex(int iFirst, int iLast) {
+    if (iLast < 0) {
+      return iFirst;
+    }
+    int center = iFirst + distance(iFirst, iLast) / 2;
+    if (center >= HistoryLength) {
+      center -= HistoryLength;
+    }
+    return center;
+  }
+
+  /**
+   * Detects zero crossing in proxFilteredBuffer[iP]
+   */
+  void detectZeroCrossing(Sample value) {
+    if (lessZero && value >= 0) {
+      lessZero = false;
+      iZeroPrev = iZero;
+      iZero = iP;
+    } else if (!lessZero && value <= 0) {
+      lessZero = true;
+      iZeroPrev = iZero;
+      iZero = iP;
+    }
+  }
+
+  /**
+   * Very efficient edge detection based on thresholds and hysterises.
+   * Works similar to a state machine.
+   *
+   * The function looks much more complicated than it is:
+   *  - If positive rising edge (pos threshold + hyst crossed upwards)
+   *    Remember the crossing and start tracking the maximum value.
+   *  - While above the positive threshold
+   *    Update the maximum value and the first and last index it occurred at.
+   *  - If positive falling edge (pos threshold - hyst crossed downwards)
+   *    Take the tracked maximum value between last positive rising edge and now.
+   *    If multiple occurences of max value the index center is taken as iMax.
+   *    [1,4,7,5,4,3,7,2,3,1] -> iMax = (6 + 2) / 2 = 4 (index starting at 0)
+   *  - If negative falling edge (neg threshold - hyst crossed downwards)
+   *    Remember the crossing and start tracking the minimum value.
+   *  - While below the negative threshold
+   *    Update the minimum value and the first and last index it occurred at.
+   *  - If negative rising edge (neg threshold + hyst crossed upwards)
+   *    Take the tracked minimum value between last negative falling edge and now.
+   *    If multiple occurences of min value, the index center is taken as iMin.
+   *
+   * The extreme values are maintained incrementally as the samples arrive, so closing an edge
+   * costs constant time instead of rescanning up to HistoryLength samples.
+   */
+  void performEdgeDetectionAndExtremeValueDetermination(Sample value) {
+    edgeType = 0;
+    const Sample scale = analysisScale();
+    const Sample posHigh = (params.edgePosThresh + params.hyst) * scale;
+    const Sample posLow = (params.edgePosThresh - params.hyst) * scale;
+    const Sample negLow = (params.edgeNegThresh - params.hyst) * scale;
+    const Sample negHigh = (params.edgeNegThresh + params.hyst) * scale;
+
+    // Track the extreme values of the currently open edges.
+    if (abovePos) {
+      if (value > runMaxVal) {
+        runMaxVal = value;
+        iFirstMax = iP;
+        iLastMax = -1;
+      } else if (value == runMaxVal) {
+        iLastMax = iP;
+      }
+    }
+    if (belowNeg) {
+      if (value < runMinVal) {
+        runMinVal = value;
+        iFirstMin = iP;
+        iLastMin = -1;
+      } else if (value == runMinVal) {
+        iLastMin = iP;
+      }
+    }
+
+    // positive edges:
+    if (!abovePos && value > posHigh) {
+      // Positive rising edge
+      iEdgeRisingPos = iP;
+      abovePos = true;
+      runMaxVal = value;
+      iFirstMax = iP;
+      iLastMax = -1;
+    } else if (abovePos && value < posLow) {
+      // Positive falling edge
+      if (iEdgeRisingPos >= 0) {
+        // last rising edge is not more than HistoryLength samples away
+        iEdgeFallingPos = iP;
+        maxVal = runMaxVal;
+        iMax = centerIndex(iFirstMax, iLastMax);
+        edgeType = 1;
+      }
+      abovePos = false;
+    } else if (!belowNeg && value < negLow) {
+      // Negative falling edge
+      iEdgeFallingNeg = iP;
+      belowNeg = true;
+      runMinVal = value;
+      iFirstMin = iP;
+      iLastMin = -1;
+    } else if (belowNeg && value > negHigh) {
+      // Negative rising edge
+      iEdgeRisingNeg = iP;
+      if (iEdgeFallingNeg >= 0) {
+        // last falling edge is not more than HistoryLength samples away
+        minVal = runMinVal;
+        iMin = centerIndex(iFirstMin, iLastMin);
+        edgeType = -1;
+      }
+      belowNeg = false;
+    }
+  }
+
+  // Moving average filter
+  Accum maBuffer[MaDepth];  // moving average buffer
+  Accum maSum;              // temporary moving average sum.
+  Accum lastProximity;      // last proximity value
+  int iMa;                  // index for the moving average buffer. (circular array style).
+
+  // Filtered data
+  Sample proxFilteredBuffer[HistoryLength]; // filtered samples times analysisScale(), analyzed to find blinks
+  int iP;                   // index for proxFilteredBuffer used in circular array fashion.
+
+  // i<Name> indicates an index for the sample buffer. Usually last occurence of certain event / condition.
+  int iZero;                // last encountered zero crossing
+  int iZeroPrev;            // Previous zero crossing
+  int zeroCount;            // Counter for zero crossings. Will be reset more often than not. Will not overflow.
+  int iEdgeRisingPos;       // Last encountered positive rising edge.
+  int iEdgeFallingPos;      // Last encountered positive falling edge.
+  int iEdgeRisingNeg;       // Last encountered negative rising edge.
+  int iEdgeFallingNeg;      // Last encountered negative falling edge.
+  int iMax;                 // Index of last encountered maximum value above positive thresholds
+  int iMin;                 // Index of last encountered minimum value below negative thresholds
+  Sample maxVal;            // Maximal valid maximum value.
+  Sample minVal;            // Minimal valid minimum value.
+
+  // Running extreme values of the currently open positive / negative edge.
+  // Updated with every sample, taken over as maxVal / minVal when the edge closes.
+  Sample runMaxVal;         // Running maximum since last positive rising edge.
+  Sample runMinVal;         // Running minimum since last negative falling edge.
+  int iFirstMax;            // First index of the running maximum.
+  int iLastMax;             // Last index of the running maximum (-1 if it occured only once).
+  int iFirstMin;            // First index of the running minimum.
+  int iLastMin;             // Last index of the running minimum (-1 if it occured only once).
+  int8_t edgeType;          // updated every cycle.
+  //  1 means falling pos edge after rising pos edge detected
+  // -1 means rising neg edge after falling neg edge detected
+  // 0 otherwise.
+
+  bool lessZero;
+  bool abovePos;
+  bool belowNeg;
+
+  // BLINK DETECTION CONDITIONS
+  // blinkLevel is the three step procedure:
+  // blinkLevel=0 -> No blink matching in progress.
+  // blinkLevel=1 -> negative falling and rising edge detected and min value meets conditions.
+  // blinkLevel=2 -> poitive rising and falling edge detected, max value meets conditions conditions depending on min conditions.
+  // blinkLevel=3 -> overall length meets conditions.
+  uint8_t blinkLevel;       // indicating blink level as described above.
+  int iBlinkLevel;          // index of blinkLevel change
+  int lengths[3];           // lengths of ongoing eye blink fragments.
+};
+
+#endif
@@ -25,45 +25,59 @@
  * SOFTWARE.
  */
 
-// Incoming messages to RFduino
-#define BLE_IN_MESSAGE_NORMAL_MODE                0x00 // Normal operation -> Send justBlinked messages.
-#define BLE_IN_MESSAGE_START_CALIBRATION          0x01 // Request to send prefiltered proximity values additionally.
-#define BLE_IN_MESSAGE_STOP_CALIBRATION           0x02 // Request to stop sending prefiltered proximity values.
-#define BLE_IN_MESSAGE_SET_PARAMETRS              0x03 // Indicating that incoming message contains a tuning parameter value pair.
-#define BLE_IN_MESSAGE_START_DEBUG                0x0E // Request to start sending debugging messages
-#define BLE_IN_MESSAGE_STOP_DEBUG                 0x0F // Request to stop sending debugging messages
-#define BLE_IN_MESSAGE_REQUEST_BATTERY_LEVEL      0x10 // Request battery voltage level.
-#define BLE_IN_MESSAGE_RESET                      0xFF // Request system reset. Will be executet immediately.
-
-// Outgoing Messages
-#define BLE_OUT_MESSAGE_ALIVE                     0x00 // Indicating operation in normal mode.
-#define BLE_OUT_MESSAGE_BLINK_DETECTED            0x01 // Indicating a just detected eye blink
-#define BLE_OUT_MESSAGE_CALBIRATION_DATA          0x02 // indicating prefiltered proximity value eye blink detection data message.
-#define BLE_OUT_MESSAGE_PARAMTERS_SET             0x03 // Sent after receiving last paramter allowed zeros (dirty wip)
-#define BLE_OUT_MESSAGE_DEBUG                     0x0F // Followed by <data length max 255> <data> (NYI)
-#define BLE_OUT_MESSAGE_REQUEST_BATTERY_LEVEL     0x10 // Indicating battery level data as float.
-#define BLE_OUT_MESSAGE_ERROR_EXCEPTION           0xEE // Indicating Error or exception (NYI)
-#define BLE_OUT_MESSAGE_RESET                     0xFF // Indicating start up or restart of system.
-
-// Eye blink calibration Parameters
-#define BLE_CALIBRATION_PARAMETERS_THRESH_NEG     0x10
-#define BLE_CALIBRATION_PARAMETERS_THRESH_POS     0x11
-#define BLE_CALIBRATION_PARAMETERS_HYSTERESIS     0x12
-#define BLE_CALIBRATION_PARAMETERS_MIN_MIN        0x13
-#define BLE_CALIBRATION_PARAMETERS_MAX_MAX        0x14
-#define BLE_CALIBRATION_PARAMETERS_T_FALL_MIN     0x15
-#define BLE_CALIBRATION_PARAMETERS_T_FALL_MAX     0x16
-#define BLE_CALIBRATION_PARAMETERS_T_RISE_MIN     0x17
-#define BLE_CALIBRATION_PARAMETERS_T_RISE_MAX     0x18
-#define BLE_CALIBRATION_PARAMETERS_T_TOTAL_MIN    0x19
-#define BLE_CALIBRATION_PARAMETERS_T_TOTAL_MAX    0x1A
-#define BLE_CALIBRATION_PARAMETERS_ALLOWED_ZEROS  0x1B
+// Message ids, parameter ids and the encoding of the messages are defined in ProtocolCodec.h
 
 // temporarily used to determine package loss.
 // Counts number of sent packages during calibration
 // Can be compared to number of received packages.
 int packageCount = 0;
 
+// Calibration samples are collected and sent in frames of CALIBRATION_FRAME_SAMPLES samples
+// to reduce the number of radio events. 4 samples fill a 20 byte BLE packet.
+#define CALIBRATION_FRAME_SAMPLES PROTOCOL_CALIBRATION_MAX_SAMPLES
+float calibrationFrame[CALIBRATION_FRAME_SAMPLES]; // samples of the current frame
+uint8_t calibrationFrameSamples = 0;  // number of samples in the current frame
+uint8_t calibrationBlinkMask = 0;     // bit i set if sample i of the frame is a blink
+uint8_t calibrationSequence = 0;      // sequence number of the next frame, lets the app detect losses
+
+#ifdef COMPRESSED_CALIBRATION
+// With COMPRESSED_CALIBRATION up to 16 samples are delta encoded into a frame instead.
+CalibrationEncoder calibrationEncoder(PROTOCOL_OUT_CALIBRATION_COMPRESSED);
+#endif
+
+// Blink events carry a sequence number and are repeated until the app acknowledges them
+// (PROTOCOL_IN_BLINK_ACK). The app drops repeated events by their sequence number.
+#define BLINK_WINDOW 4                // unacknowledged blink events kept for repetition
+#define BLINK_RETRANSMIT_TIME 100     // (in ms) time until an unacknowledged event is sent again
+#define BLINK_TRANSMISSIONS 5         // transmissions of an event before it is dropped
+struct BlinkEvent {
+  uint8_t sequence;                   // rolling sequence number
+  uint8_t transmissions;              // 0 if the slot is free
+  volatile boolean acked;             // set by the BLE callback
+  unsigned long time;                 // millis() of the detection
+  unsigned long sentTime;             // millis() of the last transmission
+};
+BlinkEvent blinkEvents[BLINK_WINDOW];
+uint8_t blinkSequence = 0;            // sequence number of the next blink event
+unsigned long blinkEventsDropped = 0; // events given up without acknowledgement
+
+#ifdef SAMPLE_JOURNAL
+// Samples and blinks while no app is connected, sent after the app connected again.
+#define JOURNAL_DRAIN_TIME 30         // (in ms) time between two journal messages
+Journal<JOURNAL_BLOCKS> journal(JOURNAL_DECIMATION, JOURNAL_DECIMATION * SAMPLE_PERIOD / 1000);
+volatile boolean journalDrain = false;        // app is ready for the journal (normal mode)
+volatile boolean journalFlushPending = false; // journal has to be completed after a connect
+unsigned long journalSentTime = 0;            // millis() of the last journal message
+#endif
+
+// Blink profile upload (PROTOCOL_IN_SET_PROFILE). The frames are collected in the BLE
+// callback, the complete profile is applied in the loop between two samples.
+ProfileReceiver profileReceiver;          // collects the frames of a transfer
+ProfileParameters pendingProfile;         // complete profile not yet applied
+uint8_t pendingProfileTransfer = 0;       // transfer id of pendingProfile
+uint16_t pendingProfileCrc = 0;           // checksum of pendingProfile
+volatile boolean profilePending = false;  // pendingProfile has to be applied
+
 /**
  * Initialize the Bluetooth communication.
  * Set the name here.
@@ -81,108 +95,345 @@ void initBLE() {
  * 
  * If no bluetooth connected, The current information will be sent over Serial communication
  * to monitor data on computer with Processing or analyze with other software in real time.
+ * With SERIAL_BINARY_STREAM every sample is sent as binary frame by sendSampleFrame() instead.
  */
 void updateBLE(boolean justBlinked) {
   if (ble_connected) {
     if (!mode_debug && !mode_calibration) {
       if (justBlinked) {
-        RFduinoBLE.send(BLE_OUT_MESSAGE_BLINK_DETECTED);
+        queueBlinkEvent();
       }
+      updateBlinkEvents();
+#ifdef SAMPLE_JOURNAL
+      updateJournal();
+#endif
     } else if (mode_calibration) {
-      ++packageCount;
-      char* data = new char[6];
-      data[0] = BLE_OUT_MESSAGE_CALBIRATION_DATA;
-      memcpy(data + 1, &proxFiltered, sizeof(float));
-      data[5] = justBlinked;
-      RFduinoBLE.send(data, 6);
-      free(data);
+      addCalibrationSample(blinkDetector.filtered(), justBlinked);
     }
   } else {
+    clearBlinkEvents();
+#ifdef SAMPLE_JOURNAL
+    journal.add(millis(), sampleToQ16(blinkDetector.filtered()), justBlinked);
+#endif
+#ifndef SERIAL_BINARY_STREAM
     Serial.print("S");
-    Serial.print(proxFiltered*100, 4);
+    Serial.print(sampleToFloat(blinkDetector.filtered())*100, 4);
     Serial.print("\t");
     Serial.print(justBlinked);
     Serial.println();
+#endif
+  }
+}
+
+/**
+ * Sends a new blink event and keeps it until it is acknowledged.
+ * If all slots are taken, the oldest event is given up.
+ */
+void queueBlinkEvent() {
+  uint8_t slot = 0;
+  for (uint8_t i = 0; i < BLINK_WINDOW; ++i) {
+    if (blinkEvents[i].transmissions == 0) {
+      slot = i;
+      break;
+    }
+    if ((long)(blinkEvents[i].time - blinkEvents[slot].time) < 0) {
+      slot = i;
+    }
+  }
+  if (blinkEvents[slot].transmissions > 0) {
+    ++blinkEventsDropped;
+  }
+  blinkEvents[slot].sequence = blinkSequence++;
+  blinkEvents[slot].acked = false;
+  blinkEvents[slot].time = millis();
+  blinkEvents[slot].transmissions = 0;
+  sendBlinkEvent(slot);
+}
+
+/**
+ * Frees acknowledged blink events and repeats the others every BLINK_RETRANSMIT_TIME,
+ * at most BLINK_TRANSMISSIONS times.
+ */
+void updateBlinkEvents() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < BLINK_WINDOW; ++i) {
+    BlinkEvent& event = blinkEvents[i];
+    if (event.transmissions == 0) {
+      continue;
+    }
+    if (event.acked) {
+      event.transmissions = 0;
+    } else if (now - event.sentTime >= BLINK_RETRANSMIT_TIME) {
+      if (event.transmissions >= BLINK_TRANSMISSIONS) {
+        event.transmissions = 0;
+        ++blinkEventsDropped;
+      } else {
+        sendBlinkEvent(i);
+      }
+    }
+  }
+}
+
+/**
+ * Sends the blink event in the slot with 6 bytes:
+ * <PROTOCOL_OUT_BLINK_EVENT> <sequence number> <4 byte millis() of the detection (little endian)>
+ * Repetitions are sent unchanged, so the app recognises them.
+ */
+void sendBlinkEvent(uint8_t slot) {
+  BlinkEvent& event = blinkEvents[slot];
+  uint8_t data[PROTOCOL_BLINK_EVENT_SIZE];
+  uint8_t len = protocolEncodeBlinkEvent(data, event.sequence, event.time);
+  RFduinoBLE.send((const char*)data, len);
+  event.sentTime = millis();
+  ++event.transmissions;
+}
+
+/**
+ * Returns true while a blink event waits for its acknowledgement.
+ */
+boolean blinkEventsPending() {
+  for (uint8_t i = 0; i < BLINK_WINDOW; ++i) {
+    if (blinkEvents[i].transmissions > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Gives up the blink events of a lost connection. Blinks while disconnected are journaled.
+ */
+void clearBlinkEvents() {
+  for (uint8_t i = 0; i < BLINK_WINDOW; ++i) {
+    if (blinkEvents[i].transmissions > 0) {
+      blinkEvents[i].transmissions = 0;
+      ++blinkEventsDropped;
+    }
   }
 }
 
+#ifdef SAMPLE_JOURNAL
+/**
+ * Sends the journal after a reconnect, one block every JOURNAL_DRAIN_TIME ms.
+ * Live blink events go first: no journal message is sent while one is not acknowledged.
+ */
+void updateJournal() {
+  if (!journalDrain) {
+    return;
+  }
+  if (journalFlushPending) {
+    journalFlushPending = false;
+    journal.flush();
+#if defined(SERIAL_DEBUG) && !defined(SERIAL_BINARY_STREAM)
+    Serial.print("Journal: ");
+    Serial.print(journal.blocks());
+    Serial.print(" blocks, dropped ");
+    Serial.println(journal.droppedBlocks());
+#endif
+  }
+  if (journal.blocks() == 0 || blinkEventsPending() || millis() - journalSentTime < JOURNAL_DRAIN_TIME) {
+    return;
+  }
+  uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE];
+  uint8_t len = journal.frame(PROTOCOL_OUT_JOURNAL, data);
+  if (RFduinoBLE.send((const char*)data, len)) {
+    journal.pop();
+  }
+  journalSentTime = millis();
+}
+#endif
+
+/**
+ * Marks the blink event with the sequence number as acknowledged.
+ * Called from the BLE callback, the slot is freed by updateBlinkEvents().
+ */
+void acknowledgeBlinkEvent(uint8_t sequence) {
+  for (uint8_t i = 0; i < BLINK_WINDOW; ++i) {
+    if (blinkEvents[i].transmissions > 0 && blinkEvents[i].sequence == sequence) {
+      blinkEvents[i].acked = true;
+    }
+  }
+}
+
+/**
+ * Adds a sample to the current calibration frame, sends the frame when it is full.
+ */
+void addCalibrationSample(sample_t value, boolean justBlinked) {
+#ifdef COMPRESSED_CALIBRATION
+  if (calibrationEncoder.add(sampleToQ16(value), justBlinked)) {
+    RFduinoBLE.send((const char*)calibrationEncoder.frame(), calibrationEncoder.frameLength());
+    ++packageCount;
+  }
+#else
+  calibrationFrame[calibrationFrameSamples] = sampleToFloat(value); // frames transmit floats
+  if (justBlinked) {
+    calibrationBlinkMask |= 1 << calibrationFrameSamples;
+  }
+  ++calibrationFrameSamples;
+  if (calibrationFrameSamples == CALIBRATION_FRAME_SAMPLES) {
+    sendCalibrationFrame();
+  }
+#endif
+}
+
+/**
+ * Sends the samples of the current calibration frame (if any) and starts a new frame.
+ * A frame consists of 3 + 4 * n bytes, n = 1 ... CALIBRATION_FRAME_SAMPLES:
+ * <PROTOCOL_OUT_CALIBRATION_FRAME> <sequence number> <blink mask> <n 4 byte floats>
+ * The sequence number is incremented by one per frame (mod 256), bit i of the blink mask
+ * belongs to sample i. The number of samples follows from the message length.
+ * With COMPRESSED_CALIBRATION the frame layout is described in CalibrationCodec.h.
+ */
+void sendCalibrationFrame() {
+#ifdef COMPRESSED_CALIBRATION
+  if (calibrationEncoder.flush()) {
+    RFduinoBLE.send((const char*)calibrationEncoder.frame(), calibrationEncoder.frameLength());
+    ++packageCount;
+  }
+#else
+  if (calibrationFrameSamples == 0) {
+    return;
+  }
+  uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE];
+  uint8_t len = protocolEncodeCalibrationFrame(data, calibrationSequence++, calibrationBlinkMask,
+                                               calibrationFrame, calibrationFrameSamples);
+  RFduinoBLE.send((const char*)data, len);
+  ++packageCount;
+  calibrationFrameSamples = 0;
+  calibrationBlinkMask = 0;
+#endif
+}
+
 /**
  * Callback function for new bluetooth connection.
  * 
  * No bluetooth messages can be sent in that function.
+ * The BLE callbacks interrupt the loop anywhere, also in the middle of a binary frame of
+ * sendSampleFrame(), so they only print to Serial without SERIAL_BINARY_STREAM.
  */
 void RFduinoBLE_onConnect() {
   ble_connected = true;
+#ifdef SAMPLE_JOURNAL
+  journalFlushPending = true;
+#endif
+#ifndef SERIAL_BINARY_STREAM
   Serial.println("Connected");
+#endif
 }
 
 /**
  * Callback function for stopped connection.
+ * The RFduino advertises again by itself. It keeps measuring (and with SAMPLE_JOURNAL
+ * journaling) instead of resetting, the app sets the modes again after the next connect.
  */
 void RFduinoBLE_onDisconnect() {
-  // go back to discovery
   ble_connected = false;
+  mode_calibration = false;
+  mode_debug = false;
+#ifdef SAMPLE_JOURNAL
+  journalDrain = false;
+#endif
+#ifndef SERIAL_BINARY_STREAM
   Serial.println("Disconnected");
-  delay(100);
-  resetSystemControlled();
+#endif
 }
 
 /**
  * Callback function for incoming bluetooth messages.
+ * Prints only without SERIAL_BINARY_STREAM, like RFduinoBLE_onConnect().
  */
 void RFduinoBLE_onReceive(char *data, int len) {
 
+#ifndef SERIAL_BINARY_STREAM
   // display incoming message for debgging only.
   for (int i = 0; i < len; ++i) {
     Serial.print(data[i], HEX);
     Serial.print("\t");
   }
   Serial.println();
+#endif
+
+  if (!protocolCheckIn((const uint8_t*)data, len)) {
+#if defined(SERIAL_DEBUG) && !defined(SERIAL_BINARY_STREAM)
+    Serial.println("ERROR BLE message with unknown identifier or wrong length");
+#endif
+    return;
+  }
   
-  switch (data[0]) {
-    case BLE_IN_MESSAGE_NORMAL_MODE:
+  switch ((uint8_t)data[0]) {
+    case PROTOCOL_IN_NORMAL_MODE:
       mode_calibration = false;
       mode_debug = false;
-      delay(200); // TODO find out why needed otherwise no BLE_OUT_MESSAGE_ALIVE is sent.
-      RFduinoBLE.send(BLE_OUT_MESSAGE_ALIVE);
+#ifdef SAMPLE_JOURNAL
+      journalDrain = true;
+#endif
+      delay(200); // TODO find out why needed otherwise no PROTOCOL_OUT_ALIVE is sent.
+      RFduinoBLE.send(PROTOCOL_OUT_ALIVE);
       break;
 
-    case BLE_IN_MESSAGE_SET_PARAMETRS:
+    case PROTOCOL_IN_SET_PARAMETER:
       setParameter(data, len);
       break;
 
-    case BLE_IN_MESSAGE_START_CALIBRATION:
+    case PROTOCOL_IN_SET_PROFILE:
+      receiveProfileFrame(data, len);
+      break;
+
+    case PROTOCOL_IN_BLINK_ACK: {
+      uint8_t sequence;
+      if (protocolDecodeBlinkAck((const uint8_t*)data, len, &sequence)) {
+        acknowledgeBlinkEvent(sequence);
+      }
+      break;
+    }
+
+    case PROTOCOL_IN_START_CALIBRATION:
       mode_calibration = true;
       packageCount = 0;
+      calibrationFrameSamples = 0;
+      calibrationBlinkMask = 0;
+      calibrationSequence = 0;
+#ifdef COMPRESSED_CALIBRATION
+      calibrationEncoder.reset();
+#endif
+#ifndef SERIAL_BINARY_STREAM
       Serial.println("Start Calibration mode");
+#endif
       break;
 
-    case BLE_IN_MESSAGE_STOP_CALIBRATION:
+    case PROTOCOL_IN_STOP_CALIBRATION:
+      sendCalibrationFrame(); // remaining samples
       mode_calibration = false;
+#ifndef SERIAL_BINARY_STREAM
       Serial.print("Stop Calibration mode: ");
       Serial.println(packageCount);
+#endif
       break;
 
-    case BLE_IN_MESSAGE_START_DEBUG:
+    case PROTOCOL_IN_START_DEBUG:
       mode_debug = true;
       break;
 
-    case BLE_IN_MESSAGE_STOP_DEBUG:
+    case PROTOCOL_IN_STOP_DEBUG:
       mode_debug = false;
       break;
 
-    case BLE_IN_MESSAGE_REQUEST_BATTERY_LEVEL: {
-      char* batteryData = new char[5];
-      batteryData[0] = BLE_OUT_MESSAGE_REQUEST_BATTERY_LEVEL;
+    case PROTOCOL_IN_REQUEST_BATTERY_LEVEL: {
+      uint8_t batteryData[PROTOCOL_BATTERY_LEVEL_SIZE];
       float batteryVoltage = readBatteryVoltage();
+#ifndef SERIAL_BINARY_STREAM
       Serial.print("Battery level: ");
       Serial.println(batteryVoltage);
-      memcpy(batteryData + 1, &batteryVoltage, sizeof(float));
-      RFduinoBLE.send(batteryData, 5);
-      free(batteryData);
+#endif
+      uint8_t batteryLen = protocolEncodeBatteryLevel(batteryData, batteryVoltage);
+      RFduinoBLE.send((const char*)batteryData, batteryLen);
       break;
     }
-    case BLE_IN_MESSAGE_RESET:
+    case PROTOCOL_IN_REQUEST_TIMING:
+      sendTimingStatistics();
+      break;
+
+    case PROTOCOL_IN_RESET:
       resetSystemControlled();
     default:
 #ifdef DEBUG_SERIAL
@@ -193,54 +444,158 @@ void RFduinoBLE_onReceive(char *data, int len) {
   }
 }
 
+/**
+ * Sends the sample timing statistics since the last request and resets them
+ * (PROTOCOL_OUT_TIMING, see protocolEncodeTiming()).
+ * Intervals in us, all 2 byte values are saturated.
+ */
+void sendTimingStatistics() {
+  const SampleClockStatistics& stats = sampleClock.statistics();
+  ProtocolTiming timing;
+  timing.rate = sampleClock.effectiveRate();
+  timing.samples = stats.samples;
+  timing.missed = saturate16(stats.missed);
+  timing.intervalMin = saturate16(stats.samples > 1 ? stats.intervalMin : 0);
+  timing.interval50 = saturate16(sampleClock.intervalPercentile(50));
+  timing.interval99 = saturate16(sampleClock.intervalPercentile(99));
+  timing.intervalMax = saturate16(stats.intervalMax);
+  uint8_t data[PROTOCOL_TIMING_SIZE];
+  uint8_t len = protocolEncodeTiming(data, &timing);
+  RFduinoBLE.send((const char*)data, len);
+#ifndef SERIAL_BINARY_STREAM
+  printSampleClockStatistics(); // called from RFduinoBLE_onReceive()
+#endif
+  sampleClock.resetStatistics();
+}
+
+uint16_t saturate16(uint32_t value) {
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+/**
+ * Collects a frame of a profile upload (see ProfileMessage.h).
+ * A complete profile with matching checksum is handed over to applyPendingProfile(),
+ * a broken one is answered right away.
+ */
+void receiveProfileFrame(char *data, int len) {
+  uint8_t result = profileReceiverAdd(&profileReceiver, (const uint8_t*)data, len);
+  uint8_t transfer = len > 1 ? data[1] : 0;
+  switch (result) {
+    case PROFILE_COMPLETE:
+      unpackProfile(profileReceiver.packed, &pendingProfile);
+      pendingProfileTransfer = transfer;
+      pendingProfileCrc = packedProfileCrc(profileReceiver.packed);
+      profilePending = true;
+      break;
+    case PROFILE_BAD_CRC:
+      sendProfileStatus(transfer, packedProfileCrc(profileReceiver.packed), PROTOCOL_PROFILE_BAD_CRC);
+      break;
+    case PROFILE_BAD_FRAME:
+      sendProfileStatus(transfer, 0, PROTOCOL_PROFILE_BAD_FRAME);
+      break;
+  }
+}
+
+/**
+ * Applies a completely received profile. Called from the loop, so the parameters never
+ * change while a sample is processed. All parameters are replaced at once.
+ */
+void applyPendingProfile() {
+  if (!profilePending) {
+    return;
+  }
+  noInterrupts(); // the BLE callback could overwrite the pending profile meanwhile
+  ProfileParameters profile = pendingProfile;
+  uint8_t transfer = pendingProfileTransfer;
+  uint16_t crc = pendingProfileCrc;
+  profilePending = false;
+  interrupts();
+
+  BlinkParameters<sample_t> params;
+  params.edgeNegThresh = toSample(profile.edgeNegThresh);
+  params.edgePosThresh = toSample(profile.edgePosThresh);
+  params.hyst = toSample(profile.hyst);
+  params.min_min = toSample(profile.min_min);
+  params.max_max = toSample(profile.max_max);
+  params.t_fall[0] = profile.t_fall[0];
+  params.t_fall[1] = profile.t_fall[1];
+  params.t_rise[0] = profile.t_rise[0];
+  params.t_rise[1] = profile.t_rise[1];
+  params.t_total[0] = profile.t_total[0];
+  params.t_total[1] = profile.t_total[1];
+  params.allowedZeros = profile.allowedZeros;
+  blinkDetector.params = params;
+  sendProfileStatus(transfer, crc, PROTOCOL_PROFILE_APPLIED);
+}
+
+/**
+ * Answers a profile upload (PROTOCOL_OUT_PROFILE_SET, see protocolEncodeProfileStatus()).
+ */
+void sendProfileStatus(uint8_t transfer, uint16_t crc, uint8_t status) {
+  uint8_t data[PROTOCOL_PROFILE_STATUS_SIZE];
+  uint8_t len = protocolEncodeProfileStatus(data, transfer, crc, status);
+  RFduinoBLE.send((const char*)data, len);
+#if defined(SERIAL_DEBUG) && !defined(SERIAL_BINARY_STREAM) // also called from RFduinoBLE_onReceive()
+  Serial.print("Profile ");
+  Serial.print(transfer);
+  Serial.print(" status ");
+  Serial.println(status);
+#endif
+}
+
 /**  
  *   Set parameter depending on specification in data[1].
  *   A paramter set request consists of a message with a length of 6 bytes
- *   <BLE_IN_MESSAGE_SET_PARAMETRS><Paramter type 0x10:0x1B> < 4 byte float>
+ *   <PROTOCOL_IN_SET_PARAMETER><Paramter type 0x10:0x1B> < 4 byte float>
  */
 void setParameter(char *data, int len) {
+  uint8_t parameter;
   float f;
-  memcpy(&f, data + 2, sizeof(float));
-  Serial.print(data[0], HEX);
+  if (!protocolDecodeParameter((const uint8_t*)data, len, &parameter, &f)) {
+    return;
+  }
+#ifndef SERIAL_BINARY_STREAM
+  Serial.print(parameter, HEX);
   Serial.print("\t");
   Serial.println(f, 5);
-  switch (data[1]) {
-    case BLE_CALIBRATION_PARAMETERS_THRESH_NEG:
-      edgeNegThresh = f;
+#endif
+  switch (parameter) {
+    case PROTOCOL_PARAMETER_THRESH_NEG:
+      blinkDetector.params.edgeNegThresh = toSample(f);
       break;
-    case BLE_CALIBRATION_PARAMETERS_THRESH_POS:
-      edgePosThresh = f;
+    case PROTOCOL_PARAMETER_THRESH_POS:
+      blinkDetector.params.edgePosThresh = toSample(f);
       break;
-    case BLE_CALIBRATION_PARAMETERS_HYSTERESIS:
-      hyst = f;
+    case PROTOCOL_PARAMETER_HYSTERESIS:
+      blinkDetector.params.hyst = toSample(f);
       break;
-    case BLE_CALIBRATION_PARAMETERS_MIN_MIN:
-      min_min = f;
+    case PROTOCOL_PARAMETER_MIN_MIN:
+      blinkDetector.params.min_min = toSample(f);
       break;
-    case BLE_CALIBRATION_PARAMETERS_MAX_MAX:
-      max_max = f;
+    case PROTOCOL_PARAMETER_MAX_MAX:
+      blinkDetector.params.max_max = toSample(f);
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_FALL_MIN:
-      t_fall[0] = (uint8_t)f;
+    case PROTOCOL_PARAMETER_T_FALL_MIN:
+      blinkDetector.params.t_fall[0] = (uint8_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_FALL_MAX:
-      t_fall[1] = (uint8_t)f;
+    case PROTOCOL_PARAMETER_T_FALL_MAX:
+      blinkDetector.params.t_fall[1] = (uint8_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_RISE_MIN:
-      t_rise[0] = (uint8_t)f;
+    case PROTOCOL_PARAMETER_T_RISE_MIN:
+      blinkDetector.params.t_rise[0] = (uint8_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_RISE_MAX:
-      t_rise[1] = (uint8_t)f;
+    case PROTOCOL_PARAMETER_T_RISE_MAX:
+      blinkDetector.params.t_rise[1] = (uint8_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_TOTAL_MIN:
-      t_total[0] = (uint16_t)f;
+    case PROTOCOL_PARAMETER_T_TOTAL_MIN:
+      blinkDetector.params.t_total[0] = (uint16_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_T_TOTAL_MAX:
-      t_total[1] = (uint16_t)f;
+    case PROTOCOL_PARAMETER_T_TOTAL_MAX:
+      blinkDetector.params.t_total[1] = (uint16_t)f;
       break;
-    case BLE_CALIBRATION_PARAMETERS_ALLOWED_ZEROS:
-      allowedZeros = (uint8_t)f;
-      RFduinoBLE.send(BLE_OUT_MESSAGE_PARAMTERS_SET);
+    case PROTOCOL_PARAMETER_ALLOWED_ZEROS:
+      blinkDetector.params.allowedZeros = (uint8_t)f;
+      RFduinoBLE.send(PROTOCOL_OUT_PARAMETERS_SET);
       break;
   }
 }
@@ -0,0 +1,216 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CALIBRATION_CODEC_H
+#define CALIBRATION_CODEC_H
+
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Compressed calibration stream.
+// The filtered values change only by a few LSB from sample to sample, so instead of 4 byte
+// floats they are sent as Q15.16 values (see FixedPoint.h), delta encoded, zig-zag mapped and
+// written as varints (7 bits per byte, least significant group first, bit 7 set if another
+// byte follows). A frame fits into one 20 byte BLE packet:
+//   <message id> <sequence> <blink mask low> <blink mask high> <first value> <delta> ...
+//   - the first value of a frame is absolute, so every frame can be decoded on its own and a
+//     lost frame does not corrupt the following ones.
+//   - bit i of the blink mask is the blink flag of sample i.
+//   - the number of samples follows from the frame length (at most 16).
+// Like BlinkDetector.h it only depends on <stdint.h>, so the host tools use the same code.
+// Apart from the C++ CalibrationEncoder it is plain C, so the app decodes with it as well.
+
+#define CALIBRATION_CODEC_FRAME_SIZE  20  // maximal BLE packet size
+#define CALIBRATION_CODEC_HEADER_SIZE 4
+#define CALIBRATION_CODEC_MAX_SAMPLES 16  // bits of the blink mask
+
+/**
+ * Maps signed to unsigned values, small magnitudes to small values (0, -1, 1, -2, ...).
+ */
+static inline uint32_t zigZagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigZagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Writes value as varint to out and returns the number of bytes (1 to 5).
+ */
+static inline uint8_t writeVarint(uint32_t value, uint8_t* out) {
+  uint8_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (uint8_t)value;
+  return length;
+}
+
+/**
+ * Reads a varint from data (at most end - data bytes).
+ * Returns the number of bytes read, 0 if the varint is incomplete or too long.
+ */
+static inline uint8_t readVarint(const uint8_t* data, const uint8_t* end, uint32_t* value) {
+  *value = 0;
+  for (uint8_t i = 0; i < 5 && data + i < end; ++i) {
+    *value |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+    if (!(data[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+#ifdef __cplusplus
+class CalibrationEncoder {
+public:
+  explicit CalibrationEncoder(uint8_t messageId) : id(messageId) {
+    reset();
+  }
+
+  /**
+   * Starts a new stream: sequence number 0, current frame empty.
+   */
+  void reset() {
+    sequence = 0;
+    samples = 0;
+    length = CALIBRATION_CODEC_HEADER_SIZE;
+    blinkMask = 0;
+    last = 0;
+    completeLength = 0;
+  }
+
+  /**
+   * Adds a Q15.16 sample.
+   * Returns true if a frame is complete, it is available by frame() and frameLength() until
+   * the next call. A sample which does not fit into the current frame starts the next one.
+   */
+  bool add(int32_t value, bool blink) {
+    uint8_t encoded[5];
+    // wrapping difference, so any pair of values is fine
+    int32_t delta = (int32_t)((uint32_t)value - (uint32_t)last);
+    uint8_t size = writeVarint(zigZagEncode(samples == 0 ? value : delta), encoded);
+    bool frameDone = false;
+    if (length + size > CALIBRATION_CODEC_FRAME_SIZE) {
+      frameDone = finish();
+      size = writeVarint(zigZagEncode(value), encoded);
+    }
+    for (uint8_t i = 0; i < size; ++i) {
+      current[length++] = encoded[i];
+    }
+    if (blink) {
+      blinkMask |= 1 << samples;
+    }
+    last = value;
+    ++samples;
+    if (samples == CALIBRATION_CODEC_MAX_SAMPLES) {
+      frameDone = finish();
+    }
+    return frameDone;
+  }
+
+  /**
+   * Completes the current frame if it contains samples (end of the stream).
+   * Returns true if a frame is available.
+   */
+  bool flush() {
+    return finish();
+  }
+
+  const uint8_t* frame() const {
+    return complete;
+  }
+
+  uint8_t frameLength() const {
+    return completeLength;
+  }
+
+private:
+  bool finish() {
+    if (samples == 0) {
+      return false;
+    }
+    current[0] = id;
+    current[1] = sequence++;
+    current[2] = (uint8_t)blinkMask;
+    current[3] = (uint8_t)(blinkMask >> 8);
+    for (uint8_t i = 0; i < length; ++i) {
+      complete[i] = current[i];
+    }
+    completeLength = length;
+    samples = 0;
+    length = CALIBRATION_CODEC_HEADER_SIZE;
+    blinkMask = 0;
+    return true;
+  }
+
+  uint8_t id;                                      // message id written into byte 0
+  uint8_t sequence;                                // sequence number of the next frame
+  uint8_t samples;                                 // samples in the current frame
+  uint8_t length;                                  // bytes used in the current frame
+  uint16_t blinkMask;                              // blink flags of the current frame
+  int32_t last;                                    // last value added
+  uint8_t current[CALIBRATION_CODEC_FRAME_SIZE];   // frame being filled
+  uint8_t complete[CALIBRATION_CODEC_FRAME_SIZE];  // last complete frame
+  uint8_t completeLength;
+};
+#endif
+
+/**
+ * Decodes a frame into at most CALIBRATION_CODEC_MAX_SAMPLES values and blink flags.
+ * Returns the number of samples, -1 if the frame is malformed.
+ */
+static inline int decodeCalibrationFrame(const uint8_t* frame, uint8_t length, int32_t* values,
+                                         bool* blinks) {
+  if (length <= CALIBRATION_CODEC_HEADER_SIZE) {
+    return -1;
+  }
+  uint16_t blinkMask = frame[2] | frame[3] << 8;
+  const uint8_t* data = frame + CALIBRATION_CODEC_HEADER_SIZE;
+  const uint8_t* end = frame + length;
+  int samples = 0;
+  int32_t value = 0;
+  while (data < end) {
+    uint32_t encoded;
+    uint8_t size = readVarint(data, end, &encoded);
+    if (size == 0 || samples == CALIBRATION_CODEC_MAX_SAMPLES) {
+      return -1;
+    }
+    data += size;
+    value = samples == 0 ? zigZagDecode(encoded) : (int32_t)((uint32_t)value + (uint32_t)zigZagDecode(encoded));
+    values[samples] = value;
+    blinks[samples] = (blinkMask >> samples) & 1;
+    ++samples;
+  }
+  return samples;
+}
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CYCLE_SCHEDULER_H
+#define CYCLE_SCHEDULER_H
+
+#include <stdint.h>
+
+// Decides how long the RFduino can sleep between two samples.
+// Like BlinkDetector.h it only depends on <stdint.h>: the clock and the radio state are
+// passed in, so the decisions can be replayed on a host with a simulated clock.
+//
+// Sleeping is not safe while
+//   - the radio is active (RFduinoBLE.radioActive),
+//   - samples are waiting for the blink detection,
+//   - calibration or debug data is streamed (a send could block while sleeping).
+// Otherwise the MCU sleeps until guard ms before the next sensor deadline. A sleep ends early
+// when the data ready interrupt of the sensor comes, so a sample is processed when it is read
+// and not when the next one is due.
+//
+// The slack of every cycle (time left until the next deadline when the processing of the sample
+// of the cycle ended, see endCycle()) is collected in CycleStatistics.
+
+struct CycleStatistics {
+  uint32_t cycles;      // cycles (processed samples) since the last reset
+  uint32_t sleeps;      // number of sleeps
+  uint32_t busy;        // cycles in which sleeping was not safe
+  uint32_t overruns;    // cycles which ended after the deadline of the next sample
+  int32_t slackMin;     // minimal slack in ms
+  int32_t slackMax;     // maximal slack in ms
+  int32_t slackSum;     // sum of all slacks in ms (average = slackSum / cycles)
+  uint32_t sleptMs;     // total sleep time in ms, see sleptFor()
+};
+
+class CycleScheduler {
+public:
+  explicit CycleScheduler(uint32_t guard = 1) : guardMs(guard) {
+    resetStatistics();
+  }
+
+  /**
+   * Records the slack of a cycle, called when the processing of its sample ended.
+   * now and deadline are millis() values, the computation is safe for the overflow of millis().
+   */
+  void endCycle(uint32_t now, uint32_t deadline) {
+    int32_t slack = (int32_t)(deadline - now);
+    ++stats.cycles;
+    if (slack < 0) {
+      ++stats.overruns;
+    }
+    if (slack < stats.slackMin) {
+      stats.slackMin = slack;
+    }
+    if (slack > stats.slackMax) {
+      stats.slackMax = slack;
+    }
+    stats.slackSum += slack;
+  }
+
+  /**
+   * Returns the time in ms the MCU can sleep now, 0 if it must not sleep.
+   * now and deadline are millis() values as for endCycle().
+   * cycleDone is true in the loop pass which processed a sample, only then a busy cycle is
+   * counted.
+   */
+  uint32_t sleepTime(uint32_t now, uint32_t deadline, bool busy, bool cycleDone) {
+    int32_t slack = (int32_t)(deadline - now);
+    if (cycleDone && busy) {
+      ++stats.busy;
+    }
+    if (busy || slack <= (int32_t)guardMs) {
+      return 0;
+    }
+    ++stats.sleeps;
+    return (uint32_t)slack - guardMs;
+  }
+
+  /**
+   * Records the time in ms the MCU actually slept, less than sleepTime() if the data ready
+   * interrupt ended the sleep.
+   */
+  void sleptFor(uint32_t ms) {
+    stats.sleptMs += ms;
+  }
+
+  const CycleStatistics& statistics() const {
+    return stats;
+  }
+
+  void resetStatistics() {
+    stats.cycles = 0;
+    stats.sleeps = 0;
+    stats.busy = 0;
+    stats.overruns = 0;
+    stats.slackMin = 0x7FFFFFFF;
+    stats.slackMax = -0x7FFFFFFF - 1;
+    stats.slackSum = 0;
+    stats.sleptMs = 0;
+  }
+
+private:
+  uint32_t guardMs;       // wake up this many ms before the deadline
+  CycleStatistics stats;
+};
+
+#endif
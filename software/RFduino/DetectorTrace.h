@@ -0,0 +1,213 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DETECTOR_TRACE_H
+#define DETECTOR_TRACE_H
+
+#include <stdint.h>
+
+// Stored proximity trace for timing the blink detection on the board (DETECTOR_TIMING, see
+// timeBlinkDetection() in RTBlinkDetection.ino).
+//
+// 2000 raw VCNL4020 counts (12 s at SAMPLE_PERIOD 6000 us) of a capture of the worn device,
+// recorded with tools/serialcapture. The detector with the default profile finds three blinks
+// (at the samples 478, 1268 and 1704, the same as tools/replay -r on the capture).
+// Flash cost: 4000 bytes, only linked in with DETECTOR_TIMING.
+#define DETECTOR_TRACE_LENGTH 2000
+#define DETECTOR_TRACE_BLINKS 3
+
+const uint16_t detectorTrace[DETECTOR_TRACE_LENGTH] = {
+  1735, 1735, 1730, 1736, 1730, 1727, 1732, 1728, 1732, 1735, 1735, 1736,
+  1735, 1730, 1729, 1735, 1731, 1732, 1731, 1737, 1737, 1732, 1733, 1731,
+  1734, 1730, 1735, 1735, 1733, 1729, 1731, 1738, 1729, 1733, 1735, 1729,
+  1735, 1733, 1734, 1732, 1733, 1730, 1729, 1736, 1734, 1732, 1733, 1731,
+  1734, 1732, 1733, 1728, 1735, 1729, 1733, 1733, 1735, 1730, 1734, 1736,
+  1738, 1732, 1735, 1736, 1733, 1732, 1735, 1729, 1732, 1732, 1732, 1734,
+  1738, 1730, 1738, 1736, 1733, 1734, 1733, 1739, 1731, 1731, 1725, 1730,
+  1730, 1731, 1732, 1728, 1732, 1740, 1734, 1733, 1736, 1730, 1735, 1728,
+  1735, 1731, 1729, 1729, 1730, 1730, 1732, 1736, 1735, 1731, 1737, 1734,
+  1733, 1732, 1735, 1742, 1732, 1733, 1729, 1734, 1737, 1734, 1739, 1742,
+  1733, 1731, 1732, 1734, 1730, 1728, 1731, 1734, 1734, 1730, 1737, 1734,
+  1732, 1730, 1733, 1735, 1736, 1730, 1733, 1735, 1733, 1732, 1736, 1732,
+  1733, 1733, 1729, 1730, 1733, 1731, 1732, 1732, 1728, 1728, 1731, 1731,
+  1732, 1729, 1730, 1728, 1728, 1729, 1732, 1733, 1729, 1732, 1727, 1733,
+  1729, 1734, 1725, 1730, 1733, 1734, 1731, 1729, 1737, 1727, 1729, 1731,
+  1728, 1725, 1732, 1732, 1733, 1729, 1733, 1731, 1726, 1727, 1734, 1734,
+  1735, 1732, 1733, 1736, 1734, 1731, 1727, 1732, 1734, 1738, 1729, 1731,
+  1736, 1731, 1733, 1736, 1736, 1728, 1730, 1728, 1727, 1739, 1732, 1734,
+  1730, 1733, 1727, 1734, 1735, 1732, 1733, 1732, 1728, 1732, 1730, 1737,
+  1737, 1734, 1732, 1731, 1737, 1730, 1734, 1728, 1734, 1726, 1738, 1734,
+  1733, 1739, 1731, 1728, 1731, 1729, 1733, 1731, 1732, 1731, 1734, 1731,
+  1731, 1726, 1729, 1736, 1735, 1732, 1725, 1736, 1731, 1732, 1729, 1734,
+  1730, 1734, 1733, 1734, 1729, 1735, 1735, 1728, 1733, 1729, 1731, 1730,
+  1734, 1726, 1733, 1728, 1729, 1728, 1729, 1728, 1727, 1737, 1736, 1729,
+  1736, 1732, 1737, 1732, 1731, 1731, 1724, 1731, 1730, 1730, 1732, 1731,
+  1732, 1734, 1728, 1727, 1733, 1732, 1730, 1729, 1732, 1726, 1729, 1730,
+  1727, 1735, 1733, 1733, 1728, 1732, 1732, 1726, 1724, 1729, 1728, 1731,
+  1731, 1727, 1736, 1731, 1728, 1731, 1729, 1730, 1733, 1732, 1725, 1728,
+  1728, 1728, 1724, 1728, 1728, 1730, 1729, 1730, 1729, 1731, 1734, 1730,
+  1734, 1727, 1732, 1728, 1728, 1732, 1730, 1728, 1730, 1727, 1734, 1734,
+  1735, 1728, 1730, 1734, 1728, 1728, 1734, 1729, 1730, 1730, 1731, 1739,
+  1734, 1730, 1731, 1730, 1729, 1731, 1723, 1727, 1729, 1732, 1729, 1732,
+  1729, 1728, 1734, 1733, 1729, 1727, 1724, 1731, 1729, 1731, 1733, 1730,
+  1731, 1726, 1731, 1729, 1727, 1732, 1729, 1725, 1725, 1723, 1735, 1725,
+  1730, 1734, 1728, 1731, 1732, 1738, 1727, 1726, 1733, 1727, 1732, 1730,
+  1727, 1730, 1730, 1730, 1728, 1725, 1731, 1729, 1728, 1732, 1724, 1730,
+  1730, 1733, 1726, 1726, 1733, 1739, 1757, 1774, 1789, 1796, 1813, 1825,
+  1844, 1838, 1845, 1844, 1842, 1845, 1844, 1839, 1836, 1826, 1813, 1806,
+  1797, 1787, 1775, 1766, 1765, 1756, 1742, 1736, 1728, 1730, 1726, 1727,
+  1730, 1725, 1734, 1730, 1731, 1732, 1732, 1735, 1729, 1737, 1731, 1728,
+  1727, 1730, 1732, 1727, 1733, 1737, 1733, 1734, 1734, 1726, 1730, 1733,
+  1734, 1732, 1734, 1730, 1729, 1726, 1729, 1725, 1731, 1732, 1728, 1729,
+  1733, 1731, 1732, 1729, 1730, 1724, 1728, 1729, 1725, 1731, 1731, 1729,
+  1726, 1729, 1729, 1728, 1727, 1729, 1729, 1728, 1729, 1728, 1729, 1728,
+  1729, 1728, 1727, 1730, 1738, 1728, 1727, 1734, 1730, 1731, 1726, 1732,
+  1728, 1727, 1731, 1730, 1727, 1730, 1731, 1730, 1734, 1734, 1731, 1738,
+  1731, 1727, 1728, 1732, 1731, 1727, 1733, 1732, 1730, 1730, 1729, 1735,
+  1737, 1728, 1727, 1728, 1734, 1733, 1731, 1734, 1734, 1729, 1730, 1724,
+  1730, 1732, 1725, 1729, 1729, 1730, 1732, 1726, 1732, 1729, 1733, 1731,
+  1729, 1733, 1729, 1725, 1731, 1728, 1729, 1733, 1727, 1728, 1730, 1731,
+  1722, 1733, 1730, 1729, 1727, 1730, 1735, 1725, 1732, 1729, 1727, 1730,
+  1730, 1731, 1735, 1730, 1727, 1730, 1727, 1733, 1730, 1731, 1729, 1728,
+  1736, 1722, 1727, 1726, 1726, 1734, 1728, 1733, 1729, 1733, 1734, 1728,
+  1736, 1730, 1731, 1733, 1729, 1733, 1736, 1733, 1728, 1732, 1730, 1725,
+  1725, 1728, 1727, 1734, 1732, 1734, 1732, 1728, 1728, 1730, 1730, 1734,
+  1730, 1733, 1733, 1731, 1731, 1728, 1732, 1733, 1730, 1729, 1723, 1730,
+  1730, 1723, 1736, 1730, 1729, 1729, 1734, 1726, 1727, 1728, 1729, 1725,
+  1733, 1729, 1728, 1726, 1730, 1727, 1726, 1725, 1730, 1727, 1726, 1729,
+  1725, 1728, 1725, 1728, 1733, 1730, 1724, 1728, 1727, 1728, 1726, 1727,
+  1726, 1722, 1731, 1723, 1730, 1728, 1729, 1727, 1728, 1728, 1727, 1731,
+  1726, 1729, 1731, 1733, 1725, 1726, 1728, 1726, 1722, 1728, 1727, 1727,
+  1725, 1725, 1734, 1727, 1729, 1728, 1732, 1730, 1721, 1725, 1729, 1732,
+  1729, 1728, 1731, 1727, 1726, 1731, 1733, 1728, 1728, 1725, 1733, 1733,
+  1726, 1728, 1724, 1722, 1733, 1731, 1730, 1730, 1730, 1728, 1730, 1729,
+  1729, 1730, 1729, 1730, 1721, 1726, 1730, 1727, 1724, 1728, 1728, 1729,
+  1731, 1725, 1732, 1726, 1722, 1728, 1732, 1730, 1728, 1728, 1728, 1731,
+  1729, 1729, 1730, 1729, 1726, 1729, 1725, 1725, 1725, 1728, 1722, 1731,
+  1726, 1728, 1731, 1731, 1728, 1724, 1728, 1723, 1727, 1730, 1731, 1727,
+  1728, 1734, 1727, 1735, 1728, 1732, 1731, 1733, 1734, 1727, 1725, 1728,
+  1728, 1728, 1727, 1726, 1728, 1729, 1727, 1726, 1728, 1728, 1730, 1721,
+  1728, 1735, 1732, 1731, 1726, 1730, 1727, 1728, 1731, 1728, 1730, 1725,
+  1731, 1731, 1729, 1730, 1729, 1735, 1730, 1730, 1732, 1731, 1731, 1727,
+  1734, 1732, 1732, 1727, 1728, 1729, 1724, 1727, 1724, 1726, 1725, 1725,
+  1730, 1728, 1725, 1731, 1727, 1726, 1727, 1730, 1729, 1728, 1726, 1723,
+  1725, 1732, 1731, 1728, 1726, 1728, 1733, 1730, 1725, 1728, 1738, 1730,
+  1728, 1730, 1723, 1728, 1726, 1728, 1728, 1730, 1729, 1732, 1731, 1734,
+  1726, 1729, 1730, 1727, 1730, 1727, 1725, 1730, 1730, 1733, 1729, 1734,
+  1725, 1726, 1726, 1731, 1730, 1727, 1731, 1730, 1730, 1731, 1730, 1731,
+  1723, 1726, 1726, 1728, 1729, 1731, 1731, 1725, 1725, 1726, 1729, 1727,
+  1728, 1726, 1729, 1729, 1730, 1725, 1733, 1728, 1722, 1729, 1726, 1726,
+  1728, 1732, 1730, 1727, 1726, 1726, 1730, 1725, 1729, 1727, 1727, 1727,
+  1725, 1726, 1728, 1726, 1723, 1725, 1733, 1724, 1729, 1731, 1733, 1725,
+  1727, 1730, 1730, 1721, 1728, 1731, 1728, 1727, 1724, 1724, 1725, 1726,
+  1733, 1731, 1733, 1731, 1734, 1727, 1729, 1727, 1728, 1737, 1730, 1729,
+  1733, 1731, 1726, 1731, 1728, 1732, 1730, 1727, 1737, 1729, 1733, 1727,
+  1735, 1727, 1729, 1725, 1728, 1729, 1726, 1727, 1729, 1733, 1730, 1727,
+  1727, 1728, 1727, 1727, 1729, 1726, 1730, 1724, 1728, 1734, 1734, 1730,
+  1725, 1733, 1728, 1731, 1735, 1732, 1728, 1727, 1726, 1730, 1732, 1728,
+  1728, 1730, 1730, 1732, 1728, 1733, 1719, 1728, 1728, 1730, 1722, 1726,
+  1728, 1726, 1730, 1733, 1732, 1726, 1728, 1726, 1729, 1729, 1734, 1729,
+  1724, 1730, 1731, 1728, 1729, 1729, 1731, 1732, 1729, 1730, 1725, 1729,
+  1731, 1733, 1731, 1729, 1730, 1730, 1730, 1730, 1725, 1731, 1729, 1724,
+  1725, 1733, 1727, 1726, 1727, 1730, 1728, 1730, 1728, 1729, 1726, 1728,
+  1727, 1723, 1729, 1729, 1727, 1731, 1722, 1723, 1723, 1730, 1730, 1719,
+  1730, 1727, 1732, 1727, 1728, 1729, 1729, 1732, 1726, 1733, 1728, 1729,
+  1730, 1733, 1731, 1733, 1731, 1731, 1727, 1732, 1732, 1722, 1726, 1735,
+  1725, 1732, 1725, 1731, 1726, 1729, 1731, 1731, 1724, 1728, 1732, 1730,
+  1727, 1732, 1730, 1728, 1726, 1727, 1720, 1731, 1726, 1731, 1730, 1729,
+  1735, 1729, 1728, 1730, 1725, 1732, 1726, 1728, 1731, 1731, 1728, 1732,
+  1730, 1729, 1729, 1733, 1727, 1726, 1727, 1730, 1729, 1735, 1728, 1728,
+  1734, 1729, 1730, 1727, 1730, 1728, 1727, 1731, 1734, 1727, 1724, 1729,
+  1727, 1736, 1726, 1727, 1726, 1728, 1727, 1730, 1743, 1748, 1763, 1778,
+  1788, 1800, 1813, 1822, 1837, 1832, 1835, 1841, 1832, 1840, 1836, 1838,
+  1836, 1832, 1840, 1837, 1825, 1820, 1814, 1806, 1804, 1793, 1784, 1778,
+  1769, 1759, 1752, 1748, 1742, 1733, 1729, 1730, 1730, 1731, 1729, 1726,
+  1728, 1724, 1728, 1730, 1731, 1728, 1727, 1732, 1728, 1727, 1723, 1732,
+  1733, 1719, 1723, 1726, 1728, 1726, 1726, 1726, 1729, 1730, 1727, 1730,
+  1724, 1730, 1729, 1729, 1724, 1727, 1726, 1733, 1727, 1727, 1721, 1730,
+  1722, 1727, 1730, 1730, 1731, 1731, 1727, 1726, 1729, 1729, 1727, 1724,
+  1729, 1733, 1724, 1733, 1725, 1728, 1728, 1730, 1726, 1724, 1725, 1730,
+  1724, 1727, 1730, 1720, 1722, 1730, 1731, 1729, 1725, 1729, 1728, 1731,
+  1726, 1733, 1735, 1730, 1728, 1729, 1734, 1728, 1727, 1734, 1727, 1735,
+  1731, 1732, 1725, 1729, 1734, 1731, 1723, 1731, 1726, 1729, 1723, 1725,
+  1726, 1727, 1728, 1719, 1723, 1729, 1729, 1730, 1727, 1728, 1729, 1729,
+  1723, 1728, 1728, 1731, 1726, 1732, 1731, 1727, 1732, 1728, 1726, 1727,
+  1730, 1728, 1725, 1721, 1723, 1731, 1727, 1728, 1730, 1731, 1731, 1732,
+  1735, 1726, 1733, 1730, 1727, 1727, 1729, 1725, 1729, 1727, 1725, 1731,
+  1727, 1728, 1732, 1726, 1731, 1726, 1730, 1730, 1734, 1725, 1725, 1728,
+  1729, 1729, 1728, 1730, 1723, 1731, 1726, 1734, 1733, 1731, 1728, 1727,
+  1731, 1736, 1733, 1732, 1731, 1727, 1728, 1729, 1734, 1729, 1726, 1731,
+  1729, 1733, 1732, 1724, 1727, 1730, 1727, 1728, 1729, 1734, 1731, 1735,
+  1730, 1729, 1733, 1730, 1727, 1728, 1735, 1737, 1731, 1729, 1728, 1734,
+  1730, 1728, 1731, 1732, 1729, 1732, 1731, 1727, 1727, 1732, 1731, 1729,
+  1734, 1728, 1731, 1727, 1731, 1732, 1733, 1735, 1733, 1734, 1729, 1731,
+  1734, 1734, 1735, 1727, 1730, 1731, 1732, 1729, 1731, 1736, 1734, 1733,
+  1731, 1728, 1732, 1732, 1733, 1732, 1727, 1724, 1733, 1724, 1731, 1725,
+  1727, 1721, 1725, 1728, 1732, 1725, 1732, 1723, 1731, 1733, 1719, 1726,
+  1735, 1725, 1735, 1731, 1729, 1729, 1729, 1726, 1727, 1728, 1730, 1726,
+  1720, 1720, 1725, 1725, 1726, 1725, 1733, 1724, 1727, 1728, 1730, 1733,
+  1725, 1737, 1727, 1731, 1724, 1728, 1728, 1729, 1732, 1728, 1722, 1729,
+  1730, 1736, 1732, 1732, 1726, 1737, 1721, 1726, 1728, 1728, 1725, 1729,
+  1729, 1733, 1726, 1727, 1728, 1733, 1731, 1728, 1733, 1732, 1732, 1734,
+  1727, 1732, 1733, 1730, 1732, 1734, 1727, 1720, 1731, 1727, 1726, 1735,
+  1732, 1734, 1735, 1727, 1729, 1731, 1731, 1729, 1728, 1727, 1729, 1732,
+  1740, 1739, 1733, 1730, 1729, 1729, 1732, 1730, 1730, 1731, 1732, 1729,
+  1727, 1732, 1735, 1730, 1735, 1728, 1732, 1730, 1732, 1734, 1733, 1737,
+  1736, 1738, 1726, 1731, 1736, 1733, 1730, 1733, 1739, 1731, 1728, 1737,
+  1735, 1734, 1732, 1736, 1726, 1734, 1732, 1739, 1735, 1733, 1726, 1731,
+  1737, 1743, 1747, 1751, 1759, 1770, 1771, 1779, 1790, 1795, 1800, 1808,
+  1818, 1821, 1815, 1819, 1819, 1820, 1812, 1803, 1797, 1792, 1794, 1783,
+  1782, 1770, 1768, 1767, 1758, 1757, 1748, 1747, 1741, 1734, 1735, 1734,
+  1734, 1730, 1733, 1737, 1735, 1734, 1731, 1734, 1735, 1734, 1733, 1732,
+  1730, 1729, 1730, 1732, 1729, 1744, 1729, 1729, 1735, 1734, 1731, 1732,
+  1735, 1734, 1732, 1734, 1730, 1729, 1736, 1731, 1735, 1732, 1731, 1728,
+  1727, 1738, 1726, 1730, 1733, 1728, 1726, 1735, 1729, 1729, 1733, 1729,
+  1735, 1732, 1729, 1735, 1731, 1730, 1729, 1733, 1731, 1736, 1727, 1731,
+  1733, 1733, 1735, 1727, 1732, 1736, 1736, 1729, 1733, 1730, 1728, 1733,
+  1732, 1734, 1732, 1729, 1735, 1727, 1726, 1735, 1732, 1731, 1726, 1728,
+  1732, 1733, 1729, 1730, 1735, 1731, 1730, 1734, 1732, 1738, 1732, 1732,
+  1730, 1730, 1732, 1730, 1731, 1736, 1734, 1730, 1732, 1733, 1725, 1727,
+  1731, 1728, 1731, 1723, 1728, 1726, 1730, 1732, 1731, 1732, 1727, 1736,
+  1735, 1736, 1729, 1733, 1725, 1732, 1729, 1731, 1727, 1730, 1729, 1723,
+  1736, 1731, 1733, 1735, 1729, 1732, 1732, 1724, 1725, 1731, 1734, 1727,
+  1734, 1727, 1732, 1730, 1721, 1728, 1732, 1731, 1730, 1727, 1737, 1733,
+  1731, 1733, 1728, 1731, 1731, 1724, 1734, 1728, 1735, 1727, 1727, 1730,
+  1727, 1726, 1728, 1731, 1727, 1726, 1726, 1725, 1729, 1728, 1728, 1722,
+  1729, 1725, 1730, 1726, 1726, 1727, 1724, 1724, 1726, 1727, 1727, 1732,
+  1729, 1726, 1725, 1725, 1732, 1727, 1725, 1728, 1729, 1724, 1727, 1724,
+  1724, 1722, 1728, 1729, 1725, 1729, 1729, 1723, 1731, 1725, 1724, 1731,
+  1727, 1723, 1730, 1730, 1726, 1723, 1725, 1725, 1725, 1730, 1722, 1730,
+  1728, 1728, 1729, 1731, 1734, 1725, 1724, 1725, 1724, 1725, 1724, 1727,
+  1729, 1726, 1725, 1731, 1719, 1725, 1727, 1724, 1729, 1725, 1732, 1723,
+  1731, 1727, 1731, 1728, 1726, 1723, 1725, 1728, 1723, 1729, 1735, 1731,
+  1726, 1729, 1730, 1724, 1724, 1727, 1728, 1729, 1727, 1732, 1727, 1731,
+  1727, 1729, 1726, 1727, 1730, 1724, 1730, 1724, 1728, 1729, 1726, 1724,
+  1728, 1728, 1727, 1724, 1726, 1728, 1725, 1728, 1732, 1729, 1727, 1725,
+  1727, 1728, 1727, 1725, 1724, 1722, 1721, 1727
+};
+
+#endif
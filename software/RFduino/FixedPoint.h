@@ -0,0 +1,102 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+
+// Sample types used by the blink detection.
+// The RFduino's Cortex-M0 has no FPU, so every float / double operation ends up in the
+// soft-float library. With FIXED_POINT_DETECTION defined (before including this header) all
+// distances are kept in Q15.16 fixed point millimetres instead:
+//   - 1 LSB = 1/65536 mm = 0.0000153 mm, which is more than 100 times finer than the smallest
+//     threshold / hysteresis used by the detection (0.0002 mm).
+//   - The range of +-32767 mm easily covers the sensor range (1 to 200 mm), and the moving
+//     average sum of MA_BUFFER differences cannot overflow either.
+// Without FIXED_POINT_DETECTION the original float / double arithmetic is used.
+#ifdef FIXED_POINT_DETECTION
+
+typedef int32_t sample_t;   // single sample (filtered value, thresholds, extreme values)
+typedef int32_t accum_t;    // proximity values and moving average sum
+
+#define SAMPLE_FRACTION_BITS  16
+#define SAMPLE_ONE            (1L << SAMPLE_FRACTION_BITS)
+
+// Converts a value in mm into a sample. Rounds to the nearest LSB.
+static inline sample_t toSample(double x) {
+  return (sample_t)(x * SAMPLE_ONE + (x < 0 ? -0.5 : 0.5));
+}
+
+// Converts a proximity value in mm into the accumulator type.
+static inline accum_t toAccum(double x) {
+  return toSample(x);
+}
+
+// Converts a Q15.16 proximity value (see ProximityTable.h) into the accumulator type.
+static inline accum_t proximityToAccum(int32_t x) {
+  return x;
+}
+
+// Converts a sample back to mm. Only needed for output (BLE / Serial).
+static inline float sampleToFloat(sample_t x) {
+  return (float)x / SAMPLE_ONE;
+}
+
+// Converts a sample into Q15.16 mm (compressed calibration stream, see CalibrationCodec.h).
+static inline int32_t sampleToQ16(sample_t x) {
+  return x;
+}
+
+#else
+
+typedef float sample_t;
+typedef double accum_t;
+
+static inline sample_t toSample(double x) {
+  return (sample_t)x;
+}
+
+static inline accum_t toAccum(double x) {
+  return x;
+}
+
+static inline accum_t proximityToAccum(int32_t x) {
+  return x / 65536.0;
+}
+
+static inline float sampleToFloat(sample_t x) {
+  return x;
+}
+
+static inline int32_t sampleToQ16(sample_t x) {
+  return (int32_t)(x * 65536.0f + (x < 0 ? -0.5f : 0.5f));
+}
+
+#endif
+
+#endif
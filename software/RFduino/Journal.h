@@ -0,0 +1,264 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#include "CalibrationCodec.h"
+#include "ProtocolCodec.h"
+
+// Journal of the filtered samples and blinks while no app is connected.
+// Every decimation-th sample is kept in a ring of BLOCKS blocks in RAM, the blink flags of
+// the skipped samples are added to the kept one, so no blink is lost. When the ring is full
+// the oldest block is overwritten. After a reconnect the blocks are sent oldest first, one
+// block per message:
+//   <message id> <sequence> <4 byte time of the first sample in ms> <2 byte blink mask> <values>
+//   - the values are varints (see CalibrationCodec.h): the zig-zag encoded Q15.16 value of the
+//     first sample followed by the zig-zag encoded differences to the previous sample.
+//   - sample i was taken at time + i * interval, a missed sample starts a new block.
+//   - bit i of the blink mask is set if a blink was detected up to sample i.
+//   - the sequence number is incremented by one per message (mod 256).
+// Every block can be decoded on its own (decodeJournalBlock()), so overwritten or lost blocks
+// do not corrupt the others.
+// Like CalibrationCodec.h it only depends on <stdint.h> and the Journal class is the only C++
+// part, so it can be tested on a host and the app decodes the blocks with it.
+
+#define JOURNAL_FRAME_HEADER_SIZE 2   // message id and sequence
+#define JOURNAL_HEADER_SIZE       6   // time and blink mask
+#define JOURNAL_BLOCK_SIZE        (CALIBRATION_CODEC_FRAME_SIZE - JOURNAL_FRAME_HEADER_SIZE)
+#define JOURNAL_MAX_SAMPLES       16  // bits of the blink mask
+
+#ifdef __cplusplus
+template<uint8_t BLOCKS>
+class Journal {
+public:
+  /**
+   * Keeps every decimation-th sample, interval is the time between two kept samples in ms.
+   */
+  Journal(uint8_t decimationFactor, uint16_t intervalMs)
+      : decimation(decimationFactor), interval(intervalMs) {
+    reset();
+  }
+
+  /**
+   * Drops all samples.
+   */
+  void reset() {
+    first = 0;
+    count = 0;
+    sequence = 0;
+    dropped = 0;
+    skipped = 0;
+    pendingBlink = false;
+    startBlock(0);
+  }
+
+  /**
+   * Adds a sample taken at time (in ms) with the Q15.16 value.
+   */
+  void add(uint32_t time, int32_t value, bool blink) {
+    pendingBlink = pendingBlink || blink;
+    if (skipped > 0) {
+      --skipped;
+      return;
+    }
+    skipped = decimation - 1;
+    if (samples > 0) {
+      // more than half an interval off: samples were missed, the sample times would be wrong
+      int32_t offset = (int32_t)(time - (blockTime + (uint32_t)samples * interval));
+      if (offset > (int32_t)interval / 2 || offset < -(int32_t)interval / 2) {
+        finish();
+      }
+    }
+    uint8_t encoded[5];
+    // wrapping difference, so any pair of values is fine
+    int32_t delta = (int32_t)((uint32_t)value - (uint32_t)last);
+    uint8_t size = writeVarint(zigZagEncode(samples == 0 ? value : delta), encoded);
+    if (samples > 0 && length + size > JOURNAL_BLOCK_SIZE) {
+      finish();
+      size = writeVarint(zigZagEncode(value), encoded);
+    }
+    if (samples == 0) {
+      startBlock(time);
+    }
+    for (uint8_t i = 0; i < size; ++i) {
+      current[length++] = encoded[i];
+    }
+    if (pendingBlink) {
+      blinkMask |= 1 << samples;
+      pendingBlink = false;
+    }
+    last = value;
+    ++samples;
+    if (samples == JOURNAL_MAX_SAMPLES) {
+      finish();
+    }
+  }
+
+  /**
+   * Moves the samples of the current block into the ring, so they are sent as well.
+   */
+  void flush() {
+    if (pendingBlink && samples > 0) {
+      blinkMask |= 1 << (samples - 1);
+      pendingBlink = false;
+    }
+    finish();
+  }
+
+  /**
+   * Number of complete blocks waiting to be sent.
+   */
+  uint8_t blocks() const {
+    return count;
+  }
+
+  /**
+   * Blocks overwritten before they were sent since the last reset.
+   */
+  uint32_t droppedBlocks() const {
+    return dropped;
+  }
+
+  /**
+   * Writes the message of the oldest block into frame (at most CALIBRATION_CODEC_FRAME_SIZE
+   * bytes). Returns the length of the message, 0 if there is no block.
+   * The block is kept until pop() is called, so a message which could not be sent is
+   * built again.
+   */
+  uint8_t frame(uint8_t messageId, uint8_t* frame) const {
+    if (count == 0) {
+      return 0;
+    }
+    frame[0] = messageId;
+    frame[1] = sequence;
+    for (uint8_t i = 0; i < lengths[first]; ++i) {
+      frame[JOURNAL_FRAME_HEADER_SIZE + i] = ring[first][i];
+    }
+    return JOURNAL_FRAME_HEADER_SIZE + lengths[first];
+  }
+
+  /**
+   * Removes the oldest block after its message was sent.
+   */
+  void pop() {
+    if (count == 0) {
+      return;
+    }
+    first = (first + 1) % BLOCKS;
+    --count;
+    ++sequence;
+  }
+
+private:
+  void startBlock(uint32_t time) {
+    blockTime = time;
+    samples = 0;
+    length = JOURNAL_HEADER_SIZE;
+    blinkMask = 0;
+    last = 0;
+  }
+
+  void finish() {
+    if (samples == 0) {
+      return;
+    }
+    current[0] = (uint8_t)blockTime;
+    current[1] = (uint8_t)(blockTime >> 8);
+    current[2] = (uint8_t)(blockTime >> 16);
+    current[3] = (uint8_t)(blockTime >> 24);
+    current[4] = (uint8_t)blinkMask;
+    current[5] = (uint8_t)(blinkMask >> 8);
+    if (count == BLOCKS) {
+      // overwrite the oldest block
+      first = (first + 1) % BLOCKS;
+      --count;
+      ++dropped;
+    }
+    uint8_t index = (first + count) % BLOCKS;
+    for (uint8_t i = 0; i < length; ++i) {
+      ring[index][i] = current[i];
+    }
+    lengths[index] = length;
+    ++count;
+    startBlock(0);
+  }
+
+  uint8_t decimation;                           // every decimation-th sample is kept
+  uint16_t interval;                            // time between two kept samples in ms
+  uint8_t skipped;                              // samples to skip until the next kept one
+  bool pendingBlink;                            // blink in a skipped sample
+  uint32_t blockTime;                           // time of the first sample of the current block
+  uint8_t samples;                              // samples in the current block
+  uint8_t length;                               // bytes used in the current block
+  uint16_t blinkMask;                           // blink flags of the current block
+  int32_t last;                                 // last value added
+  uint8_t current[JOURNAL_BLOCK_SIZE];          // block being filled
+  uint8_t ring[BLOCKS][JOURNAL_BLOCK_SIZE];     // complete blocks
+  uint8_t lengths[BLOCKS];                      // bytes used in the blocks of the ring
+  uint8_t first;                                // index of the oldest block in the ring
+  uint8_t count;                                // blocks in the ring
+  uint8_t sequence;                             // sequence number of the next message
+  uint32_t dropped;                             // blocks overwritten before they were sent
+};
+#endif
+
+/**
+ * Decodes the block of a journal message (without message id and sequence) into at most
+ * JOURNAL_MAX_SAMPLES values and blink flags. Returns the number of samples, -1 if the block
+ * is malformed.
+ */
+static inline int decodeJournalBlock(const uint8_t* block, uint8_t length, uint32_t* time,
+                                     int32_t* values, bool* blinks) {
+  if (length <= JOURNAL_HEADER_SIZE || length > JOURNAL_BLOCK_SIZE) {
+    return -1;
+  }
+  *time = protocolRead32(block);
+  uint16_t blinkMask = block[4] | block[5] << 8;
+  const uint8_t* data = block + JOURNAL_HEADER_SIZE;
+  const uint8_t* end = block + length;
+  int samples = 0;
+  int32_t value = 0;
+  while (data < end) {
+    uint32_t encoded;
+    uint8_t size = readVarint(data, end, &encoded);
+    if (size == 0 || samples == JOURNAL_MAX_SAMPLES) {
+      return -1;
+    }
+    data += size;
+    value = samples == 0 ? zigZagDecode(encoded) : (int32_t)((uint32_t)value + (uint32_t)zigZagDecode(encoded));
+    values[samples] = value;
+    blinks[samples] = (blinkMask >> samples) & 1;
+    ++samples;
+  }
+  return samples;
+}
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROFILE_MESSAGE_H
+#define PROFILE_MESSAGE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Blink profile upload in one checksummed message instead of one message per parameter.
+// The packed profile (PROFILE_MESSAGE_PACKED_SIZE bytes, little endian) holds the parameters
+// in the order of their BLE_CALIBRATION_PARAMETERS_* ids:
+//   5 floats  edgeNegThresh, edgePosThresh, hyst, min_min, max_max
+//   4 uint8   t_fall[0], t_fall[1], t_rise[0], t_rise[1]
+//   2 uint16  t_total[0], t_total[1]
+//   1 uint8   allowedZeros
+//   1 uint16  CRC-16/CCITT (polynomial 0x1021, start 0xFFFF) of the bytes above
+// It is sent in PROFILE_MESSAGE_PARTS frames of at most 20 bytes:
+//   <message id> <transfer id> <part index << 4 | number of parts> <up to 17 bytes>
+// The receiver applies the profile only when all parts of one transfer arrived and the
+// checksum matches, so a profile is never applied half.
+// Plain C with <stdint.h> and <string.h> only, so the sketch and the host tools share it.
+
+#define PROFILE_MESSAGE_PROFILE_SIZE 29  // packed parameters without checksum
+#define PROFILE_MESSAGE_PACKED_SIZE  31  // packed parameters and checksum
+#define PROFILE_MESSAGE_HEADER_SIZE  3
+#define PROFILE_MESSAGE_PART_SIZE    17  // packed bytes per frame
+#define PROFILE_MESSAGE_PARTS        2
+
+// Results of profileReceiverAdd()
+#define PROFILE_INCOMPLETE  0            // more parts expected
+#define PROFILE_COMPLETE    1            // all parts received, checksum ok
+#define PROFILE_BAD_CRC     2            // all parts received, checksum wrong
+#define PROFILE_BAD_FRAME   3            // malformed frame
+
+typedef struct {
+  float edgeNegThresh;
+  float edgePosThresh;
+  float hyst;
+  float min_min;
+  float max_max;
+  uint8_t t_fall[2];
+  uint8_t t_rise[2];
+  uint16_t t_total[2];
+  uint8_t allowedZeros;
+} ProfileParameters;
+
+typedef struct {
+  uint8_t transfer;                              // transfer id of the parts received
+  uint8_t received;                              // bit i set if part i was received
+  uint8_t packed[PROFILE_MESSAGE_PACKED_SIZE];
+} ProfileReceiver;
+
+static inline uint16_t profileCrc16(const uint8_t* data, uint8_t length) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < length; ++i) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = crc & 0x8000 ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+ * Packs the profile and its checksum into packed (PROFILE_MESSAGE_PACKED_SIZE bytes).
+ * Returns the checksum.
+ */
+static inline uint16_t packProfile(const ProfileParameters* profile, uint8_t* packed) {
+  memcpy(packed, &profile->edgeNegThresh, 4);
+  memcpy(packed + 4, &profile->edgePosThresh, 4);
+  memcpy(packed + 8, &profile->hyst, 4);
+  memcpy(packed + 12, &profile->min_min, 4);
+  memcpy(packed + 16, &profile->max_max, 4);
+  packed[20] = profile->t_fall[0];
+  packed[21] = profile->t_fall[1];
+  packed[22] = profile->t_rise[0];
+  packed[23] = profile->t_rise[1];
+  packed[24] = (uint8_t)profile->t_total[0];
+  packed[25] = (uint8_t)(profile->t_total[0] >> 8);
+  packed[26] = (uint8_t)profile->t_total[1];
+  packed[27] = (uint8_t)(profile->t_total[1] >> 8);
+  packed[28] = profile->allowedZeros;
+  uint16_t crc = profileCrc16(packed, PROFILE_MESSAGE_PROFILE_SIZE);
+  packed[29] = (uint8_t)crc;
+  packed[30] = (uint8_t)(crc >> 8);
+  return crc;
+}
+
+/**
+ * Unpacks a profile packed by packProfile() (the checksum is not checked here).
+ */
+static inline void unpackProfile(const uint8_t* packed, ProfileParameters* profile) {
+  memcpy(&profile->edgeNegThresh, packed, 4);
+  memcpy(&profile->edgePosThresh, packed + 4, 4);
+  memcpy(&profile->hyst, packed + 8, 4);
+  memcpy(&profile->min_min, packed + 12, 4);
+  memcpy(&profile->max_max, packed + 16, 4);
+  profile->t_fall[0] = packed[20];
+  profile->t_fall[1] = packed[21];
+  profile->t_rise[0] = packed[22];
+  profile->t_rise[1] = packed[23];
+  profile->t_total[0] = (uint16_t)(packed[24] | packed[25] << 8);
+  profile->t_total[1] = (uint16_t)(packed[26] | packed[27] << 8);
+  profile->allowedZeros = packed[28];
+}
+
+/**
+ * Returns the checksum stored in a packed profile.
+ */
+static inline uint16_t packedProfileCrc(const uint8_t* packed) {
+  return (uint16_t)(packed[29] | packed[30] << 8);
+}
+
+/**
+ * Writes frame 'part' of a packed profile into frame (at most 20 bytes).
+ * Returns the length of the frame.
+ */
+static inline uint8_t buildProfileFrame(const uint8_t* packed, uint8_t messageId, uint8_t transfer,
+                                        uint8_t part, uint8_t* frame) {
+  uint8_t offset = part * PROFILE_MESSAGE_PART_SIZE;
+  uint8_t length = PROFILE_MESSAGE_PACKED_SIZE - offset;
+  if (length > PROFILE_MESSAGE_PART_SIZE) {
+    length = PROFILE_MESSAGE_PART_SIZE;
+  }
+  frame[0] = messageId;
+  frame[1] = transfer;
+  frame[2] = (uint8_t)(part << 4 | PROFILE_MESSAGE_PARTS);
+  memcpy(frame + PROFILE_MESSAGE_HEADER_SIZE, packed + offset, length);
+  return PROFILE_MESSAGE_HEADER_SIZE + length;
+}
+
+static inline void profileReceiverReset(ProfileReceiver* receiver) {
+  receiver->transfer = 0;
+  receiver->received = 0;
+}
+
+/**
+ * Adds a received frame. Parts of an older transfer are dropped as soon as a part of a new
+ * transfer arrives. Returns one of the PROFILE_* results above. On PROFILE_COMPLETE the
+ * packed profile is in receiver->packed and the receiver waits for the next transfer.
+ */
+static inline uint8_t profileReceiverAdd(ProfileReceiver* receiver, const uint8_t* frame,
+                                         uint8_t length) {
+  if (length <= PROFILE_MESSAGE_HEADER_SIZE) {
+    return PROFILE_BAD_FRAME;
+  }
+  uint8_t part = frame[2] >> 4;
+  uint8_t offset = part * PROFILE_MESSAGE_PART_SIZE;
+  uint8_t expected = PROFILE_MESSAGE_PACKED_SIZE - offset;
+  if (expected > PROFILE_MESSAGE_PART_SIZE) {
+    expected = PROFILE_MESSAGE_PART_SIZE;
+  }
+  if ((frame[2] & 0x0F) != PROFILE_MESSAGE_PARTS || part >= PROFILE_MESSAGE_PARTS
+      || length != PROFILE_MESSAGE_HEADER_SIZE + expected) {
+    return PROFILE_BAD_FRAME;
+  }
+  if (receiver->received == 0 || receiver->transfer != frame[1]) {
+    receiver->transfer = frame[1];
+    receiver->received = 0;
+  }
+  memcpy(receiver->packed + offset, frame + PROFILE_MESSAGE_HEADER_SIZE, expected);
+  receiver->received |= 1 << part;
+  if (receiver->received != (1 << PROFILE_MESSAGE_PARTS) - 1) {
+    return PROFILE_INCOMPLETE;
+  }
+  receiver->received = 0;
+  if (profileCrc16(receiver->packed, PROFILE_MESSAGE_PROFILE_SIZE) != packedProfileCrc(receiver->packed)) {
+    return PROFILE_BAD_CRC;
+  }
+  return PROFILE_COMPLETE;
+}
+
+#endif
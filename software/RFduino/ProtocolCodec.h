@@ -0,0 +1,395 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef PROTOCOL_CODEC_H
+#define PROTOCOL_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Wire protocol between the RFduino and the app.
+// This is the only definition of the message ids, the sketch uses them directly and the app
+// maps its enums in Protocol.h onto them. IN and OUT are seen from the RFduino:
+// PROTOCOL_IN_* is sent by the app, PROTOCOL_OUT_* by the RFduino.
+//
+// Every message is a single BLE packet of at most PROTOCOL_MAX_MESSAGE_SIZE bytes, byte 0 is
+// the message id, multi byte values are little endian. protocolInMessages and
+// protocolOutMessages list the allowed length of every message, protocolCheckIn() and
+// protocolCheckOut() validate a received message against them before it is decoded.
+// The encoders write into a buffer of the caller and return the message length, the
+// decoders read straight from the received bytes. Nothing is allocated or copied.
+//
+// Plain C with <stdint.h> and <string.h> only. The sketch and the host tools compile it as C++,
+// but the app imports it through Protocol.h, and with AppDelegate.h, BLEDeviceManager.h,
+// AnimationView.h and UserProfileManager.h into six of its Objective-C (.m) files; a C++ header
+// would turn all of them into Objective-C++. The length tables are static const arrays, which
+// gcc places in the flash of the RFduino just like constexpr ones.
+// The blink profile (PROTOCOL_IN_SET_PROFILE) is encoded by ProfileMessage.h, compressed
+// calibration frames (PROTOCOL_OUT_CALIBRATION_COMPRESSED) by CalibrationCodec.h.
+
+#define PROTOCOL_MAX_MESSAGE_SIZE 20
+
+// Messages to the RFduino
+#define PROTOCOL_IN_NORMAL_MODE                 0x00 // Normal operation -> send blink events.
+#define PROTOCOL_IN_START_CALIBRATION           0x01 // Start sending prefiltered proximity values.
+#define PROTOCOL_IN_STOP_CALIBRATION            0x02 // Stop sending prefiltered proximity values.
+#define PROTOCOL_IN_SET_PARAMETER               0x03 // <parameter id> <float>, see protocolEncodeParameter()
+#define PROTOCOL_IN_SET_PROFILE                 0x04 // Complete blink profile, see ProfileMessage.h
+#define PROTOCOL_IN_BLINK_ACK                   0x05 // Acknowledges a PROTOCOL_OUT_BLINK_EVENT: <sequence number>
+#define PROTOCOL_IN_START_DEBUG                 0x0E // Start sending debugging messages.
+#define PROTOCOL_IN_STOP_DEBUG                  0x0F // Stop sending debugging messages.
+#define PROTOCOL_IN_REQUEST_BATTERY_LEVEL       0x10 // Request battery voltage level.
+#define PROTOCOL_IN_REQUEST_TIMING              0x11 // Request sample timing statistics (resets them).
+#define PROTOCOL_IN_RESET                       0xFF // Request system reset.
+
+// Messages from the RFduino
+#define PROTOCOL_OUT_ALIVE                      0x00 // Answer to PROTOCOL_IN_NORMAL_MODE.
+#define PROTOCOL_OUT_BLINK_DETECTED             0x01 // Blink detected (older sketches, replaced by 0x07).
+#define PROTOCOL_OUT_CALIBRATION_DATA           0x02 // Single calibration sample <float> <blink> (older sketches).
+#define PROTOCOL_OUT_PARAMETERS_SET             0x03 // Sent after the last parameter (allowed zeros) was set.
+#define PROTOCOL_OUT_CALIBRATION_FRAME          0x04 // Up to 4 calibration samples, see protocolEncodeCalibrationFrame()
+#define PROTOCOL_OUT_CALIBRATION_COMPRESSED     0x05 // Up to 16 compressed calibration samples, see CalibrationCodec.h
+#define PROTOCOL_OUT_PROFILE_SET                0x06 // Answer to PROTOCOL_IN_SET_PROFILE, see protocolEncodeProfileStatus()
+#define PROTOCOL_OUT_BLINK_EVENT                0x07 // Blink detected, see protocolEncodeBlinkEvent()
+#define PROTOCOL_OUT_JOURNAL                    0x08 // Samples recorded while disconnected, see Journal.h
+#define PROTOCOL_OUT_DEBUG                      0x0F // <data length> <data> (NYI)
+#define PROTOCOL_OUT_BATTERY_LEVEL              0x10 // Battery voltage <float>
+#define PROTOCOL_OUT_TIMING                     0x11 // Sample timing statistics, see protocolEncodeTiming()
+#define PROTOCOL_OUT_ERROR_EXCEPTION            0xEE // Error or exception (NYI)
+#define PROTOCOL_OUT_RESET                      0xFF // Start up or restart of the system.
+
+// Parameter ids of PROTOCOL_IN_SET_PARAMETER, in the order of the packed profile.
+// They are carried in byte 1, so they do not collide with the message ids.
+#define PROTOCOL_PARAMETER_THRESH_NEG           0x10
+#define PROTOCOL_PARAMETER_THRESH_POS           0x11
+#define PROTOCOL_PARAMETER_HYSTERESIS           0x12
+#define PROTOCOL_PARAMETER_MIN_MIN              0x13
+#define PROTOCOL_PARAMETER_MAX_MAX              0x14
+#define PROTOCOL_PARAMETER_T_FALL_MIN           0x15
+#define PROTOCOL_PARAMETER_T_FALL_MAX           0x16
+#define PROTOCOL_PARAMETER_T_RISE_MIN           0x17
+#define PROTOCOL_PARAMETER_T_RISE_MAX           0x18
+#define PROTOCOL_PARAMETER_T_TOTAL_MIN          0x19
+#define PROTOCOL_PARAMETER_T_TOTAL_MAX          0x1A
+#define PROTOCOL_PARAMETER_ALLOWED_ZEROS        0x1B
+
+// Status of PROTOCOL_OUT_PROFILE_SET
+#define PROTOCOL_PROFILE_APPLIED                0x00 // Profile applied.
+#define PROTOCOL_PROFILE_BAD_CRC                0x01 // Checksum does not match, profile dropped.
+#define PROTOCOL_PROFILE_BAD_FRAME              0x02 // Malformed frame, profile dropped.
+
+// Message sizes
+#define PROTOCOL_PARAMETER_SIZE                 6
+#define PROTOCOL_BLINK_ACK_SIZE                 2
+#define PROTOCOL_BLINK_EVENT_SIZE               6
+#define PROTOCOL_BATTERY_LEVEL_SIZE             5
+#define PROTOCOL_PROFILE_STATUS_SIZE            5
+#define PROTOCOL_TIMING_SIZE                    19
+#define PROTOCOL_CALIBRATION_HEADER_SIZE        3
+#define PROTOCOL_CALIBRATION_MAX_SAMPLES        4  // floats fitting into one message
+
+typedef struct {
+  uint8_t id;
+  uint8_t minLength;
+  uint8_t maxLength;
+} ProtocolMessageInfo;
+
+static const ProtocolMessageInfo protocolInMessages[] = {
+  { PROTOCOL_IN_NORMAL_MODE,            1, 1 },
+  { PROTOCOL_IN_START_CALIBRATION,      1, 1 },
+  { PROTOCOL_IN_STOP_CALIBRATION,       1, 1 },
+  { PROTOCOL_IN_SET_PARAMETER,          PROTOCOL_PARAMETER_SIZE, PROTOCOL_PARAMETER_SIZE },
+  { PROTOCOL_IN_SET_PROFILE,            4, PROTOCOL_MAX_MESSAGE_SIZE },
+  { PROTOCOL_IN_BLINK_ACK,              PROTOCOL_BLINK_ACK_SIZE, PROTOCOL_BLINK_ACK_SIZE },
+  { PROTOCOL_IN_START_DEBUG,            1, 1 },
+  { PROTOCOL_IN_STOP_DEBUG,             1, 1 },
+  { PROTOCOL_IN_REQUEST_BATTERY_LEVEL,  1, 1 },
+  { PROTOCOL_IN_REQUEST_TIMING,         1, 1 },
+  { PROTOCOL_IN_RESET,                  1, 1 }
+};
+
+static const ProtocolMessageInfo protocolOutMessages[] = {
+  { PROTOCOL_OUT_ALIVE,                  1, 1 },
+  { PROTOCOL_OUT_BLINK_DETECTED,         1, 1 },
+  { PROTOCOL_OUT_CALIBRATION_DATA,       6, 6 },
+  { PROTOCOL_OUT_PARAMETERS_SET,         1, 1 },
+  { PROTOCOL_OUT_CALIBRATION_FRAME,      PROTOCOL_CALIBRATION_HEADER_SIZE + 4,
+                                         PROTOCOL_CALIBRATION_HEADER_SIZE + 4 * PROTOCOL_CALIBRATION_MAX_SAMPLES },
+  { PROTOCOL_OUT_CALIBRATION_COMPRESSED, 5, PROTOCOL_MAX_MESSAGE_SIZE },
+  { PROTOCOL_OUT_PROFILE_SET,            PROTOCOL_PROFILE_STATUS_SIZE, PROTOCOL_PROFILE_STATUS_SIZE },
+  { PROTOCOL_OUT_BLINK_EVENT,            PROTOCOL_BLINK_EVENT_SIZE, PROTOCOL_BLINK_EVENT_SIZE },
+  { PROTOCOL_OUT_JOURNAL,                9, PROTOCOL_MAX_MESSAGE_SIZE },
+  { PROTOCOL_OUT_DEBUG,                  1, PROTOCOL_MAX_MESSAGE_SIZE },
+  { PROTOCOL_OUT_BATTERY_LEVEL,          PROTOCOL_BATTERY_LEVEL_SIZE, PROTOCOL_BATTERY_LEVEL_SIZE },
+  { PROTOCOL_OUT_TIMING,                 PROTOCOL_TIMING_SIZE, PROTOCOL_TIMING_SIZE },
+  { PROTOCOL_OUT_ERROR_EXCEPTION,        1, PROTOCOL_MAX_MESSAGE_SIZE },
+  { PROTOCOL_OUT_RESET,                  1, 1 }
+};
+
+#define PROTOCOL_IN_MESSAGES  (sizeof(protocolInMessages) / sizeof(protocolInMessages[0]))
+#define PROTOCOL_OUT_MESSAGES (sizeof(protocolOutMessages) / sizeof(protocolOutMessages[0]))
+
+// Sample timing statistics of PROTOCOL_OUT_TIMING, intervals in us.
+typedef struct {
+  float rate;               // effective sample rate in samples/s
+  uint32_t samples;
+  uint16_t missed;          // missed sample slots
+  uint16_t intervalMin;
+  uint16_t interval50;      // 50 % percentile
+  uint16_t interval99;      // 99 % percentile
+  uint16_t intervalMax;
+} ProtocolTiming;
+
+static inline uint16_t protocolRead16(const uint8_t* data) {
+  return (uint16_t)(data[0] | data[1] << 8);
+}
+
+static inline uint32_t protocolRead32(const uint8_t* data) {
+  return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline float protocolReadFloat(const uint8_t* data) {
+  uint32_t bits = protocolRead32(data);
+  float value;
+  memcpy(&value, &bits, sizeof(float));
+  return value;
+}
+
+static inline void protocolWrite16(uint8_t* data, uint16_t value) {
+  data[0] = (uint8_t)value;
+  data[1] = (uint8_t)(value >> 8);
+}
+
+static inline void protocolWrite32(uint8_t* data, uint32_t value) {
+  data[0] = (uint8_t)value;
+  data[1] = (uint8_t)(value >> 8);
+  data[2] = (uint8_t)(value >> 16);
+  data[3] = (uint8_t)(value >> 24);
+}
+
+static inline void protocolWriteFloat(uint8_t* data, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(float));
+  protocolWrite32(data, bits);
+}
+
+/**
+ * Returns 1 if data starts with a message id of the table and length is allowed for it.
+ */
+static inline int protocolCheck(const ProtocolMessageInfo* table, uint8_t messages,
+                                const uint8_t* data, int length) {
+  if (length < 1) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < messages; ++i) {
+    if (table[i].id == data[0]) {
+      return length >= table[i].minLength && length <= table[i].maxLength;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Checks a message received by the RFduino.
+ */
+static inline int protocolCheckIn(const uint8_t* data, int length) {
+  return protocolCheck(protocolInMessages, PROTOCOL_IN_MESSAGES, data, length);
+}
+
+/**
+ * Checks a message received by the app.
+ */
+static inline int protocolCheckOut(const uint8_t* data, int length) {
+  return protocolCheck(protocolOutMessages, PROTOCOL_OUT_MESSAGES, data, length);
+}
+
+// The encoders return the message length, the decoders 1 if the message could be decoded
+// (right id and length), 0 otherwise.
+
+/**
+ * <PROTOCOL_IN_SET_PARAMETER> <parameter id> <float>
+ */
+static inline uint8_t protocolEncodeParameter(uint8_t* data, uint8_t parameter, float value) {
+  data[0] = PROTOCOL_IN_SET_PARAMETER;
+  data[1] = parameter;
+  protocolWriteFloat(data + 2, value);
+  return PROTOCOL_PARAMETER_SIZE;
+}
+
+static inline int protocolDecodeParameter(const uint8_t* data, int length, uint8_t* parameter,
+                                          float* value) {
+  if (length != PROTOCOL_PARAMETER_SIZE || data[0] != PROTOCOL_IN_SET_PARAMETER) {
+    return 0;
+  }
+  *parameter = data[1];
+  *value = protocolReadFloat(data + 2);
+  return 1;
+}
+
+/**
+ * <PROTOCOL_IN_BLINK_ACK> <sequence number>
+ */
+static inline uint8_t protocolEncodeBlinkAck(uint8_t* data, uint8_t sequence) {
+  data[0] = PROTOCOL_IN_BLINK_ACK;
+  data[1] = sequence;
+  return PROTOCOL_BLINK_ACK_SIZE;
+}
+
+static inline int protocolDecodeBlinkAck(const uint8_t* data, int length, uint8_t* sequence) {
+  if (length != PROTOCOL_BLINK_ACK_SIZE || data[0] != PROTOCOL_IN_BLINK_ACK) {
+    return 0;
+  }
+  *sequence = data[1];
+  return 1;
+}
+
+/**
+ * <PROTOCOL_OUT_BLINK_EVENT> <sequence number> <4 byte millis() of the detection>
+ */
+static inline uint8_t protocolEncodeBlinkEvent(uint8_t* data, uint8_t sequence, uint32_t time) {
+  data[0] = PROTOCOL_OUT_BLINK_EVENT;
+  data[1] = sequence;
+  protocolWrite32(data + 2, time);
+  return PROTOCOL_BLINK_EVENT_SIZE;
+}
+
+static inline int protocolDecodeBlinkEvent(const uint8_t* data, int length, uint8_t* sequence,
+                                           uint32_t* time) {
+  if (length != PROTOCOL_BLINK_EVENT_SIZE || data[0] != PROTOCOL_OUT_BLINK_EVENT) {
+    return 0;
+  }
+  *sequence = data[1];
+  *time = protocolRead32(data + 2);
+  return 1;
+}
+
+/**
+ * <PROTOCOL_OUT_BATTERY_LEVEL> <float voltage>
+ */
+static inline uint8_t protocolEncodeBatteryLevel(uint8_t* data, float voltage) {
+  data[0] = PROTOCOL_OUT_BATTERY_LEVEL;
+  protocolWriteFloat(data + 1, voltage);
+  return PROTOCOL_BATTERY_LEVEL_SIZE;
+}
+
+static inline int protocolDecodeBatteryLevel(const uint8_t* data, int length, float* voltage) {
+  if (length != PROTOCOL_BATTERY_LEVEL_SIZE || data[0] != PROTOCOL_OUT_BATTERY_LEVEL) {
+    return 0;
+  }
+  *voltage = protocolReadFloat(data + 1);
+  return 1;
+}
+
+/**
+ * <PROTOCOL_OUT_PROFILE_SET> <transfer id> <2 byte checksum> <PROTOCOL_PROFILE_*>
+ */
+static inline uint8_t protocolEncodeProfileStatus(uint8_t* data, uint8_t transfer, uint16_t crc,
+                                                  uint8_t status) {
+  data[0] = PROTOCOL_OUT_PROFILE_SET;
+  data[1] = transfer;
+  protocolWrite16(data + 2, crc);
+  data[4] = status;
+  return PROTOCOL_PROFILE_STATUS_SIZE;
+}
+
+static inline int protocolDecodeProfileStatus(const uint8_t* data, int length, uint8_t* transfer,
+                                              uint16_t* crc, uint8_t* status) {
+  if (length != PROTOCOL_PROFILE_STATUS_SIZE || data[0] != PROTOCOL_OUT_PROFILE_SET) {
+    return 0;
+  }
+  *transfer = data[1];
+  *crc = protocolRead16(data + 2);
+  *status = data[4];
+  return 1;
+}
+
+/**
+ * <PROTOCOL_OUT_TIMING> <float rate> <4 byte samples> <2 byte missed> <2 byte interval min>
+ * <2 byte 50 %> <2 byte 99 %> <2 byte interval max>
+ */
+static inline uint8_t protocolEncodeTiming(uint8_t* data, const ProtocolTiming* timing) {
+  data[0] = PROTOCOL_OUT_TIMING;
+  protocolWriteFloat(data + 1, timing->rate);
+  protocolWrite32(data + 5, timing->samples);
+  protocolWrite16(data + 9, timing->missed);
+  protocolWrite16(data + 11, timing->intervalMin);
+  protocolWrite16(data + 13, timing->interval50);
+  protocolWrite16(data + 15, timing->interval99);
+  protocolWrite16(data + 17, timing->intervalMax);
+  return PROTOCOL_TIMING_SIZE;
+}
+
+static inline int protocolDecodeTiming(const uint8_t* data, int length, ProtocolTiming* timing) {
+  if (length != PROTOCOL_TIMING_SIZE || data[0] != PROTOCOL_OUT_TIMING) {
+    return 0;
+  }
+  timing->rate = protocolReadFloat(data + 1);
+  timing->samples = protocolRead32(data + 5);
+  timing->missed = protocolRead16(data + 9);
+  timing->intervalMin = protocolRead16(data + 11);
+  timing->interval50 = protocolRead16(data + 13);
+  timing->interval99 = protocolRead16(data + 15);
+  timing->intervalMax = protocolRead16(data + 17);
+  return 1;
+}
+
+/**
+ * <PROTOCOL_OUT_CALIBRATION_FRAME> <sequence number> <blink mask> <1 to 4 floats>
+ * Bit i of the blink mask belongs to sample i.
+ */
+static inline uint8_t protocolEncodeCalibrationFrame(uint8_t* data, uint8_t sequence,
+                                                     uint8_t blinkMask, const float* values,
+                                                     uint8_t samples) {
+  data[0] = PROTOCOL_OUT_CALIBRATION_FRAME;
+  data[1] = sequence;
+  data[2] = blinkMask;
+  for (uint8_t i = 0; i < samples; ++i) {
+    protocolWriteFloat(data + PROTOCOL_CALIBRATION_HEADER_SIZE + 4 * i, values[i]);
+  }
+  return PROTOCOL_CALIBRATION_HEADER_SIZE + 4 * samples;
+}
+
+/**
+ * Returns the number of samples of a calibration frame, 0 if it is malformed.
+ * The samples are read with protocolCalibrationSample().
+ */
+static inline uint8_t protocolCalibrationSamples(const uint8_t* data, int length) {
+  if (length < PROTOCOL_CALIBRATION_HEADER_SIZE + 4
+      || length > PROTOCOL_CALIBRATION_HEADER_SIZE + 4 * PROTOCOL_CALIBRATION_MAX_SAMPLES
+      || (length - PROTOCOL_CALIBRATION_HEADER_SIZE) % 4 != 0
+      || data[0] != PROTOCOL_OUT_CALIBRATION_FRAME) {
+    return 0;
+  }
+  return (uint8_t)((length - PROTOCOL_CALIBRATION_HEADER_SIZE) / 4);
+}
+
+static inline float protocolCalibrationSample(const uint8_t* data, uint8_t index) {
+  return protocolReadFloat(data + PROTOCOL_CALIBRATION_HEADER_SIZE + 4 * index);
+}
+
+#endif
@@ -0,0 +1,219 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROXIMITY_TABLE_H
+#define PROXIMITY_TABLE_H
+
+#include <stdint.h>
+
+// Conversion table raw VCNL4020 proximity counts -> distance in mm.
+//
+// The exact conversion mm = exp(log(68000 / raw) / 1.765) = (68000 / raw)^(1 / 1.765)
+// (see https://forums.adafruit.com/viewtopic.php?f=19&t=89699) needs two transcendental
+// functions per sample, which are very expensive in soft-float on the Cortex-M0.
+//
+// The table is piecewise linear on a logarithmic grid: every octave [2^p, 2^(p+1)) of the
+// raw count (p = 0 .. 15) is split into 2^PROXIMITY_TABLE_SUB_BITS equally wide segments.
+// Entry i = (p << PROXIMITY_TABLE_SUB_BITS) + s holds the distance at
+//   raw = 2^p * (1 + s / 2^PROXIMITY_TABLE_SUB_BITS)
+// in Q15.16 fixed point mm (see FixedPoint.h). The last entry is the distance at raw = 65536.
+// Values in between are linearly interpolated by proximityFromRaw().
+//
+// Error bound against the exact formula (checked for every raw count 1 .. 65535):
+//   - relative error < 0.003 %
+//   - absolute error < 0.0003 mm for raw >= 1000 (distances below 11 mm, i.e. when worn)
+//   - absolute error < 0.001 mm over the whole range
+// Flash cost: 1025 * 4 = 4100 bytes for the table.
+// Error bound, speed and size are checked on the host by tools/proximitybench.
+//
+// Generated with:
+//   mm = lambda r: math.exp(math.log(68000.0 / r) / 1.765)
+//   [round(mm(2**p * (1 + s / 64.0)) * 65536) for p in range(16) for s in range(64)]
+//   + [round(mm(65536.0) * 65536)]
+#define PROXIMITY_TABLE_SUB_BITS  6
+
+const uint32_t proximityTable[(16 << PROXIMITY_TABLE_SUB_BITS) + 1] = {
+  35846381, 35532877, 35226839, 34927979, 34636027, 34350725, 34071827, 33799102,
+  33532329, 33271298, 33015810, 32765673, 32520707, 32280740, 32045605, 31815146,
+  31589212, 31367660, 31150352, 30937156, 30727946, 30522602, 30321008, 30123053,
+  29928631, 29737639, 29549980, 29365560, 29184287, 29006075, 28830839, 28658500,
+  28488980, 28322204, 28158099, 27996597, 27837631, 27681136, 27527049, 27375311,
+  27225863, 27078650, 26933617, 26790711, 26649883, 26511082, 26374263, 26239378,
+  26106383, 25975236, 25845894, 25718318, 25592468, 25468306, 25345795, 25224901,
+  25105587, 24987821, 24871569, 24756801, 24643486, 24531593, 24421094, 24311960,
+  24204164, 23992480, 23785837, 23584041, 23386910, 23194268, 23005951, 22821802,
+  22641671, 22465418, 22292907, 22124010, 21958605, 21796574, 21637807, 21482196,
+  21329642, 21180045, 21033314, 20889360, 20748098, 20609446, 20473326, 20339663,
+  20208385, 20079424, 19952713, 19828189, 19705790, 19585458, 19467135, 19350769,
+  19236305, 19123695, 19012888, 18903839, 18796502, 18690833, 18586791, 18484335,
+  18383425, 18284023, 18186094, 18089602, 17994512, 17900791, 17808408, 17717331,
+  17627530, 17538977, 17451643, 17365501, 17280525, 17196688, 17113967, 17032336,
+  16951773, 16872256, 16793760, 16716267, 16639754, 16564202, 16489591, 16415901,
+  16343115, 16200182, 16060653, 15924397, 15791290, 15661214, 15534059, 15409718,
+  15288090, 15169081, 15052598, 14938556, 14826871, 14717465, 14610262, 14505191,
+  14402183, 14301173, 14202097, 14104897, 14009513, 13915893, 13823982, 13733730,
+  13645089, 13558012, 13472454, 13388373, 13305727, 13224476, 13144583, 13066010,
+  12988722, 12912685, 12837867, 12764235, 12691758, 12620409, 12550158, 12480977,
+  12412841, 12345723, 12279599, 12214446, 12150239, 12086957, 12024578, 11963081,
+  11902446, 11842654, 11783684, 11725519, 11668142, 11611534, 11555678, 11500560,
+  11446162, 11392470, 11339469, 11287144, 11235481, 11184467, 11134088, 11084331,
+  11035185, 10938673, 10844461, 10752458, 10662581, 10574752, 10488894, 10404937,
+  10322812, 10242454, 10163803, 10086799, 10011387, 9937514, 9865129, 9794183,
+  9724630, 9656426, 9589528, 9523896, 9459492, 9396278, 9334218, 9273278,
+  9213426, 9154630, 9096859, 9040086, 8984282, 8929420, 8875474, 8822420,
+  8770234, 8718893, 8668374, 8618656, 8569719, 8521542, 8474107, 8427395,
+  8381388, 8336069, 8291421, 8247428, 8204074, 8161345, 8119226, 8077702,
+  8036760, 7996387, 7956569, 7917295, 7878553, 7840330, 7802616, 7765399,
+  7728668, 7692414, 7656627, 7621296, 7586412, 7551966, 7517949, 7484353,
+  7451168, 7386002, 7322388, 7260266, 7199579, 7140275, 7082302, 7025613,
+  6970160, 6915901, 6862795, 6810800, 6759881, 6710000, 6661124, 6613220,
+  6566257, 6520204, 6475033, 6430717, 6387230, 6344547, 6302643, 6261495,
+  6221082, 6181381, 6142374, 6104039, 6066359, 6029315, 5992890, 5957067,
+  5921830, 5887163, 5853052, 5819482, 5786438, 5753908, 5721879, 5690339,
+  5659274, 5628673, 5598526, 5568821, 5539548, 5510697, 5482257, 5454219,
+  5426574, 5399314, 5372428, 5345910, 5319750, 5293941, 5268476, 5243346,
+  5218545, 5194066, 5169901, 5146045, 5122491, 5099232, 5076263, 5053578,
+  5031172, 4987170, 4944216, 4902270, 4861294, 4821251, 4782106, 4743828,
+  4706386, 4669749, 4633890, 4598783, 4564401, 4530721, 4497719, 4465373,
+  4433662, 4402567, 4372067, 4342144, 4312780, 4283960, 4255665, 4227881,
+  4200594, 4173787, 4147449, 4121564, 4096122, 4071109, 4046514, 4022326,
+  3998533, 3975126, 3952093, 3929426, 3907114, 3885149, 3863523, 3842226,
+  3821250, 3800588, 3780232, 3760175, 3740409, 3720928, 3701725, 3682793,
+  3664127, 3645720, 3627566, 3609661, 3591997, 3574570, 3557376, 3540408,
+  3523662, 3507133, 3490816, 3474708, 3458804, 3443099, 3427590, 3412273,
+  3397143, 3367433, 3338430, 3310107, 3282439, 3255401, 3228970, 3203124,
+  3177842, 3153104, 3128892, 3105186, 3081971, 3059229, 3036946, 3015105,
+  2993694, 2972697, 2952103, 2931899, 2912072, 2892612, 2873507, 2854747,
+  2836321, 2818221, 2800437, 2782959, 2765780, 2748891, 2732284, 2715952,
+  2699886, 2684081, 2668529, 2653223, 2638158, 2623327, 2608725, 2594344,
+  2580181, 2566230, 2552485, 2538942, 2525596, 2512442, 2499476, 2486693,
+  2474089, 2461660, 2449402, 2437312, 2425385, 2413619, 2402008, 2390551,
+  2379244, 2368083, 2357066, 2346190, 2335451, 2324847, 2314375, 2304032,
+  2293816, 2273755, 2254172, 2235048, 2216366, 2198109, 2180262, 2162811,
+  2145740, 2129036, 2112688, 2096681, 2081006, 2065650, 2050604, 2035857,
+  2021399, 2007222, 1993317, 1979674, 1966287, 1953147, 1940247, 1927580,
+  1915138, 1902917, 1890909, 1879107, 1867508, 1856104, 1844891, 1833863,
+  1823015, 1812343, 1801842, 1791507, 1781335, 1771321, 1761461, 1751751,
+  1742188, 1732768, 1723487, 1714342, 1705331, 1696449, 1687694, 1679063,
+  1670552, 1662160, 1653883, 1645720, 1637667, 1629721, 1621882, 1614146,
+  1606511, 1598975, 1591536, 1584192, 1576941, 1569781, 1562710, 1555727,
+  1548829, 1535283, 1522060, 1509147, 1496533, 1484205, 1472155, 1460371,
+  1448845, 1437566, 1426527, 1415719, 1405135, 1394767, 1384607, 1374650,
+  1364888, 1355315, 1345926, 1336714, 1327675, 1318802, 1310092, 1301539,
+  1293138, 1284886, 1276778, 1268809, 1260977, 1253277, 1245705, 1238259,
+  1230935, 1223729, 1216638, 1209660, 1202792, 1196030, 1189372, 1182816,
+  1176359, 1169998, 1163731, 1157557, 1151472, 1145475, 1139563, 1133735,
+  1127989, 1122322, 1116734, 1111222, 1105784, 1100419, 1095126, 1089902,
+  1084747, 1079659, 1074636, 1069677, 1064781, 1059946, 1055172, 1050456,
+  1045799, 1036653, 1027724, 1019005, 1010487, 1002164, 994027, 986071,
+  978288, 970672, 963218, 955921, 948774, 941773, 934913, 928190,
+  921598, 915135, 908795, 902575, 896471, 890480, 884599, 878824,
+  873152, 867580, 862105, 856724, 851436, 846237, 841124, 836096,
+  831151, 826285, 821497, 816786, 812148, 807582, 803087, 798660,
+  794300, 790005, 785774, 781605, 777496, 773447, 769455, 765520,
+  761640, 757814, 754040, 750318, 746646, 743024, 739450, 735923,
+  732442, 729006, 725615, 722266, 718960, 715696, 712472, 709288,
+  706143, 699968, 693939, 688052, 682301, 676680, 671186, 665814,
+  660559, 655416, 650384, 645456, 640630, 635903, 631271, 626732,
+  622281, 617916, 613636, 609436, 605315, 601269, 597298, 593399,
+  589569, 585806, 582110, 578477, 574906, 571395, 567943, 564548,
+  561209, 557924, 554691, 551509, 548378, 545295, 542260, 539271,
+  536327, 533427, 530570, 527754, 524980, 522246, 519551, 516894,
+  514274, 511690, 509142, 506629, 504150, 501704, 499291, 496909,
+  494559, 492239, 489949, 487688, 485456, 483252, 481075, 478925,
+  476802, 472632, 468561, 464586, 460702, 456907, 453198, 449570,
+  446022, 442550, 439151, 435824, 432566, 429374, 426247, 423181,
+  420176, 417229, 414339, 411503, 408720, 405989, 403307, 400674,
+  398088, 395548, 393052, 390599, 388187, 385817, 383486, 381194,
+  378939, 376721, 374538, 372390, 370275, 368194, 366144, 364126,
+  362138, 360180, 358251, 356350, 354477, 352630, 350811, 349016,
+  347247, 345503, 343783, 342086, 340412, 338760, 337131, 335523,
+  333936, 332369, 330823, 329296, 327789, 326301, 324831, 323379,
+  321946, 319130, 316381, 313697, 311075, 308513, 306008, 303558,
+  301162, 298818, 296523, 294277, 292077, 289922, 287810, 285740,
+  283711, 281721, 279769, 277855, 275976, 274131, 272321, 270543,
+  268797, 267081, 265396, 263740, 262112, 260511, 258937, 257389,
+  255867, 254369, 252895, 251445, 250017, 248611, 247228, 245865,
+  244522, 243200, 241898, 240614, 239349, 238103, 236874, 235663,
+  234468, 233290, 232129, 230983, 229853, 228737, 227637, 226551,
+  225480, 224422, 223378, 222347, 221329, 220325, 219332, 218352,
+  217384, 215483, 213627, 211814, 210044, 208314, 206622, 204968,
+  203351, 201768, 200218, 198701, 197216, 195761, 194335, 192937,
+  191567, 190223, 188906, 187613, 186344, 185099, 183876, 182676,
+  181497, 180338, 179200, 178082, 176983, 175902, 174839, 173794,
+  172766, 171755, 170760, 169780, 168816, 167867, 166933, 166013,
+  165106, 164214, 163334, 162467, 161613, 160772, 159942, 159124,
+  158317, 157522, 156738, 155964, 155201, 154448, 153705, 152972,
+  152248, 151534, 150829, 150133, 149446, 148767, 148097, 147435,
+  146782, 145498, 144245, 143021, 141826, 140657, 139515, 138399,
+  137306, 136237, 135191, 134167, 133164, 132181, 131219, 130275,
+  129350, 128443, 127553, 126680, 125823, 124982, 124157, 123346,
+  122550, 121768, 121000, 120244, 119502, 118772, 118055, 117349,
+  116655, 115972, 115300, 114639, 113988, 113347, 112716, 112095,
+  111483, 110880, 110286, 109701, 109124, 108556, 107996, 107444,
+  106899, 106362, 105832, 105310, 104795, 104286, 103785, 103289,
+  102801, 102319, 101843, 101373, 100909, 100451, 99998, 99551,
+  99110, 98243, 97397, 96571, 95763, 94975, 94203, 93449,
+  92712, 91990, 91284, 90592, 89915, 89251, 88601, 87964,
+  87339, 86727, 86126, 85537, 84958, 84390, 83833, 83286,
+  82748, 82220, 81701, 81191, 80690, 80197, 79713, 79236,
+  78768, 78307, 77853, 77406, 76967, 76534, 76108, 75689,
+  75275, 74868, 74467, 74072, 73683, 73299, 72921, 72548,
+  72180, 71818, 71460, 71107, 70759, 70416, 70077, 69743,
+  69413, 69088, 68766, 68449, 68136, 67826, 67521, 67219,
+  66921
+};
+
+/**
+ * Converts a raw proximity count into Q15.16 mm.
+ * Table lookup with linear interpolation, only integer operations.
+ */
+static inline int32_t proximityFromRaw(uint16_t raw) {
+  if (raw == 0) {
+    // exact formula is infinite here, return the largest distance in the table.
+    return proximityTable[0];
+  }
+  // octave of the raw value (position of the highest bit set)
+  uint8_t octave = 31 - __builtin_clz(raw);
+  uint16_t segment;
+  uint16_t fraction = 0;
+  uint8_t fractionBits = 0;
+  if (octave >= PROXIMITY_TABLE_SUB_BITS) {
+    fractionBits = octave - PROXIMITY_TABLE_SUB_BITS;
+    segment = (raw >> fractionBits) & ((1 << PROXIMITY_TABLE_SUB_BITS) - 1);
+    fraction = raw & ((1 << fractionBits) - 1);
+  } else {
+    // small raw values lie exactly on a table entry
+    segment = (raw << (PROXIMITY_TABLE_SUB_BITS - octave)) & ((1 << PROXIMITY_TABLE_SUB_BITS) - 1);
+  }
+  uint16_t i = (octave << PROXIMITY_TABLE_SUB_BITS) + segment;
+  int32_t value = proximityTable[i];
+  int32_t delta = (int32_t)proximityTable[i + 1] - value; // table is decreasing, delta <= 0
+  return value + ((delta * fraction) >> fractionBits);
+}
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+
+// Timebase of the sensor sampling with an exact sample period.
+// The slots are multiples of the period after start(), so late samples do not shift the
+// following slots and the rate does not drift. If the loop misses whole slots, they are
+// skipped and counted instead of being sampled in a burst.
+//
+// The time stamps of the samples are collected in SampleClockStatistics. The sample count
+// thresholds of the blink detection (t_fall, t_rise, t_total) assume the sample period, so
+// the statistics show if they mean the same on a device.
+// Like BlinkDetector.h it only depends on <stdint.h>, all times are micros() values.
+
+// Number of histogram buckets of the inter-sample intervals.
+// The buckets cover 0 to 2 periods, longer intervals are counted in the last bucket.
+#define SAMPLE_CLOCK_HISTOGRAM_SIZE 32
+
+struct SampleClockStatistics {
+  uint32_t samples;     // samples since the last reset
+  uint32_t missed;      // slots without sample (skipped or lost measurements)
+  uint32_t intervalMin; // minimal interval between two samples in us
+  uint32_t intervalMax; // maximal interval between two samples in us
+  uint32_t firstTime;   // time stamp of the first sample
+  uint32_t lastTime;    // time stamp of the last sample
+  uint32_t histogram[SAMPLE_CLOCK_HISTOGRAM_SIZE]; // intervals, period / 16 per bucket
+};
+
+class SampleClock {
+public:
+  explicit SampleClock(uint32_t period) : periodUs(period), nextSlotTime(0) {
+    resetStatistics();
+  }
+
+  /**
+   * Starts the slots at now.
+   */
+  void start(uint32_t now) {
+    nextSlotTime = now;
+  }
+
+  /**
+   * Returns true once per slot as soon as now has reached it.
+   * Slots which have passed completely are skipped and counted as missed.
+   * All computations are safe for the overflow of micros().
+   */
+  bool due(uint32_t now) {
+    int32_t late = (int32_t)(now - nextSlotTime);
+    if (late < 0) {
+      return false;
+    }
+    uint32_t skipped = (uint32_t)late / periodUs;
+    stats.missed += skipped;
+    nextSlotTime += (skipped + 1) * periodUs;
+    return true;
+  }
+
+  /**
+   * Returns the time in us until the next slot, negative if it is overdue.
+   */
+  int32_t untilNextSlot(uint32_t now) const {
+    return (int32_t)(nextSlotTime - now);
+  }
+
+  uint32_t period() const {
+    return periodUs;
+  }
+
+  /**
+   * Records the time stamp of a sample.
+   */
+  void recordSample(uint32_t time) {
+    if (stats.samples == 0) {
+      stats.firstTime = time;
+    } else {
+      uint32_t interval = time - stats.lastTime;
+      if (interval < stats.intervalMin) {
+        stats.intervalMin = interval;
+      }
+      if (interval > stats.intervalMax) {
+        stats.intervalMax = interval;
+      }
+      uint32_t bucket = SAMPLE_CLOCK_HISTOGRAM_SIZE - 1;
+      if (interval < 2 * periodUs) {
+        bucket = interval * SAMPLE_CLOCK_HISTOGRAM_SIZE / (2 * periodUs);
+      }
+      ++stats.histogram[bucket];
+    }
+    stats.lastTime = time;
+    ++stats.samples;
+  }
+
+  /**
+   * Records a slot whose measurement got lost.
+   */
+  void recordMissed() {
+    ++stats.missed;
+  }
+
+  const SampleClockStatistics& statistics() const {
+    return stats;
+  }
+
+  /**
+   * Returns the effective sample rate in samples/s since the last reset, 0 if unknown.
+   */
+  float effectiveRate() const {
+    uint32_t span = stats.lastTime - stats.firstTime;
+    if (stats.samples < 2 || span == 0) {
+      return 0;
+    }
+    return (stats.samples - 1) * 1000000.0f / span;
+  }
+
+  /**
+   * Returns the interval in us which percent % of the intervals do not exceed.
+   * The resolution is a histogram bucket (period / 16), the result is the upper bound of
+   * the bucket, but never more than the maximal interval. Intervals of 2 periods and more
+   * all count as the maximal interval.
+   */
+  uint32_t intervalPercentile(uint8_t percent) const {
+    uint32_t intervals = stats.samples > 0 ? stats.samples - 1 : 0;
+    if (intervals == 0) {
+      return 0;
+    }
+    uint32_t count = 0;
+    uint8_t bucket = 0;
+    for (; bucket < SAMPLE_CLOCK_HISTOGRAM_SIZE - 1; ++bucket) {
+      count += stats.histogram[bucket];
+      if ((uint64_t)count * 100 >= (uint64_t)intervals * percent) {
+        break;
+      }
+    }
+    uint32_t upper = (bucket + 1) * 2 * periodUs / SAMPLE_CLOCK_HISTOGRAM_SIZE;
+    if (bucket == SAMPLE_CLOCK_HISTOGRAM_SIZE - 1 || upper > stats.intervalMax) {
+      return stats.intervalMax;
+    }
+    return upper;
+  }
+
+  void resetStatistics() {
+    stats.samples = 0;
+    stats.missed = 0;
+    stats.intervalMin = 0xFFFFFFFF;
+    stats.intervalMax = 0;
+    stats.firstTime = 0;
+    stats.lastTime = 0;
+    for (uint8_t i = 0; i < SAMPLE_CLOCK_HISTOGRAM_SIZE; ++i) {
+      stats.histogram[i] = 0;
+    }
+  }
+
+private:
+  uint32_t periodUs;      // sample period in us
+  uint32_t nextSlotTime;  // micros() of the next slot
+  SampleClockStatistics stats;
+};
+
+#endif
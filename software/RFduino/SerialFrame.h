@@ -0,0 +1,194 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Binary sample stream over Serial, replaces the text lines "S<proxFiltered * 100>\t<blink>"
+// (formatting a float as text costs more than the whole blink detection of a sample).
+// One frame per sample:
+//   0 uint8   SERIAL_FRAME_SAMPLE
+//   1 uint8   sequence number, incremented by one per frame (mod 256)
+//   2 uint32  micros() at which the sample was taken
+//   6 uint16  raw proximity count of the VCNL4020
+//   8 int32   filtered value, Q15.16 mm (see FixedPoint.h)
+//  12 uint8   detector state: bit 0 blink detected, bits 1-2 blink level (see BlinkDetector.h),
+//             bits 3-4 edge type + 1 (0 negative, 1 none, 2 positive)
+//  13 uint16  CRC-16/CCITT of the bytes above (serialFrameCrc16())
+// All values little endian. On the wire the frame is COBS encoded (consistent overhead byte
+// stuffing: no zero bytes inside the frame) and enclosed in zero bytes:
+//   0x00 <COBS encoded frame> 0x00
+// The leading zero separates the frame from text the loop prints in between (the statistics,
+// ...), so the receiver drops that text as one invalid frame and resynchronizes at the next zero
+// byte. Text inside a frame breaks its checksum; the BLE callbacks, which can interrupt a frame,
+// do not print with SERIAL_BINARY_STREAM.
+// Only <stdint.h>: the sketch writes the frames, tools/serialcapture and tools/archive read them.
+
+#define SERIAL_FRAME_SAMPLE         0x53  // 'S'
+#define SERIAL_FRAME_SAMPLE_SIZE    15    // sample frame with checksum
+#define SERIAL_FRAME_MAX_SIZE       32    // largest frame without COBS overhead
+#define SERIAL_FRAME_MAX_ENCODED    (SERIAL_FRAME_MAX_SIZE + SERIAL_FRAME_MAX_SIZE / 254 + 3)
+
+#define SERIAL_FRAME_STATE_BLINK    0x01
+#define SERIAL_FRAME_STATE_LEVEL    1     // shift of the blink level
+#define SERIAL_FRAME_STATE_EDGE     3     // shift of the edge type
+
+typedef struct {
+  uint8_t sequence;
+  uint32_t time;       // us
+  uint16_t raw;
+  int32_t filtered;    // Q15.16 mm
+  uint8_t state;
+} SerialSample;
+
+/**
+ * CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of length bytes of data.
+ */
+static inline uint16_t serialFrameCrc16(const uint8_t* data, uint8_t length) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < length; ++i) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = crc & 0x8000 ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+ * COBS encodes length bytes of data into out (at most length + length / 254 + 1 bytes).
+ * Returns the encoded length. The encoded bytes contain no zero.
+ */
+static inline uint16_t cobsEncode(const uint8_t* data, uint16_t length, uint8_t* out) {
+  uint16_t code = 0;       // position of the current code byte
+  uint16_t written = 1;
+  uint8_t run = 1;         // code byte value: bytes since the code byte + 1
+  for (uint16_t i = 0; i < length; ++i) {
+    if (data[i] == 0) {
+      out[code] = run;
+      code = written++;
+      run = 1;
+    } else {
+      out[written++] = data[i];
+      if (++run == 0xFF) {
+        out[code] = run;
+        code = written++;
+        run = 1;
+      }
+    }
+  }
+  out[code] = run;
+  return written;
+}
+
+/**
+ * Decodes length COBS encoded bytes (without the delimiting zeros) into out (at most length
+ * bytes). Returns the decoded length, -1 if the data contain a zero or a code byte points
+ * behind the end.
+ */
+static inline int cobsDecode(const uint8_t* data, uint16_t length, uint8_t* out) {
+  uint16_t written = 0;
+  uint16_t i = 0;
+  while (i < length) {
+    uint8_t code = data[i++];
+    if (code == 0 || i + code - 1 > length) {
+      return -1;
+    }
+    for (uint8_t j = 1; j < code; ++j) {
+      if (data[i] == 0) {
+        return -1;
+      }
+      out[written++] = data[i++];
+    }
+    if (code != 0xFF && i < length) {
+      out[written++] = 0;
+    }
+  }
+  return written;
+}
+
+/**
+ * Builds the COBS encoded sample frame including both delimiters into out
+ * (SERIAL_FRAME_MAX_ENCODED bytes). Returns the number of bytes to write.
+ */
+static inline uint8_t encodeSerialSample(const SerialSample* sample, uint8_t* out) {
+  uint8_t frame[SERIAL_FRAME_SAMPLE_SIZE];
+  frame[0] = SERIAL_FRAME_SAMPLE;
+  frame[1] = sample->sequence;
+  frame[2] = (uint8_t)sample->time;
+  frame[3] = (uint8_t)(sample->time >> 8);
+  frame[4] = (uint8_t)(sample->time >> 16);
+  frame[5] = (uint8_t)(sample->time >> 24);
+  frame[6] = (uint8_t)sample->raw;
+  frame[7] = (uint8_t)(sample->raw >> 8);
+  frame[8] = (uint8_t)sample->filtered;
+  frame[9] = (uint8_t)((uint32_t)sample->filtered >> 8);
+  frame[10] = (uint8_t)((uint32_t)sample->filtered >> 16);
+  frame[11] = (uint8_t)((uint32_t)sample->filtered >> 24);
+  frame[12] = sample->state;
+  uint16_t crc = serialFrameCrc16(frame, SERIAL_FRAME_SAMPLE_SIZE - 2);
+  frame[13] = (uint8_t)crc;
+  frame[14] = (uint8_t)(crc >> 8);
+  out[0] = 0;
+  uint8_t length = (uint8_t)cobsEncode(frame, SERIAL_FRAME_SAMPLE_SIZE, out + 1);
+  out[length + 1] = 0;
+  return length + 2;
+}
+
+/**
+ * Decodes one COBS encoded frame (the bytes between two zero bytes) into sample.
+ * Returns false if it is no sample frame or the checksum is wrong.
+ */
+static inline bool decodeSerialSample(const uint8_t* data, uint16_t length, SerialSample* sample) {
+  uint8_t frame[SERIAL_FRAME_MAX_SIZE];
+  if (length == 0 || length > SERIAL_FRAME_MAX_SIZE) {
+    return false;
+  }
+  int decoded = cobsDecode(data, length, frame);
+  if (decoded != SERIAL_FRAME_SAMPLE_SIZE || frame[0] != SERIAL_FRAME_SAMPLE) {
+    return false;
+  }
+  uint16_t crc = serialFrameCrc16(frame, SERIAL_FRAME_SAMPLE_SIZE - 2);
+  if (frame[13] != (uint8_t)crc || frame[14] != (uint8_t)(crc >> 8)) {
+    return false;
+  }
+  sample->sequence = frame[1];
+  sample->time = (uint32_t)frame[2] | (uint32_t)frame[3] << 8 | (uint32_t)frame[4] << 16 |
+                 (uint32_t)frame[5] << 24;
+  sample->raw = (uint16_t)(frame[6] | frame[7] << 8);
+  sample->filtered = (int32_t)((uint32_t)frame[8] | (uint32_t)frame[9] << 8 |
+                               (uint32_t)frame[10] << 16 | (uint32_t)frame[11] << 24);
+  sample->state = frame[12];
+  return true;
+}
+
+#endif
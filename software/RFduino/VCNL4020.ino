@@ -25,175 +25,165 @@
  * SOFTWARE.
  */
 
-boolean isContinuous = false;
+// Register access and sample acquisition, see VCNL4020Acquisition.h.
+// All I2C communication with the sensor goes through vcnlBus.
+#define SAMPLE_RING_SIZE 8  // samples read but not yet processed, power of two
+VCNL4020Bus<TwoWire> vcnlBus(Wire, VCNL_ADDRESS);
+VCNL4020Acquisition<TwoWire, SAMPLE_RING_SIZE> vcnl4020(vcnlBus, sampleClock);
+
+#ifdef VCNL_INTERRUPT
+// Set by the data ready interrupt of the VCNL4020, reset when updateVCNL4020() takes it over.
+volatile boolean vcnlDataReady = false;
+volatile unsigned long vcnlDataReadyTime = 0; // micros() of the last data ready interrupt
+#endif
 
 uint8_t initVCNL4020() {
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x83); // IR LED current register
-  Wire.write(B00001010); // set led_current = val*10mA max 200mA
+  uint8_t transmitResult = vcnlBus.writeRegister(0x83, B00001010); // IR LED current register: led_current = val*10mA max 200mA
   delay(20); // TODO can be removed or reduced in final version
   Serial.print(".");
-  Wire.write(0x82); // Proximity rate register
-  Wire.write(B00000111); // set prox_rate to 250 samples /s
+  transmitResult |= vcnlBus.writeRegister(0x82, B00000111); // Proximity rate register: prox_rate 250 samples /s
   delay(20); // TODO can be removed or reduced in final version
   Serial.print(",");
-  Wire.write(0x84); // Ambient light register
-  Wire.write(B10011101); // cont_conv, als_rate= 10/s, auto_offset_comp, 32 conversions/sample
+  transmitResult |= vcnlBus.writeRegister(0x84, B10011101); // Ambient light register: cont_conv, als_rate= 10/s, auto_offset_comp, 32 conversions/sample
   delay(20);
   Serial.print("-");
-  Wire.write(0x80);
-  Wire.write(B00001000); // prox_od: Just enable the on demand measurements
-  uint8_t transmitResult = Wire.endTransmission();
+  transmitResult |= vcnlBus.writeRegister(VCNL_REG_COMMAND, VCNL_COMMAND_PROX_OD); // Just enable the on demand measurements
+#ifdef VCNL_INTERRUPT
+  initVCNL4020Interrupt();
+#else
   setContinuousMode(true);
+#endif
+  sampleClock.start(micros());
   return transmitResult;
 }
 
 void setContinuousMode(boolean isCont) {
   if (isCont) {
-    Wire.beginTransmission(VCNL_ADDRESS);
-    Wire.write(0x82); // Proximity rate register
-    Wire.write(B00000111); // set prox_rate to 250 samples /s
+    vcnlBus.writeRegister(0x82, B00000111); // Proximity rate register: prox_rate 250 samples /s
     delay(50); // TODO can be removed or reduced in final version
-    Wire.write(0x84);
-    Wire.write(B10001010); // cont mode, 1s/s, auto offset enabled, 4 conv averaging
-    Wire.endTransmission();
+    vcnlBus.writeRegister(0x84, B10001010); // cont mode, 1s/s, auto offset enabled, 4 conv averaging
     delay(50);
-    Wire.beginTransmission(VCNL_ADDRESS);
-    Wire.write(0x80);
-    Wire.write(B10011000); // als_en, prox_en, selftimed_en
-    Wire.endTransmission();
+    vcnlBus.writeRegister(VCNL_REG_COMMAND, B10011000); // als_en, prox_en, selftimed_en
     delay(100);
-    isContinuous = true;
   } else {
-    Wire.beginTransmission(VCNL_ADDRESS);
-    Wire.write(0x80);
-    Wire.write(B00001000); // prox_od: Just enable the on demand measurements
-    Wire.endTransmission();
+    vcnlBus.writeRegister(VCNL_REG_COMMAND, VCNL_COMMAND_PROX_OD); // Just enable the on demand measurements
     delay(100);
-    trigger_prox_od_VCNL4020();
-    isContinuous = false;
   }
+  vcnl4020.setContinuous(isCont);
+  vcnl4020.trigger();
+  updateTime = millis();
 }
 
 
 /**
  * Updates the measurement.
  * Returns true if new data were obtained succesfully.
- * If last measurement is older than CYCLE_TIME,
+ * Once per sample slot (every SAMPLE_PERIOD us, see SampleClock.h)
  * new values are read and a new measurment is triggered.
  * If not nothing happens and false is returned.
+ *
+ * With VCNL_INTERRUPT the data ready interrupt replaces the polling of the status register,
+ * see VCNL4020Acquisition::update().
  */
 boolean updateVCNL4020() {
-  boolean new_data = false;
-  if (millis() - updateTime > CYCLE_TIME) {
-    if (isContinuous) {
-      if (newVCNL4020_data()) {
-        // read measurements
-        Wire.beginTransmission(VCNL_ADDRESS);
-        Wire.write(0x85); // amb light results and prox results following.
-        Wire.endTransmission();
-        Wire.requestFrom(VCNL_ADDRESS, 4);
-        if (Wire.available()) {
-          ambient = (double)(Wire.read()<<8 | Wire.read()) / 4;
-          proximity = exp(log(68000.0 / (uint16_t)(Wire.read() << 8 | Wire.read())) / 1.765);
-        }
-        trigger_od_VCNL4020();
-        new_data = true;
-      } else {
-        trigger_od_VCNL4020();
-      }
-    } else {
-      if (newVCNL4020_prox_data()) {
-        // read old measurement.
-        proximity = getVCNL4020Proximity_mm();
-        // Initiate new measurement.
-        trigger_prox_od_VCNL4020();
-      } else {
-        trigger_prox_od_VCNL4020();
-      }
-      new_data = true;
-    }
+#ifdef VCNL_INTERRUPT
+  noInterrupts();
+  boolean dataReady = vcnlDataReady;
+  unsigned long dataReadyTime = vcnlDataReadyTime;
+  vcnlDataReady = false;
+  interrupts();
+  vcnl4020.update(micros(), dataReady, dataReadyTime);
+#else
+  vcnl4020.poll(micros());
+  ambient = (double)vcnl4020.ambient() / 4;
+#endif
+  uint16_t raw;
+  uint32_t time;
+  if (!vcnl4020.take(raw, time)) {
+    return false;
   }
-  return new_data;
+  proximityRaw = raw;
+  proximityTime = time;
+  proximity = rawToProximity(proximityRaw);
+  updateTime = millis();
+  return true;
 }
 
+#ifdef VCNL_INTERRUPT
 /**
- * Returns true if new prox data are available and can be read and false otherwise.
+ * Enables the proximity data ready interrupt of the VCNL4020 on VCNL_INT_PIN.
+ * The INT output is open drain and active low, the pull up is on the board.
  */
-boolean newVCNL4020_prox_data() {
-  boolean isNewData = false;
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x80);
-  Wire.endTransmission();
-  Wire.requestFrom(VCNL_ADDRESS, 1);
-  if (Wire.available()) {
-    char val = Wire.read();
-    isNewData = (val & B00100000);
-  }
-  while(Wire.available()) {
-    Wire.read();
-  }
-  return isNewData;
+void initVCNL4020Interrupt() {
+  vcnl4020.beginInterrupt();
+  vcnlDataReady = false;
+  pinMode(VCNL_INT_PIN, INPUT);
+  attachPinInterrupt(VCNL_INT_PIN, vcnl4020Interrupt, LOW);
+  RFduino_pinWake(VCNL_INT_PIN, LOW); // wakes the loop from RFduino_ULPDelay(), see vcnl4020Interrupt()
 }
 
 /**
- * Returns true if new data (prox and amb) are available and can be read and false otherwise.
+ * Interrupt service routine of the VCNL4020 data ready interrupt.
+ * No I2C communication in here, the result is read by updateVCNL4020().
+ * The INT pin is a wake source, the non zero return value ends a running RFduino_ULPDelay():
+ * the loop reads and processes the sample right away instead of sleeping until the next slot.
  */
-boolean newVCNL4020_data() {
-  boolean isNewData = false;
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x80);
-  Wire.endTransmission();
-  Wire.requestFrom(VCNL_ADDRESS, 1);
-  if (Wire.available()) {
-    char val = Wire.read();
-    isNewData = (val & B00100000 && val & B01000000);
-  }
-  while(Wire.available()) {
-    // remove any stuck data.
-    Wire.read();
-  }
-  return isNewData;
+int vcnl4020Interrupt(uint32_t pin) {
+  vcnlDataReadyTime = micros();
+  vcnlDataReady = true;
+  return 1;
 }
+#endif
 
 /**
- * triggers a new proximity measurement for the VCNL4020
+ * Returns the millis() value at which updateVCNL4020() triggers or reads the next measurement.
+ * Rounded down, so a sleep until then never misses the sample slot.
  */
-void trigger_prox_od_VCNL4020() {
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x80);
-  Wire.write(B00001000); // als_od, prox_od als_en prox_en ( od = on demand)
-  Wire.endTransmission();
-  updateTime = millis();
+unsigned long nextVCNL4020Update() {
+  int32_t untilSlot = sampleClock.untilNextSlot(micros());
+  return millis() + (untilSlot > 0 ? untilSlot / 1000 : 0);
 }
 
 /**
- * triggers a new set of prox and amb light measurements for the VCNL4020
+ * Prints the sample timing since the last PROTOCOL_IN_REQUEST_TIMING.
  */
-void trigger_od_VCNL4020() {
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x80);
-  Wire.write(B00011000); // als_od, prox_od ( od = on demand)
-  Wire.endTransmission();
-  updateTime = millis();
+void printSampleClockStatistics() {
+  const SampleClockStatistics& stats = sampleClock.statistics();
+  Serial.print("Samples: ");
+  Serial.print(stats.samples);
+  Serial.print("\trate [1/s]: ");
+  Serial.print(sampleClock.effectiveRate(), 2);
+  Serial.print("\tinterval min/50%/99%/max [us]: ");
+  Serial.print(stats.intervalMin);
+  Serial.print("/");
+  Serial.print(sampleClock.intervalPercentile(50));
+  Serial.print("/");
+  Serial.print(sampleClock.intervalPercentile(99));
+  Serial.print("/");
+  Serial.print(stats.intervalMax);
+  Serial.print("\tmissed: ");
+  Serial.print(stats.missed);
+  Serial.print("\tI2C transactions: ");
+  Serial.println(vcnlBus.transactions());
 }
 
 /**
- * gets the raw data from the VCNL4020 and returns them normalized to mm.
+ * Returns true if samples are read but not yet taken by updateVCNL4020().
  */
-double getVCNL4020Proximity_mm() {
-  
-  double proximity = -1;
-  Wire.beginTransmission(VCNL_ADDRESS);
-  Wire.write(0x87); // Proximity measurement result register
-  Wire.endTransmission();
-  Wire.requestFrom(VCNL_ADDRESS, 2);
-  if (Wire.available()) {
-    // should be converted to mm according to:
-    // https://forums.adafruit.com/viewtopic.php?f=19&t=89699
-    proximity = exp(log(68000.0 / (uint16_t)(Wire.read() << 8 | Wire.read())) / 1.765);
-//    result = Wire.read() << 8 | Wire.read();
-  }
-  Wire.endTransmission();
-  return proximity;
+boolean sampleVCNL4020Available() {
+#ifdef VCNL_INTERRUPT
+  return vcnlDataReady || vcnl4020.available();
+#else
+  return vcnl4020.available();
+#endif
+}
+
+/**
+ * Converts a raw proximity count into mm.
+ * Replaces exp(log(68000.0 / raw) / 1.765) by a table lookup with linear interpolation
+ * (see proximityFromRaw() in ProximityTable.h for the table layout and the error bound).
+ * Only integer operations are needed, the float build converts the result once at the end.
+ */
+accum_t rawToProximity(uint16_t raw) {
+  return proximityToAccum(proximityFromRaw(raw));
 }
@@ -0,0 +1,280 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef VCNL4020_ACQUISITION_H
+#define VCNL4020_ACQUISITION_H
+
+#include <stdint.h>
+
+#include "SampleClock.h"
+
+// Register access and sample acquisition of the VCNL4020 proximity sensor.
+// The I2C bus is a template parameter with the interface of the Arduino TwoWire class
+// (beginTransmission(), write(), endTransmission(), requestFrom(), available(), read()):
+// Wire in the sketch (VCNL4020.ino), a mock which simulates the sensor in tools/vcnlbench.cpp.
+// Like SampleClock.h it only depends on <stdint.h>, all times are micros() values.
+
+// Registers
+#define VCNL_REG_COMMAND        0x80
+#define VCNL_REG_AMBIENT_RESULT 0x85  // 2 bytes, followed by the proximity result
+#define VCNL_REG_PROX_RESULT    0x87  // 2 bytes
+#define VCNL_REG_INT_CONTROL    0x89
+#define VCNL_REG_INT_STATUS     0x8E
+
+// Bits of the command register
+#define VCNL_COMMAND_PROX_OD    0x08  // start an on demand proximity measurement
+#define VCNL_COMMAND_ALS_OD     0x10  // start an on demand ambient light measurement
+#define VCNL_COMMAND_PROX_READY 0x20  // proximity result available
+#define VCNL_COMMAND_ALS_READY  0x40  // ambient light result available
+
+// Bits of the interrupt control and the interrupt status register
+#define VCNL_INT_PROX_READY     0x08
+
+
+/**
+ * Register access of the VCNL4020.
+ * Counts the bus transactions, the register pointer write of a read is a transaction of its own.
+ */
+template<typename Bus>
+class VCNL4020Bus {
+public:
+  VCNL4020Bus(Bus& bus, uint8_t address) : bus(bus), address(address), transactionCount(0) {
+  }
+
+  /**
+   * Writes a single register.
+   * Returns the result of endTransmission() (0 on success).
+   */
+  uint8_t writeRegister(uint8_t reg, uint8_t value) {
+    ++transactionCount;
+    bus.beginTransmission(address);
+    bus.write(reg);
+    bus.write(value);
+    return bus.endTransmission();
+  }
+
+  /**
+   * Reads len consecutive registers starting at reg.
+   * Returns true if all bytes were received.
+   */
+  bool readRegisters(uint8_t reg, uint8_t* data, uint8_t len) {
+    transactionCount += 2;
+    bus.beginTransmission(address);
+    bus.write(reg);
+    bus.endTransmission();
+    bus.requestFrom(address, len);
+    uint8_t i = 0;
+    while (bus.available()) {
+      uint8_t value = bus.read();
+      if (i < len) {
+        data[i++] = value;
+      }
+    }
+    return i == len;
+  }
+
+  /**
+   * Returns the number of bus transactions since start up.
+   */
+  unsigned long transactions() const {
+    return transactionCount;
+  }
+
+private:
+  Bus& bus;
+  uint8_t address;
+  unsigned long transactionCount;
+};
+
+
+/**
+ * Sample acquisition, one on demand proximity measurement per slot of the SampleClock.
+ *
+ * With the data ready interrupt (update()):
+ *  - after a data ready interrupt the proximity result is read into the sample ring and the
+ *    interrupt is cleared (3 I2C transactions per sample, no status polling).
+ *    The time stamp of the interrupt is the time stamp of the sample.
+ *  - every sample slot a new on demand measurement is triggered (1 I2C transaction).
+ *    If the interrupt of the previous slot did not come, its sample is counted as missed.
+ * Without the interrupt (poll()) the status register is read every slot instead, the result is
+ * read if the measurement of the last slot is done and the next one is triggered.
+ *
+ * The ring decouples reading the sensor from the blink detection, which takes the samples out
+ * with take(). RingSize has to be a power of two.
+ */
+template<typename Bus, uint8_t RingSize>
+class VCNL4020Acquisition {
+public:
+  VCNL4020Acquisition(VCNL4020Bus<Bus>& bus, SampleClock& clock)
+    : bus(bus), clock(clock), continuous(false), measurementPending(false), head(0), tail(0),
+      overflowCount(0), ambientRaw(0) {
+  }
+
+  /**
+   * Enables the proximity data ready interrupt and clears the interrupt status.
+   * Attaching the INT pin is left to the caller.
+   */
+  void beginInterrupt() {
+    bus.writeRegister(VCNL_REG_INT_CONTROL, VCNL_INT_PROX_READY);
+    bus.writeRegister(VCNL_REG_INT_STATUS, 0x0F); // clear all interrupt status flags
+    measurementPending = false;
+    head = tail = 0;
+  }
+
+  /**
+   * Selects the measurement polled by poll(): proximity and ambient light (continuous) or
+   * proximity only.
+   */
+  void setContinuous(bool enabled) {
+    continuous = enabled;
+  }
+
+  /**
+   * Interrupt driven acquisition, called every loop.
+   * dataReady is true if the data ready interrupt came since the last call, at dataReadyTime.
+   */
+  void update(uint32_t now, bool dataReady, uint32_t dataReadyTime) {
+    if (dataReady) {
+      uint8_t data[2];
+      if (bus.readRegisters(VCNL_REG_PROX_RESULT, data, 2)) {
+        push(data[0] << 8 | data[1], dataReadyTime);
+      }
+      bus.writeRegister(VCNL_REG_INT_STATUS, VCNL_INT_PROX_READY); // releases the INT pin
+      measurementPending = false;
+    }
+
+    if (clock.due(now)) {
+      if (measurementPending) {
+        // interrupt lost, make sure the INT pin is released before triggering again.
+        bus.writeRegister(VCNL_REG_INT_STATUS, VCNL_INT_PROX_READY);
+        clock.recordMissed();
+      }
+      trigger();
+      measurementPending = true;
+    }
+  }
+
+  /**
+   * Polling acquisition, called every loop. Only talks to the sensor once per slot.
+   */
+  void poll(uint32_t now) {
+    if (!clock.due(now)) {
+      return;
+    }
+    uint8_t ready = continuous ? VCNL_COMMAND_PROX_READY | VCNL_COMMAND_ALS_READY : VCNL_COMMAND_PROX_READY;
+    uint8_t status;
+    if (bus.readRegisters(VCNL_REG_COMMAND, &status, 1) && (status & ready) == ready) {
+      if (continuous) {
+        // ambient light result and proximity result following.
+        uint8_t data[4];
+        if (bus.readRegisters(VCNL_REG_AMBIENT_RESULT, data, 4)) {
+          ambientRaw = data[0] << 8 | data[1];
+          push(data[2] << 8 | data[3], now);
+        }
+      } else {
+        uint8_t data[2];
+        if (bus.readRegisters(VCNL_REG_PROX_RESULT, data, 2)) {
+          push(data[0] << 8 | data[1], now);
+        }
+      }
+    } else {
+      clock.recordMissed();
+    }
+    trigger();
+  }
+
+  /**
+   * Triggers a new on demand measurement.
+   */
+  void trigger() {
+    bus.writeRegister(VCNL_REG_COMMAND, continuous ? VCNL_COMMAND_ALS_OD | VCNL_COMMAND_PROX_OD : VCNL_COMMAND_PROX_OD);
+  }
+
+  /**
+   * Takes the oldest sample out of the ring.
+   * Returns false if the ring is empty.
+   */
+  bool take(uint16_t& raw, uint32_t& time) {
+    if (head == tail) {
+      return false;
+    }
+    raw = ringRaw[tail & (RingSize - 1)];
+    time = ringTime[tail & (RingSize - 1)];
+    ++tail;
+    return true;
+  }
+
+  /**
+   * Returns true if samples are read but not yet taken.
+   */
+  bool available() const {
+    return head != tail;
+  }
+
+  /**
+   * Returns the number of samples dropped because the ring was full.
+   */
+  unsigned long overflows() const {
+    return overflowCount;
+  }
+
+  /**
+   * Returns the raw ambient light result of the last continuous poll().
+   */
+  uint16_t ambient() const {
+    return ambientRaw;
+  }
+
+private:
+  // Compile time check of the ring size (array size turns negative on failure).
+  typedef char checkRingSize[RingSize > 0 && (RingSize & (RingSize - 1)) == 0 ? 1 : -1];
+
+  void push(uint16_t raw, uint32_t time) {
+    if ((uint8_t)(head - tail) < RingSize) {
+      ringRaw[head & (RingSize - 1)] = raw;
+      ringTime[head & (RingSize - 1)] = time;
+      ++head;
+      clock.recordSample(time);
+    } else {
+      ++overflowCount;
+      clock.recordMissed();
+    }
+  }
+
+  VCNL4020Bus<Bus>& bus;
+  SampleClock& clock;
+  bool continuous;              // poll() measures ambient light as well
+  bool measurementPending;      // measurement triggered, no interrupt yet
+  uint16_t ringRaw[RingSize];   // raw proximity counts read but not yet taken
+  uint32_t ringTime[RingSize];  // their time stamps
+  uint8_t head;                 // next write position
+  uint8_t tail;                 // next read position
+  unsigned long overflowCount;
+  uint16_t ambientRaw;
+};
+
+#endif
@@ -29,7 +29,7 @@
  *  Pin layout:
  *    SDA GPIO 6
  *    SCL GPIO 5
- *    INT
+ *    INT GPIO 4
  */
 
 #include <Arduino.h>
@@ -37,42 +37,78 @@
 #include <math.h>
 #include "RFduinoBLE.h"
 
+// Uncomment to run the blink detection with fixed point arithmetic instead of floating point.
+// Makes the same decisions for the same input (tools/fixedbench), the time per sample on the
+// board is measured with DETECTOR_TIMING.
+//#define FIXED_POINT_DETECTION
+
+// Uncomment to time the blink detection over the stored trace of DetectorTrace.h in setup() and
+// print the us per sample over Serial (needs SERIAL_DEBUG). Works in both builds.
+//#define DETECTOR_TIMING
+#include "FixedPoint.h"
+#include "ProximityTable.h"
+#include "BlinkDetector.h"
+#include "CycleScheduler.h"
+#include "SampleClock.h"
+#include "VCNL4020Acquisition.h"
+#include "CalibrationCodec.h"
+#include "ProfileMessage.h"
+#include "ProtocolCodec.h"
+#include "Journal.h"
+#include "SerialFrame.h"
+#ifdef DETECTOR_TIMING
+#include "DetectorTrace.h"
+#endif
+
 
 #define VCNL_ADDRESS 0x13 // I2C Address of the VCNL 4020 Sensor
+#define VCNL_INT_PIN 4    // INT output of the VCNL 4020 Sensor
 #define CYCLES 200        // Buffersize for the samples and preprocessing.
-#define CYCLE_TIME 5      // (in ms) time step, in which samples are obtained processed.
+#define SAMPLE_PERIOD 6000 // (in us) time step, in which samples are obtained and processed.
+                          // The timing parameters of the blink profiles are sample counts at
+                          // this period (the former CYCLE_TIME 5 sampled every 6 ms at best).
+#define MA_BUFFER 16      // Depth of the moving average filter of the blink detection.
+#define PROX_FILTERED_BUFFER 200 // Number of filtered samples analyzed to find blinks.
+
+// Comment to poll the status register of the VCNL 4020 instead of using its data ready interrupt.
+#define VCNL_INTERRUPT
+
+// Comment to keep the MCU awake between the samples.
+#define SLEEP_BETWEEN_CYCLES
+#define SCHEDULER_REPORT_CYCLES 2000 // Cycles between two scheduler reports over Serial.
+
+// Comment to send the calibration samples as floats instead of the compressed stream.
+#define COMPRESSED_CALIBRATION
+
+// Comment to not keep samples and blinks while no app is connected (see Journal.h).
+#define SAMPLE_JOURNAL
+#define JOURNAL_BLOCKS 96         // blocks of up to 16 samples kept, 18 bytes each
+#define JOURNAL_DECIMATION 8      // every 8th sample is kept
 
 // Comment to deactivate Serial communication.
 #define SERIAL_DEBUG
 
-double proximity = 0;             // current proximity value
-double lastProximity = 0;         // last proximity value
+// Comment to print the samples as text lines instead of binary frames (see SerialFrame.h).
+// The frames are read by tools/serialcapture.
+#define SERIAL_BINARY_STREAM
+
+accum_t proximity = 0;            // current proximity value
+uint16_t proximityRaw = 0;        // raw count of the current proximity value
+unsigned long proximityTime = 0;  // micros() at which the current proximity value was taken
 double ambient = 0.0;             // ambient light measurement - not used
 boolean new_data = false;         // flag set true if new data obtained.
 boolean mode_calibration = false; // flag if calibration data should be sent.
 boolean mode_debug = false;       // flag if debugging data should be sent.
 boolean ble_connected = false;    // flag to indicate that RFduino is connected via BLE.
 
-// Blink Profile paramters (can be set via computer app)
-float edgePosThresh = 0.0025;     // pos threshold for blink detection
-float edgeNegThresh = -0.0035;    // neg threshold for blink detection
-float hyst = 0.0002;              // not applied to zero crossing intentionally (doesn't cross all the way all the time).
-float max_max = 0.02;             // everything bigger than this as maximum is ignored
-float min_min = -0.02;            // everything smaller than this as minimum is ignored.
-uint8_t* t_fall;                  // two values indicating min and max samples allowed for falling edge
-uint8_t* t_rise;                  // two values indicating min and max samples allowed for rising edge
-uint16_t* t_total;                // two values indicating min and max samples allowed for total blink duration
-uint8_t allowedZeros = 4;         // allowed sample number the eye is closed during an eye blink
-
-// Internal data structure variables
-float* proxFilteredBuffer;        // CYCLES is size of buffer. Proximity value samples from that buffer are analyzed to find blinks
-uint8_t iP = 0;                   // index for proxFilteredBuffer used in circular array fashion.
-float proxFiltered = 0.0;         // current filtered value (with moving average filter)
+// Blink detection including the blink profile parameters (can be set via computer app).
+// See BlinkDetector.h
+BlinkDetector<sample_t, accum_t, MA_BUFFER, PROX_FILTERED_BUFFER> blinkDetector;
 
 // other variables
-int blinkAckAmount = 10;           // send blink message multiple times to accomodate package loss.
-int blinkAckCounter = 0;           // counter used to keep track how often it was sent.
 unsigned long updateTime = 0;     // Last time the a value was received from the sensor.
+CycleScheduler scheduler;         // Decides about sleeping between the samples. See CycleScheduler.h
+SampleClock sampleClock(SAMPLE_PERIOD); // Sample slots and timing statistics. See SampleClock.h
 
 /**
  * Arduino default setup function.
@@ -83,6 +119,9 @@ void setup() {
 #ifdef SERIAL_DEBUG
   override_uart_limit = true; // allow fast serial communiation while using BLE.
   Serial.begin(115200);
+#endif
+#if defined(DETECTOR_TIMING) && defined(SERIAL_DEBUG)
+  timeBlinkDetection(); // before the sensor and the radio run
 #endif
   init_device();
 }
@@ -91,25 +130,94 @@ void setup() {
  * Arduino default Loop function
  */
 void loop() {
-  if (updateVCNL4020()) {
+  applyPendingProfile();
+  boolean cycleDone = updateVCNL4020();
+  if (cycleDone) {
     boolean justBlinked = detectBlinks();
-    updateBLE(justBlinked | blinkAckCounter);
-    if (justBlinked) {
+    updateBLE(justBlinked);
 #ifdef SERIAL_DEBUG
+#ifdef SERIAL_BINARY_STREAM
+    sendSampleFrame(justBlinked);
+#else
+    if (justBlinked) {
       Serial.println("Blinked");
-#endif
-      blinkAckCounter = blinkAckAmount;
-    }
-    if (blinkAckCounter > 0) {
-      --blinkAckCounter;
-    }
-    // send RFduino in power saving mode until cycle time is met.
-    // Seems to fuck up calibration mode some times.
-    if (!RFduinoBLE.radioActive && !mode_calibration && !mode_debug) {
-      // Deactivated for now. Breakes the bluetooth comunication.
-      //RFduino_ULPDelay(CYCLE_TIME - (millis() - updateTime));
     }
+#endif
+#endif
+    scheduler.endCycle(millis(), nextVCNL4020Update());
   }
+  sleepUntilNextCycle(cycleDone);
+}
+
+/**
+ * Sends the RFduino in power saving mode until the next measurement is due.
+ * The old RFduino_ULPDelay(CYCLE_TIME - (millis() - updateTime)) broke the bluetooth
+ * communication: whenever a cycle took longer than CYCLE_TIME the unsigned subtraction
+ * underflowed and the RFduino slept for weeks. The CycleScheduler computes the sleep time
+ * from the next deadline without underflow and does not sleep while it is not safe
+ * (radio active, samples waiting, calibration or debug data streamed).
+ * With VCNL_INTERRUPT the data ready interrupt ends the sleep, see vcnl4020Interrupt().
+ */
+void sleepUntilNextCycle(boolean cycleDone) {
+#ifdef SLEEP_BETWEEN_CYCLES
+  boolean busy = RFduinoBLE.radioActive || mode_calibration || mode_debug || sampleVCNL4020Available();
+#else
+  boolean busy = true; // sleeping deactivated, only the slack is measured.
+#endif
+  uint32_t sleepMs = scheduler.sleepTime(millis(), nextVCNL4020Update(), busy, cycleDone);
+  if (sleepMs > 0) {
+    uint32_t sleepStart = millis();
+    RFduino_ULPDelay(sleepMs);
+    scheduler.sleptFor(millis() - sleepStart);
+  }
+  if (cycleDone && scheduler.statistics().cycles >= SCHEDULER_REPORT_CYCLES) {
+#if defined(SERIAL_DEBUG) && !defined(SERIAL_BINARY_STREAM) // text would break the binary frames
+    printSchedulerStatistics();
+    printSampleClockStatistics();
+#endif
+    scheduler.resetStatistics();
+  }
+}
+
+#ifdef SERIAL_BINARY_STREAM
+/**
+ * Writes the current sample, its raw count and the detector state as binary frame.
+ * 18 bytes per sample instead of a formatted float, see SerialFrame.h.
+ */
+void sendSampleFrame(boolean justBlinked) {
+  static uint8_t sequence = 0;
+  SerialSample sample;
+  sample.sequence = sequence++;
+  sample.time = proximityTime;
+  sample.raw = proximityRaw;
+  sample.filtered = sampleToQ16(blinkDetector.filtered());
+  sample.state = (justBlinked ? SERIAL_FRAME_STATE_BLINK : 0) |
+                 blinkDetector.level() << SERIAL_FRAME_STATE_LEVEL |
+                 (blinkDetector.edge() + 1) << SERIAL_FRAME_STATE_EDGE;
+  uint8_t out[SERIAL_FRAME_MAX_ENCODED];
+  Serial.write(out, encodeSerialSample(&sample, out));
+}
+#endif
+
+/**
+ * Prints the scheduler statistics since the last report.
+ */
+void printSchedulerStatistics() {
+  const CycleStatistics& stats = scheduler.statistics();
+  Serial.print("Cycles: ");
+  Serial.print(stats.cycles);
+  Serial.print("\tslack min/avg/max [ms]: ");
+  Serial.print(stats.slackMin);
+  Serial.print("/");
+  Serial.print((float)stats.slackSum / stats.cycles, 2);
+  Serial.print("/");
+  Serial.print(stats.slackMax);
+  Serial.print("\toverruns: ");
+  Serial.print(stats.overruns);
+  Serial.print("\tbusy: ");
+  Serial.print(stats.busy);
+  Serial.print("\tslept [ms]: ");
+  Serial.println(stats.sleptMs);
 }
 
 /**
@@ -83,6 +83,13 @@
  */
 - (void)nextStep:(id)sender;
 
+/**
+ * This method returns the times at which the user is prompted to blink (shut eye circles).
+ *
+ * @return  The times in seconds after the start of the calibration on the RFDuino (NSNumber).
+ */
+- (NSArray<NSNumber *> *)blinkPromptTimes;
+
 /**
  * This methods starts a test animation.
  */
@@ -104,6 +104,8 @@
 #define GAP_DELAY       1
 #define END_DELAY       1
 
+#define STEP_DURATION   1.0     // seconds a circle is highlighted
+
 /*
  * Initialization method.
  */
@@ -266,7 +268,7 @@
         [self setNeedsDisplay:YES];
         
         // After 1 secon do the next step.
-        [self performSelector:@selector(nextStep:) withObject:self afterDelay:1.0];
+        [self performSelector:@selector(nextStep:) withObject:self afterDelay:STEP_DURATION];
         
         return;
     }
@@ -290,7 +292,7 @@
         pos++;
         
         // After 1 secon do the next step.
-        [self performSelector:@selector(nextStep:) withObject:self afterDelay:1.0];
+        [self performSelector:@selector(nextStep:) withObject:self afterDelay:STEP_DURATION];
         
         return;
         
@@ -341,9 +343,27 @@
     if (isRunning) {
         
         // After 1 secon do the next step.
-        [self performSelector:@selector(nextStep:) withObject:self afterDelay:1.0];
+        [self performSelector:@selector(nextStep:) withObject:self afterDelay:STEP_DURATION];
+    }
+    
+}
+
+/*
+ * Returns the times of the blink prompts.
+ */
+- (NSArray<NSNumber *> *)blinkPromptTimes {
+    
+    NSMutableArray<NSNumber *> *times = [[NSMutableArray alloc] init];
+    
+    // Circle i is highlighted i steps after the calibration was started, the shut eye circles
+    // are the large ones (see drawRect:).
+    for (int i=0; i<[circles count]; i++) {
+        if ([[circles objectAtIndex:i] bounds].size.height != DIAMETER) {
+            [times addObject:[NSNumber numberWithDouble:i * STEP_DURATION]];
+        }
     }
     
+    return times;
 }
 
 /*
@@ -385,7 +405,7 @@
             [self setNeedsDisplay:YES];
             
             // After 1 secon do the next step.
-            [self performSelector:@selector(nextStep:) withObject:nil afterDelay:1.0];
+            [self performSelector:@selector(nextStep:) withObject:nil afterDelay:STEP_DURATION];
         }
     }
 }
@@ -56,4 +56,10 @@
  */
 - (void)stopAnimation;
 
+/**
+ * The times at which the animation prompts the user to blink, in seconds after the start of the
+ * calibration (see AnimationView).
+ */
+- (NSArray<NSNumber *> *)blinkPromptTimes;
+
 @end
@@ -73,4 +73,11 @@
     [animationView stopAnimation];
 }
 
+/*
+ * The times of the blink prompts.
+ */
+- (NSArray<NSNumber *> *)blinkPromptTimes {
+    return [animationView blinkPromptTimes];
+}
+
 @end
@@ -35,18 +35,27 @@
 #import "Protocol.h"
 #import "Settings.h"
 
+// Connection logic without CoreBluetooth, shared with tools/sessionsim.
+#import "DeviceSession.h"
+
+// Calibration samples for the plots, read without notifications.
+#import "SampleRing.h"
+
+// Archive of all calibration sessions, shared with tools/archive.
+#import "SampleArchive.h"
+
 /**
  * @brief   This enumeration contains the connection state the device manger is currently in.
  *
  * @enum    CON_STATE
  */
 typedef enum CON_STATE : NSInteger {
-    CON_STATE_BOOT_UP,                      /*!< Boot up. Device freshly connected. */
-    CON_STATE_SETTING_PROFILE,              /*!< Currently sending the profile  to the RFDuino. */
-    CON_STATE_NORMAL_MODE,                  /*!< Normal mode. Waiting for user to blink. */
-    CON_STATE_BLURRING,                     /*!< Screen is blurred, too long without blinking. */
-    CON_STATE_CALIBRATION_INCOMING_DATA,    /*!< Calibration mode. Data is coming in. */
-    CON_STATE_CALIBRATION,                  /*!< Calibration mode. Data has been sent. Visual calibration is in progress. */
+    CON_STATE_BOOT_UP = SESSION_BOOT_UP,                                        /*!< Boot up. Device freshly connected. */
+    CON_STATE_SETTING_PROFILE = SESSION_SETTING_PROFILE,                        /*!< Currently sending the profile  to the RFDuino. */
+    CON_STATE_NORMAL_MODE = SESSION_NORMAL_MODE,                                /*!< Normal mode. Waiting for user to blink. */
+    CON_STATE_BLURRING = SESSION_BLURRING,                                      /*!< Screen is blurred, too long without blinking. */
+    CON_STATE_CALIBRATION_INCOMING_DATA = SESSION_CALIBRATION_INCOMING_DATA,    /*!< Calibration mode. Data is coming in. */
+    CON_STATE_CALIBRATION = SESSION_CALIBRATION,                                /*!< Calibration mode. Data has been sent. Visual calibration is in progress. */
 } CON_STATE;
 
 /**
@@ -70,6 +79,11 @@ typedef enum USER_NOTIFICATION : NSInteger {
  * @discussion  This class manages the connection and communication with a BLE device. It uses the
  *      defined protocol to decode and encode the sent messages between the RFDuino and the PC.
  *      <p>
+ *      The connection logic (states, incoming messages, profile upload and the blurring timer) lives
+ *      in DeviceSession.h, which does not depend on CoreBluetooth. This class connects it to the
+ *      RFDuino and to the app: it passes the incoming data on, sends what the session sends and
+ *      runs the session's timers with an NSTimer.
+ *      <p>
  *      Since the device manager is handling the imcoming messages, blink detection messages are
  *      recognized here. In normal operating mode (blink detection) a timer is used to start
  *      blurring the screen if there was no blink in a user defined time interval. Every incoming
@@ -108,11 +122,6 @@ typedef enum USER_NOTIFICATION : NSInteger {
      */
     NSString *hardwareState;
     
-    /**
-     * The state the instance of this class is currently in.
-     */
-    NSInteger state;
-
     /**
      * Boolean value that indicates whether an autoscan is desired.
      */
@@ -135,40 +144,27 @@ typedef enum USER_NOTIFICATION : NSInteger {
      */
     CBCharacteristic *disconnect_characteristic;
     
-    /**
-     * Boolean value that indicates whether a service is loaded.
-     */
-    bool loadedService;
-    
-    /**
-     * Boolean value that indicates whether a connection to a device is established.
-     */
-    bool isConnected;
-
     /**
      * Boolean value that indicates whether a calibration is ongoing.
      */
     bool isCalibrating;
     
-    /**
-     * Boolean value that indicates whether blurring is desired.
-     */
-    bool wantsBlurring;
-    
     /**
      * Stores all found BLE devices.
      */
     NSMutableArray *BLEDevices;
     
     /**
-     * The timer to stop time with a blink.
+     * The timer which calls sessionPoll() at the next deadline of the session. Created once, only
+     * its fire date is changed.
      */
-    NSTimer *repeatingTimer;
+    NSTimer *sessionTimer;
     
     /**
-     * The counter for enforced blinks.
+     * Whether the fire date of sessionTimer is a deadline of the session and which one (ms).
      */
-    NSUInteger enforcedBlinks;
+    bool sessionTimerArmed;
+    uint32_t sessionTimerDeadline;
     
     /**
      * The current user profile.
@@ -181,14 +177,21 @@ typedef enum USER_NOTIFICATION : NSInteger {
     NSUInteger noBlinkTimeInterval;
     
     /**
-     * Package counter
+     * The connection state, counters and timers (see DeviceSession.h).
      */
-    NSUInteger packageCounter;
+    DeviceSession session;
     
     /**
-     * The battery level.
+     * The calibration samples. Written once per sample, read by the consumers with their own
+     * RingCursor (see SampleRing.h).
      */
-    float batteryLevel;
+    SampleRing calibrationRing;
+    
+    /**
+     * The archive every calibration session is appended to (~/eyeDrops/samples.eda). Opened with
+     * the first calibration, NULL before.
+     */
+    ArchiveWriter *calibrationArchive;
 }
 
 
@@ -248,17 +251,27 @@ typedef enum USER_NOTIFICATION : NSInteger {
 /**
  * This method represents a message receiver. By calling this method and passing a
  * <b>BLE_OUT_MESSAGE</b> a corresponding communication with the connected device will take
- * place. If there is addional data to send, the data has to be passed via the <code>obj</code>
- * parameter.
+ * place.
  *
  * @see BLE_OUT_MESSAGE
  *
  * @param   message 
  *      The outgoing message to the connected device.
- * @param   data
- *      The data to be send.
  */
-- (void)communicateMessage:(BLE_OUT_MESSAGE)message withData:(NSNumber *)data;
+- (void)communicateMessage:(BLE_OUT_MESSAGE)message;
+
+/**
+ * This method sends a single calibration parameter to the connected device
+ * (BLE_OUT_MESSAGE_SET_PARAMETERS followed by the parameter id and its value).
+ *
+ * @see BLE_CAL_PARAM
+ *
+ * @param   parameter
+ *      The calibration parameter to set.
+ * @param   value
+ *      The value of the parameter.
+ */
+- (void)sendParameter:(BLE_CAL_PARAM)parameter withValue:(NSNumber *)value;
 
 /**
  * This method returns the connected device as a CBPeripheral object.
@@ -306,4 +319,20 @@ typedef enum USER_NOTIFICATION : NSInteger {
  */
 - (void)requestBatteryLevel;
 
+/**
+ * This methods requests the sample timing statistics of the RFDuino (effective sample rate,
+ * inter-sample intervals and missed samples since the last request). They are logged when
+ * they come in.
+ */
+- (void)requestTimingStatistics;
+
+/**
+ * This method returns the ring the calibration samples are written to. A consumer attaches a
+ * RingCursor with ringAttach() and reads the samples with ringRead() (on the main thread, like
+ * the writes).
+ *
+ * @return  The calibration sample ring.
+ */
+- (const SampleRing *)calibrationRing;
+
 @end
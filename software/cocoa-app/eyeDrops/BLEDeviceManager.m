@@ -31,8 +31,99 @@
 #import "BLEDeviceManager.h"
 
 
+@interface BLEDeviceManager ()
+
+/*
+ * Sends data to the connected device, used by the session.
+ */
+- (BOOL)writeBytes:(const uint8_t *)bytes length:(uint8_t)length;
+
+/*
+ * Opens the sample archive if necessary and begins a new session in it.
+ */
+- (void)beginArchiveSession;
+
+@end
+
+
 @implementation BLEDeviceManager
 
+#pragma mark
+#pragma mark - Session callbacks
+
+/*
+ * The callbacks of the DeviceSession. The context is the BLEDeviceManager.
+ */
+
+static bool sessionTransportSend(void *context, const uint8_t *data, uint8_t length) {
+    return [(__bridge BLEDeviceManager *)context writeBytes:data length:length];
+}
+
+static void sessionEventBlink(void *context, uint32_t count) {
+    NSLog(@"BLINK DETECTED (%u)", count);
+}
+
+static void sessionEventStartBlur(void *context) {
+    
+    // Update tooltip.
+    [[[NSApplication sharedApplication] delegate] performSelector:@selector(updateToolTip)];
+    
+    // Start blurring.
+    [[[NSApplication sharedApplication] delegate] performSelector:@selector(startBlur)];
+}
+
+static void sessionEventStopBlur(void *context) {
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationStopBlurring" object:nil];
+}
+
+static void sessionEventProfileApplied(void *context) {
+    [[[NSApplication sharedApplication] delegate] performSelector:@selector(updateMenuWithProfiles)];
+}
+
+/*
+ * Returns the wall clock time in us since 1970, the time base of the sample archive.
+ */
+static int64_t archiveTime(void) {
+    return (int64_t)((CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000000);
+}
+
+/*
+ * Writes a single calibration sample into the calibration ring, the plots read it from there, and
+ * appends it to the sample archive. The calibration messages carry neither the raw count nor a
+ * time, so the raw count is unknown and all samples of a message get its arrival time.
+ */
+static void sessionEventCalibrationSample(void *context, float value, bool blink, uint32_t lostBefore) {
+    BLEDeviceManager *deviceManager = (__bridge BLEDeviceManager *)context;
+    ringWrite(&deviceManager->calibrationRing, value, blink, lostBefore);
+    
+    if (deviceManager->calibrationArchive) {
+        ArchiveSample sample = { archiveTime(), value, 0, blink ? 1 : 0, blink ? ARCHIVE_STATE_BLINK : 0 };
+        archiveAppend(deviceManager->calibrationArchive, &sample);
+    }
+}
+
+static void sessionEventBatteryLevel(void *context, float level) {
+    NSLog(@"BATTERY LEVEL");
+    Settings *settings = [Settings sharedInstance];
+    settings.batteryLevel = level;
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationBatteryLevelChanged" object:nil];
+}
+
+static void sessionEventTiming(void *context, const ProtocolTiming *timing) {
+    NSLog(@"SAMPLE TIMING: %.2f samples/s, %u samples, %u missed, interval min/50%%/99%%/max %u/%u/%u/%u us",
+          timing->rate, timing->samples, timing->missed, timing->intervalMin, timing->interval50,
+          timing->interval99, timing->intervalMax);
+}
+
+static void sessionEventLog(void *context, const char *message) {
+    NSLog(@"%s", message);
+}
+
+static uint32_t sessionEventNoBlinkInterval(void *context) {
+    return (uint32_t)([[Settings sharedInstance] blinkTimerValue] * 1000);
+}
+
+
 /*
  * This method returns the shared instance of this singleton class.
  */
@@ -64,9 +155,6 @@
     // Call super contrusctor.
     self = [super init];
     
-    // Initialize the manager's state.
-    state = CON_STATE_BOOT_UP;
-    
     // Initialize bluetooth hardware state.
     hardwareState = @"Bluetooth state unknown";
     
@@ -84,20 +172,29 @@
     autoConnect     = [[Settings sharedInstance] autoConnect];
     
     // Initialize status variables.
-    wantsBlurring   = false;
-    loadedService   = false;
-    isConnected     = false;
     isCalibrating   = false;
     
-    // Initialize package counter.
-    packageCounter = 0;
+    // Initialize the session, it sends through writeBytes:length: and reports to the app.
+    SessionTransport transport = { (__bridge void *)self, sessionTransportSend };
+    SessionEvents events = {
+        (__bridge void *)self,
+        sessionEventBlink,
+        sessionEventStartBlur,
+        sessionEventStopBlur,
+        sessionEventProfileApplied,
+        sessionEventCalibrationSample,
+        sessionEventBatteryLevel,
+        sessionEventTiming,
+        sessionEventLog,
+        sessionEventNoBlinkInterval
+    };
+    sessionInit(&session, &transport, &events);
+    ringInit(&calibrationRing);
+    calibrationArchive = NULL;
     
     // Create CoreBluetooth Central Manager.
     manager = [[CBCentralManager alloc] initWithDelegate:self queue:nil];
     
-    // Initialize enforced blinks.
-    enforcedBlinks = 0;
-    
     // Initialize allowed time interval without a blink.
     noBlinkTimeInterval = 4;
     
@@ -200,7 +297,7 @@
  * Returns the connection state.
  */
 - (bool)hasConnection {
-    return isConnected;
+    return session.connected;
 }
 
 /*
@@ -218,7 +315,7 @@
     settings.lastKnownDevice = lastKnownDevice;
     
     // No device connected yet, connect to the given device.
-    if (!isConnected) {
+    if (!session.connected) {
         
         NSLog(@"BLE Manager: no device connected so far");
         [[[NSApplication sharedApplication] delegate] performSelector:@selector(updateMenuWithConnectionAttempt)];
@@ -253,17 +350,12 @@
  */
 - (void)disconnectFromDevice {
     
-    // Stop blurring in case screen is blurred right now.
-    [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationStopBlurring" object:nil];
-    
-    // Stop running timer.
-    [self stopTimer];
+    // Stop blurring in case screen is blurred right now, stop the timers and reset the state.
+    sessionDisconnected(&session);
+    [self updateTimer];
     
-    // [self communicateMessage:BLE_OUT_MESSAGE_RESET withData:nil];
+    // [self communicateMessage:BLE_OUT_MESSAGE_RESET];
     [manager cancelPeripheralConnection:peripheral];
-    
-    // Reset the state.
-    state = CON_STATE_BOOT_UP;
 }
 
 /*
@@ -385,9 +477,8 @@
     // Show user Notification pop up.
     [self showUserNotification:USER_NOTIFICATION_DEVICE_CONNECTED withInfo:aPeripheral.name];
     
-    state = CON_STATE_BOOT_UP;
-    
-    isConnected = true;
+    // Boot up, the session waits for the service to be loaded.
+    sessionConnected(&session);
 }
 
 /*
@@ -397,8 +488,10 @@
 - (void)centralManager:(CBCentralManager *)central didDisconnectPeripheral:(CBPeripheral *)aPeripheral error:(NSError *)error {
     // change connectButton function to connect
     //[self.connectButton setTitle:@"Connect"];
-    isConnected = false;
-    loadedService = false;
+    
+    // Stops the timers and the blurring, there is no blink to end it without a device.
+    sessionDisconnected(&session);
+    [self updateTimer];
     
     //forget about any peripherals
     if (peripheral) {
@@ -461,6 +554,8 @@
  */
 - (void) peripheral:(CBPeripheral *)aPeripheral didDiscoverCharacteristicsForService:(CBService *)service error:(NSError *)error {
     
+    bool loadedService = false;
+    
     for (CBService *service in peripheral.services) {
         if ([service.UUID isEqual:[CBUUID UUIDWithString:@"2220"]]) {
             
@@ -494,11 +589,15 @@
         }
     }
     
-    NSLog(@"Send a BLE_OUT_MESSAGE_NORMAL_MODE");
-    
-    // Connection completely established. Now send a "normal mode" to
-    // signalize the device that PC is ready for communictation.
-    [self communicateMessage:BLE_OUT_MESSAGE_NORMAL_MODE withData:nil];
+    if (loadedService) {
+        
+        NSLog(@"Send a BLE_OUT_MESSAGE_NORMAL_MODE");
+        
+        // Connection completely established. Now send a "normal mode" to
+        // signalize the device that PC is ready for communictation.
+        sessionReady(&session, [self now]);
+        [self updateTimer];
+    }
 }
 
 /*
@@ -544,254 +643,94 @@
 #pragma mark - Methods for communication with connected device
 
 /*
- * Sends data to the connected device.
+ * Sends data to the connected device. Called by the session, which sends only when the service
+ * is loaded. Returns NO if the data could not be sent.
  */
-- (void)send:(NSData *)data
+- (BOOL)writeBytes:(const uint8_t *)bytes length:(uint8_t)length
 {
     NSInteger max_data = 20;
     
-    if (! loadedService) {
-        @throw [NSException exceptionWithName:@"sendData" reason:@"please wait for ready callback" userInfo:nil];
-    }
-    
-    if ([data length] > max_data) {
-        @throw [NSException exceptionWithName:@"sendData" reason:@"max data size exceeded" userInfo:nil];
+    if (peripheral == nil || send_characteristic == nil || length > max_data) {
+        return NO;
     }
     
     //    [peripheral writeValue:data forCharacteristic:send_characteristic type:CBCharacteristicWriteWithoutResponse];
-    [peripheral writeValue:data forCharacteristic:send_characteristic type:CBCharacteristicWriteWithResponse];
+    [peripheral writeValue:[NSData dataWithBytes:bytes length:length] forCharacteristic:send_characteristic
+                      type:CBCharacteristicWriteWithResponse];
     //NSLog(@"rfduino send data");
+    return YES;
 }
 
 /*
- * Send the given message with the given data to the connected device.
+ * Send the given message to the connected device.
  */
-- (void)communicateMessage:(BLE_OUT_MESSAGE)message withData:(NSNumber *)data {
+- (void)communicateMessage:(BLE_OUT_MESSAGE)message {
     
-    // No data to send means we just have to communicate one byte.
-    if (data == nil) {
-        
-        // NSLog(@"Message to send is: %i", message);
-        
-        // Send data (just the given message)
-        [self send:[[NSData alloc] initWithBytes:&message length:sizeof(message)]];
-    } else {
-        
-        float floatData = [data floatValue];
-        
-        // Create byte buffer for message indentifier plus given data
-        unsigned char byteBuffer[2 + sizeof(floatData)];
-        byteBuffer[0] = BLE_OUT_MESSAGE_SET_PARAMETERS;
-        byteBuffer[1] = message;
-        memcpy(byteBuffer+2, &floatData, sizeof(floatData));
-        
-        NSData *data =[[NSData alloc] initWithBytes:byteBuffer length:sizeof(byteBuffer)];
-        
-        NSLog(@"Data to send looks like: %@", [data description]);
-        
-        // Send data
-        [self send:data];
-    }
+    // NSLog(@"Message to send is: %i", message);
+    
+    // Send data (just the given message)
+    sessionSendMessage(&session, (uint8_t)message);
 }
 
 /*
- * Inoked when data came in. The corresponding message and the data bytes will be
- * extracted. This method will control the states the App is in.
+ * Send the given calibration parameter to the connected device.
  */
-- (void)handleIncomingData:(NSData *)incomingData {
+- (void)sendParameter:(BLE_CAL_PARAM)parameter withValue:(NSNumber *)value {
     
-    // The incoming message identifier.
-    unsigned char message;
+    // Create byte buffer for message indentifier, parameter id and value.
+    unsigned char byteBuffer[PROTOCOL_PARAMETER_SIZE];
+    uint8_t length = protocolEncodeParameter(byteBuffer, parameter, [value floatValue]);
     
-    // Extract first byte as message identifier into variable 'message'.
-    [incomingData getBytes:&message length:1];
+    NSLog(@"Data to send looks like: %@", [[NSData dataWithBytes:byteBuffer length:length] description]);
     
-    // Handle the message.
-    switch (message) {
-            
-        case BLE_IN_MESSAGE_BLINK_DETECTED:
-            
-            if (state == CON_STATE_NORMAL_MODE) {
-                
-                // A blink was detected. Reset the timer. FIRST!!! Otherwise timer could expire and start blurring again
-                // right after blurring was stopped due to a blink.
-                [self resetTimer];
-                
-                // Stop blurring even if it is off. Does not matter. We have to be fast!
-                [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationStopBlurring" object:nil];
-                
-                NSLog(@"BLINK DETECTED");
-            }
-            
-            if (state == CON_STATE_BLURRING) {
-                
-                // Screen is currently blurred and the releasing blink was detected.
-                // So clear the screen ...
-                [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationStopBlurring" object:nil];
-                
-                // ... and restart the timer.
-                [self startTimer];
-                
-                state = CON_STATE_NORMAL_MODE;
-            }
-            
-            break;
-            
-        case BLE_IN_MESSAGE_ALIVE:
-            
-            // Here should:
-            // a) happen the boot up and initialization procedure and
-            // b) the handling of general alive messages.
-            
-            NSLog(@"ALIVE");
-            
-            // If freshly booted, set profile if there exists one.
-            if (state == CON_STATE_BOOT_UP) {
-                
-                // Check for valid user profile.
-                if (userProfile != nil) {
-                    
-                    // Send the profile to the RFDuino.
-                    [self setProfile:userProfile];
-                    
-                } else {
-                    NSLog(@"NO USER PROFILE HAS BEEN SET YET!!!");
-                }
-            }
-            
-            // If general alive message appears in normal mode react to taht.
-            if (state == CON_STATE_NORMAL_MODE) {
-                
-                // Maybe start a timer and detect when the device crashed.
-            }
-            
-            break;
-            
-        case BLE_IN_MESSAGE_CAL_DATA:
-            
-            // Handle incoming calibration data. There are incoming data packages as long as
-            // the calibration process is running. The length depends on the user settings.
-            // We have extract the data (a float for the derivative of the sensor data and an
-            // bollean value for blinked/not blinked). Message consists of 1 byte for
-            // identifier and 5 bytes for the current calibraiton data --> total 6 bytes.
-            
-        {
-            packageCounter = packageCounter + 1;
-            NSLog(@"Package counter: %li", packageCounter);
-            
-            // Cut the first byte off and collect the rest as one calibration parameter.
-            NSData *data  = [incomingData subdataWithRange:NSMakeRange(1, 5)];
-            //NSData *blink = [incomingData subdataWithRange:NSMakeRange(5, 5)];
-            
-            // NSLog(@"Cutted data has length: %i", [data length]);
-            
-            if (state != CON_STATE_CALIBRATION) {
-            
-                [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotifictaionCalibrationData" object:data];
-            }
-            
-            // Send data to the CalibrationSheet 
-            // blink = data;
-        }
-            
-            break;
-            
-        case BLE_IN_MESSAGE_PARAMETERS_SET:
-            
-            // Calibration parameters successfully set.
-            // Now set the corresponding state and start blurring if desired.
-            
-            packageCounter = 0;
-            
-            if (state == CON_STATE_NORMAL_MODE) {
-                
-                // Finally set RFD to normal mode.
-                [self communicateMessage:BLE_OUT_MESSAGE_NORMAL_MODE withData:nil];
-            }
-            
-            if (state == CON_STATE_BOOT_UP) {
-                
-                // Go into normal mode.
-                state = CON_STATE_NORMAL_MODE;
-                
-                // Finally set RFD to normal mode.
-                [self communicateMessage:BLE_OUT_MESSAGE_NORMAL_MODE withData:nil];
-            }
-            
-            [[[NSApplication sharedApplication] delegate] performSelector:@selector(updateMenuWithProfiles)];
-            
-            // Check if blurring is enabled.
-            if (wantsBlurring) {
-                
-                // Start the timer.
-                [self startTimer];
-            }
-            
-            break;
-            
-        case BLE_IN_MESSAGE_BATTERY_LEVEL:
-            
-            // Battery level data is incoming. Store it to batteryLevel.
-            
-            NSLog(@"BATTERY LEVEL");
-            [[incomingData subdataWithRange:NSMakeRange(1, 4)] getBytes:&batteryLevel length:sizeof(float)];
-            // NSLog(@"battery level in ble dev manager = %f", batteryLevel);
-        {
-            Settings *settings = [Settings sharedInstance];
-            settings.batteryLevel = batteryLevel;
-            [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationBatteryLevelChanged" object:nil];
-        }
-            break;
-            
-        case BLE_IN_MESSAGE_DEBUG:
-            NSLog(@"DEBUG");
-            break;
-            
-        case BLE_IN_MESSAGE_ERROR_EXCEPTION:
-            NSLog(@"ERROR EXCEPTION");
-            break;
-            
-        case BLE_IN_MESSAGE_RESET:
-            NSLog(@"RESET");
-            
-            break;
-            
-        default:
-            break;
+    // Send data
+    sessionSend(&session, byteBuffer, length);
+}
+
+/*
+ * Inoked when data came in. The session decodes the message and controls the states the App is in
+ * (see sessionReceive() in DeviceSession.h).
+ */
+- (void)handleIncomingData:(NSData *)incomingData {
+    
+    // Drop unknown messages and messages with a wrong length.
+    if (!sessionReceive(&session, [incomingData bytes], (int)[incomingData length], [self now])) {
+        NSLog(@"Dropped malformed message: %@", [incomingData description]);
     }
+    
+    // A blink restarts the timer, an answer ends a reply timeout.
+    [self updateTimer];
 }
 
 /*
  * Ask RFDuino for battery level.
  */
 - (void)requestBatteryLevel {
-    if (isConnected) {
-        [self communicateMessage:BLE_OUT_MESSAGE_REQUEST_BATTERY_LEVEL withData:nil];
-    }
+    sessionRequestBatteryLevel(&session);
+}
+
+/*
+ * Ask RFDuino for the sample timing statistics.
+ */
+- (void)requestTimingStatistics {
+    sessionRequestTiming(&session);
 }
 
 /*
- * Change in wantsBlurring. Enable timer if normal mode is active and a device is connected.
+ * Return the calibration sample ring.
+ */
+- (const SampleRing *)calibrationRing {
+    return &calibrationRing;
+}
+
+/*
+ * Change in wantsBlurring. Enable timer if normal mode is active and a device is connected, stop
+ * blurring and timer if blurring is not desired.
  */
 - (void)wantsBlurring:(BOOL)blurring {
     
-    // Set new value.
-    wantsBlurring = blurring;
-    
-    if (CON_STATE_NORMAL_MODE && isConnected) {
-        if (wantsBlurring) {
-            [self startTimer];
-        }
-    }
-    
-    if (!wantsBlurring) {
-        
-        // Stop blurring in case screen is blurred right now.
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"EDNotificationStopBlurring" object:nil];
-
-        // Stop timer
-        [self stopTimer];
-    }
+    sessionSetBlurring(&session, blurring, [self now]);
+    [self updateTimer];
 }
 
 /*
@@ -805,7 +744,7 @@
  * Return the enforced blinks counter.
  */
 - (NSUInteger)getEnforcedBlinks {
-    return enforcedBlinks;
+    return session.enforcedBlinks;
 }
 
 /*
@@ -813,33 +752,36 @@
  */
 - (void)setProfile:(UserProfile *)profile {
     
-    // For initialization purposes, set the profile to work with but do not flash it.
-    if (!isConnected) {
-        
-        userProfile = profile;
-        
-    // If connected, change the profile and send calibration data to RFDuino.
-    } else {
-        
-         // NSLog(@"User profile name: %@", [profile getName]);
-         // [self printStatus];
-        
-        // Set the user profile.
-        userProfile = profile;
-        
-        // Reset enforced blink counter.
-        enforcedBlinks = 0;
-        
-        // Set first parameter so we can iterate over the rest.
-        unsigned char firstParameter = BLE_OUT_MESSAGE_CAL_PARAM_THRESH_NEG;
-        
-        // Now send all the calibration parameters.
-        for (int i=0; i<12; i++) {
-            
-            // Send current calibration parameter to RFD.
-            [self communicateMessage:(firstParameter+i) withData:[profile getParameter:i]];
-        }
-    }
+    // Set the user profile.
+    userProfile = profile;
+    
+    // If connected, the session resets the enforced blink counter and sends all calibration
+    // parameters at once. Otherwise they are sent after the next connect.
+    ProfileParameters parameters = [self parametersOfProfile:profile];
+    sessionSetProfile(&session, &parameters, [self now]);
+    [self updateTimer];
+}
+
+/*
+ * Converts the parameters of the given profile to the packed profile upload (see ProfileMessage.h,
+ * which the RFDuino sketch uses to unpack the profile).
+ */
+- (ProfileParameters)parametersOfProfile:(UserProfile *)profile {
+    
+    ProfileParameters parameters;
+    parameters.edgeNegThresh = [[profile getParameter:0] floatValue];
+    parameters.edgePosThresh = [[profile getParameter:1] floatValue];
+    parameters.hyst = [[profile getParameter:2] floatValue];
+    parameters.min_min = [[profile getParameter:3] floatValue];
+    parameters.max_max = [[profile getParameter:4] floatValue];
+    parameters.t_fall[0] = (uint8_t)[[profile getParameter:5] floatValue];
+    parameters.t_fall[1] = (uint8_t)[[profile getParameter:6] floatValue];
+    parameters.t_rise[0] = (uint8_t)[[profile getParameter:7] floatValue];
+    parameters.t_rise[1] = (uint8_t)[[profile getParameter:8] floatValue];
+    parameters.t_total[0] = (uint16_t)[[profile getParameter:9] floatValue];
+    parameters.t_total[1] = (uint16_t)[[profile getParameter:10] floatValue];
+    parameters.allowedZeros = (uint8_t)[[profile getParameter:11] floatValue];
+    return parameters;
 }
 
 /*
@@ -847,17 +789,17 @@
  */
 - (void)startCalibrationWithDevice {
     
-    [self stopTimer];
+    NSLog(@"Send calibration message to device");
     
-    state = CON_STATE_CALIBRATION_INCOMING_DATA;
+    // Stops the timer and starts a new timing window, so the statistics requested at the end
+    // cover the calibration data.
+    sessionStartCalibration(&session);
+    [self updateTimer];
     
-    [self printStatus];
+    // Every calibration is kept as a session of the sample archive.
+    [self beginArchiveSession];
     
-    NSLog(@"Send calibration message to device");
-    
-    if (isConnected) {
-        [self communicateMessage:BLE_OUT_MESSAGE_START_CALIBRATION withData:nil];
-    }
+    [self printStatus];
 }
 
 /*
@@ -865,20 +807,18 @@
  */
 - (void)stopCalibrationWithDevice {
     
-    state = CON_STATE_CALIBRATION;
+    // Stops the calibration data and requests the timing statistics. RFDUINO in NORMAL_MODE
+    sessionStopCalibration(&session);
+    
+    // Write the session to the archive.
+    if (calibrationArchive) {
+        archiveFlush(calibrationArchive);
+    }
     
     [self printStatus];
     
     NSLog(@"Calibration data sent, now calculate parameters");
-    
-    if (isConnected) {
-        [self communicateMessage:BLE_OUT_MESSAGE_STOP_CALIBRATION withData:nil];
-        
-        // RFDUINO in NORMAL_MODE
-    }
-    
-    NSLog(@"Package counter: %li", packageCounter);
-    //packageCounter = 0;
+    NSLog(@"Package counter: %u", session.packageCounter);
 }
 
 /*
@@ -886,82 +826,90 @@
  */
 - (void)calibrationComplete {
     [self printStatus];
-    if (isConnected) {
-        state = CON_STATE_NORMAL_MODE;
-        [self communicateMessage:BLE_OUT_MESSAGE_NORMAL_MODE withData:nil];
+    sessionCalibrationComplete(&session);
+    
+    // Write the samples which came in after the stop.
+    if (calibrationArchive) {
+        archiveFlush(calibrationArchive);
     }
 }
 
+/*
+ * Open the sample archive if necessary and begin a new session.
+ */
+- (void)beginArchiveSession {
+    
+    if (!calibrationArchive) {
+        NSString *archiveFile = [NSHomeDirectory() stringByAppendingString:@"/eyeDrops/samples.eda"];
+        calibrationArchive = malloc(sizeof(ArchiveWriter));
+        if (!calibrationArchive || !archiveOpen(calibrationArchive, [archiveFile fileSystemRepresentation], archiveTime())) {
+            NSLog(@"Cannot open the sample archive %@", archiveFile);
+            free(calibrationArchive);
+            calibrationArchive = NULL;
+            return;
+        }
+    }
+    archiveBeginSession(calibrationArchive);
+}
+
 
 #pragma mark
 #pragma mark - Timer methods
 
 /*
- * Start the timer.
+ * Returns the time in ms the session works with.
  */
-- (void)startTimer {
-    
-    // Create new timer (1 additional second)
-    NSTimer *timer = [NSTimer scheduledTimerWithTimeInterval:[[Settings sharedInstance] blinkTimerValue]
-                                                      target:self selector:@selector(longTimeNoBlink:)
-                                                    userInfo:@{ @"StartDate"  : [NSDate date]}
-                                                     repeats:YES];
-    // Start new timer.
-    repeatingTimer = timer;
+- (uint32_t)now {
+    return (uint32_t)([[NSProcessInfo processInfo] systemUptime] * 1000);
 }
 
 /*
- * Stop the timer.
+ * Moves the timer to the next deadline of the session (blurring or reply timeout), far into the
+ * future if there is none. Called after every call into the session. The timer is created once
+ * and only gets a new fire date, so a blink does not allocate a new timer.
  */
-- (void)stopTimer {
+- (void)updateTimer {
     
-    // Stop running timer.
-    [repeatingTimer invalidate];
+    uint32_t deadline = 0;
+    bool armed = sessionNextDeadline(&session, &deadline);
     
-    // Delete the timer.
-    repeatingTimer = nil;
-}
-
-/*
- * Reset the timer.
- */
-- (void)resetTimer {
+    // Nothing changed, e.g. a message which does not touch the timers.
+    if (sessionTimer != nil && armed == sessionTimerArmed && (!armed || deadline == sessionTimerDeadline)) {
+        return;
+    }
+    sessionTimerArmed = armed;
+    sessionTimerDeadline = deadline;
     
-    if (repeatingTimer && isConnected) {
+    NSDate *fireDate = [NSDate distantFuture];
+    if (armed) {
+        int32_t remaining = MAX((int32_t)(deadline - [self now]), 0);
+        fireDate = [NSDate dateWithTimeIntervalSinceNow:remaining / 1000.0];
+    }
     
-        // Stop running timer.
-        [repeatingTimer invalidate];
+    if (sessionTimer == nil) {
         
-        // Create new timer.
-        NSTimer *timer = [NSTimer scheduledTimerWithTimeInterval:[[Settings sharedInstance] blinkTimerValue]
-                                                          target:self selector:@selector(longTimeNoBlink:)
-                                                        userInfo:@{ @"StartDate"  : [NSDate date]}
-                                                         repeats:YES];
-        // Start new timer.
-        repeatingTimer = timer;
+        // Repeating, so the timer stays valid after it fired. The interval does not matter, the
+        // fire date is always set here.
+        sessionTimer = [[NSTimer alloc] initWithFireDate:fireDate interval:86400
+                                                  target:self selector:@selector(sessionTimerExpired:)
+                                                userInfo:nil
+                                                 repeats:YES];
+        [[NSRunLoop currentRunLoop] addTimer:sessionTimer forMode:NSDefaultRunLoopMode];
+    } else {
+        [sessionTimer setFireDate:fireDate];
     }
 }
 
 /*
- * Method to be called when timer expires.
+ * Method to be called when timer expires. Too long without a blink starts blurring.
  */
-- (void)longTimeNoBlink:(NSTimer*)theTimer {
-    
-    // NSDate *startDate = [[theTimer userInfo] objectForKey:@"StartDate"];
-    enforcedBlinks++;
-    // NSLog(@"Timer started on %@", startDate);
-    
-    // Update tooltip.
-    [[[NSApplication sharedApplication] delegate] performSelector:@selector(updateToolTip)];
-    
-    // Start blurring.
-    [[[NSApplication sharedApplication] delegate] performSelector:@selector(startBlur)];
-    
-    // Stop running timer.
-    [self stopTimer];
+- (void)sessionTimerExpired:(NSTimer*)theTimer {
     
-    // Set blur flag.
-    state = CON_STATE_BLURRING;
+    // Not armed until updateTimer sets the next deadline.
+    [theTimer setFireDate:[NSDate distantFuture]];
+    sessionTimerArmed = false;
+    sessionPoll(&session, [self now]);
+    [self updateTimer];
 }
 
 
@@ -1023,7 +971,7 @@
  */
 - (void)printStatus {
     
-    switch (state) {
+    switch (session.state) {
             
         case CON_STATE_BOOT_UP:
             NSLog(@">>> BOOT UP");
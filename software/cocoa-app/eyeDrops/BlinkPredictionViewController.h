@@ -97,12 +97,13 @@
 // - (NSUInteger)numberOfRecordsForPlot:(nonnull CPTPlot *)plot;
 
 /**
- * This method handles incoming calibraion data.
+ * This method reads the calibration data which came in since the last call from the calibration
+ * ring of the BLE device manager. Invoked by the data timer and before the data is shown.
  *
- * @param sender
- *      The sending instance.
+ * @param timer
+ *      The data timer, nil if invoked directly.
  */
-- (void)incomingCalibrationData:(nonnull id)sender;
+- (void)readCalibrationData:(nullable NSTimer *)timer;
 
 /**
  * This method resets the graph.
@@ -29,13 +29,34 @@
  */
 
 #import "BlinkPredictionViewController.h"
+#import "BLEDeviceManager.h"
+#import "PlotDownsampler.h"
+
+#define READ_INTERVAL   0.1     // seconds between two reads of the calibration ring
+#define READ_SAMPLES    256     // samples copied from the ring at once
 
 static NSString *const kPlotIdentifier  = @"RealTimePlot";
 
-@interface BlinkPredictionViewController ()
+@interface BlinkPredictionViewController () {
+    
+    /**
+     * The read position in the calibration ring.
+     */
+    RingCursor calibrationCursor;
+    
+    /**
+     * Min and max of the samples in plotDataY, kept up to date while they come in.
+     */
+    MinMaxPyramid plotPyramid;
+    
+    /**
+     * The number of samples the plotted points were computed from.
+     */
+    NSUInteger shownSamples;
+}
 
-@property NSMutableArray *plotDataX;
-@property NSMutableArray *plotDataY;
+@property NSMutableData *plotPoints;
+@property NSMutableData *plotDataY;
 @property (nonatomic, readwrite, assign) NSUInteger currentIndex;
 @property (nonatomic, readwrite, strong, nullable) NSTimer *dataTimer;
 
@@ -46,7 +67,7 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
 @synthesize hostingView;
 @synthesize currentIndex;
 @synthesize dataTimer;
-@synthesize plotDataX;
+@synthesize plotPoints;
 @synthesize plotDataY;
 
 /*
@@ -55,30 +76,46 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
 - (void)viewDidLoad {
     
     // Init plot data arrays.
-    plotDataX = [[NSMutableArray alloc] init];
-    plotDataY = [[NSMutableArray alloc] init];
-    dataTimer = nil;
+    plotPoints = [[NSMutableData alloc] init];
+    plotDataY = [[NSMutableData alloc] init];
+    pyramidInit(&plotPyramid);
+    shownSamples = 0;
     
     // Init index.
     self.currentIndex = 0;
     
-    // Add observers for notifications.
-    [[NSNotificationCenter defaultCenter] addObserver:self
-                                             selector:@selector(incomingCalibrationData:)
-                                                 name:@"EDNotifictaionCalibrationData"
-                                               object:nil];
+    // Read the calibration data from the ring of the device manager, starting with the next sample.
+    ringAttach([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor);
+    dataTimer = [NSTimer scheduledTimerWithTimeInterval:READ_INTERVAL
+                                                 target:self
+                                               selector:@selector(readCalibrationData:)
+                                               userInfo:nil
+                                                repeats:YES];
     
+    // Add observers for notifications.
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(showData:) name:@"EDNotificationStopCalibration" object:nil];
 }
 
+/*
+ * Free the pyramid.
+ */
+- (void)dealloc {
+    pyramidFree(&plotPyramid);
+}
+
 /*
  * Reset the graph.
  */
 - (void)resetGraph {
     
     // Delete all data.
-    plotDataX = [[NSMutableArray alloc] init];
-    plotDataY = [[NSMutableArray alloc] init];
+    plotPoints = [[NSMutableData alloc] init];
+    plotDataY = [[NSMutableData alloc] init];
+    pyramidReset(&plotPyramid);
+    shownSamples = 0;
+    
+    // Skip the samples which are still in the ring.
+    ringAttach([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor);
     
     // Reset index.
     self.currentIndex = 0;
@@ -241,18 +278,24 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
 }
 
 /*
- * Handler for incoming calibraiton data.
+ * Read the calibration data which came in since the last call.
  */
-- (void)incomingCalibrationData:(nonnull id)sender {
+- (void)readCalibrationData:(nullable NSTimer *)timer {
     
-    // Extract the blink data (bool)
-    NSData *data = [[(NSNotification *)sender object] subdataWithRange:NSMakeRange(4, 1)];
-    bool blinkData;
-    [data getBytes:&blinkData length:sizeof(bool)];
+    RingSample samples[READ_SAMPLES];
+    uint32_t count;
     
-    if (blinkDataPlot) {
-        self.currentIndex++;        
-        [self.plotDataY addObject:[NSNumber numberWithFloat:blinkData]];
+    while ((count = ringRead([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor, samples, READ_SAMPLES)) > 0) {
+        
+        // Add the blink data to the plot.
+        if (blinkDataPlot) {
+            for (uint32_t i = 0; i < count; i++) {
+                float blinkData = samples[i].blink;
+                [self.plotDataY appendBytes:&blinkData length:sizeof(float)];
+                pyramidAppend(&plotPyramid, blinkData);
+            }
+            self.currentIndex += count;
+        }
     }
 }
 
@@ -261,11 +304,18 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
  */
 - (void)showData:(nonnull id)sender {
     
-    // Scale x values.
-    for (int i=0; i<self.currentIndex; i++) {
-        float xValue = (float)(plotMaxTime / (float)self.currentIndex) * (float)i;
-        [self.plotDataX addObject:[NSNumber numberWithFloat:xValue]];
-    }
+    // Take the samples which are still in the ring.
+    [self readCalibrationData:nil];
+    
+    // Reduce the samples to two points per pixel of the plot (see PlotDownsampler.h), the x values
+    // follow from the sample index.
+    uint32_t points = 2 * (uint32_t)MAX(hostingView.bounds.size.width, 2);
+    NSMutableData *scratch = [NSMutableData dataWithLength:4 * points * sizeof(PlotPoint)];
+    [self.plotPoints setLength:points * sizeof(PlotPoint)];
+    uint32_t count = downsample(&plotPyramid, (const float *)self.plotDataY.bytes, 0, self.currentIndex, points,
+                                (PlotPoint *)scratch.mutableBytes, (PlotPoint *)self.plotPoints.mutableBytes);
+    [self.plotPoints setLength:count * sizeof(PlotPoint)];
+    shownSamples = self.currentIndex;
     
     [graph addPlot:blinkDataPlot];
     
@@ -280,7 +330,7 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
 -(NSUInteger)numberOfRecordsForPlot:(nonnull CPTPlot *)plot {
     
     if (plot.identifier == kPlotIdentifier) {
-        return plotDataY.count;
+        return plotPoints.length / sizeof(PlotPoint);
     }
     
     return 0;
@@ -293,14 +343,15 @@ static NSString *const kPlotIdentifier  = @"RealTimePlot";
         case CPTScatterPlotFieldX:
             
             if (plot.identifier == kPlotIdentifier) {
-                num = [self.plotDataX objectAtIndex:index];
+                const PlotPoint *point = (const PlotPoint *)self.plotPoints.bytes + index;
+                num = [NSNumber numberWithFloat:(float)(plotMaxTime / (float)shownSamples) * (float)point->index];
                 break;
             }
             
         case CPTScatterPlotFieldY:
             
             if (plot.identifier == kPlotIdentifier) {
-                num = [plotDataY objectAtIndex:index];
+                num = [NSNumber numberWithFloat:((const PlotPoint *)plotPoints.bytes)[index].value];
                 break;
             }
             
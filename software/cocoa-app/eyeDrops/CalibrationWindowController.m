@@ -340,11 +340,21 @@
  */
 - (void)animationFinished:(id)sender {
     
+    // Propose the amplitude parameters from the calibration data.
+    ThresholdEstimate estimate;
+    BOOL estimated = [sensorDataViewController estimateThresholds:&estimate];
+    
     // Create alert.
     NSAlert *alert = [[NSAlert alloc] init];
     [alert addButtonWithTitle:@"OK"];
     [alert setMessageText:@"Data Acquisition completed!"];
-    [alert setInformativeText:@"Click on the graph in order to set the negative and positive threshold values. After doing so you can either save the profile or test it with the selected parameters."];
+    if (estimated) {
+        [alert setInformativeText:@"The parameters have been proposed from the data. Click on the graph in order to change the negative and positive threshold values. You can either save the profile or test it with the selected parameters."];
+    } else if (estimate.saturated) {
+        [alert setInformativeText:@"The blinks were too large to propose parameters from the data. Click on the graph in order to set the negative and positive threshold values. After doing so you can either save the profile or test it with the selected parameters."];
+    } else {
+        [alert setInformativeText:@"Click on the graph in order to set the negative and positive threshold values. After doing so you can either save the profile or test it with the selected parameters."];
+    }
     [alert setAlertStyle:NSWarningAlertStyle];
     
     if ([alert runModal] == NSAlertFirstButtonReturn) {
@@ -352,6 +362,28 @@
         [_startCalibrationButton setTitle:@"Try Parameters"];
         [_startCalibrationButton setEnabled:false];
     }
+    
+    // Set the proposed parameters (scaled like the values of the graph). Setting both thresholds
+    // enables the buttons again.
+    if (estimated) {
+        self.hysteresis = estimate.hysteresis * SCALING_FACTOR;
+        self.minValue = estimate.minValue * SCALING_FACTOR;
+        self.maxValue = estimate.maxValue * SCALING_FACTOR;
+        [sensorDataViewController createThresholdLineFromValue:estimate.negativeThreshold * SCALING_FACTOR];
+        [sensorDataViewController createThresholdLineFromValue:estimate.positiveThreshold * SCALING_FACTOR];
+    }
+    
+    // Set the windows of the fall, rise and total time (in samples) from the prompted blinks.
+    TimingEstimate timing;
+    if ([sensorDataViewController estimateTimings:&timing promptTimes:[animationViewController blinkPromptTimes]]) {
+        self.minFall = timing.fall[0];
+        self.maxFall = timing.fall[1];
+        self.minRise = timing.rise[0];
+        self.maxRise = timing.rise[1];
+        self.riseTimeRangeMin = timing.total[0];
+        self.riseTimeRangeMax = timing.total[1];
+        self.eyeClosedTime = timing.closed;
+    }
 }
 
 /*
@@ -0,0 +1,760 @@
+/**
+ * @file        DeviceSession.h
+ * @brief       Header file containing the connection logic of the device manager in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/01/21
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef DEVICE_SESSION_H
+#define DEVICE_SESSION_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Shared with the RFDuino sketch (software/RFduino).
+#include "CalibrationCodec.h"
+#include "Journal.h"
+#include "ProfileMessage.h"
+#include "ProtocolCodec.h"
+
+// Connection logic of the BLEDeviceManager without CoreBluetooth and Foundation: the state machine
+// (CON_STATE), the handling of the incoming messages, the profile upload and the no blink timer.
+// The session sends through a SessionTransport and reports to the host through SessionEvents, both
+// plain function pointers with a context. The session does not own a timer either: the host passes
+// the current time in ms to every call which may start a timer, asks sessionNextDeadline() when to
+// call sessionPoll() next and calls it then. Besides the no blink timer there is a reply timeout:
+// notifications can get lost, so normal mode and the profile are sent again if the RFDuino does not
+// answer within SESSION_REPLY_TIMEOUT ms.
+// The BLEDeviceManager drives it with CoreBluetooth and an NSTimer, tools/sessionsim with a simulated
+// RFDuino on a socket pair, so the same code can be load tested on any platform.
+// BLEDeviceManager.h holds the DeviceSession by value and is imported by AppDelegate.h and with it
+// by six Objective-C (.m) files; with a C++ class there all of them would have to be compiled as
+// Objective-C++. So the transport interface is SessionTransport, a function pointer with a context
+// in place of a virtual send(), and the C++ side wraps it (tools/SessionEngine.h).
+
+#define SESSION_RECENT_BLINKS           8       // blink events remembered to drop repetitions
+#define SESSION_PROFILE_MAX_ATTEMPTS    3       // uploads of a profile before giving up
+#define SESSION_REPLY_TIMEOUT           1000    // ms to wait for PROTOCOL_OUT_ALIVE or PROTOCOL_OUT_PROFILE_SET
+#define SESSION_JOURNAL_INTERVAL        48      // ms between two journal samples (JOURNAL_DECIMATION samples of the sketch)
+#define SESSION_NO_BLINK_INTERVAL       4000    // ms until the screen is blurred, if the host does not tell
+#define SESSION_LOG_SIZE                160     // maximal length of a log message
+
+/**
+ * The connection states, see CON_STATE of the BLEDeviceManager.
+ */
+typedef enum {
+    SESSION_BOOT_UP,                        // Device freshly connected.
+    SESSION_SETTING_PROFILE,                // Currently sending the profile to the RFDuino.
+    SESSION_NORMAL_MODE,                    // Normal mode. Waiting for user to blink.
+    SESSION_BLURRING,                       // Screen is blurred, too long without blinking.
+    SESSION_CALIBRATION_INCOMING_DATA,      // Calibration mode. Data is coming in.
+    SESSION_CALIBRATION                     // Calibration mode. Data has been sent. Visual calibration is in progress.
+} SessionState;
+
+/**
+ * The answers the session waits for.
+ */
+typedef enum {
+    SESSION_AWAITING_NOTHING,
+    SESSION_AWAITING_ALIVE,                 // normal mode sent after the connect
+    SESSION_AWAITING_PROFILE_SET            // profile uploaded
+} SessionAwaiting;
+
+/**
+ * The way to the RFDuino.
+ */
+typedef struct {
+    void *context;
+    
+    // Writes one message of at most PROTOCOL_MAX_MESSAGE_SIZE bytes. Returns false if it was not sent.
+    bool (*send)(void *context, const uint8_t *data, uint8_t length);
+} SessionTransport;
+
+/**
+ * The notifications of the host. Every function may be NULL.
+ */
+typedef struct {
+    void *context;
+    
+    // A blink was handled (live blinks only, not the journal). count: blinks since the connect.
+    void (*blink)(void *context, uint32_t count);
+    
+    // No blink within the no blink interval, the screen has to be blurred.
+    void (*startBlur)(void *context);
+    
+    // A blink or the host ended the blurring (also sent if the screen is not blurred).
+    void (*stopBlur)(void *context);
+    
+    // The RFDuino applied the profile.
+    void (*profileApplied)(void *context);
+    
+    // One calibration sample (filtered value and blink flag), from any calibration message.
+    // lostBefore: samples missing right before this one because frames were lost (estimated), else 0.
+    void (*calibrationSample)(void *context, float value, bool blink, uint32_t lostBefore);
+    
+    void (*batteryLevel)(void *context, float level);
+    void (*timing)(void *context, const ProtocolTiming *timing);
+    void (*log)(void *context, const char *message);
+    
+    // Returns the allowed time without a blink in ms. Asked whenever the timer is started.
+    uint32_t (*noBlinkInterval)(void *context);
+} SessionEvents;
+
+/**
+ * Counters since sessionInit().
+ */
+typedef struct {
+    uint32_t messages;          // messages received
+    uint32_t malformed;         // messages dropped because of an unknown id, a wrong length or a bad encoding
+    uint32_t sent;              // messages sent
+    uint32_t sendFailures;      // messages not sent (not ready or rejected by the transport)
+    uint32_t repeatedBlinks;    // repeated blink events dropped
+    uint32_t profileUploads;    // profile uploads (attempts)
+    uint32_t replyTimeouts;     // answers not received within SESSION_REPLY_TIMEOUT
+} SessionStatistics;
+
+typedef struct {
+    SessionState state;
+    bool connected;             // link established
+    bool ready;                 // service loaded, messages can be sent
+    bool wantsBlurring;
+    
+    // No blink timer.
+    bool timerRunning;
+    uint32_t timerDeadline;     // ms
+    
+    // Reply timeout.
+    SessionAwaiting awaiting;
+    uint32_t replyDeadline;     // ms
+    uint8_t aliveAttempts;      // normal mode messages sent since the connect
+    
+    // Profile and its upload.
+    bool hasProfile;
+    ProfileParameters profile;
+    uint8_t profileTransfer;    // transfer id of the last upload
+    uint16_t profileChecksum;   // checksum of the last upload
+    uint8_t profileAttempts;    // attempts of the current upload
+    
+    // Blinks since the connect, the last blink events to drop repetitions.
+    uint32_t blinkCounter;
+    uint32_t enforcedBlinks;    // timer expirations since the profile was set
+    uint8_t recentBlinkSequences[SESSION_RECENT_BLINKS];
+    uint32_t recentBlinkTimes[SESSION_RECENT_BLINKS];
+    uint8_t recentBlinks;       // valid entries
+    uint8_t nextRecentBlink;    // entry to replace next
+    
+    // Calibration since the start of the calibration.
+    uint32_t packageCounter;
+    int calibrationFrameSequence;   // -1 if no frame has been received yet
+    uint32_t lostCalibrationFrames;
+    uint32_t calibrationSamples;
+    uint32_t pendingLostSamples;    // samples of lost frames, passed on with the next sample
+    
+    // Journal recorded by the RFDuino while disconnected, since the connect.
+    int journalSequence;        // -1 if no frame has been received yet
+    uint32_t journalSamples;
+    uint32_t journalBlinks;
+    uint32_t lostJournalFrames;
+    
+    float batteryLevel;
+    
+    SessionStatistics stats;
+    SessionTransport transport;
+    SessionEvents events;
+} DeviceSession;
+
+
+// Internal helpers
+
+static inline void sessionLog(DeviceSession *session, const char *format, ...) {
+    if (session->events.log == NULL) {
+        return;
+    }
+    char message[SESSION_LOG_SIZE];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    session->events.log(session->events.context, message);
+}
+
+static inline bool sessionSend(DeviceSession *session, const uint8_t *data, uint8_t length) {
+    if (!session->ready || session->transport.send == NULL ||
+        !session->transport.send(session->transport.context, data, length)) {
+        session->stats.sendFailures++;
+        return false;
+    }
+    session->stats.sent++;
+    return true;
+}
+
+static inline bool sessionSendMessage(DeviceSession *session, uint8_t message) {
+    return sessionSend(session, &message, 1);
+}
+
+static inline void sessionStartTimer(DeviceSession *session, uint32_t now) {
+    uint32_t interval = SESSION_NO_BLINK_INTERVAL;
+    if (session->events.noBlinkInterval != NULL) {
+        interval = session->events.noBlinkInterval(session->events.context);
+    }
+    session->timerRunning = true;
+    session->timerDeadline = now + interval;
+}
+
+static inline void sessionStopTimer(DeviceSession *session) {
+    session->timerRunning = false;
+}
+
+static inline void sessionStopBlur(DeviceSession *session) {
+    if (session->events.stopBlur != NULL) {
+        session->events.stopBlur(session->events.context);
+    }
+}
+
+/**
+ * Sends the profile as one packed message with checksum, split into PROFILE_MESSAGE_PARTS frames
+ * (see ProfileMessage.h). The RFDuino applies it only if it arrived completely and answers with
+ * PROTOCOL_OUT_PROFILE_SET.
+ */
+static inline void sessionUploadProfile(DeviceSession *session, uint32_t now) {
+    uint8_t packed[PROFILE_MESSAGE_PACKED_SIZE];
+    session->profileChecksum = packProfile(&session->profile, packed);
+    session->profileTransfer++;
+    session->profileAttempts++;
+    session->stats.profileUploads++;
+    for (uint8_t part = 0; part < PROFILE_MESSAGE_PARTS; part++) {
+        uint8_t frame[PROTOCOL_MAX_MESSAGE_SIZE];
+        uint8_t length = buildProfileFrame(packed, PROTOCOL_IN_SET_PROFILE, session->profileTransfer, part, frame);
+        sessionSend(session, frame, length);
+    }
+    session->awaiting = SESSION_AWAITING_PROFILE_SET;
+    session->replyDeadline = now + SESSION_REPLY_TIMEOUT;
+}
+
+/**
+ * Sends normal mode after the connect. The RFDuino answers with PROTOCOL_OUT_ALIVE, which starts the
+ * profile upload.
+ */
+static inline void sessionSendNormalModeAfterConnect(DeviceSession *session, uint32_t now) {
+    session->aliveAttempts++;
+    sessionSendMessage(session, PROTOCOL_IN_NORMAL_MODE);
+    session->awaiting = SESSION_AWAITING_ALIVE;
+    session->replyDeadline = now + SESSION_REPLY_TIMEOUT;
+}
+
+/**
+ * Handles a detected blink: restarts the timer in normal mode and ends the blurring.
+ */
+static inline void sessionBlinkDetected(DeviceSession *session, uint32_t now) {
+    session->blinkCounter++;
+    
+    if (session->state == SESSION_NORMAL_MODE) {
+        // Restart the timer FIRST, otherwise it could expire and start blurring again right after
+        // blurring was stopped due to the blink.
+        if (session->timerRunning && session->connected) {
+            sessionStartTimer(session, now);
+        }
+        sessionStopBlur(session);
+    } else if (session->state == SESSION_BLURRING) {
+        // The releasing blink: clear the screen and restart the timer.
+        sessionStopBlur(session);
+        sessionStartTimer(session, now);
+        session->state = SESSION_NORMAL_MODE;
+    }
+    
+    if (session->events.blink != NULL) {
+        session->events.blink(session->events.context, session->blinkCounter);
+    }
+}
+
+/**
+ * Returns true if the blink event was received before (same sequence number and device time),
+ * otherwise remembers it and returns false.
+ */
+static inline bool sessionIsRepeatedBlink(DeviceSession *session, uint8_t sequence, uint32_t deviceTime) {
+    for (uint8_t i = 0; i < session->recentBlinks; i++) {
+        if (session->recentBlinkSequences[i] == sequence && session->recentBlinkTimes[i] == deviceTime) {
+            return true;
+        }
+    }
+    session->recentBlinkSequences[session->nextRecentBlink] = sequence;
+    session->recentBlinkTimes[session->nextRecentBlink] = deviceTime;
+    session->nextRecentBlink = (session->nextRecentBlink + 1) % SESSION_RECENT_BLINKS;
+    if (session->recentBlinks < SESSION_RECENT_BLINKS) {
+        session->recentBlinks++;
+    }
+    return false;
+}
+
+/**
+ * The RFDuino applied a profile: go to normal mode and start the timer if blurring is desired.
+ */
+static inline void sessionProfileApplied(DeviceSession *session, uint32_t now) {
+    session->packageCounter = 0;
+    session->profileAttempts = 0;
+    session->awaiting = SESSION_AWAITING_NOTHING;
+    
+    if (session->state == SESSION_BOOT_UP) {
+        session->state = SESSION_NORMAL_MODE;
+    }
+    if (session->state == SESSION_NORMAL_MODE) {
+        sessionSendMessage(session, PROTOCOL_IN_NORMAL_MODE);
+    }
+    if (session->events.profileApplied != NULL) {
+        session->events.profileApplied(session->events.context);
+    }
+    if (session->wantsBlurring) {
+        sessionStartTimer(session, now);
+    }
+}
+
+/**
+ * Counts a calibration frame with the given sequence number and number of samples. Lost frames are
+ * detected by gaps in the sequence number, which is incremented by one per frame (mod 256). Their
+ * samples are estimated with the average frame so far (exact for the full frames of 4 samples of
+ * PROTOCOL_OUT_CALIBRATION_FRAME) and reported with the first sample of this frame, so the host
+ * can keep the sample indices in step with the time.
+ */
+static inline void sessionCheckCalibrationSequence(DeviceSession *session, uint8_t sequence, uint32_t samples) {
+    if (session->calibrationFrameSequence >= 0) {
+        uint8_t lost = (uint8_t)(sequence - session->calibrationFrameSequence - 1);
+        if (lost > 0) {
+            session->lostCalibrationFrames += lost;
+            session->pendingLostSamples += session->packageCounter > 0
+                ? (lost * session->calibrationSamples + session->packageCounter / 2) / session->packageCounter
+                : lost * samples;
+            sessionLog(session, "Lost %u calibration frames before frame %u", lost, sequence);
+        }
+    }
+    session->calibrationFrameSequence = sequence;
+    session->packageCounter++;
+    session->calibrationSamples += samples;
+}
+
+/**
+ * Passes a calibration sample on, unless the visual calibration is already in progress.
+ */
+static inline void sessionCalibrationSample(DeviceSession *session, float value, bool blink) {
+    if (session->state != SESSION_CALIBRATION && session->events.calibrationSample != NULL) {
+        session->events.calibrationSample(session->events.context, value, blink, session->pendingLostSamples);
+    }
+    session->pendingLostSamples = 0;
+}
+
+/**
+ * Handles a journal frame (see Journal.h). The blinks are not handled as live blinks, they are only logged.
+ */
+static inline bool sessionHandleJournal(DeviceSession *session, const uint8_t *data, int length) {
+    uint32_t deviceTime;
+    int32_t values[JOURNAL_MAX_SAMPLES];
+    bool blinks[JOURNAL_MAX_SAMPLES];
+    int samples = decodeJournalBlock(data + JOURNAL_FRAME_HEADER_SIZE, (uint8_t)(length - JOURNAL_FRAME_HEADER_SIZE),
+                                     &deviceTime, values, blinks);
+    if (samples < 0) {
+        return false;
+    }
+    
+    if (session->journalSequence < 0) {
+        sessionLog(session, "Receiving journal starting at device time %u ms", deviceTime);
+    } else {
+        session->lostJournalFrames += (uint8_t)(data[1] - session->journalSequence - 1);
+    }
+    session->journalSequence = data[1];
+    
+    for (int i = 0; i < samples; i++) {
+        if (blinks[i]) {
+            session->journalBlinks++;
+            sessionLog(session, "JOURNAL BLINK at device time %u ms (%u)",
+                       deviceTime + i * SESSION_JOURNAL_INTERVAL, session->journalBlinks);
+        }
+    }
+    session->journalSamples += samples;
+    return true;
+}
+
+
+// Setup and connection
+
+/**
+ * Initializes the session. transport and events are copied.
+ */
+static inline void sessionInit(DeviceSession *session, const SessionTransport *transport, const SessionEvents *events) {
+    memset(session, 0, sizeof(DeviceSession));
+    session->state = SESSION_BOOT_UP;
+    session->calibrationFrameSequence = -1;
+    session->journalSequence = -1;
+    session->transport = *transport;
+    session->events = *events;
+}
+
+/**
+ * The link to the RFDuino is established (the service is not loaded yet).
+ */
+static inline void sessionConnected(DeviceSession *session) {
+    session->state = SESSION_BOOT_UP;
+    session->connected = true;
+    session->ready = false;
+    session->awaiting = SESSION_AWAITING_NOTHING;
+    session->aliveAttempts = 0;
+    
+    // The RFDuino restarts its blink sequence numbers with every connection.
+    session->recentBlinks = 0;
+    session->nextRecentBlink = 0;
+    session->blinkCounter = 0;
+    
+    // The RFDuino sends what it recorded while disconnected after normal mode is set.
+    session->journalSequence = -1;
+    session->journalSamples = 0;
+    session->journalBlinks = 0;
+    session->lostJournalFrames = 0;
+}
+
+/**
+ * The service is loaded. Sends normal mode to signal the RFDuino that the host is ready.
+ */
+static inline void sessionReady(DeviceSession *session, uint32_t now) {
+    session->ready = true;
+    sessionSendNormalModeAfterConnect(session, now);
+}
+
+/**
+ * The link is gone (or is closed by the host). Stops the timer and the blurring, there is no blink
+ * to end it without a device.
+ */
+static inline void sessionDisconnected(DeviceSession *session) {
+    if (session->state == SESSION_BLURRING) {
+        sessionStopBlur(session);
+    }
+    sessionStopTimer(session);
+    session->connected = false;
+    session->ready = false;
+    session->awaiting = SESSION_AWAITING_NOTHING;
+    session->state = SESSION_BOOT_UP;
+}
+
+
+// Incoming messages
+
+/**
+ * Handles a message of the RFDuino. now is the current time in ms.
+ * Returns false if the message was dropped as malformed.
+ */
+static inline bool sessionReceive(DeviceSession *session, const uint8_t *data, int length, uint32_t now) {
+    session->stats.messages++;
+    
+    // Drop unknown messages and messages with a wrong length right away.
+    if (!protocolCheckOut(data, length)) {
+        session->stats.malformed++;
+        return false;
+    }
+    
+    switch (data[0]) {
+            
+        case PROTOCOL_OUT_BLINK_DETECTED:
+            sessionBlinkDetected(session, now);
+            break;
+            
+        case PROTOCOL_OUT_BLINK_EVENT: {
+            // Repeated by the RFDuino until it is acknowledged, so acknowledge every copy but handle
+            // the blink only once.
+            uint8_t sequence;
+            uint32_t deviceTime;
+            if (!protocolDecodeBlinkEvent(data, length, &sequence, &deviceTime)) {
+                session->stats.malformed++;
+                return false;
+            }
+            uint8_t ack[PROTOCOL_BLINK_ACK_SIZE];
+            sessionSend(session, ack, protocolEncodeBlinkAck(ack, sequence));
+            if (sessionIsRepeatedBlink(session, sequence, deviceTime)) {
+                session->stats.repeatedBlinks++;
+            } else {
+                sessionBlinkDetected(session, now);
+            }
+            break;
+        }
+            
+        case PROTOCOL_OUT_ALIVE:
+            // Answer to normal mode. If freshly booted, set the profile if there is one.
+            if (session->awaiting == SESSION_AWAITING_ALIVE) {
+                session->awaiting = SESSION_AWAITING_NOTHING;
+            }
+            if (session->state == SESSION_BOOT_UP && session->awaiting == SESSION_AWAITING_NOTHING) {
+                if (session->hasProfile) {
+                    session->enforcedBlinks = 0;
+                    session->profileAttempts = 0;
+                    sessionUploadProfile(session, now);
+                } else {
+                    sessionLog(session, "NO USER PROFILE HAS BEEN SET YET!!!");
+                }
+            }
+            break;
+            
+        case PROTOCOL_OUT_CALIBRATION_DATA:
+            // Single calibration sample of older sketches: float and blink byte.
+            session->packageCounter++;
+            sessionCalibrationSample(session, protocolReadFloat(data + 1), data[5] != 0);
+            break;
+            
+        case PROTOCOL_OUT_CALIBRATION_FRAME: {
+            // Up to 4 floats with sequence number and blink mask.
+            uint8_t samples = protocolCalibrationSamples(data, length);
+            if (samples == 0) {
+                session->stats.malformed++;
+                return false;
+            }
+            sessionCheckCalibrationSequence(session, data[1], samples);
+            for (uint8_t i = 0; i < samples; i++) {
+                sessionCalibrationSample(session, protocolCalibrationSample(data, i), (data[2] >> i) & 1);
+            }
+            break;
+        }
+            
+        case PROTOCOL_OUT_CALIBRATION_COMPRESSED: {
+            // Delta encoded samples (see CalibrationCodec.h). A malformed frame is dropped as a whole.
+            int32_t values[CALIBRATION_CODEC_MAX_SAMPLES];
+            bool blinks[CALIBRATION_CODEC_MAX_SAMPLES];
+            int samples = decodeCalibrationFrame(data, (uint8_t)length, values, blinks);
+            if (samples < 0) {
+                session->stats.malformed++;
+                return false;
+            }
+            sessionCheckCalibrationSequence(session, data[1], (uint32_t)samples);
+            for (int i = 0; i < samples; i++) {
+                sessionCalibrationSample(session, values[i] / 65536.0f, blinks[i]);
+            }
+            break;
+        }
+            
+        case PROTOCOL_OUT_JOURNAL:
+            if (!sessionHandleJournal(session, data, length)) {
+                session->stats.malformed++;
+                return false;
+            }
+            break;
+            
+        case PROTOCOL_OUT_PROFILE_SET: {
+            // Answer to a packed profile upload: transfer id, checksum and status.
+            uint8_t transfer;
+            uint16_t checksum;
+            uint8_t status;
+            if (!protocolDecodeProfileStatus(data, length, &transfer, &checksum, &status)) {
+                session->stats.malformed++;
+                return false;
+            }
+            if (transfer != session->profileTransfer) {
+                // Answer to an older upload.
+                break;
+            }
+            if (status != PROTOCOL_PROFILE_APPLIED || checksum != session->profileChecksum) {
+                sessionLog(session, "Profile upload %u failed with status %u", transfer, status);
+                session->awaiting = SESSION_AWAITING_NOTHING;
+                if (session->profileAttempts < SESSION_PROFILE_MAX_ATTEMPTS && session->hasProfile) {
+                    sessionUploadProfile(session, now);
+                }
+                break;
+            }
+            sessionLog(session, "Profile upload %u applied", transfer);
+            sessionProfileApplied(session, now);
+            break;
+        }
+            
+        case PROTOCOL_OUT_PARAMETERS_SET:
+            // Single parameter upload of older versions.
+            sessionProfileApplied(session, now);
+            break;
+            
+        case PROTOCOL_OUT_BATTERY_LEVEL:
+            if (protocolDecodeBatteryLevel(data, length, &session->batteryLevel) &&
+                session->events.batteryLevel != NULL) {
+                session->events.batteryLevel(session->events.context, session->batteryLevel);
+            }
+            break;
+            
+        case PROTOCOL_OUT_TIMING: {
+            ProtocolTiming timing;
+            if (protocolDecodeTiming(data, length, &timing) && session->events.timing != NULL) {
+                session->events.timing(session->events.context, &timing);
+            }
+            break;
+        }
+            
+        case PROTOCOL_OUT_DEBUG:
+            sessionLog(session, "DEBUG");
+            break;
+            
+        case PROTOCOL_OUT_ERROR_EXCEPTION:
+            sessionLog(session, "ERROR EXCEPTION");
+            break;
+            
+        case PROTOCOL_OUT_RESET:
+            sessionLog(session, "RESET");
+            break;
+            
+        default:
+            break;
+    }
+    return true;
+}
+
+
+// Timer
+
+/**
+ * Returns true and the time in ms at which sessionPoll() has to be called next, false if no timer is running.
+ */
+static inline bool sessionNextDeadline(const DeviceSession *session, uint32_t *deadline) {
+    bool awaiting = session->awaiting != SESSION_AWAITING_NOTHING;
+    if (session->timerRunning && (!awaiting || (int32_t)(session->timerDeadline - session->replyDeadline) < 0)) {
+        *deadline = session->timerDeadline;
+        return true;
+    }
+    *deadline = session->replyDeadline;
+    return awaiting;
+}
+
+/**
+ * Handles the timers which expired at now (ms):
+ *   - the no blink timer counts an enforced blink and starts the blurring,
+ *   - the reply timeout sends normal mode or the profile again.
+ * Returns true if a timer expired.
+ */
+static inline bool sessionPoll(DeviceSession *session, uint32_t now) {
+    bool expired = false;
+    if (session->awaiting != SESSION_AWAITING_NOTHING && (int32_t)(now - session->replyDeadline) >= 0) {
+        expired = true;
+        session->stats.replyTimeouts++;
+        SessionAwaiting awaiting = session->awaiting;
+        session->awaiting = SESSION_AWAITING_NOTHING;
+        if (awaiting == SESSION_AWAITING_ALIVE && session->aliveAttempts < SESSION_PROFILE_MAX_ATTEMPTS) {
+            sessionSendNormalModeAfterConnect(session, now);
+        } else if (awaiting == SESSION_AWAITING_PROFILE_SET && session->profileAttempts < SESSION_PROFILE_MAX_ATTEMPTS) {
+            sessionLog(session, "No answer to profile upload %u", session->profileTransfer);
+            sessionUploadProfile(session, now);
+        } else {
+            sessionLog(session, "RFDuino does not answer");
+        }
+    }
+    if (session->timerRunning && (int32_t)(now - session->timerDeadline) >= 0) {
+        expired = true;
+        sessionStopTimer(session);
+        session->enforcedBlinks++;
+        session->state = SESSION_BLURRING;
+        if (session->events.startBlur != NULL) {
+            session->events.startBlur(session->events.context);
+        }
+    }
+    return expired;
+}
+
+
+// Commands of the host
+
+/**
+ * Sets the profile. If connected it is uploaded right away, otherwise after the next connect.
+ */
+static inline void sessionSetProfile(DeviceSession *session, const ProfileParameters *profile, uint32_t now) {
+    session->profile = *profile;
+    session->hasProfile = true;
+    if (session->connected) {
+        session->enforcedBlinks = 0;
+        session->profileAttempts = 0;
+        sessionUploadProfile(session, now);
+    }
+}
+
+/**
+ * Enables or disables the blurring. The timer is started if a device is connected in normal mode.
+ */
+static inline void sessionSetBlurring(DeviceSession *session, bool blurring, uint32_t now) {
+    session->wantsBlurring = blurring;
+    if (blurring) {
+        if (session->state == SESSION_NORMAL_MODE && session->connected) {
+            sessionStartTimer(session, now);
+        }
+    } else {
+        // Stop blurring in case the screen is blurred right now.
+        sessionStopBlur(session);
+        sessionStopTimer(session);
+        if (session->state == SESSION_BLURRING) {
+            session->state = SESSION_NORMAL_MODE;
+        }
+    }
+}
+
+static inline void sessionStartCalibration(DeviceSession *session) {
+    sessionStopTimer(session);
+    session->state = SESSION_CALIBRATION_INCOMING_DATA;
+    if (session->connected) {
+        // Start a new timing window, so the statistics requested at the end cover the calibration data.
+        sessionSendMessage(session, PROTOCOL_IN_REQUEST_TIMING);
+        session->calibrationFrameSequence = -1;
+        session->packageCounter = 0;
+        session->lostCalibrationFrames = 0;
+        session->calibrationSamples = 0;
+        session->pendingLostSamples = 0;
+        sessionSendMessage(session, PROTOCOL_IN_START_CALIBRATION);
+    }
+}
+
+static inline void sessionStopCalibration(DeviceSession *session) {
+    session->state = SESSION_CALIBRATION;
+    if (session->connected) {
+        sessionSendMessage(session, PROTOCOL_IN_STOP_CALIBRATION);
+        sessionSendMessage(session, PROTOCOL_IN_REQUEST_TIMING);
+    }
+    sessionLog(session, "Calibration samples: %u, lost frames: %u (about %u samples)", session->calibrationSamples,
+               session->lostCalibrationFrames, session->packageCounter > 0 ?
+               session->lostCalibrationFrames * session->calibrationSamples / session->packageCounter : 0);
+}
+
+/**
+ * The visual calibration is done, go back to normal mode.
+ */
+static inline void sessionCalibrationComplete(DeviceSession *session) {
+    if (session->connected) {
+        session->state = SESSION_NORMAL_MODE;
+        sessionSendMessage(session, PROTOCOL_IN_NORMAL_MODE);
+    }
+}
+
+static inline void sessionRequestBatteryLevel(DeviceSession *session) {
+    if (session->connected) {
+        sessionSendMessage(session, PROTOCOL_IN_REQUEST_BATTERY_LEVEL);
+    }
+}
+
+static inline void sessionRequestTiming(DeviceSession *session) {
+    if (session->connected) {
+        sessionSendMessage(session, PROTOCOL_IN_REQUEST_TIMING);
+    }
+}
+
+#endif
@@ -0,0 +1,376 @@
+/**
+ * @file        PlotDownsampler.h
+ * @brief       Header file containing the downsampling of long sample series for the plots in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/01/28
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef PLOT_DOWNSAMPLER_H
+#define PLOT_DOWNSAMPLER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Reduces a series of samples to a number of points bounded by the width of the plot, however
+// long the series is, so Core Plot draws the same picture from a few thousand points.
+// A MinMaxPyramid is built while the samples come in (pyramidAppend, amortized O(1)): level 0
+// holds min and max of every PYRAMID_BASE samples, every further level combines two buckets of
+// the level below. The samples themselves stay with the caller (NSMutableData of the plot, mapped
+// archive), the pyramid needs 12 / PYRAMID_BASE * 2 bytes per sample.
+// pyramidMinMax() returns min and max of every pixel column of an index range in O(PYRAMID_BASE
+// + levels) per column: the samples at the ends of a column are scanned, the middle is covered
+// by the largest aligned buckets. Min and max are returned in the order they occur, so spikes and
+// blinks survive any zoom level.
+// downsample() selects the final points with Largest-Triangle-Three-Buckets (LTTB) from the min
+// and max of twice as many columns (MinMaxLTTB): LTTB alone would have to look at every sample.
+// The callers are the plot data sources of SensorDataViewController.m and
+// BlinkPredictionViewController.m, plain Objective-C; tools/downsamplebench times the same code.
+
+#define PYRAMID_BASE            64      // samples per bucket of level 0, power of two
+#define PYRAMID_BASE_SHIFT      6
+#define PYRAMID_LEVELS          26      // 64 * 2^25 samples per bucket of the top level
+
+/**
+ * Min and max of a bucket and which of them comes first.
+ */
+typedef struct {
+    float min;
+    float max;
+    uint8_t minFirst;
+} PyramidBucket;
+
+typedef struct {
+    PyramidBucket *buckets;
+    uint32_t count;
+    uint32_t capacity;
+} PyramidLevel;
+
+typedef struct {
+    PyramidLevel levels[PYRAMID_LEVELS];
+    uint64_t samples;                       // samples appended
+    PyramidBucket pending;                  // the incomplete bucket of level 0
+    bool failed;                            // an allocation failed, levels are incomplete
+} MinMaxPyramid;
+
+/**
+ * A point of a downsampled series: position in the series and value.
+ */
+typedef struct {
+    uint64_t index;
+    float value;
+} PlotPoint;
+
+static inline void pyramidInit(MinMaxPyramid *pyramid) {
+    memset(pyramid, 0, sizeof(MinMaxPyramid));
+}
+
+static inline void pyramidFree(MinMaxPyramid *pyramid) {
+    int level;
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        free(pyramid->levels[level].buckets);
+    }
+    pyramidInit(pyramid);
+}
+
+/**
+ * Forgets all samples but keeps the memory.
+ */
+static inline void pyramidReset(MinMaxPyramid *pyramid) {
+    int level;
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        pyramid->levels[level].count = 0;
+    }
+    pyramid->samples = 0;
+    pyramid->failed = false;
+}
+
+static inline PyramidBucket pyramidCombine(const PyramidBucket *left, const PyramidBucket *right) {
+    PyramidBucket bucket;
+    bool minLeft = left->min <= right->min;
+    bool maxLeft = left->max >= right->max;
+
+    bucket.min = minLeft ? left->min : right->min;
+    bucket.max = maxLeft ? left->max : right->max;
+    if (minLeft == maxLeft) {
+        bucket.minFirst = minLeft ? left->minFirst : right->minFirst;
+    } else {
+        bucket.minFirst = minLeft;
+    }
+    return bucket;
+}
+
+static inline bool pyramidPush(MinMaxPyramid *pyramid, int level, const PyramidBucket *bucket) {
+    PyramidLevel *buckets = &pyramid->levels[level];
+    if (buckets->count == buckets->capacity) {
+        uint32_t capacity = buckets->capacity ? buckets->capacity * 2 : 64;
+        PyramidBucket *grown = (PyramidBucket *)realloc(buckets->buckets, capacity * sizeof(PyramidBucket));
+        if (!grown) {
+            pyramid->failed = true;
+            return false;
+        }
+        buckets->buckets = grown;
+        buckets->capacity = capacity;
+    }
+    buckets->buckets[buckets->count++] = *bucket;
+    return true;
+}
+
+/**
+ * Adds the next sample of the series.
+ */
+static inline void pyramidAppend(MinMaxPyramid *pyramid, float value) {
+    PyramidBucket *pending = &pyramid->pending;
+    uint32_t position = (uint32_t)(pyramid->samples++ & (PYRAMID_BASE - 1));
+    int level;
+
+    if (position == 0) {
+        pending->min = value;
+        pending->max = value;
+        pending->minFirst = 1;
+    } else if (value < pending->min) {
+        pending->min = value;
+        pending->minFirst = 0;
+    } else if (value > pending->max) {
+        pending->max = value;
+        pending->minFirst = 1;
+    }
+    if (position != PYRAMID_BASE - 1 || pyramid->failed) {
+        return;
+    }
+    // Bucket complete: push it and every bucket of the levels above it completes.
+    if (!pyramidPush(pyramid, 0, pending)) {
+        return;
+    }
+    for (level = 0; level + 1 < PYRAMID_LEVELS && (pyramid->levels[level].count & 1) == 0; level++) {
+        const PyramidBucket *pair = &pyramid->levels[level].buckets[pyramid->levels[level].count - 2];
+        PyramidBucket combined = pyramidCombine(&pair[0], &pair[1]);
+        if (!pyramidPush(pyramid, level + 1, &combined)) {
+            return;
+        }
+    }
+}
+
+/**
+ * Min and max of the samples from <= i < to with their (approximate) positions.
+ */
+typedef struct {
+    float min;
+    float max;
+    uint64_t minIndex;
+    uint64_t maxIndex;
+} PyramidRange;
+
+static inline void pyramidRangeAdd(PyramidRange *range, float min, uint64_t minIndex, float max, uint64_t maxIndex) {
+    if (min < range->min) {
+        range->min = min;
+        range->minIndex = minIndex;
+    }
+    if (max > range->max) {
+        range->max = max;
+        range->maxIndex = maxIndex;
+    }
+}
+
+/**
+ * Computes min and max of samples[from ... to - 1] (to > from). Inside a bucket the positions of
+ * min and max are not known: the first of them is placed at the start of the bucket, the other at
+ * its end.
+ */
+static inline void pyramidRange(const MinMaxPyramid *pyramid, const float *samples, uint64_t from, uint64_t to,
+                                PyramidRange *range) {
+    uint64_t complete = pyramid->failed ? 0 : (uint64_t)pyramid->levels[0].count << PYRAMID_BASE_SHIFT;
+    uint64_t i = from;
+    uint64_t end;
+    int level = 0;
+
+    range->min = samples[from];
+    range->max = samples[from];
+    range->minIndex = from;
+    range->maxIndex = from;
+
+    // Samples up to the first bucket boundary.
+    end = (from + PYRAMID_BASE - 1) & ~(uint64_t)(PYRAMID_BASE - 1);
+    if (end > to || end > complete) {
+        end = to;
+    }
+    for (; i < end; i++) {
+        pyramidRangeAdd(range, samples[i], i, samples[i], i);
+    }
+    // The largest aligned buckets which fit: the levels go up from the start and down to the end.
+    while (i + PYRAMID_BASE <= to && i + PYRAMID_BASE <= complete) {
+        uint64_t size;
+        while (level > 0 && (i + ((uint64_t)PYRAMID_BASE << level) > to ||
+                             (i >> (PYRAMID_BASE_SHIFT + level)) >= pyramid->levels[level].count)) {
+            level--;
+        }
+        while (level + 1 < PYRAMID_LEVELS) {
+            size = (uint64_t)PYRAMID_BASE << (level + 1);
+            if ((i & (size - 1)) != 0 || i + size > to ||
+                (i >> (PYRAMID_BASE_SHIFT + level + 1)) >= pyramid->levels[level + 1].count) {
+                break;
+            }
+            level++;
+        }
+        size = (uint64_t)PYRAMID_BASE << level;
+        const PyramidBucket *bucket = &pyramid->levels[level].buckets[i >> (PYRAMID_BASE_SHIFT + level)];
+        uint64_t first = i;
+        uint64_t last = i + size - 1;
+        pyramidRangeAdd(range, bucket->min, bucket->minFirst ? first : last, bucket->max,
+                        bucket->minFirst ? last : first);
+        i += size;
+    }
+    // The rest.
+    for (; i < to; i++) {
+        pyramidRangeAdd(range, samples[i], i, samples[i], i);
+    }
+}
+
+/**
+ * Writes min and max of every of columns equal parts of samples[from ... to - 1] in the order
+ * they occur (one point if they are the same sample) to points (2 * columns). Returns the number
+ * of points written.
+ */
+static inline uint32_t pyramidMinMax(const MinMaxPyramid *pyramid, const float *samples, uint64_t from, uint64_t to,
+                                     uint32_t columns, PlotPoint *points) {
+    uint32_t count = 0;
+    uint32_t column;
+
+    if (to <= from || columns == 0) {
+        return 0;
+    }
+    for (column = 0; column < columns; column++) {
+        uint64_t start = from + (to - from) * column / columns;
+        uint64_t end = from + (to - from) * (column + 1) / columns;
+        PyramidRange range;
+        if (end <= start) {
+            continue;
+        }
+        pyramidRange(pyramid, samples, start, end, &range);
+        if (range.minIndex == range.maxIndex) {
+            points[count].index = range.minIndex;
+            points[count++].value = range.min;
+        } else if (range.minIndex < range.maxIndex) {
+            points[count].index = range.minIndex;
+            points[count++].value = range.min;
+            points[count].index = range.maxIndex;
+            points[count++].value = range.max;
+        } else {
+            points[count].index = range.maxIndex;
+            points[count++].value = range.max;
+            points[count].index = range.minIndex;
+            points[count++].value = range.min;
+        }
+    }
+    return count;
+}
+
+/**
+ * Largest-Triangle-Three-Buckets: selects threshold (>= 3) of the count points, keeping the
+ * first and the last. Returns the number of points written to out (count if count <= threshold).
+ */
+static inline uint32_t plotLttb(const PlotPoint *points, uint32_t count, uint32_t threshold, PlotPoint *out) {
+    double every;
+    uint32_t selected = 0;
+    uint32_t a = 0;
+    uint32_t bucket;
+
+    if (count <= threshold || threshold < 3) {
+        memcpy(out, points, count * sizeof(PlotPoint));
+        return count;
+    }
+    every = (double)(count - 2) / (threshold - 2);
+    out[selected++] = points[0];
+    for (bucket = 0; bucket < threshold - 2; bucket++) {
+        // Average of the next bucket, the third corner of the triangles.
+        uint32_t nextStart = (uint32_t)((bucket + 1) * every) + 1;
+        uint32_t nextEnd = (uint32_t)((bucket + 2) * every) + 1;
+        double averageX = 0;
+        double averageY = 0;
+        uint32_t i;
+        if (nextEnd > count) {
+            nextEnd = count;
+        }
+        for (i = nextStart; i < nextEnd; i++) {
+            averageX += (double)points[i].index;
+            averageY += points[i].value;
+        }
+        if (nextEnd > nextStart) {
+            averageX /= nextEnd - nextStart;
+            averageY /= nextEnd - nextStart;
+        }
+
+        // The point of this bucket with the largest triangle with the selected point and the average.
+        uint32_t start = (uint32_t)(bucket * every) + 1;
+        uint32_t end = (uint32_t)((bucket + 1) * every) + 1;
+        double ax = (double)points[a].index;
+        double ay = points[a].value;
+        double largest = -1;
+        uint32_t chosen = start;
+        for (i = start; i < end; i++) {
+            double area = (ax - averageX) * (points[i].value - ay) - (ax - (double)points[i].index) * (averageY - ay);
+            if (area < 0) {
+                area = -area;
+            }
+            if (area > largest) {
+                largest = area;
+                chosen = i;
+            }
+        }
+        out[selected++] = points[chosen];
+        a = chosen;
+    }
+    out[selected++] = points[count - 1];
+    return selected;
+}
+
+/**
+ * Downsamples samples[from ... to - 1] to at most points points (MinMaxLTTB). scratch needs room
+ * for 4 * points points. Short ranges are returned as they are. Returns the number of points.
+ */
+static inline uint32_t downsample(const MinMaxPyramid *pyramid, const float *samples, uint64_t from, uint64_t to,
+                                  uint32_t points, PlotPoint *scratch, PlotPoint *out) {
+    uint64_t i;
+    uint32_t candidates;
+
+    if (to <= from) {
+        return 0;
+    }
+    if (to - from <= points) {
+        for (i = from; i < to; i++) {
+            out[i - from].index = i;
+            out[i - from].value = samples[i];
+        }
+        return (uint32_t)(to - from);
+    }
+    candidates = pyramidMinMax(pyramid, samples, from, to, 2 * points, scratch);
+    return plotLttb(scratch, candidates, points, out);
+}
+
+#endif
@@ -30,47 +30,70 @@
 
 #import <Foundation/Foundation.h>
 
+// Message ids and encoding shared with the RFDuino sketch (software/RFduino/ProtocolCodec.h).
+// The sketch names messages from its point of view, so its IN messages are our OUT messages.
+#import "ProtocolCodec.h"
+
 /**
  * @brief   This enumeration contains the byte decoded message values for outgoing BLE mesages.
  *
  * @enum    BLE_OUT_MESSAGE
  */
 typedef enum BLE_OUT_MESSAGE : unsigned char {
-    BLE_OUT_MESSAGE_NORMAL_MODE             = 0x00,             /*!< Normal operation. Blink detection! */
-    BLE_OUT_MESSAGE_START_CALIBRATION       = 0x01,             /*!< PC wants to start a calibration (due to creating new profile). */
-    BLE_OUT_MESSAGE_STOP_CALIBRATION        = 0x02,             /*!< Data acquisition completed. Tell RFDuino to stop sending calibration data. */
-    BLE_OUT_MESSAGE_SET_PARAMETERS          = 0x03,             /*!< Package identifier for calibration parameters. */
-    BLE_OUT_MESSAGE_CAL_PARAM_THRESH_NEG    = 0x10,             /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_THRESH_POS,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_HYSTERESIS,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_MIN_MIN,                          /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_MAX_MAX,                          /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_FALL_MIN,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_FALL_MAX,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_RISE_MIN,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_RISE_MAX,                       /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_TOTAL_MIN,                      /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_T_TOTAL_MAX,                      /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_CAL_PARAM_ALLOWED_ZEROS,                    /*!< Calibration parameter. */
-    BLE_OUT_MESSAGE_REQUEST_BATTERY_LEVEL   = 0x10,             /*!< Tell RFDuino to send battery level. */
-    BLE_OUT_MESSAGE_START_DEBUG             = 0x0E,             /*!< Tell RFDUino to enter debug mode. */
-    BLE_OUT_MESSAGE_STOP_DEBUG              = 0x0F,             /*!< Tell RFDuino to leave debug mode. */
-    BLE_OUT_MESSAGE_RESET                   = 0xFF              /*!< ACK for BLE_IN_MESSAGE_NEED_RESET. */
+    BLE_OUT_MESSAGE_NORMAL_MODE             = PROTOCOL_IN_NORMAL_MODE,            /*!< Normal operation. Blink detection! */
+    BLE_OUT_MESSAGE_START_CALIBRATION       = PROTOCOL_IN_START_CALIBRATION,      /*!< PC wants to start a calibration (due to creating new profile). */
+    BLE_OUT_MESSAGE_STOP_CALIBRATION        = PROTOCOL_IN_STOP_CALIBRATION,       /*!< Data acquisition completed. Tell RFDuino to stop sending calibration data. */
+    BLE_OUT_MESSAGE_SET_PARAMETERS          = PROTOCOL_IN_SET_PARAMETER,          /*!< Package identifier for calibration parameters (followed by a BLE_CAL_PARAM). */
+    BLE_OUT_MESSAGE_SET_PROFILE             = PROTOCOL_IN_SET_PROFILE,            /*!< Complete checksummed profile in two frames (see setProfile:). */
+    BLE_OUT_MESSAGE_BLINK_ACK               = PROTOCOL_IN_BLINK_ACK,              /*!< ACK for BLE_IN_MESSAGE_BLINK_EVENT (0x05 <sequence>). */
+    BLE_OUT_MESSAGE_REQUEST_BATTERY_LEVEL   = PROTOCOL_IN_REQUEST_BATTERY_LEVEL,  /*!< Tell RFDuino to send battery level. */
+    BLE_OUT_MESSAGE_REQUEST_TIMING          = PROTOCOL_IN_REQUEST_TIMING,         /*!< Tell RFDuino to send (and reset) its sample timing statistics. */
+    BLE_OUT_MESSAGE_START_DEBUG             = PROTOCOL_IN_START_DEBUG,            /*!< Tell RFDUino to enter debug mode. */
+    BLE_OUT_MESSAGE_STOP_DEBUG              = PROTOCOL_IN_STOP_DEBUG,             /*!< Tell RFDuino to leave debug mode. */
+    BLE_OUT_MESSAGE_RESET                   = PROTOCOL_IN_RESET                   /*!< ACK for BLE_IN_MESSAGE_NEED_RESET. */
 } BLE_OUT_MESSAGE;
 
 
+/**
+ * @brief   This enumeration contains the calibration parameter ids sent after BLE_OUT_MESSAGE_SET_PARAMETERS.
+ *          They share values with message ids, so they have their own enumeration.
+ *
+ * @enum    BLE_CAL_PARAM
+ */
+typedef enum BLE_CAL_PARAM : unsigned char {
+    BLE_CAL_PARAM_THRESH_NEG                = PROTOCOL_PARAMETER_THRESH_NEG,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_THRESH_POS                = PROTOCOL_PARAMETER_THRESH_POS,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_HYSTERESIS                = PROTOCOL_PARAMETER_HYSTERESIS,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_MIN_MIN                   = PROTOCOL_PARAMETER_MIN_MIN,         /*!< Calibration parameter. */
+    BLE_CAL_PARAM_MAX_MAX                   = PROTOCOL_PARAMETER_MAX_MAX,         /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_FALL_MIN                = PROTOCOL_PARAMETER_T_FALL_MIN,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_FALL_MAX                = PROTOCOL_PARAMETER_T_FALL_MAX,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_RISE_MIN                = PROTOCOL_PARAMETER_T_RISE_MIN,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_RISE_MAX                = PROTOCOL_PARAMETER_T_RISE_MAX,      /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_TOTAL_MIN               = PROTOCOL_PARAMETER_T_TOTAL_MIN,     /*!< Calibration parameter. */
+    BLE_CAL_PARAM_T_TOTAL_MAX               = PROTOCOL_PARAMETER_T_TOTAL_MAX,     /*!< Calibration parameter. */
+    BLE_CAL_PARAM_ALLOWED_ZEROS             = PROTOCOL_PARAMETER_ALLOWED_ZEROS    /*!< Calibration parameter. */
+} BLE_CAL_PARAM;
+
+
 /**
  * @brief   This enumeration contains the byte decoded messages values for incoming BLE messages.
  *
  * @enum    BLE_IN_MESSAGE
  */
 typedef enum BLE_IN_MESSAGE : unsigned char {
-    BLE_IN_MESSAGE_ALIVE                    = 0x00,             /*!< ACK for BLE_OUT_MESSAGE_NORMAL_OPERATION. */
-    BLE_IN_MESSAGE_BLINK_DETECTED           = 0x01,             /*!< Blink detected. */
-    BLE_IN_MESSAGE_CAL_DATA                 = 0x02,             /*!< Package identifier for incoming sensor data. */
-    BLE_IN_MESSAGE_PARAMETERS_SET           = 0x03,             /*!< ACK for all paramerters received. */
-    BLE_IN_MESSAGE_BATTERY_LEVEL            = 0x10,             /*!< The current battery level. */
-    BLE_IN_MESSAGE_DEBUG                    = 0x0F,             /*!< Sending debug data (0x0F <data length max 255> <data>). */
-    BLE_IN_MESSAGE_ERROR_EXCEPTION          = 0xEE,             /*!< Error / exeption occurred. */
-    BLE_IN_MESSAGE_RESET                    = 0xFF              /*!< Reset happend / always on connect --> send calibration data to RFDuino. */
+    BLE_IN_MESSAGE_ALIVE                    = PROTOCOL_OUT_ALIVE,                 /*!< ACK for BLE_OUT_MESSAGE_NORMAL_OPERATION. */
+    BLE_IN_MESSAGE_BLINK_DETECTED           = PROTOCOL_OUT_BLINK_DETECTED,        /*!< Blink detected (older firmware). */
+    BLE_IN_MESSAGE_CAL_DATA                 = PROTOCOL_OUT_CALIBRATION_DATA,      /*!< Package identifier for incoming sensor data. */
+    BLE_IN_MESSAGE_PARAMETERS_SET           = PROTOCOL_OUT_PARAMETERS_SET,        /*!< ACK for all paramerters received. */
+    BLE_IN_MESSAGE_CAL_FRAME                = PROTOCOL_OUT_CALIBRATION_FRAME,     /*!< Up to 4 calibration samples (0x04 <sequence> <blink mask> <floats>). */
+    BLE_IN_MESSAGE_CAL_COMPRESSED           = PROTOCOL_OUT_CALIBRATION_COMPRESSED,/*!< Up to 16 delta encoded calibration samples (see handleCompressedCalibrationFrame:). */
+    BLE_IN_MESSAGE_PROFILE_SET              = PROTOCOL_OUT_PROFILE_SET,           /*!< Answer to BLE_OUT_MESSAGE_SET_PROFILE (0x06 <transfer> <checksum> <status>). */
+    BLE_IN_MESSAGE_BLINK_EVENT              = PROTOCOL_OUT_BLINK_EVENT,           /*!< Blink detected (0x07 <sequence> <4 byte device time in ms>), repeated until acknowledged. */
+    BLE_IN_MESSAGE_JOURNAL                  = PROTOCOL_OUT_JOURNAL,               /*!< Samples and blinks recorded while disconnected (see handleJournalFrame:). */
+    BLE_IN_MESSAGE_BATTERY_LEVEL            = PROTOCOL_OUT_BATTERY_LEVEL,         /*!< The current battery level. */
+    BLE_IN_MESSAGE_TIMING                   = PROTOCOL_OUT_TIMING,                /*!< Sample timing statistics since the last request. */
+    BLE_IN_MESSAGE_DEBUG                    = PROTOCOL_OUT_DEBUG,                 /*!< Sending debug data (0x0F <data length max 255> <data>). */
+    BLE_IN_MESSAGE_ERROR_EXCEPTION          = PROTOCOL_OUT_ERROR_EXCEPTION,       /*!< Error / exeption occurred. */
+    BLE_IN_MESSAGE_RESET                    = PROTOCOL_OUT_RESET                  /*!< Reset happend / always on connect --> send calibration data to RFDuino. */
 } BLE_IN_MESSAGE;
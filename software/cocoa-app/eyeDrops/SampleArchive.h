@@ -0,0 +1,490 @@
+/**
+ * @file        SampleArchive.h
+ * @brief       Header file containing the archive file format for the recorded samples in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/01/26
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef SAMPLE_ARCHIVE_H
+#define SAMPLE_ARCHIVE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Append-only archive of recorded samples (calibration sessions of the app, captures of
+// tools/serialcapture), so no session is thrown away and days of samples can be sliced by time
+// without parsing. One file:
+//   0                      ArchiveHeader (ARCHIVE_HEADER_SIZE bytes)
+//   ARCHIVE_INDEX_OFFSET   chunk index: ARCHIVE_MAX_CHUNKS ArchiveChunkEntry of 32 bytes
+//   ARCHIVE_CHUNKS_OFFSET  chunks of ARCHIVE_CHUNK_SAMPLES samples, stored column by column:
+//                          time (int64 us since 1970), filtered value (float mm), raw count
+//                          (uint16, 0 if unknown), blink flag (uint8), detector state (uint8,
+//                          as in SerialFrame.h)
+// Every offset is fixed, chunk i starts at ARCHIVE_CHUNKS_OFFSET + i * ARCHIVE_CHUNK_SIZE. The
+// index and the unused parts of the chunks are never written, so the file stays sparse. A chunk
+// holds the samples of one session only; the times never decrease over the whole archive (the
+// writer clamps them), so a time range is found by a binary search in the index and one in the
+// time column of the chunk. All values are in host byte order (little endian on x86 and ARM).
+// The writer keeps the open chunk in memory and writes the new part of every column on
+// archiveFlush() or when the chunk is full, then the index entry, then the header. A reader
+// maps the file (archiveMap) and gets pointers into the columns (ArchiveSlice), nothing is
+// copied or decoded. With ARCHIVE_MAX_CHUNKS chunks an archive holds 6 days at 1 kHz.
+// Only POSIX calls (pwrite, mmap), no Foundation: BLEDeviceManager.m writes the archive,
+// tools/serialcapture writes it from a wired device and tools/archive reads it on any Unix.
+
+#define ARCHIVE_MAGIC               0x52414445  // "EDAR"
+#define ARCHIVE_VERSION             1
+#define ARCHIVE_CHUNK_SAMPLES       4096
+#define ARCHIVE_CHUNK_SIZE          (ARCHIVE_CHUNK_SAMPLES * 16)
+#define ARCHIVE_MAX_CHUNKS          131072
+#define ARCHIVE_HEADER_SIZE         4096
+#define ARCHIVE_INDEX_OFFSET        ARCHIVE_HEADER_SIZE
+#define ARCHIVE_CHUNKS_OFFSET       (ARCHIVE_INDEX_OFFSET + ARCHIVE_MAX_CHUNKS * 32)
+
+// Offsets of the columns in a chunk.
+#define ARCHIVE_TIME_COLUMN         0
+#define ARCHIVE_FILTERED_COLUMN     (ARCHIVE_CHUNK_SAMPLES * 8)
+#define ARCHIVE_RAW_COLUMN          (ARCHIVE_CHUNK_SAMPLES * 12)
+#define ARCHIVE_BLINK_COLUMN        (ARCHIVE_CHUNK_SAMPLES * 14)
+#define ARCHIVE_STATE_COLUMN        (ARCHIVE_CHUNK_SAMPLES * 15)
+
+// Bit of the detector state set with the blink flag (SERIAL_FRAME_STATE_BLINK of SerialFrame.h).
+#define ARCHIVE_STATE_BLINK         0x01
+
+/**
+ * The start of the file.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkSamples;                  // ARCHIVE_CHUNK_SAMPLES of the writer
+    uint32_t maxChunks;                     // ARCHIVE_MAX_CHUNKS of the writer
+    uint32_t chunkCount;                    // chunks with an index entry
+    uint32_t sessionCount;                  // sessions begun
+    int64_t created;                        // us since 1970
+} ArchiveHeader;
+
+/**
+ * One entry of the chunk index.
+ */
+typedef struct {
+    int64_t firstTime;                      // us since 1970
+    int64_t lastTime;
+    uint32_t count;                         // samples in the chunk
+    uint32_t session;                       // number of the session, counted from 0
+    uint32_t blinks;                        // samples with the blink flag
+    uint32_t reserved;
+} ArchiveChunkEntry;
+
+/**
+ * One chunk, exactly as it is stored.
+ */
+typedef struct {
+    int64_t time[ARCHIVE_CHUNK_SAMPLES];
+    float filtered[ARCHIVE_CHUNK_SAMPLES];
+    uint16_t raw[ARCHIVE_CHUNK_SAMPLES];
+    uint8_t blink[ARCHIVE_CHUNK_SAMPLES];
+    uint8_t state[ARCHIVE_CHUNK_SAMPLES];
+} ArchiveChunk;
+
+typedef char ArchiveEntrySizeCheck[sizeof(ArchiveChunkEntry) == 32 ? 1 : -1];
+typedef char ArchiveChunkSizeCheck[sizeof(ArchiveChunk) == ARCHIVE_CHUNK_SIZE ? 1 : -1];
+
+/**
+ * One sample to append.
+ */
+typedef struct {
+    int64_t time;                           // us since 1970
+    float filtered;                         // mm
+    uint16_t raw;                           // raw proximity count, 0 if unknown
+    uint8_t blink;
+    uint8_t state;                          // detector state, see SerialFrame.h
+} ArchiveSample;
+
+/**
+ * The writer. Holds the open chunk (64 KiB), so better not on a small stack.
+ */
+typedef struct {
+    int fd;
+    ArchiveHeader header;
+    bool sessionBegun;
+    uint32_t session;                       // number of the current session
+    bool chunkOpen;
+    uint32_t chunk;                         // number of the open (or next) chunk
+    uint32_t written;                       // samples of the open chunk already in the file
+    ArchiveChunkEntry entry;                // index entry of the open chunk
+    int64_t lastTime;                       // time of the last sample appended
+    ArchiveChunk buffer;                    // the open chunk
+} ArchiveWriter;
+
+/**
+ * A mapped archive.
+ */
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    const ArchiveHeader *header;
+    const ArchiveChunkEntry *index;
+    uint32_t chunkCount;                    // complete chunks in the mapping
+} ArchiveReader;
+
+/**
+ * The samples of one chunk within a time range, pointers into the mapping.
+ */
+typedef struct {
+    const int64_t *time;
+    const float *filtered;
+    const uint16_t *raw;
+    const uint8_t *blink;
+    const uint8_t *state;
+    uint32_t count;
+    uint32_t session;
+} ArchiveSlice;
+
+static inline off_t archiveChunkOffset(uint32_t chunk) {
+    return (off_t)ARCHIVE_CHUNKS_OFFSET + (off_t)chunk * ARCHIVE_CHUNK_SIZE;
+}
+
+static inline bool archiveWriteAt(int fd, const void *data, size_t length, off_t offset) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, bytes, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        length -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+static inline void archiveInit(ArchiveWriter *writer) {
+    memset(&writer->header, 0, sizeof(ArchiveHeader));
+    writer->fd = -1;
+    writer->sessionBegun = false;
+    writer->session = 0;
+    writer->chunkOpen = false;
+    writer->chunk = 0;
+    writer->written = 0;
+    writer->lastTime = INT64_MIN;
+}
+
+static inline bool archiveIsOpen(const ArchiveWriter *writer) {
+    return writer->fd >= 0;
+}
+
+/**
+ * Opens the archive at path for appending, creates it if it does not exist (created: us since
+ * 1970). Returns false if the file cannot be opened or is no archive of this format.
+ */
+static inline bool archiveOpen(ArchiveWriter *writer, const char *path, int64_t created) {
+    ArchiveChunkEntry last;
+
+    archiveInit(writer);
+    writer->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (writer->fd < 0) {
+        return false;
+    }
+    ssize_t n = pread(writer->fd, &writer->header, sizeof(ArchiveHeader), 0);
+    if (n == 0) {
+        writer->header.magic = ARCHIVE_MAGIC;
+        writer->header.version = ARCHIVE_VERSION;
+        writer->header.chunkSamples = ARCHIVE_CHUNK_SAMPLES;
+        writer->header.maxChunks = ARCHIVE_MAX_CHUNKS;
+        writer->header.created = created;
+        if (archiveWriteAt(writer->fd, &writer->header, sizeof(ArchiveHeader), 0)) {
+            return true;
+        }
+    } else if (n == (ssize_t)sizeof(ArchiveHeader) && writer->header.magic == ARCHIVE_MAGIC &&
+               writer->header.version == ARCHIVE_VERSION &&
+               writer->header.chunkSamples == ARCHIVE_CHUNK_SAMPLES &&
+               writer->header.maxChunks == ARCHIVE_MAX_CHUNKS) {
+        // Continue behind the last chunk, a session never continues a chunk of an earlier one.
+        writer->chunk = writer->header.chunkCount;
+        if (writer->chunk == 0) {
+            return true;
+        }
+        off_t offset = ARCHIVE_INDEX_OFFSET + (off_t)(writer->chunk - 1) * sizeof(ArchiveChunkEntry);
+        if (pread(writer->fd, &last, sizeof(last), offset) == (ssize_t)sizeof(last)) {
+            writer->lastTime = last.lastTime;
+            return true;
+        }
+    }
+    close(writer->fd);
+    writer->fd = -1;
+    return false;
+}
+
+/**
+ * Writes the samples of the open chunk which are not in the file yet, its index entry and the
+ * header. Returns false on a write error.
+ */
+static inline bool archiveFlush(ArchiveWriter *writer) {
+    if (writer->fd < 0) {
+        return false;
+    }
+    if (writer->chunkOpen && writer->written < writer->entry.count) {
+        const ArchiveChunk *chunk = &writer->buffer;
+        off_t offset = archiveChunkOffset(writer->chunk);
+        uint32_t from = writer->written;
+        uint32_t count = writer->entry.count - from;
+        bool ok;
+
+        if (from == 0 && count == ARCHIVE_CHUNK_SAMPLES) {
+            // A chunk filled in one go is written at once.
+            ok = archiveWriteAt(writer->fd, chunk, sizeof(ArchiveChunk), offset);
+        } else {
+            ok = archiveWriteAt(writer->fd, chunk->time + from, count * sizeof(int64_t),
+                                offset + ARCHIVE_TIME_COLUMN + from * sizeof(int64_t)) &&
+                 archiveWriteAt(writer->fd, chunk->filtered + from, count * sizeof(float),
+                                offset + ARCHIVE_FILTERED_COLUMN + from * sizeof(float)) &&
+                 archiveWriteAt(writer->fd, chunk->raw + from, count * sizeof(uint16_t),
+                                offset + ARCHIVE_RAW_COLUMN + from * sizeof(uint16_t)) &&
+                 archiveWriteAt(writer->fd, chunk->blink + from, count, offset + ARCHIVE_BLINK_COLUMN + from) &&
+                 archiveWriteAt(writer->fd, chunk->state + from, count, offset + ARCHIVE_STATE_COLUMN + from);
+        }
+        if (!ok || !archiveWriteAt(writer->fd, &writer->entry, sizeof(ArchiveChunkEntry),
+                                   ARCHIVE_INDEX_OFFSET + (off_t)writer->chunk * sizeof(ArchiveChunkEntry))) {
+            return false;
+        }
+        writer->written = writer->entry.count;
+        if (writer->header.chunkCount < writer->chunk + 1) {
+            writer->header.chunkCount = writer->chunk + 1;
+        }
+    }
+    if (writer->chunkOpen && writer->entry.count == ARCHIVE_CHUNK_SAMPLES) {
+        writer->chunkOpen = false;
+        writer->chunk++;
+    }
+    return archiveWriteAt(writer->fd, &writer->header, sizeof(ArchiveHeader), 0);
+}
+
+/**
+ * Begins a new session: the samples appended from now on go to a new chunk.
+ */
+static inline bool archiveBeginSession(ArchiveWriter *writer) {
+    bool ok = true;
+    if (writer->chunkOpen) {
+        ok = archiveFlush(writer);
+        if (writer->chunkOpen) {
+            writer->chunkOpen = false;
+            writer->chunk++;
+        }
+    }
+    writer->session = writer->header.sessionCount++;
+    writer->sessionBegun = true;
+    return ok;
+}
+
+/**
+ * Appends one sample, begins a session if none was begun. A time before the time of the last
+ * sample is replaced by that time. Returns false if the archive is full or a full chunk could not
+ * be written.
+ */
+static inline bool archiveAppend(ArchiveWriter *writer, const ArchiveSample *sample) {
+    ArchiveChunk *chunk = &writer->buffer;
+    int64_t time = sample->time > writer->lastTime ? sample->time : writer->lastTime;
+    uint32_t i;
+
+    if (writer->fd < 0) {
+        return false;
+    }
+    if (!writer->sessionBegun) {
+        archiveBeginSession(writer);
+    }
+    if (writer->chunkOpen && writer->entry.count == ARCHIVE_CHUNK_SAMPLES && !archiveFlush(writer)) {
+        // The full chunk could not be written before, it still cannot.
+        return false;
+    }
+    if (!writer->chunkOpen) {
+        if (writer->chunk >= ARCHIVE_MAX_CHUNKS) {
+            return false;
+        }
+        memset(&writer->entry, 0, sizeof(ArchiveChunkEntry));
+        writer->entry.firstTime = time;
+        writer->entry.session = writer->session;
+        writer->written = 0;
+        writer->chunkOpen = true;
+    }
+    i = writer->entry.count++;
+    chunk->time[i] = time;
+    chunk->filtered[i] = sample->filtered;
+    chunk->raw[i] = sample->raw;
+    chunk->blink[i] = sample->blink;
+    chunk->state[i] = sample->state;
+    writer->entry.lastTime = time;
+    writer->entry.blinks += sample->blink != 0;
+    writer->lastTime = time;
+    if (writer->entry.count == ARCHIVE_CHUNK_SAMPLES) {
+        return archiveFlush(writer);
+    }
+    return true;
+}
+
+/**
+ * Flushes and closes the archive.
+ */
+static inline bool archiveClose(ArchiveWriter *writer) {
+    bool ok = archiveFlush(writer);
+    if (writer->fd >= 0) {
+        ok = close(writer->fd) == 0 && ok;
+    }
+    archiveInit(writer);
+    return ok;
+}
+
+/**
+ * Maps the archive at path read only. Chunks which are not completely in the file (a writer
+ * which has not flushed yet) are left out. Returns false if the file is no archive.
+ */
+static inline bool archiveMap(ArchiveReader *reader, const char *path) {
+    struct stat status;
+    void *base;
+    int fd = open(path, O_RDONLY);
+
+    memset(reader, 0, sizeof(ArchiveReader));
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &status) != 0 || status.st_size < ARCHIVE_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    base = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    reader->base = (const uint8_t *)base;
+    reader->size = (size_t)status.st_size;
+    reader->header = (const ArchiveHeader *)base;
+    reader->index = (const ArchiveChunkEntry *)(reader->base + ARCHIVE_INDEX_OFFSET);
+    if (reader->header->magic != ARCHIVE_MAGIC || reader->header->version != ARCHIVE_VERSION ||
+        reader->header->chunkSamples != ARCHIVE_CHUNK_SAMPLES ||
+        reader->header->maxChunks != ARCHIVE_MAX_CHUNKS) {
+        munmap(base, reader->size);
+        memset(reader, 0, sizeof(ArchiveReader));
+        return false;
+    }
+    // The count of the header is not trusted: no more chunks than the index holds, no index
+    // entries beyond the end of the file.
+    reader->chunkCount = reader->header->chunkCount;
+    if (reader->chunkCount > ARCHIVE_MAX_CHUNKS) {
+        reader->chunkCount = ARCHIVE_MAX_CHUNKS;
+    }
+    if ((uint64_t)ARCHIVE_INDEX_OFFSET + (uint64_t)reader->chunkCount * sizeof(ArchiveChunkEntry) > reader->size) {
+        reader->chunkCount = (uint32_t)((reader->size - ARCHIVE_INDEX_OFFSET) / sizeof(ArchiveChunkEntry));
+    }
+    // The state column is written last, its end shows that the whole chunk is in the file.
+    while (reader->chunkCount > 0 &&
+           (uint64_t)archiveChunkOffset(reader->chunkCount - 1) + ARCHIVE_STATE_COLUMN +
+               reader->index[reader->chunkCount - 1].count > reader->size) {
+        reader->chunkCount--;
+    }
+    return true;
+}
+
+static inline void archiveUnmap(ArchiveReader *reader) {
+    if (reader->base) {
+        munmap((void *)reader->base, reader->size);
+    }
+    memset(reader, 0, sizeof(ArchiveReader));
+}
+
+static inline const ArchiveChunk *archiveChunk(const ArchiveReader *reader, uint32_t chunk) {
+    return (const ArchiveChunk *)(reader->base + archiveChunkOffset(chunk));
+}
+
+/**
+ * Returns the first chunk with samples at or after time, chunkCount if there is none.
+ */
+static inline uint32_t archiveFindChunk(const ArchiveReader *reader, int64_t time) {
+    uint32_t low = 0;
+    uint32_t high = reader->chunkCount;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (reader->index[middle].lastTime < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Returns the first of count times at or after time.
+ */
+static inline uint32_t archiveLowerBound(const int64_t *times, uint32_t count, int64_t time) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (times[middle] < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Fills slice with the samples of chunk with from <= time < to. A time range is read with
+ *   for (c = archiveFindChunk(reader, from); c < reader->chunkCount && reader->index[c].firstTime < to; c++)
+ *       archiveSlice(reader, c, from, to, &slice);
+ */
+static inline void archiveSlice(const ArchiveReader *reader, uint32_t chunk, int64_t from, int64_t to,
+                                ArchiveSlice *slice) {
+    const ArchiveChunk *data = archiveChunk(reader, chunk);
+    uint32_t count = reader->index[chunk].count;
+    uint32_t first = archiveLowerBound(data->time, count, from);
+    uint32_t end = archiveLowerBound(data->time, count, to);
+
+    slice->time = data->time + first;
+    slice->filtered = data->filtered + first;
+    slice->raw = data->raw + first;
+    slice->blink = data->blink + first;
+    slice->state = data->state + first;
+    slice->count = end > first ? end - first : 0;
+    slice->session = reader->index[chunk].session;
+}
+
+#endif
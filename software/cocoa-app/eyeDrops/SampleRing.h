@@ -0,0 +1,165 @@
+/**
+ * @file        SampleRing.h
+ * @brief       Header file containing the ring buffer for the calibration samples in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/01/24
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Single producer, multiple consumer ring for the calibration samples. The receive callback of the
+// BLEDeviceManager writes every sample once, the consumers (plots, recorder, analytics) read with
+// a RingCursor of their own and copy into buffers they own, so nothing is allocated per sample and
+// the producer never waits for a consumer.
+// The producer does not know the consumers: it overwrites the oldest samples when the ring is
+// full. A consumer which falls more than SAMPLE_RING_SIZE - 1 samples behind skips the overwritten
+// samples and counts them in its cursor (overruns); the slot after the newest sample may be being
+// written. Since a slot can be overwritten while a consumer copies it, ringRead() loads the write
+// position again after the copy and drops the samples which were overwritten in the meantime
+// (like a seqlock). The producer orders the write position of the previous sample before the
+// slot (release fence), so a consumer which copied a new value also sees the position.
+// The position is a free running 32 bit counter, so differences stay correct when it wraps.
+// The ring is a member of BLEDeviceManager, whose header is imported by six Objective-C (.m)
+// files of the app, so it is written in C with the __atomic builtins of clang and gcc instead of
+// std::atomic. tools/ringbench compiles the same header as C++ and hammers it from threads.
+
+#define SAMPLE_RING_SIZE        4096    // samples, power of two (4 s at 1 kHz)
+
+/**
+ * One calibration sample. 8 bytes, so a slot is written with one atomic store.
+ */
+typedef struct {
+    float value;                            // filtered sensor value
+    uint8_t blink;                          // 1 if the RFDuino detected a blink with this sample
+    uint8_t reserved;
+    uint16_t lostBefore;                    // samples lost right before this one (see DeviceSession.h)
+} RingSample;
+
+/**
+ * The ring. The write position has a cache line of its own, the producer does not share a line
+ * with the slots the consumers are reading.
+ */
+typedef struct {
+    uint32_t head;                          // number of samples written
+    char padding[64 - sizeof(uint32_t)];
+    RingSample slots[SAMPLE_RING_SIZE];
+} SampleRing;
+
+/**
+ * The read position of one consumer. Only touched by its consumer.
+ */
+typedef struct {
+    uint32_t position;                      // number of the next sample to read
+    uint32_t overruns;                      // samples overwritten before they were read
+} RingCursor;
+
+static inline void ringInit(SampleRing *ring) {
+    memset(ring, 0, sizeof(SampleRing));
+}
+
+/**
+ * Appends one sample. lostBefore is saturated at 0xFFFF. Producer only.
+ */
+static inline void ringWrite(SampleRing *ring, float value, bool blink, uint32_t lostBefore) {
+    RingSample sample;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    sample.value = value;
+    sample.blink = blink ? 1 : 0;
+    sample.reserved = 0;
+    sample.lostBefore = lostBefore < 0xFFFF ? (uint16_t)lostBefore : 0xFFFF;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store(&ring->slots[head & (SAMPLE_RING_SIZE - 1)], &sample, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the number of samples written so far (modulo 2^32).
+ */
+static inline uint32_t ringHead(const SampleRing *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Places the cursor at the current end of the ring: it reads the samples written from now on.
+ */
+static inline void ringAttach(const SampleRing *ring, RingCursor *cursor) {
+    cursor->position = ringHead(ring);
+    cursor->overruns = 0;
+}
+
+/**
+ * Returns the number of samples the cursor has not read yet (at most SAMPLE_RING_SIZE - 1 are
+ * still in the ring).
+ */
+static inline uint32_t ringAvailable(const SampleRing *ring, const RingCursor *cursor) {
+    return ringHead(ring) - cursor->position;
+}
+
+/**
+ * Copies up to max unread samples into samples and advances the cursor. Returns the number of
+ * samples copied; 0 if there are none. Samples overwritten before they could be copied are
+ * skipped and added to cursor->overruns.
+ */
+static inline uint32_t ringRead(const SampleRing *ring, RingCursor *cursor, RingSample *samples, uint32_t max) {
+    uint32_t head = ringHead(ring);
+    uint32_t available = head - cursor->position;
+    uint32_t count, stale, i;
+
+    if (available > SAMPLE_RING_SIZE - 1) {
+        cursor->overruns += available - (SAMPLE_RING_SIZE - 1);
+        cursor->position = head - (SAMPLE_RING_SIZE - 1);
+        available = SAMPLE_RING_SIZE - 1;
+    }
+    count = available < max ? available : max;
+    for (i = 0; i < count; i++) {
+        __atomic_load(&ring->slots[(cursor->position + i) & (SAMPLE_RING_SIZE - 1)], &samples[i], __ATOMIC_RELAXED);
+    }
+
+    // Samples older than head - SAMPLE_RING_SIZE + 1 may have been overwritten during the copy.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    stale = head - cursor->position;
+    stale = stale > SAMPLE_RING_SIZE - 1 ? stale - (SAMPLE_RING_SIZE - 1) : 0;
+    if (stale > count) {
+        stale = count;
+    }
+    if (stale > 0) {
+        memmove(samples, samples + stale, (count - stale) * sizeof(RingSample));
+        cursor->overruns += stale;
+    }
+    cursor->position += count;
+    return count - stale;
+}
+
+#endif
@@ -31,6 +31,9 @@
 #import <Cocoa/Cocoa.h>
 #import <CorePlot/CorePlot.h>
 
+#import "ThresholdEstimator.h"
+#import "TimingEstimator.h"
+
 /**
  * @brief       Sensor data view controller class class.
  *
@@ -123,12 +126,45 @@
 // - (NSUInteger)numberOfRecordsForPlot:(nonnull CPTPlot *)plot;
 
 /**
- * This method handles incoming calibraion data.
+ * This method reads the calibration data which came in since the last call from the calibration
+ * ring of the BLE device manager. Invoked by the data timer and before the data is shown.
  *
- * @param sender
- *      The sending instance.
+ * @param timer
+ *      The data timer, nil if invoked directly.
+ */
+- (void)readCalibrationData:(nullable NSTimer *)timer;
+
+/**
+ * This method proposes the negative and positive threshold, the hysteresis and the min and max
+ * value from the calibration data which came in since the last reset (see ThresholdEstimator.h).
+ *
+ * @param   estimate
+ *      The proposed parameters in mm (not scaled).
+ * @return  YES if there were enough blinks for an estimate, NO otherwise.
+ */
+- (BOOL)estimateThresholds:(nonnull ThresholdEstimate *)estimate;
+
+/**
+ * This method proposes the windows of the fall, rise and total time and the eye closed time from
+ * the blinks at the prompts of the calibration (see TimingEstimator.h). Lobes have to cross the
+ * threshold lines, if they are set.
+ *
+ * @param   estimate
+ *      The proposed windows in samples and the segmented blinks.
+ * @param   promptTimes
+ *      The times of the prompts in seconds after the start of the calibration (NSNumber).
+ * @return  YES if enough prompted blinks were found, NO otherwise.
+ */
+- (BOOL)estimateTimings:(nonnull TimingEstimate *)estimate promptTimes:(nonnull NSArray<NSNumber *> *)promptTimes;
+
+/**
+ * This method creates or moves the negative or positive threshold line (depending on the sign of
+ * the value) and passes the threshold on to the window controller.
+ *
+ * @param   value
+ *      The threshold as shown in the plot (scaled).
  */
-- (void)incomingCalibrationData:(nonnull id)sender;
+- (void)createThresholdLineFromValue:(float)value;
 
 /**
  * This method resets the graph.
@@ -30,22 +30,50 @@
 
 #import "SensorDataViewController.h"
 #import "CalibrationWindowController.h"
+#import "BLEDeviceManager.h"
+#import "PlotDownsampler.h"
+#import "ThresholdEstimator.h"
+#import "TimingEstimator.h"
 
 #define SCALING_FACTOR  10
 #define MAX_X           8
 #define X_PADDING       100
 #define Y_PADDING       148
 
+#define READ_INTERVAL   0.1     // seconds between two reads of the calibration ring
+#define READ_SAMPLES    256     // samples copied from the ring at once
+
 static NSString *const kPlotIdentifier  = @"RealTimePlot";
 static NSString *const kHLIdentifier    = @"Horizontal Line";
 
 static NSString *const kNegativeTresholdLine = @"Negative Threshold Line";
 static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
 
-@interface SensorDataViewController ()
+@interface SensorDataViewController () {
+    
+    /**
+     * The read position in the calibration ring.
+     */
+    RingCursor calibrationCursor;
+    
+    /**
+     * Min and max of the samples in plotDataY, kept up to date while they come in.
+     */
+    MinMaxPyramid plotPyramid;
+    
+    /**
+     * The number of samples the plotted points were computed from.
+     */
+    NSUInteger shownSamples;
+    
+    /**
+     * Proposes the thresholds from the samples which came in so far.
+     */
+    ThresholdEstimator thresholdEstimator;
+}
 
-@property NSMutableArray *plotDataX;
-@property NSMutableArray *plotDataY;
+@property NSMutableData *plotPoints;
+@property NSMutableData *plotDataY;
 
 @property (nonatomic, readwrite, assign) NSUInteger currentIndex;
 @property (nonatomic, readwrite, strong, nullable) NSTimer *dataTimer;
@@ -61,7 +89,7 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
 @synthesize hostingView;
 @synthesize currentIndex;
 @synthesize dataTimer;
-@synthesize plotDataX;
+@synthesize plotPoints;
 @synthesize plotDataY;
 
 /*
@@ -70,11 +98,21 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
 - (void)viewDidLoad {
     
     // Init the plot data arrays.
-    plotDataY = [[NSMutableArray alloc] init];
-    plotDataX = [[NSMutableArray alloc] init];
+    plotDataY = [[NSMutableData alloc] init];
+    plotPoints = [[NSMutableData alloc] init];
+    pyramidInit(&plotPyramid);
+    shownSamples = 0;
+    estimatorInit(&thresholdEstimator);
+    
+    // Read the calibration data from the ring of the device manager, starting with the next sample.
+    ringAttach([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor);
+    dataTimer = [NSTimer scheduledTimerWithTimeInterval:READ_INTERVAL
+                                                 target:self
+                                               selector:@selector(readCalibrationData:)
+                                               userInfo:nil
+                                                repeats:YES];
     
     // Add observers for notifications.
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(incomingCalibrationData:) name:@"EDNotifictaionCalibrationData" object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(showData:) name:@"EDNotificationStopCalibration" object:nil];
     
     // Init index.
@@ -87,14 +125,27 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
     positiveThresholdLine = nil;
 }
 
+/*
+ * Free the pyramid.
+ */
+- (void)dealloc {
+    pyramidFree(&plotPyramid);
+}
+
 /*
  * Reset the graph.
  */
 - (void)resetGraph {
     
     // Delete all data.
-    [plotDataX removeAllObjects];
-    [plotDataY removeAllObjects];
+    [plotPoints setLength:0];
+    [plotDataY setLength:0];
+    pyramidReset(&plotPyramid);
+    shownSamples = 0;
+    estimatorInit(&thresholdEstimator);
+    
+    // Skip the samples which are still in the ring.
+    ringAttach([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor);
     
     // Reset index.
     self.currentIndex = 0;
@@ -267,23 +318,68 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
 }
 
 /*
- * Handler for incoming calibraiton data.
+ * Read the calibration data which came in since the last call.
+ */
+- (void)readCalibrationData:(nullable NSTimer *)timer {
+    
+    RingSample samples[READ_SAMPLES];
+    uint32_t count;
+    
+    while ((count = ringRead([[BLEDeviceManager sharedInstance] calibrationRing], &calibrationCursor, samples, READ_SAMPLES)) > 0) {
+        
+        // Add the scaled sensor data to the plot.
+        if (sensorDataPlot) {
+            for (uint32_t i = 0; i < count; i++) {
+                float sensorData = samples[i].value * SCALING_FACTOR;
+                
+                // Hold the last value over the samples of lost frames, so the indices stay in step
+                // with the times of the prompts (see TimingEstimator.h). The estimator skips them.
+                if (samples[i].lostBefore > 0) {
+                    float held = self.currentIndex > 0 ? ((const float *)self.plotDataY.bytes)[self.currentIndex - 1] : sensorData;
+                    for (uint16_t j = 0; j < samples[i].lostBefore; j++) {
+                        [self.plotDataY appendBytes:&held length:sizeof(float)];
+                        pyramidAppend(&plotPyramid, held);
+                    }
+                    self.currentIndex += samples[i].lostBefore;
+                }
+                [self.plotDataY appendBytes:&sensorData length:sizeof(float)];
+                pyramidAppend(&plotPyramid, sensorData);
+                estimatorAdd(&thresholdEstimator, samples[i].value);
+                self.currentIndex++;
+            }
+        }
+    }
+}
+
+/*
+ * Estimate the amplitude parameters from the calibration data.
  */
-- (void)incomingCalibrationData:(nonnull id)sender {
+- (BOOL)estimateThresholds:(nonnull ThresholdEstimate *)estimate {
     
-    // Extract the sensor data (float)
-    NSData *data = [[(NSNotification *)sender object] subdataWithRange:NSMakeRange(0, 4)];
-    float sensorData;
-    [data getBytes:&sensorData length:sizeof(float)];
+    // Take the samples which are still in the ring.
+    [self readCalibrationData:nil];
     
-    // Scale the incoming data.
-    sensorData = sensorData * SCALING_FACTOR;
+    return estimatorEstimate(&thresholdEstimator, estimate);
+}
+
+/*
+ * Estimate the time windows from the prompted blinks.
+ */
+- (BOOL)estimateTimings:(nonnull TimingEstimate *)estimate promptTimes:(nonnull NSArray<NSNumber *> *)promptTimes {
+    
+    uint32_t prompts[TIMING_MAX_PROMPTS];
+    uint32_t count = (uint32_t)MIN([promptTimes count], TIMING_MAX_PROMPTS);
+    
+    // Take the samples which are still in the ring.
+    [self readCalibrationData:nil];
     
-    // Add the data to the plot
-    if (sensorDataPlot) {
-        self.currentIndex++;
-        [self.plotDataY addObject:[NSNumber numberWithFloat:sensorData]];
+    // The first sample came in when the calibration was started.
+    for (uint32_t i = 0; i < count; i++) {
+        prompts[i] = timingSample([[promptTimes objectAtIndex:i] doubleValue]);
     }
+    
+    // The samples and the threshold lines are both scaled.
+    return timingEstimate(self.plotDataY.bytes, (uint32_t)(self.plotDataY.length / sizeof(float)), prompts, count, negativeThresholdValue, positiveThresholdValue, estimate);
 }
 
 /*
@@ -291,11 +387,18 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
  */
 - (void)showData:(nonnull id)sender {
     
-    // Scale x values.
-    for (int i=0; i<self.currentIndex; i++) {
-        float xValue = (float)(plotMaxTime / (float)self.currentIndex) * (float)i;
-        [self.plotDataX addObject:[NSNumber numberWithFloat:xValue]];
-    }
+    // Take the samples which are still in the ring.
+    [self readCalibrationData:nil];
+    
+    // Reduce the samples to two points per pixel of the plot (see PlotDownsampler.h), the x values
+    // follow from the sample index.
+    uint32_t points = 2 * (uint32_t)MAX(hostingView.bounds.size.width, 2);
+    NSMutableData *scratch = [NSMutableData dataWithLength:4 * points * sizeof(PlotPoint)];
+    [self.plotPoints setLength:points * sizeof(PlotPoint)];
+    uint32_t count = downsample(&plotPyramid, (const float *)self.plotDataY.bytes, 0, self.currentIndex, points,
+                                (PlotPoint *)scratch.mutableBytes, (PlotPoint *)self.plotPoints.mutableBytes);
+    [self.plotPoints setLength:count * sizeof(PlotPoint)];
+    shownSamples = self.currentIndex;
     
     // Add the plot to the graph.
     [graph addPlot:sensorDataPlot];
@@ -311,7 +414,7 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
 - (NSUInteger)numberOfRecordsForPlot:(nonnull CPTPlot *)plot {
     
     if (plot.identifier == kPlotIdentifier) {
-        return plotDataY.count;
+        return plotPoints.length / sizeof(PlotPoint);
     }
     
     if (plot.identifier == kNegativeTresholdLine) {
@@ -334,8 +437,9 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
         case CPTScatterPlotFieldX:
             
             if (plot.identifier == kPlotIdentifier) {
-                // Return the saved xValue from plotDataX
-                num = [self.plotDataX objectAtIndex:index];
+                // Time of the sample the point stands for.
+                const PlotPoint *point = (const PlotPoint *)self.plotPoints.bytes + index;
+                num = [NSNumber numberWithFloat:(float)(plotMaxTime / (float)shownSamples) * (float)point->index];
                 break;
             }
             
@@ -356,7 +460,7 @@ static NSString *const kPositiveTresholdLine = @"Positive Threshold Line";
         case CPTScatterPlotFieldY:
             
             if (plot.identifier == kPlotIdentifier) {
-                num = [self.plotDataY objectAtIndex:index];
+                num = [NSNumber numberWithFloat:((const PlotPoint *)self.plotPoints.bytes)[index].value];
                 break;
             }
             
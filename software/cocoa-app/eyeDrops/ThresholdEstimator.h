@@ -0,0 +1,269 @@
+/**
+ * @file        ThresholdEstimator.h
+ * @brief       Header file containing the streaming estimation of the calibration thresholds in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/01/30
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef THRESHOLD_ESTIMATOR_H
+#define THRESHOLD_ESTIMATOR_H
+
+#include <stdint.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Proposes the amplitude parameters of a blink profile (negative and positive threshold,
+// hysteresis, min and max value) from the filtered calibration samples, in one pass while they
+// come in.
+// Every sample goes into a histogram of the values. The noise floor is taken from it robustly:
+// the median, and sigma from the quantiles around the median (the blinks are in the tails, so
+// they hardly move these quantiles). Every excursion of more than ESTIMATOR_GATE sigma from
+// the median is followed to its extreme value, which goes into the histogram of the positive or
+// negative peaks. estimatorEstimate() takes the peaks of more than ESTIMATOR_PEAK_SIGMAS sigma as
+// blinks: the thresholds are placed at a fraction of their median height, min and max value
+// leave room above the highest of them.
+// The histograms are Fenwick trees, so adding a sample and estimating are O(log ESTIMATOR_BINS)
+// and the estimate can be repeated after every sample. No memory is allocated.
+// The bins are fixed: ESTIMATOR_RANGE is several times the blink peaks of the recorded sessions
+// (0.005 to 0.015 mm) and the bins (31 nm) are still much finer than the noise. Values beyond the range count in the
+// outermost bins. Widening the range with the data would let a single outlier (the first
+// samples after a reset reach 0.5 mm) coarsen the bins for the whole calibration, so a
+// saturated estimate fails instead: if the median or the highest blink peaks are in the
+// outermost bins, estimatorEstimate() sets saturated and returns false.
+// All values in mm like the samples of the SampleRing (the plots show them scaled).
+// ThresholdEstimate is returned by -estimateThresholds: of SensorDataViewController.h, which
+// CalibrationWindowController.m imports, so the types are C structs; tools/thresholdbench
+// replays recordings through the same functions.
+
+#define ESTIMATOR_BINS              4096    // bins per histogram, power of two
+#define ESTIMATOR_RANGE             0.064f  // mm, the histograms cover -RANGE..RANGE
+#define ESTIMATOR_WARMUP            100     // samples before excursions are followed
+#define ESTIMATOR_NOISE_QUANTILE    0.125f  // sigma from the quantiles median +- this
+#define ESTIMATOR_NOISE_Z           0.3186f // these quantiles of a normal distribution in sigma
+#define ESTIMATOR_GATE              4.0f    // sigma, an excursion starts this far from the median
+#define ESTIMATOR_PEAK_SIGMAS       6.0f    // sigma, smaller peaks are noise
+#define ESTIMATOR_MIN_PEAKS         3       // blink peaks needed on each side for an estimate
+#define ESTIMATOR_THRESHOLD         0.5f    // threshold at this fraction of the median blink peak
+#define ESTIMATOR_HYSTERESIS        0.25f   // sigma
+#define ESTIMATOR_MAX_HYSTERESIS    0.25f   // at most this fraction of the threshold distance
+#define ESTIMATOR_EXTREME_QUANTILE  0.9f    // quantile of the blink peaks taken as highest
+#define ESTIMATOR_EXTREME_MARGIN    1.5f    // min and max value at this factor of the highest peak
+
+/**
+ * Histogram as Fenwick tree: counts[i - 1] holds the number of values in the bins
+ * i - (i & -i) .. i - 1.
+ */
+typedef struct {
+    uint32_t counts[ESTIMATOR_BINS];
+    uint32_t total;
+} EstimatorHistogram;
+
+typedef struct {
+    EstimatorHistogram values;
+    EstimatorHistogram positivePeaks;
+    EstimatorHistogram negativePeaks;
+    float median;                           // of the values, updated with every sample
+    float sigma;
+    float peak;                             // extreme value of the current excursion
+    int8_t excursion;                       // 1 above, -1 below the gate, 0 within
+} ThresholdEstimator;
+
+/**
+ * The proposed parameters, in mm (createProfile: divides the scaled values of the window by
+ * SCALING_FACTOR to get these).
+ */
+typedef struct {
+    float negativeThreshold;
+    float positiveThreshold;
+    float hysteresis;
+    float minValue;
+    float maxValue;
+    float median;                           // noise floor
+    float sigma;
+    uint32_t negativePeaks;                 // peaks taken as blinks
+    uint32_t positivePeaks;
+    uint32_t saturatedPeaks;                // blink peaks beyond ESTIMATOR_RANGE
+    bool saturated;                         // no estimate, the blinks exceed ESTIMATOR_RANGE
+} ThresholdEstimate;
+
+static inline void estimatorInit(ThresholdEstimator *estimator) {
+    memset(estimator, 0, sizeof(ThresholdEstimator));
+}
+
+static inline int estimatorBin(float value) {
+    int bin = (int)((value + ESTIMATOR_RANGE) * (ESTIMATOR_BINS / (2 * ESTIMATOR_RANGE)));
+    return bin < 0 ? 0 : (bin >= ESTIMATOR_BINS ? ESTIMATOR_BINS - 1 : bin);
+}
+
+/**
+ * Returns the center of a bin.
+ */
+static inline float estimatorBinValue(int bin) {
+    return (bin + 0.5f) * (2 * ESTIMATOR_RANGE / ESTIMATOR_BINS) - ESTIMATOR_RANGE;
+}
+
+static inline void histogramAdd(EstimatorHistogram *histogram, int bin) {
+    uint32_t i;
+    for (i = bin + 1; i <= ESTIMATOR_BINS; i += i & -i) {
+        histogram->counts[i - 1]++;
+    }
+    histogram->total++;
+}
+
+/**
+ * Returns the number of values in the bins below bin.
+ */
+static inline uint32_t histogramBelow(const EstimatorHistogram *histogram, int bin) {
+    uint32_t count = 0;
+    uint32_t i;
+    for (i = bin; i > 0; i -= i & -i) {
+        count += histogram->counts[i - 1];
+    }
+    return count;
+}
+
+/**
+ * Returns the bin of the value with the given rank (0 is the smallest value).
+ */
+static inline int histogramFind(const EstimatorHistogram *histogram, uint32_t rank) {
+    uint32_t position = 0;
+    uint32_t step;
+    for (step = ESTIMATOR_BINS; step > 0; step >>= 1) {
+        if (position + step <= ESTIMATOR_BINS && histogram->counts[position + step - 1] <= rank) {
+            position += step;
+            rank -= histogram->counts[position - 1];
+        }
+    }
+    return position < ESTIMATOR_BINS ? (int)position : ESTIMATOR_BINS - 1;
+}
+
+/**
+ * Returns the value at quantile q of the count values from rank first on.
+ */
+static inline float histogramQuantile(const EstimatorHistogram *histogram, uint32_t first, uint32_t count, float q) {
+    return estimatorBinValue(histogramFind(histogram, first + (uint32_t)(q * (count - 1) + 0.5f)));
+}
+
+/**
+ * Adds one filtered sample.
+ */
+static inline void estimatorAdd(ThresholdEstimator *estimator, float value) {
+    const EstimatorHistogram *values = &estimator->values;
+    float low, high, gate;
+
+    histogramAdd(&estimator->values, estimatorBin(value));
+    if (values->total < ESTIMATOR_WARMUP) {
+        return;
+    }
+
+    // Noise floor, at least one bin wide.
+    estimator->median = histogramQuantile(values, 0, values->total, 0.5f);
+    low = histogramQuantile(values, 0, values->total, 0.5f - ESTIMATOR_NOISE_QUANTILE);
+    high = histogramQuantile(values, 0, values->total, 0.5f + ESTIMATOR_NOISE_QUANTILE);
+    estimator->sigma = (high - low) / (2 * ESTIMATOR_NOISE_Z);
+    if (estimator->sigma < 2 * ESTIMATOR_RANGE / ESTIMATOR_BINS) {
+        estimator->sigma = 2 * ESTIMATOR_RANGE / ESTIMATOR_BINS;
+    }
+    gate = ESTIMATOR_GATE * estimator->sigma;
+
+    // Follow the current excursion to its extreme value, it ends within half the gate.
+    if (estimator->excursion > 0) {
+        if (value > estimator->peak) {
+            estimator->peak = value;
+        }
+        if (value < estimator->median + gate / 2) {
+            histogramAdd(&estimator->positivePeaks, estimatorBin(estimator->peak));
+            estimator->excursion = 0;
+        }
+    } else if (estimator->excursion < 0) {
+        if (value < estimator->peak) {
+            estimator->peak = value;
+        }
+        if (value > estimator->median - gate / 2) {
+            histogramAdd(&estimator->negativePeaks, estimatorBin(estimator->peak));
+            estimator->excursion = 0;
+        }
+    }
+    if (estimator->excursion == 0 && (value > estimator->median + gate || value < estimator->median - gate)) {
+        estimator->excursion = value > estimator->median ? 1 : -1;
+        estimator->peak = value;
+    }
+}
+
+/**
+ * Computes the parameters from the samples added so far. Returns false if there are not
+ * ESTIMATOR_MIN_PEAKS blink peaks on both sides yet, the estimate is saturated (see above) or
+ * the thresholds do not have the sign the RFDuino expects; estimate is filled in anyway.
+ */
+static inline bool estimatorEstimate(const ThresholdEstimator *estimator, ThresholdEstimate *estimate) {
+    const EstimatorHistogram *positive = &estimator->positivePeaks;
+    const EstimatorHistogram *negative = &estimator->negativePeaks;
+    float median = estimator->median;
+    float sigma = estimator->sigma;
+    uint32_t positiveFirst = histogramBelow(positive, estimatorBin(median + ESTIMATOR_PEAK_SIGMAS * sigma));
+    uint32_t negativeCount = histogramBelow(negative, estimatorBin(median - ESTIMATOR_PEAK_SIGMAS * sigma) + 1);
+    float positivePeak, negativePeak, distance, highest, lowest;
+
+    memset(estimate, 0, sizeof(ThresholdEstimate));
+    estimate->median = median;
+    estimate->sigma = sigma;
+    estimate->positivePeaks = positive->total - positiveFirst;
+    estimate->negativePeaks = negativeCount;
+    estimate->saturatedPeaks = positive->total - histogramBelow(positive, ESTIMATOR_BINS - 1)
+        + histogramBelow(negative, 1);
+    if (estimate->positivePeaks < ESTIMATOR_MIN_PEAKS || estimate->negativePeaks < ESTIMATOR_MIN_PEAKS) {
+        return false;
+    }
+
+    // Thresholds at a fraction of the median blink peak.
+    positivePeak = histogramQuantile(positive, positiveFirst, estimate->positivePeaks, 0.5f) - median;
+    negativePeak = median - histogramQuantile(negative, 0, negativeCount, 0.5f);
+    estimate->positiveThreshold = median + ESTIMATOR_THRESHOLD * positivePeak;
+    estimate->negativeThreshold = median - ESTIMATOR_THRESHOLD * negativePeak;
+
+    // Hysteresis from the noise, small enough to keep both thresholds clear of the median.
+    distance = ESTIMATOR_THRESHOLD * (positivePeak < negativePeak ? positivePeak : negativePeak);
+    estimate->hysteresis = ESTIMATOR_HYSTERESIS * sigma;
+    if (estimate->hysteresis > ESTIMATOR_MAX_HYSTERESIS * distance) {
+        estimate->hysteresis = ESTIMATOR_MAX_HYSTERESIS * distance;
+    }
+
+    // Room above the highest blinks.
+    highest = histogramQuantile(positive, positiveFirst, estimate->positivePeaks, ESTIMATOR_EXTREME_QUANTILE);
+    lowest = histogramQuantile(negative, 0, negativeCount, 1 - ESTIMATOR_EXTREME_QUANTILE);
+    estimate->maxValue = median + ESTIMATOR_EXTREME_MARGIN * (highest - median);
+    estimate->minValue = median - ESTIMATOR_EXTREME_MARGIN * (median - lowest);
+
+    // Clipped peaks would place min and max value (and with more of them the thresholds) too close.
+    estimate->saturated = highest >= estimatorBinValue(ESTIMATOR_BINS - 1) || lowest <= estimatorBinValue(0)
+        || median >= estimatorBinValue(ESTIMATOR_BINS - 1) || median <= estimatorBinValue(0);
+
+    return !estimate->saturated && estimate->positiveThreshold > 0 && estimate->negativeThreshold < 0;
+}
+
+#endif
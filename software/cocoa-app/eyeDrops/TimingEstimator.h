@@ -0,0 +1,255 @@
+/**
+ * @file        TimingEstimator.h
+ * @brief       Header file containing the estimation of the blink time windows from the prompted calibration blinks in plain C.
+ *
+ * @author      Benjamin Thiemann
+ * @date        2017/02/01
+ * @copyright   MIT License, Copyright (c) 2017 University of Freiburg im Breisgau, Germany,<br>
+ *      Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,<br>
+ *      Lorenz Miething <miethinl@informatik.uni-freiburg.de>,<br>
+ *      Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de><br>
+ *      <br>
+ *      Permission is hereby granted, free of charge, to any person obtaining a copy
+ *      of this software and associated documentation files (the "Software"), to deal
+ *      in the Software without restriction, including without limitation the rights
+ *      to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *      copies of the Software, and to permit persons to whom the Software is
+ *      furnished to do so, subject to the following conditions:<br>
+ *      <br>
+ *      The above copyright notice and this permission notice shall be included in all
+ *      copies or substantial portions of the Software.<br>
+ *      <br>
+ *      THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *      IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *      FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *      AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *      LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *      OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *      SOFTWARE.
+ */
+
+#ifndef TIMING_ESTIMATOR_H
+#define TIMING_ESTIMATOR_H
+
+#include <stdint.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// Proposes the time windows of a blink profile (t_fall, t_rise, t_total and the eye closed time,
+// in samples like the RFDuino counts them) from the blinks of a calibration.
+// The AnimationView prompts the user to blink at known times, so the samples of the prompts are
+// known as well. Near every prompt the deepest negative lobe of the filtered signal is taken as
+// the blink and segmented the way the blink detection of the sketch (BlinkDetector.h) measures
+// it:
+//
+//   start    zero crossing before the negative lobe         the eye starts closing
+//   minimum  minimum of the negative lobe                   t_fall = minimum - start
+//   closed   end of the negative lobe                       the eye is closed
+//   opening  start of the positive lobe                     eye closed time = opening - closed
+//   maximum  maximum of the positive lobe                   t_rise = maximum - minimum
+//   end      zero crossing after the positive lobe          t_total = end - start
+//
+// The schedule is aligned with the signal by the reaction time: the median delay from prompt to
+// start. Blinks far off this delay (a missed prompt, an extra blink) are left out. The windows
+// span the lengths of the remaining blinks plus a margin.
+// CalibrationWindowController.m passes the prompt times of its AnimationViewController and gets
+// the TimingEstimate back through SensorDataViewController.h, both plain Objective-C;
+// tools/thresholdbench runs it on recorded calibrations with the prompt schedule given by -p.
+
+// The prompt times are turned into sample indices with the nominal TIMING_SAMPLE_PERIOD. Lost
+// calibration frames are held over in the plot data (see sessionCheckCalibrationSequence() of
+// DeviceSession.h), so they do not shift the later indices; their length is estimated, which is
+// exact for uncompressed frames and within a few samples for compressed ones. Slots the sketch
+// skipped itself (SampleClock.h) are not corrected, like a sample rate off 1 / TIMING_SAMPLE_PERIOD:
+// the median reaction time absorbs only the constant part of the drift they cause.
+#define TIMING_SAMPLE_PERIOD        0.006   // s, SAMPLE_PERIOD of the sketch
+#define TIMING_MAX_PROMPTS          16
+#define TIMING_RESPONSE_BEFORE      33      // samples (0.2 s) a blink may start before its prompt
+#define TIMING_RESPONSE_AFTER       250     // samples (1.5 s) a blink may start after its prompt
+#define TIMING_LATENCY_TOLERANCE    50      // samples (0.3 s) a blink may be off the median delay
+#define TIMING_MIN_BLINKS           3       // blinks needed for an estimate (or all prompts if fewer)
+#define TIMING_MARGIN               0.5f    // the windows are this fraction wider than the blinks
+#define TIMING_SLACK                2       // and at least this many samples
+#define TIMING_MAX_TOTAL            199     // PROX_FILTERED_BUFFER of the sketch - 1
+
+/**
+ * The phases of one prompted blink, as sample indices (see above).
+ */
+typedef struct {
+    uint32_t prompt;
+    uint32_t start;
+    uint32_t minimum;
+    uint32_t closed;
+    uint32_t opening;
+    uint32_t maximum;
+    uint32_t end;
+    bool valid;                             // a blink was found and fits the median delay
+} BlinkSegment;
+
+/**
+ * The proposed windows in samples, in the order of the profile parameters.
+ */
+typedef struct {
+    uint8_t fall[2];
+    uint8_t rise[2];
+    uint16_t total[2];
+    uint8_t closed;                         // eye closed time (allowedZeros of the sketch)
+    int32_t latency;                        // median delay from prompt to start
+    uint32_t blinks;                        // valid segments
+    uint32_t prompts;
+    BlinkSegment segments[TIMING_MAX_PROMPTS];
+} TimingEstimate;
+
+/**
+ * Returns the sample index of a time in s after the start of the calibration.
+ */
+static inline uint32_t timingSample(double seconds) {
+    return seconds > 0 ? (uint32_t)(seconds / TIMING_SAMPLE_PERIOD + 0.5) : 0;
+}
+
+/**
+ * Segments the blink following the prompt, searching its minimum in first..last - 1. Returns
+ * false if there is no complete blink whose lobes cross the thresholds (0 to skip this check).
+ */
+static inline bool timingSegment(const float *samples, uint32_t count, uint32_t first, uint32_t last,
+                                 float negativeThreshold, float positiveThreshold, BlinkSegment *segment) {
+    uint32_t i, limit;
+
+    if (first >= last) {
+        return false;
+    }
+
+    // The deepest negative lobe and where it starts and ends.
+    segment->minimum = first;
+    for (i = first + 1; i < last; i++) {
+        if (samples[i] < samples[segment->minimum]) {
+            segment->minimum = i;
+        }
+    }
+    if (samples[segment->minimum] >= 0 || samples[segment->minimum] > negativeThreshold) {
+        return false;
+    }
+    for (segment->start = segment->minimum; segment->start > 0 && samples[segment->start - 1] <= 0; segment->start--);
+    for (segment->closed = segment->minimum; segment->closed < count && samples[segment->closed] < 0; segment->closed++);
+
+    // The highest positive lobe within a blink length and where it starts and ends.
+    limit = segment->start + TIMING_MAX_TOTAL < count ? segment->start + TIMING_MAX_TOTAL : count;
+    if (segment->closed >= limit) {
+        return false;
+    }
+    segment->maximum = segment->closed;
+    for (i = segment->closed + 1; i < limit; i++) {
+        if (samples[i] > samples[segment->maximum]) {
+            segment->maximum = i;
+        }
+    }
+    if (samples[segment->maximum] <= 0 || samples[segment->maximum] < positiveThreshold) {
+        return false;
+    }
+    for (segment->opening = segment->maximum; segment->opening > segment->closed && samples[segment->opening - 1] >= 0; segment->opening--);
+    for (segment->end = segment->maximum; segment->end < count && samples[segment->end] > 0; segment->end++);
+    return segment->end < count;
+}
+
+/**
+ * Returns the window [low, high] around the lengths min..max, within 1..limit.
+ */
+static inline void timingWindow(uint32_t min, uint32_t max, uint32_t limit, uint32_t *low, uint32_t *high) {
+    int32_t from = (int32_t)(min * (1 - TIMING_MARGIN)) - TIMING_SLACK;
+    uint32_t to = (uint32_t)(max * (1 + TIMING_MARGIN) + 0.999f) + TIMING_SLACK;
+
+    *low = from < 1 ? 1 : (uint32_t)from;
+    *high = to > limit ? limit : to;
+    if (*low > *high) {
+        *low = *high;
+    }
+}
+
+/**
+ * Segments the blinks of a calibration (filtered samples, the first one at the start of the
+ * calibration) at the given prompts (sample indices, ascending) and computes the windows.
+ * The thresholds are in the units of the samples, 0 to take any lobe. Returns false if fewer than
+ * TIMING_MIN_BLINKS blinks were found; estimate->segments is filled in anyway.
+ */
+static inline bool timingEstimate(const float *samples, uint32_t count, const uint32_t *prompts, uint32_t promptCount,
+                                  float negativeThreshold, float positiveThreshold, TimingEstimate *estimate) {
+    int32_t latencies[TIMING_MAX_PROMPTS];
+    uint32_t fall[2] = {UINT32_MAX, 0}, rise[2] = {UINT32_MAX, 0}, total[2] = {UINT32_MAX, 0}, closed = 0;
+    uint32_t low, high, i, j, n = 0;
+
+    memset(estimate, 0, sizeof(TimingEstimate));
+    estimate->prompts = promptCount < TIMING_MAX_PROMPTS ? promptCount : TIMING_MAX_PROMPTS;
+
+    // A blink near every prompt, the search ends where the one of the next prompt begins.
+    for (i = 0; i < estimate->prompts; i++) {
+        BlinkSegment *segment = &estimate->segments[i];
+        uint32_t first = prompts[i] > TIMING_RESPONSE_BEFORE ? prompts[i] - TIMING_RESPONSE_BEFORE : 0;
+        uint32_t last = prompts[i] + TIMING_RESPONSE_AFTER;
+
+        if (i + 1 < estimate->prompts && prompts[i + 1] > TIMING_RESPONSE_BEFORE && last > prompts[i + 1] - TIMING_RESPONSE_BEFORE) {
+            last = prompts[i + 1] - TIMING_RESPONSE_BEFORE;
+        }
+        if (last > count) {
+            last = count;
+        }
+        segment->prompt = prompts[i];
+        if (timingSegment(samples, count, first, last, negativeThreshold, positiveThreshold, segment)) {
+            segment->valid = true;
+            latencies[n++] = (int32_t)segment->start - (int32_t)segment->prompt;
+        }
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    // Align: the median delay (insertion sort, there are only a few prompts).
+    for (i = 1; i < n; i++) {
+        int32_t latency = latencies[i];
+        for (j = i; j > 0 && latencies[j - 1] > latency; j--) {
+            latencies[j] = latencies[j - 1];
+        }
+        latencies[j] = latency;
+    }
+    estimate->latency = latencies[n / 2];
+
+    for (i = 0; i < estimate->prompts; i++) {
+        BlinkSegment *segment = &estimate->segments[i];
+        int32_t offset = (int32_t)segment->start - (int32_t)segment->prompt - estimate->latency;
+
+        if (!segment->valid) {
+            continue;
+        }
+        if (offset > TIMING_LATENCY_TOLERANCE || offset < -TIMING_LATENCY_TOLERANCE) {
+            segment->valid = false;
+            continue;
+        }
+        estimate->blinks++;
+        fall[0] = segment->minimum - segment->start < fall[0] ? segment->minimum - segment->start : fall[0];
+        fall[1] = segment->minimum - segment->start > fall[1] ? segment->minimum - segment->start : fall[1];
+        rise[0] = segment->maximum - segment->minimum < rise[0] ? segment->maximum - segment->minimum : rise[0];
+        rise[1] = segment->maximum - segment->minimum > rise[1] ? segment->maximum - segment->minimum : rise[1];
+        total[0] = segment->end - segment->start < total[0] ? segment->end - segment->start : total[0];
+        total[1] = segment->end - segment->start > total[1] ? segment->end - segment->start : total[1];
+        closed = segment->opening - segment->closed > closed ? segment->opening - segment->closed : closed;
+    }
+    if (estimate->blinks < TIMING_MIN_BLINKS && estimate->blinks < estimate->prompts) {
+        return false;
+    }
+
+    timingWindow(fall[0], fall[1], UINT8_MAX, &low, &high);
+    estimate->fall[0] = (uint8_t)low;
+    estimate->fall[1] = (uint8_t)high;
+    timingWindow(rise[0], rise[1], UINT8_MAX, &low, &high);
+    estimate->rise[0] = (uint8_t)low;
+    estimate->rise[1] = (uint8_t)high;
+    timingWindow(total[0], total[1], TIMING_MAX_TOTAL, &low, &high);
+    estimate->total[0] = (uint16_t)low;
+    estimate->total[1] = (uint16_t)high;
+    timingWindow(closed, closed, UINT8_MAX, &low, &high);
+    estimate->closed = (uint8_t)high;
+    return true;
+}
+
+#endif
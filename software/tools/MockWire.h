@@ -0,0 +1,200 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MOCK_WIRE_H
+#define MOCK_WIRE_H
+
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#include "VCNL4020Acquisition.h"
+
+// The VCNL4020 behind its I2C bus, for the host tools (vcnlbench, cyclesim).
+// Has the interface of the Arduino TwoWire class, so VCNL4020Bus runs on it unchanged.
+// Simulates on demand measurements which complete after a conversion time, the ready bits of
+// the command register, the result registers and the proximity data ready interrupt with its
+// status register (write 1 to clear). The caller sets now before every access and calls tick()
+// to complete the measurements; tick() returns true when the INT pin goes low.
+
+#define VCNL_ADDRESS 0x13   // same as the sketch
+
+/**
+ * I2C bus with a simulated VCNL4020, interface of the Arduino TwoWire class.
+ */
+class MockWire {
+public:
+  MockWire(const std::vector<uint16_t>& results, uint32_t proxConversion, uint32_t alsConversion, unsigned loseEvery)
+    : results(results), proxConversion(proxConversion), alsConversion(alsConversion), loseEvery(loseEvery),
+      pointer(0), rxPos(0), proxDone(0), alsDone(0), proxRunning(false), alsRunning(false), intPin(false),
+      measurements(0), transactions(0), bytes(0), lostInterrupts(0), errors(0) {
+    memset(registers, 0, sizeof(registers));
+  }
+
+  void beginTransmission(uint8_t address) {
+    checkAddress(address);
+    tx.clear();
+  }
+
+  size_t write(uint8_t value) {
+    tx.push_back(value);
+    return 1;
+  }
+
+  uint8_t endTransmission(bool stop = true) {
+    (void)stop;
+    ++transactions;
+    bytes += 1 + tx.size();
+    if (tx.empty()) {
+      return 0;
+    }
+    pointer = tx[0];
+    for (size_t i = 1; i < tx.size(); ++i) {
+      writeRegister(pointer + i - 1, tx[i]);
+    }
+    return 0;
+  }
+
+  uint8_t requestFrom(uint8_t address, uint8_t len) {
+    checkAddress(address);
+    ++transactions;
+    bytes += 1 + len;
+    rx.clear();
+    rxPos = 0;
+    for (uint8_t i = 0; i < len; ++i) {
+      rx.push_back(readRegister(pointer + i));
+    }
+    return len;
+  }
+
+  int available() {
+    return rx.size() - rxPos;
+  }
+
+  int read() {
+    return rxPos < rx.size() ? rx[rxPos++] : -1;
+  }
+
+  /**
+   * Completes the measurements due at now.
+   * Returns true if the INT pin went low (the interrupt of the sketch fires).
+   */
+  bool tick(uint32_t now) {
+    if (alsRunning && (int32_t)(now - alsDone) >= 0) {
+      alsRunning = false;
+      registers[VCNL_REG_COMMAND] |= VCNL_COMMAND_ALS_READY;
+      registers[VCNL_REG_AMBIENT_RESULT] = 0x01;
+      registers[VCNL_REG_AMBIENT_RESULT + 1] = 0x23;
+    }
+    if (!proxRunning || (int32_t)(now - proxDone) < 0) {
+      return false;
+    }
+    proxRunning = false;
+    uint16_t result = results[measurements % results.size()];
+    ++measurements;
+    registers[VCNL_REG_PROX_RESULT] = result >> 8;
+    registers[VCNL_REG_PROX_RESULT + 1] = result & 0xFF;
+    registers[VCNL_REG_COMMAND] |= VCNL_COMMAND_PROX_READY;
+    if (!(registers[VCNL_REG_INT_CONTROL] & VCNL_INT_PROX_READY)) {
+      return false;
+    }
+    registers[VCNL_REG_INT_STATUS] |= VCNL_INT_PROX_READY;
+    if (intPin) {
+      return false; // still low, no new falling edge
+    }
+    intPin = true;
+    if (loseEvery && measurements % loseEvery == 0) {
+      ++lostInterrupts;
+      return false;
+    }
+    return true;
+  }
+
+  const std::vector<uint16_t>& results;
+  uint32_t proxConversion;
+  uint32_t alsConversion;
+  unsigned loseEvery;
+  uint32_t now;                 // set by the simulation before every loop pass
+
+  uint8_t registers[256];
+  uint8_t pointer;
+  std::vector<uint8_t> tx;
+  std::vector<uint8_t> rx;
+  size_t rxPos;
+  uint32_t proxDone;
+  uint32_t alsDone;
+  bool proxRunning;
+  bool alsRunning;
+  bool intPin;                  // INT output asserted (low)
+
+  unsigned long measurements;   // completed proximity measurements
+  unsigned long transactions;   // endTransmission() and requestFrom() calls
+  unsigned long bytes;          // bytes on the bus including the address bytes
+  unsigned long lostInterrupts;
+  unsigned long errors;         // accesses to another address
+
+private:
+  void checkAddress(uint8_t address) {
+    if (address != VCNL_ADDRESS) {
+      ++errors;
+    }
+  }
+
+  void writeRegister(uint8_t reg, uint8_t value) {
+    if (reg == VCNL_REG_INT_STATUS) {
+      // write 1 to clear
+      registers[reg] &= ~value;
+      if (!(registers[reg] & VCNL_INT_PROX_READY)) {
+        intPin = false;
+      }
+      return;
+    }
+    registers[reg] = value;
+    if (reg == VCNL_REG_COMMAND) {
+      if (value & VCNL_COMMAND_PROX_OD) {
+        proxRunning = true;
+        proxDone = now + proxConversion;
+      }
+      if (value & VCNL_COMMAND_ALS_OD) {
+        alsRunning = true;
+        alsDone = now + alsConversion;
+      }
+    }
+  }
+
+  uint8_t readRegister(uint8_t reg) {
+    uint8_t value = registers[reg];
+    if (reg == VCNL_REG_PROX_RESULT + 1) {
+      registers[VCNL_REG_COMMAND] &= ~VCNL_COMMAND_PROX_READY;  // cleared by reading the result
+    } else if (reg == VCNL_REG_AMBIENT_RESULT + 1) {
+      registers[VCNL_REG_COMMAND] &= ~VCNL_COMMAND_ALS_READY;
+    }
+    return value;
+  }
+};
+
+#endif
@@ -0,0 +1,478 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MULTI_BLINK_DETECTOR_H
+#define MULTI_BLINK_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+
+// Blink detection for many independent channels (e.g. recordings of different wearers).
+// Makes the same decisions as one BlinkDetector per channel, but keeps the state of all
+// channels in structure of arrays form and processes one sample of every channel per call:
+//   1. difference and moving average      - one loop over all channels (vectorised)
+//   2. zero crossings and edge thresholds - one loop each over all channels (vectorised),
+//                                           the edges result in an event mask per channel
+//   3. extreme values and blink levels,   - per channel, only for channels with an event,
+//   4. removal of outdated indices          an open edge or a blink in progress
+// All channels advance in lockstep, so the ring buffer indices are shared.
+
+// Event mask of step 2.
+#define MULTI_EVENT_POS_RISING        0x01
+#define MULTI_EVENT_POS_FALLING       0x02
+#define MULTI_EVENT_NEG_FALLING       0x04
+#define MULTI_EVENT_NEG_RISING        0x08
+#define MULTI_EVENT_ACTIVE            0x10 // edge open or blink in progress
+
+
+template<typename Sample, typename Accum, int MaDepth, int HistoryLength>
+class MultiBlinkDetector {
+public:
+  explicit MultiBlinkDetector(size_t channels) : channelCount(channels) {
+    maBuffer.resize(MaDepth * channels);
+    maSum.resize(channels);
+    lastProximity.resize(channels);
+    history.resize(HistoryLength * channels);
+    events.resize(channels);
+
+    posHigh.resize(channels);
+    posLow.resize(channels);
+    negLow.resize(channels);
+    negHigh.resize(channels);
+    max_max.resize(channels);
+    min_min.resize(channels);
+    t_fall0.resize(channels);
+    t_fall1.resize(channels);
+    t_rise0.resize(channels);
+    t_rise1.resize(channels);
+    t_total0.resize(channels);
+    t_total1.resize(channels);
+    allowedZeros.resize(channels);
+
+    iZero.resize(channels);
+    iZeroPrev.resize(channels);
+    zeroCount.resize(channels);
+    iEdgeRisingPos.resize(channels);
+    iEdgeFallingPos.resize(channels);
+    iEdgeRisingNeg.resize(channels);
+    iEdgeFallingNeg.resize(channels);
+    iMax.resize(channels);
+    iMin.resize(channels);
+    maxVal.resize(channels);
+    minVal.resize(channels);
+    runMaxVal.resize(channels);
+    runMinVal.resize(channels);
+    iFirstMax.resize(channels);
+    iLastMax.resize(channels);
+    iFirstMin.resize(channels);
+    iLastMin.resize(channels);
+    lessZero.resize(channels);
+    abovePos.resize(channels);
+    belowNeg.resize(channels);
+    blinkLevel.resize(channels);
+    iBlinkLevel.resize(channels);
+    lengths0.resize(channels);
+    lengths1.resize(channels);
+    reset();
+  }
+
+  size_t channels() const {
+    return channelCount;
+  }
+
+  /**
+   * Set the default parameters (see BlinkDetector::reset()) for all channels and clear all
+   * buffers and detection states.
+   */
+  void reset() {
+    Single defaults;
+    for (size_t c = 0; c < channelCount; ++c) {
+      setParameters(c, defaults.params);
+    }
+
+    fill(maBuffer, (Accum)0);
+    fill(maSum, (Accum)0);
+    fill(lastProximity, (Accum)0);
+    fill(history, (Sample)0);
+    iMa = 0;
+    iP = 0;
+
+    fill(iZero, 0);
+    fill(iZeroPrev, 0);
+    fill(zeroCount, 0);
+    fill(iEdgeRisingPos, 0);
+    fill(iEdgeFallingPos, 0);
+    fill(iEdgeRisingNeg, 0);
+    fill(iEdgeFallingNeg, 0);
+    fill(iMax, 0);
+    fill(iMin, 0);
+    fill(maxVal, (Sample)0);
+    fill(minVal, (Sample)0);
+    fill(runMaxVal, (Sample)0);
+    fill(runMinVal, (Sample)0);
+    fill(iFirstMax, 0);
+    fill(iLastMax, -1);
+    fill(iFirstMin, 0);
+    fill(iLastMin, -1);
+    fill(lessZero, 0);
+    fill(abovePos, 0);
+    fill(belowNeg, 0);
+    fill(blinkLevel, 0);
+    fill(iBlinkLevel, 0);
+    fill(lengths0, 0);
+    fill(lengths1, 0);
+  }
+
+  /**
+   * Sets the blink profile parameters of one channel.
+   */
+  void setParameters(size_t c, const BlinkParameters<Sample>& params) {
+    const Sample scale = Single::analysisScale();
+    posHigh[c] = (params.edgePosThresh + params.hyst) * scale;
+    posLow[c] = (params.edgePosThresh - params.hyst) * scale;
+    negLow[c] = (params.edgeNegThresh - params.hyst) * scale;
+    negHigh[c] = (params.edgeNegThresh + params.hyst) * scale;
+    max_max[c] = params.max_max * scale;
+    min_min[c] = params.min_min * scale;
+    t_fall0[c] = params.t_fall[0];
+    t_fall1[c] = params.t_fall[1];
+    t_rise0[c] = params.t_rise[0];
+    t_rise1[c] = params.t_rise[1];
+    t_total0[c] = params.t_total[0];
+    t_total1[c] = params.t_total[1];
+    allowedZeros[c] = params.allowedZeros;
+  }
+
+  /**
+   * Processes one proximity value per channel.
+   * justBlinked[c] is set to 1 if an eye blink was just detected on channel c, 0 otherwise.
+   */
+  void update(const Accum* proximity, uint8_t* justBlinked) {
+    // 1. difference and moving average, same operation order as BlinkDetector::update()
+    Accum* ma = &maBuffer[iMa * channelCount];
+    Accum* sum = &maSum[0];
+    Accum* last = &lastProximity[0];
+    Sample* row = &history[iP * channelCount];
+    const bool divide = Single::analysisScale() == 1;
+    for (size_t c = 0; c < channelCount; ++c) {
+      Accum diff_prox = -last[c] + proximity[c];
+      last[c] = proximity[c];
+      sum[c] -= ma[c];
+      ma[c] = diff_prox;
+      sum[c] += diff_prox;
+      row[c] = divide ? sum[c] / MaDepth : sum[c];
+    }
+    iMa = iMa + 1 == MaDepth ? 0 : iMa + 1;
+    detect(justBlinked);
+  }
+
+  /**
+   * Processes one filtered sample per channel (see BlinkDetector::updateFiltered()).
+   */
+  void updateFiltered(const Sample* value, uint8_t* justBlinked) {
+    Sample* row = &history[iP * channelCount];
+    const Sample scale = Single::analysisScale();
+    for (size_t c = 0; c < channelCount; ++c) {
+      row[c] = value[c] * scale;
+    }
+    detect(justBlinked);
+  }
+
+  /**
+   * Copies the last filtered values of all channels to value.
+   */
+  void filtered(Sample* value) const {
+    const Sample* row = &history[(iP == 0 ? HistoryLength - 1 : iP - 1) * channelCount];
+    const Sample scale = Single::analysisScale();
+    for (size_t c = 0; c < channelCount; ++c) {
+      value[c] = row[c] / scale;
+    }
+  }
+
+private:
+  typedef BlinkDetector<Sample, Accum, MaDepth, HistoryLength> Single;
+
+  template<typename T>
+  static void fill(std::vector<T>& v, T value) {
+    for (size_t i = 0; i < v.size(); ++i) {
+      v[i] = value;
+    }
+  }
+
+  // Same index arithmetic as BlinkDetector.
+  static int distance(int from, int to) {
+    if ((HistoryLength & (HistoryLength - 1)) == 0) {
+      return (to - from) & (HistoryLength - 1);
+    }
+    return to < from ? to + HistoryLength - from : to - from;
+  }
+
+  static int centerIndex(int iFirst, int iLast) {
+    if (iLast < 0) {
+      return iFirst;
+    }
+    int center = iFirst + distance(iFirst, iLast) / 2;
+    if (center >= HistoryLength) {
+      center -= HistoryLength;
+    }
+    return center;
+  }
+
+  /**
+   * Runs steps 2. - 4. on the history row iP.
+   */
+  void detect(uint8_t* justBlinked) {
+    const size_t n = channelCount;
+    const Sample* __restrict row = &history[iP * n];
+    const int i = iP;
+    const int next = iP + 1 == HistoryLength ? 0 : iP + 1;
+
+    // 2. zero crossings of all channels, the zero crossing state is updated right here.
+    int* __restrict less = &lessZero[0];
+    int* __restrict zeroPrev = &iZeroPrev[0];
+    int* __restrict zero = &iZero[0];
+    for (size_t c = 0; c < n; ++c) {
+      const int crossed = less[c] ? row[c] >= 0 : row[c] <= 0;
+      less[c] ^= crossed;
+      zeroPrev[c] = crossed ? zero[c] : zeroPrev[c];
+      zero[c] = crossed ? i : zero[c];
+    }
+
+    // 2. threshold crossings of all channels, result is an event mask per channel.
+    // The events follow the if / else chain of the single channel edge detection:
+    // a positive edge event takes precedence over a negative one.
+    const int* __restrict above = &abovePos[0];
+    const int* __restrict below = &belowNeg[0];
+    const int* __restrict level = &blinkLevel[0];
+    const Sample* __restrict high = &posHigh[0];
+    const Sample* __restrict low = &posLow[0];
+    const Sample* __restrict negL = &negLow[0];
+    const Sample* __restrict negH = &negHigh[0];
+    int* __restrict event = &events[0];
+    for (size_t c = 0; c < n; ++c) {
+      const Sample v = row[c];
+      const int posRising = !above[c] & (v > high[c]);
+      const int posFalling = above[c] & (v < low[c]);
+      const int noPos = !(posRising | posFalling);
+      const int negFalling = noPos & !below[c] & (v < negL[c]);
+      const int negRising = noPos & below[c] & (v > negH[c]);
+      const int active = above[c] | below[c] | (level[c] != 0);
+      event[c] = posRising | posFalling << 1 | negFalling << 2 | negRising << 3 | active << 4;
+    }
+
+    // 3. extreme values and blink levels of the channels with something to do.
+    // 4. removal of outdated indices for the same channels. Inactive channels can skip it:
+    //    every index is rewritten before it is read again in a later active phase.
+    for (size_t c = 0; c < n; ++c) {
+      justBlinked[c] = 0;
+      if (event[c]) {
+        justBlinked[c] = detectChannel(c, row[c], event[c]);
+        removeOutdatedIndices(c, next);
+      }
+    }
+    iP = next;
+  }
+
+  /**
+   * Step 4. for a single channel, see the end of BlinkDetector::updateFiltered().
+   */
+  void removeOutdatedIndices(size_t c, int next) {
+    if (next == iMin[c]) {
+      iMin[c] = -1;
+    }
+    if (next == iMax[c]) {
+      iMax[c] = -1;
+    }
+    if (next == iBlinkLevel[c]) {
+      blinkLevel[c] = 0;
+    }
+    if (next == iEdgeRisingPos[c]) {
+      iEdgeRisingPos[c] = -1;
+    }
+    if (next == iEdgeFallingPos[c]) {
+      iEdgeFallingPos[c] = -1;
+    }
+    if (next == iEdgeRisingNeg[c]) {
+      iEdgeRisingNeg[c] = -1;
+    }
+    if (next == iEdgeFallingNeg[c]) {
+      iEdgeFallingNeg[c] = -1;
+    }
+  }
+
+  /**
+   * Step 3. for a single channel, see BlinkDetector::updateFiltered() and
+   * BlinkDetector::performEdgeDetectionAndExtremeValueDetermination().
+   */
+  bool detectChannel(size_t c, Sample value, int event) {
+    bool justBlinked = false;
+
+    int edgeType = 0;
+    if (abovePos[c]) {
+      if (value > runMaxVal[c]) {
+        runMaxVal[c] = value;
+        iFirstMax[c] = iP;
+        iLastMax[c] = -1;
+      } else if (value == runMaxVal[c]) {
+        iLastMax[c] = iP;
+      }
+    }
+    if (belowNeg[c]) {
+      if (value < runMinVal[c]) {
+        runMinVal[c] = value;
+        iFirstMin[c] = iP;
+        iLastMin[c] = -1;
+      } else if (value == runMinVal[c]) {
+        iLastMin[c] = iP;
+      }
+    }
+
+    if (event & MULTI_EVENT_POS_RISING) {
+      iEdgeRisingPos[c] = iP;
+      abovePos[c] = 1;
+      runMaxVal[c] = value;
+      iFirstMax[c] = iP;
+      iLastMax[c] = -1;
+    } else if (event & MULTI_EVENT_POS_FALLING) {
+      if (iEdgeRisingPos[c] >= 0) {
+        iEdgeFallingPos[c] = iP;
+        maxVal[c] = runMaxVal[c];
+        iMax[c] = centerIndex(iFirstMax[c], iLastMax[c]);
+        edgeType = 1;
+      }
+      abovePos[c] = 0;
+    } else if (event & MULTI_EVENT_NEG_FALLING) {
+      iEdgeFallingNeg[c] = iP;
+      belowNeg[c] = 1;
+      runMinVal[c] = value;
+      iFirstMin[c] = iP;
+      iLastMin[c] = -1;
+    } else if (event & MULTI_EVENT_NEG_RISING) {
+      iEdgeRisingNeg[c] = iP;
+      if (iEdgeFallingNeg[c] >= 0) {
+        minVal[c] = runMinVal[c];
+        iMin[c] = centerIndex(iFirstMin[c], iLastMin[c]);
+        edgeType = -1;
+      }
+      belowNeg[c] = 0;
+    }
+
+    // Three step blink validation.
+    if (blinkLevel[c] != 0 && distance(iBlinkLevel[c], iP) > t_total1[c]) {
+      blinkLevel[c] = 0;
+    }
+
+    if (edgeType == -1 && blinkLevel[c] == 0) {
+      if (iZero[c] == iP) {
+        lengths0[c] = distance(iZeroPrev[c], iMin[c]);
+      } else {
+        lengths0[c] = distance(iZero[c], iMin[c]);
+      }
+      if (lengths0[c] >= t_fall0[c] && lengths0[c] <= t_fall1[c]) {
+        blinkLevel[c] = 1;
+        zeroCount[c] = 0;
+        iBlinkLevel[c] = iP;
+      } else {
+        blinkLevel[c] = 0;
+      }
+    } else if (edgeType == 1 && blinkLevel[c] == 1) {
+      lengths1[c] = distance(iMin[c], iMax[c]);
+      if (lengths1[c] >= t_rise0[c] && lengths1[c] <= t_rise1[c] && zeroCount[c] < allowedZeros[c]) {
+        blinkLevel[c] = 2;
+        iBlinkLevel[c] = iP;
+        justBlinked = true;
+      } else {
+        blinkLevel[c] = 0;
+      }
+    } else if (iZero[c] == iP && blinkLevel[c] == 2) {
+      // Final zero crossing, the blink has already been reported.
+      blinkLevel[c] = 0;
+    }
+    return justBlinked;
+  }
+
+  const size_t channelCount;
+
+  // Shared ring buffer indices.
+  int iMa;
+  int iP;
+
+  // Moving average filter, MaDepth rows of channelCount values.
+  std::vector<Accum> maBuffer;
+  std::vector<Accum> maSum;
+  std::vector<Accum> lastProximity;
+
+  // Filtered samples, HistoryLength rows of channelCount values.
+  std::vector<Sample> history;            // filtered samples times analysisScale()
+  std::vector<int> events;      // event mask of step 2, int to keep all lanes 32 bit wide
+
+  // Parameters, thresholds +- hysteresis precomputed.
+  std::vector<Sample> posHigh;
+  std::vector<Sample> posLow;
+  std::vector<Sample> negLow;
+  std::vector<Sample> negHigh;
+  std::vector<Sample> max_max;
+  std::vector<Sample> min_min;
+  std::vector<int> t_fall0;
+  std::vector<int> t_fall1;
+  std::vector<int> t_rise0;
+  std::vector<int> t_rise1;
+  std::vector<int> t_total0;
+  std::vector<int> t_total1;
+  std::vector<int> allowedZeros;
+
+  // Detection state, see BlinkDetector for the single variables.
+  std::vector<int> iZero;
+  std::vector<int> iZeroPrev;
+  std::vector<int> zeroCount;
+  std::vector<int> iEdgeRisingPos;
+  std::vector<int> iEdgeFallingPos;
+  std::vector<int> iEdgeRisingNeg;
+  std::vector<int> iEdgeFallingNeg;
+  std::vector<int> iMax;
+  std::vector<int> iMin;
+  std::vector<Sample> maxVal;
+  std::vector<Sample> minVal;
+  std::vector<Sample> runMaxVal;
+  std::vector<Sample> runMinVal;
+  std::vector<int> iFirstMax;
+  std::vector<int> iLastMax;
+  std::vector<int> iFirstMin;
+  std::vector<int> iLastMin;
+  std::vector<int> lessZero;
+  std::vector<int> abovePos;
+  std::vector<int> belowNeg;
+  std::vector<int> blinkLevel;
+  std::vector<int> iBlinkLevel;
+  std::vector<int> lengths0;
+  std::vector<int> lengths1;
+};
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Loader for recorded sensor sessions, shared by the host tools.
+// Supported formats (one sample per line, everything else is skipped):
+//   - Serial log of the sketch (BLE not connected): "S<proxFiltered * 100>\t<blink>"
+//     The values are already filtered by the moving average, the blink column is the one
+//     sent by the sketch.
+//   - Proximity capture: "<proximity in mm> [...]" or, with RECORDING_RAW, "<raw count> [...]"
+//     Raw counts are converted with the exact formula the lookup table was generated from.
+
+enum RecordingFormat {
+  RECORDING_AUTO,     // Serial log if a line starts with 'S', proximity in mm otherwise
+  RECORDING_MM,       // proximity capture in mm
+  RECORDING_RAW       // proximity capture in raw counts
+};
+
+struct Recording {
+  bool filtered;                  // true if values are filtered samples (Serial log)
+  std::vector<double> values;     // filtered samples or proximity values in mm
+  std::vector<unsigned char> blinkColumn; // blink column of a Serial log (empty otherwise)
+
+  Recording() : filtered(false) {}
+
+  /**
+   * Returns the sample indices at which the log's blink column switches from 0 to 1.
+   * Older sketches repeated the blink message for several samples, so only the onset is a blink.
+   */
+  std::vector<size_t> logBlinks() const {
+    std::vector<size_t> onsets;
+    for (size_t i = 0; i < blinkColumn.size(); ++i) {
+      if (blinkColumn[i] && (i == 0 || !blinkColumn[i - 1])) {
+        onsets.push_back(i);
+      }
+    }
+    return onsets;
+  }
+};
+
+/**
+ * Converts a raw VCNL4020 proximity count into mm.
+ * Same formula as used for ProximityTable.h.
+ */
+inline double rawToMM(double raw) {
+  return exp(log(68000.0 / raw) / 1.765);
+}
+
+/**
+ * Loads a recording from the file path ("-" for stdin).
+ * Returns false if the file could not be read or contains no samples.
+ */
+inline bool loadRecording(const char* path, RecordingFormat format, Recording& recording) {
+  FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  recording = Recording();
+  char line[256];
+  bool decided = format != RECORDING_AUTO;
+  while (fgets(line, sizeof(line), file)) {
+    char* end;
+    if (line[0] == 'S' && (format == RECORDING_AUTO || recording.filtered)) {
+      // Serial log line
+      double value = strtod(line + 1, &end);
+      if (end == line + 1) {
+        continue;
+      }
+      recording.filtered = true;
+      decided = true;
+      recording.values.push_back(value / 100.0);
+      recording.blinkColumn.push_back(strtol(end, NULL, 10) != 0);
+    } else if (!recording.filtered) {
+      double value = strtod(line, &end);
+      if (end == line) {
+        // "Blinked", "Connected", header lines etc.
+        continue;
+      }
+      if (!decided) {
+        // first sample decides the format
+        format = RECORDING_MM;
+        decided = true;
+      }
+      recording.values.push_back(format == RECORDING_RAW ? rawToMM(value) : value);
+    }
+  }
+  if (file != stdin) {
+    fclose(file);
+  }
+  return !recording.values.empty();
+}
+
+/**
+ * Loads blink labels (one sample index per line) for a proximity capture.
+ * Returns false if the file could not be read.
+ */
+inline bool loadLabels(const char* path, std::vector<size_t>& labels) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  labels.clear();
+  unsigned long index;
+  while (fscanf(file, "%lu", &index) == 1) {
+    labels.push_back(index);
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Returns the number of detected blinks which match a labelled blink.
+ * A detection matches if it is at most 'tolerance' samples away from a not yet matched label.
+ * Both vectors have to be sorted.
+ */
+inline size_t countMatches(const std::vector<size_t>& detected, const std::vector<size_t>& labels,
+                           size_t tolerance) {
+  size_t matched = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < detected.size() && j < labels.size()) {
+    if (detected[i] + tolerance < labels[j]) {
+      ++i;
+    } else if (detected[i] > labels[j] + tolerance) {
+      ++j;
+    } else {
+      ++matched;
+      ++i;
+      ++j;
+    }
+  }
+  return matched;
+}
+
+/**
+ * Replays a recording through a detector and returns the sample indices of the detected blinks.
+ * Works with every BlinkDetector instantiation (see BlinkDetector.h).
+ */
+template<typename Detector>
+std::vector<size_t> replayRecording(const Recording& recording, Detector& detector) {
+  std::vector<size_t> blinks;
+  const size_t n = recording.values.size();
+  if (recording.filtered) {
+    for (size_t i = 0; i < n; ++i) {
+      if (detector.updateFiltered(Detector::fromMM(recording.values[i]))) {
+        blinks.push_back(i);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      if (detector.update(Detector::accumFromMM(recording.values[i]))) {
+        blinks.push_back(i);
+      }
+    }
+  }
+  return blinks;
+}
+
+#endif
@@ -0,0 +1,421 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SESSION_ENGINE_H
+#define SESSION_ENGINE_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "DeviceSession.h"
+#include "SpscQueue.h"
+#include "TimerWheel.h"
+
+// Host side for many RFDuinos at once (Linux): one DeviceSession per device, all driven by one
+// event loop thread with epoll. Every device is a datagram socket (one BLE packet per datagram),
+// e.g. a socket pair to a simulated RFDuino or a bridge to a BLE adapter.
+//
+//   - Incoming data: the sockets are level triggered, at most ENGINE_RECEIVE_BUDGET messages are
+//     handled per device and wakeup, so a flooding device cannot starve the others.
+//   - Timers: the next deadline of each session (no blink timer or reply timeout) is one timer of a
+//     TimerWheel. A blink rearms it in O(1) without allocating.
+//   - Commands (profile, blurring, calibration) come from one control thread through a lock-free
+//     queue per device, an eventfd wakes the loop.
+//   - Events (blinks, blurring, profile applied) go to one consumer thread through a lock-free queue
+//     per device. A full queue drops the event and counts it.
+// addDevice() is called before run(), session() and statistics() after it returned.
+// The sessions and the timers run on a ms clock of its own, which wraps at 2^32 ms (49.7 days)
+// like millis() of the RFDuino; startMillis lets it start anywhere, e.g. just before the wrap.
+
+#define ENGINE_RECEIVE_BUDGET   16      // messages handled per device and wakeup
+#define ENGINE_MAX_WAKEUPS      64      // sockets reported per epoll_wait()
+#define ENGINE_EVENT_QUEUE      256     // events buffered per device
+#define ENGINE_COMMAND_QUEUE    16      // commands buffered per device
+
+enum EngineEventType {
+  ENGINE_EVENT_BLINK,
+  ENGINE_EVENT_START_BLUR,
+  ENGINE_EVENT_STOP_BLUR,
+  ENGINE_EVENT_PROFILE_APPLIED,
+  ENGINE_EVENT_DISCONNECTED
+};
+
+struct EngineEvent {
+  uint8_t type;
+  uint32_t count;       // blinks since the connect (ENGINE_EVENT_BLINK)
+  uint32_t deviceTime;  // device time of the blink event, 0 for PROTOCOL_OUT_BLINK_DETECTED
+  uint32_t time;        // engine time in us when the event happened
+};
+
+enum EngineCommandType {
+  ENGINE_COMMAND_SET_PROFILE,
+  ENGINE_COMMAND_SET_BLURRING,
+  ENGINE_COMMAND_START_CALIBRATION,
+  ENGINE_COMMAND_STOP_CALIBRATION,
+  ENGINE_COMMAND_CALIBRATION_COMPLETE
+};
+
+struct EngineCommand {
+  uint8_t type;
+  bool blurring;                // ENGINE_COMMAND_SET_BLURRING
+  ProfileParameters profile;    // ENGINE_COMMAND_SET_PROFILE
+};
+
+struct EngineStatistics {
+  uint64_t wakeups;             // returns of epoll_wait()
+  uint64_t messages;            // messages handled
+  uint64_t timers;              // expired timers
+  uint64_t commands;            // commands handled
+  uint64_t droppedEvents;       // events lost because the consumer was too slow
+};
+
+class SessionEngine {
+public:
+  explicit SessionEngine(uint32_t startMillis = 0)
+      : epollFd(epoll_create1(EPOLL_CLOEXEC)), wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        start(std::chrono::steady_clock::now()), startMillis(startMillis), stopRequested(false),
+        timers(startMillis) {
+    memset(&stats, 0, sizeof(stats));
+    if (epollFd >= 0 && wakeFd >= 0) {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = WAKE_ID;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    }
+  }
+
+  ~SessionEngine() {
+    if (epollFd >= 0) {
+      close(epollFd);
+    }
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+  }
+
+  /**
+   * False if epoll or the eventfd could not be created.
+   */
+  bool valid() const {
+    return epollFd >= 0 && wakeFd >= 0;
+  }
+
+  /**
+   * Adds a connected device (the engine does not close fd). The session sends normal mode right away
+   * and uploads the profile when the RFDuino answers. Returns the index of the device, -1 on error.
+   */
+  int addDevice(int fd, const ProfileParameters& profile, bool blurring, uint32_t noBlinkInterval) {
+    std::unique_ptr<Device> device(new Device());
+    device->engine = this;
+    device->fd = fd;
+    device->open = true;
+    device->noBlinkInterval = noBlinkInterval;
+    device->blinkDeviceTime = 0;
+    device->timer.callback = onTimer;
+    device->timer.context = device.get();
+
+    SessionTransport transport = { device.get(), sendToDevice };
+    SessionEvents events;
+    memset(&events, 0, sizeof(events));
+    events.context = device.get();
+    events.blink = onBlink;
+    events.startBlur = onStartBlur;
+    events.stopBlur = onStopBlur;
+    events.profileApplied = onProfileApplied;
+    events.noBlinkInterval = onNoBlinkInterval;
+    sessionInit(&device->session, &transport, &events);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = devices.size();
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      return -1;
+    }
+    devices.push_back(std::move(device));
+    Device& added = *devices.back();
+
+    uint32_t now = millis();
+    sessionSetProfile(&added.session, &profile, now);
+    sessionSetBlurring(&added.session, blurring, now);
+    sessionConnected(&added.session);
+    sessionReady(&added.session, now);
+    updateTimer(added);
+    return (int)(devices.size() - 1);
+  }
+
+  size_t deviceCount() const {
+    return devices.size();
+  }
+
+  /**
+   * Runs the event loop until stop() is called.
+   */
+  void run() {
+    struct epoll_event ready[ENGINE_MAX_WAKEUPS];
+    while (!stopRequested.load(std::memory_order_acquire)) {
+      int timeout = -1;
+      uint32_t deadline = 0;
+      if (timers.nextDeadline(deadline)) {
+        int32_t remaining = (int32_t)(deadline - millis());
+        timeout = remaining > 0 ? remaining : 0;
+      }
+      int count = epoll_wait(epollFd, ready, ENGINE_MAX_WAKEUPS, timeout);
+      ++stats.wakeups;
+      for (int i = 0; i < count; ++i) {
+        if (ready[i].data.u64 == WAKE_ID) {
+          uint64_t value;
+          while (read(wakeFd, &value, sizeof(value)) > 0) {
+          }
+          handleCommands();
+        } else {
+          handleDevice(*devices[ready[i].data.u64]);
+        }
+      }
+      stats.timers += timers.advance(millis());
+    }
+  }
+
+  /**
+   * Ends run(). Any thread.
+   */
+  void stop() {
+    stopRequested.store(true, std::memory_order_release);
+    wake();
+  }
+
+  /**
+   * Control thread: queues a command for a device. Returns false if its queue is full.
+   */
+  bool post(size_t device, const EngineCommand& command) {
+    if (!devices[device]->commands.push(command)) {
+      return false;
+    }
+    wake();
+    return true;
+  }
+
+  /**
+   * Consumer thread: takes the next event of a device. Returns false if there is none.
+   */
+  bool nextEvent(size_t device, EngineEvent& event) {
+    return devices[device]->events.pop(event);
+  }
+
+  /**
+   * Engine time in us (the time base of EngineEvent::time). Any thread.
+   */
+  uint32_t micros() const {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  const DeviceSession& session(size_t device) const {
+    return devices[device]->session;
+  }
+
+  const EngineStatistics& statistics() const {
+    return stats;
+  }
+
+private:
+  static const uint64_t WAKE_ID = ~(uint64_t)0;
+
+  struct Device {
+    SessionEngine* engine;
+    int fd;
+    bool open;
+    uint32_t noBlinkInterval;   // ms
+    uint32_t blinkDeviceTime;   // of the message being handled
+    WheelTimer timer;           // armed with the next deadline of the session
+    DeviceSession session;
+    SpscQueue<EngineCommand, ENGINE_COMMAND_QUEUE> commands;
+    SpscQueue<EngineEvent, ENGINE_EVENT_QUEUE> events;
+  };
+
+  /**
+   * Time of the sessions and timers in ms. Not micros() / 1000: micros() wraps after 71.6 minutes,
+   * and its quotient would step back from 4294967 to 0 instead of wrapping at 2^32.
+   */
+  uint32_t millis() const {
+    return startMillis + (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+  }
+
+  void handleDevice(Device& device) {
+    if (!device.open) {
+      return;
+    }
+    uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE + 1];
+    for (int i = 0; i < ENGINE_RECEIVE_BUDGET; ++i) {
+      ssize_t length = recv(device.fd, data, sizeof(data), MSG_DONTWAIT);
+      if (length < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          disconnect(device);
+        }
+        break;
+      }
+      if (length == 0) {
+        disconnect(device);
+        break;
+      }
+      ++stats.messages;
+      uint8_t sequence;
+      device.blinkDeviceTime = 0;
+      protocolDecodeBlinkEvent(data, (int)length, &sequence, &device.blinkDeviceTime);
+      sessionReceive(&device.session, data, (int)length, millis());
+    }
+    updateTimer(device);
+  }
+
+  void disconnect(Device& device) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, device.fd, NULL);
+    device.open = false;
+    sessionDisconnected(&device.session);
+    pushEvent(device, ENGINE_EVENT_DISCONNECTED, 0);
+    updateTimer(device);
+  }
+
+  /**
+   * Handles the queued commands. A wakeup does not tell which device, so all queues are checked.
+   */
+  void handleCommands() {
+    for (size_t i = 0; i < devices.size(); ++i) {
+      Device& device = *devices[i];
+      EngineCommand command;
+      bool handled = false;
+      while (device.commands.pop(command)) {
+        handled = true;
+        ++stats.commands;
+        if (!device.open) {
+          continue;
+        }
+        uint32_t now = millis();
+        switch (command.type) {
+          case ENGINE_COMMAND_SET_PROFILE:
+            sessionSetProfile(&device.session, &command.profile, now);
+            break;
+          case ENGINE_COMMAND_SET_BLURRING:
+            sessionSetBlurring(&device.session, command.blurring, now);
+            break;
+          case ENGINE_COMMAND_START_CALIBRATION:
+            sessionStartCalibration(&device.session);
+            break;
+          case ENGINE_COMMAND_STOP_CALIBRATION:
+            sessionStopCalibration(&device.session);
+            break;
+          case ENGINE_COMMAND_CALIBRATION_COMPLETE:
+            sessionCalibrationComplete(&device.session);
+            break;
+          default:
+            break;
+        }
+      }
+      if (handled) {
+        updateTimer(device);
+      }
+    }
+  }
+
+  /**
+   * Arms the timer of the device with the next deadline of its session.
+   */
+  void updateTimer(Device& device) {
+    uint32_t deadline;
+    if (!sessionNextDeadline(&device.session, &deadline)) {
+      timers.cancel(device.timer);
+    } else if (!device.timer.armed() || deadline != device.timer.deadline) {
+      timers.arm(device.timer, deadline);
+    }
+  }
+
+  static void onTimer(WheelTimer* timer, uint32_t now) {
+    Device* device = (Device*)timer->context;
+    sessionPoll(&device->session, now);
+    device->engine->updateTimer(*device);
+  }
+
+  void pushEvent(Device& device, uint8_t type, uint32_t count) {
+    EngineEvent event = { type, count, type == ENGINE_EVENT_BLINK ? device.blinkDeviceTime : 0, micros() };
+    if (!device.events.push(event)) {
+      ++stats.droppedEvents;
+    }
+  }
+
+  static bool sendToDevice(void* context, const uint8_t* data, uint8_t length) {
+    Device* device = (Device*)context;
+    return send(device->fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL) == length;
+  }
+
+  static void onBlink(void* context, uint32_t count) {
+    Device* device = (Device*)context;
+    device->engine->pushEvent(*device, ENGINE_EVENT_BLINK, count);
+  }
+
+  static void onStartBlur(void* context) {
+    Device* device = (Device*)context;
+    device->engine->pushEvent(*device, ENGINE_EVENT_START_BLUR, 0);
+  }
+
+  static void onStopBlur(void* context) {
+    Device* device = (Device*)context;
+    device->engine->pushEvent(*device, ENGINE_EVENT_STOP_BLUR, 0);
+  }
+
+  static void onProfileApplied(void* context) {
+    Device* device = (Device*)context;
+    device->engine->pushEvent(*device, ENGINE_EVENT_PROFILE_APPLIED, 0);
+  }
+
+  static uint32_t onNoBlinkInterval(void* context) {
+    return ((Device*)context)->noBlinkInterval;
+  }
+
+  int epollFd;
+  int wakeFd;
+  std::chrono::steady_clock::time_point start;
+  uint32_t startMillis;
+  std::atomic<bool> stopRequested;
+  std::vector<std::unique_ptr<Device> > devices;
+  TimerWheel timers;
+  EngineStatistics stats;
+};
+
+#endif
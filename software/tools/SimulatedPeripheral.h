@@ -0,0 +1,246 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SIMULATED_PERIPHERAL_H
+#define SIMULATED_PERIPHERAL_H
+
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <sys/socket.h>
+
+#include "CalibrationCodec.h"
+#include "ProfileMessage.h"
+#include "ProtocolCodec.h"
+
+// The RFDuino as seen by the app, for the host tools (sessionsim, enginebench).
+// Follows Bluetooth.ino: answers normal mode with ALIVE, collects and confirms the profile upload,
+// sends blink events until they are acknowledged (SIM_BLINK_WINDOW events, repeated every
+// SIM_BLINK_RETRANSMIT_TIME ms, at most SIM_BLINK_TRANSMISSIONS times) and streams compressed
+// calibration frames. Every notification is one datagram on fd (a socket pair or SOCK_SEQPACKET
+// socket) and is lost with the given probability.
+// The caller drives it: it passes the messages of the app to receive(), the blinks and calibration
+// samples to blink() and calibrationSample() and calls update() regularly for the retransmissions.
+// The device time of a blink event is chosen by the caller, so it can identify the event on the
+// other side.
+
+// Same as Bluetooth.ino.
+#define SIM_BLINK_WINDOW 4
+#define SIM_BLINK_RETRANSMIT_TIME 100
+#define SIM_BLINK_TRANSMISSIONS 5
+
+class SimulatedPeripheral {
+public:
+  SimulatedPeripheral(int fd, double loss, uint32_t seed, float sampleRate = 166.7f)
+      : sent(0), lost(0), blinks(0), blinksGivenUp(0), allLost(0), calibrationSamples(0), fd(fd), loss(loss),
+        sampleRate(sampleRate), random(seed), encoder(PROTOCOL_OUT_CALIBRATION_COMPRESSED), normal(false),
+        calibration(false), blinkSequence(0) {
+    memset(events, 0, sizeof(events));
+    profileReceiverReset(&receiver);
+  }
+
+  /**
+   * Handles a message of the app.
+   */
+  void receive(const uint8_t* data, int length) {
+    if (!protocolCheckIn(data, length)) {
+      return;
+    }
+    switch (data[0]) {
+      case PROTOCOL_IN_NORMAL_MODE: {
+        normal = true;
+        calibration = false;
+        uint8_t alive = PROTOCOL_OUT_ALIVE;
+        notify(&alive, 1);
+        break;
+      }
+      case PROTOCOL_IN_SET_PROFILE: {
+        uint8_t result = profileReceiverAdd(&receiver, data, (uint8_t)length);
+        if (result == PROFILE_INCOMPLETE) {
+          break;
+        }
+        uint8_t status = result == PROFILE_COMPLETE ? PROTOCOL_PROFILE_APPLIED
+                       : result == PROFILE_BAD_CRC ? PROTOCOL_PROFILE_BAD_CRC : PROTOCOL_PROFILE_BAD_FRAME;
+        uint8_t answer[PROTOCOL_PROFILE_STATUS_SIZE];
+        notify(answer, protocolEncodeProfileStatus(answer, data[1], packedProfileCrc(receiver.packed), status));
+        break;
+      }
+      case PROTOCOL_IN_BLINK_ACK:
+        for (int i = 0; i < SIM_BLINK_WINDOW; ++i) {
+          if (events[i].transmissions > 0 && events[i].sequence == data[1]) {
+            events[i].transmissions = 0;
+          }
+        }
+        break;
+      case PROTOCOL_IN_START_CALIBRATION:
+        normal = false;
+        calibration = true;
+        encoder.reset();
+        break;
+      case PROTOCOL_IN_STOP_CALIBRATION:
+        calibration = false;
+        if (encoder.flush()) {
+          notify(encoder.frame(), encoder.frameLength());
+        }
+        break;
+      case PROTOCOL_IN_REQUEST_BATTERY_LEVEL: {
+        uint8_t answer[PROTOCOL_BATTERY_LEVEL_SIZE];
+        notify(answer, protocolEncodeBatteryLevel(answer, 3.0f));
+        break;
+      }
+      case PROTOCOL_IN_REQUEST_TIMING: {
+        ProtocolTiming timing = { sampleRate, 0, 0, 0, 0, 0, 0 };
+        uint8_t answer[PROTOCOL_TIMING_SIZE];
+        notify(answer, protocolEncodeTiming(answer, &timing));
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  /**
+   * A blink at now (ms). Sent as blink event with the given device time, in normal mode only.
+   * If the window is full, the oldest event is given up.
+   */
+  void blink(uint32_t deviceTime, uint32_t now) {
+    if (!normal) {
+      return;
+    }
+    int slot = 0;
+    for (int i = 0; i < SIM_BLINK_WINDOW; ++i) {
+      if (events[i].transmissions == 0) {
+        slot = i;
+        break;
+      }
+      if ((int8_t)(events[i].sequence - events[slot].sequence) < 0) {
+        slot = i;
+      }
+    }
+    if (events[slot].transmissions > 0) {
+      giveUp(events[slot]);
+    }
+    events[slot].sequence = blinkSequence++;
+    events[slot].transmissions = 0;
+    events[slot].delivered = 0;
+    events[slot].deviceTime = deviceTime;
+    ++blinks;
+    sendBlinkEvent(events[slot], now);
+  }
+
+  /**
+   * A calibration sample (Q15.16), sent in compressed frames during the calibration only.
+   */
+  void calibrationSample(int32_t value, bool blink) {
+    if (!calibration) {
+      return;
+    }
+    ++calibrationSamples;
+    if (encoder.add(value, blink)) {
+      notify(encoder.frame(), encoder.frameLength());
+    }
+  }
+
+  /**
+   * Repeats or gives up the unacknowledged blink events. now in ms.
+   */
+  void update(uint32_t now) {
+    for (int i = 0; i < SIM_BLINK_WINDOW; ++i) {
+      BlinkEvent& event = events[i];
+      if (event.transmissions > 0 && now - event.sentTime >= SIM_BLINK_RETRANSMIT_TIME) {
+        if (event.transmissions >= SIM_BLINK_TRANSMISSIONS) {
+          giveUp(event);
+        } else {
+          sendBlinkEvent(event, now);
+        }
+      }
+    }
+  }
+
+  bool normalMode() const {
+    return normal;
+  }
+
+  bool calibrating() const {
+    return calibration;
+  }
+
+  unsigned long sent;               // notifications sent
+  unsigned long lost;               // notifications lost
+  unsigned long blinks;             // blink events
+  unsigned long blinksGivenUp;      // events dropped without acknowledgement
+  unsigned long allLost;            // events of which every transmission was lost
+  unsigned long calibrationSamples; // samples sent in calibration frames
+
+private:
+  struct BlinkEvent {
+    uint8_t sequence;
+    uint8_t transmissions;          // 0 if the slot is free
+    uint8_t delivered;              // transmissions not lost
+    uint32_t deviceTime;
+    uint32_t sentTime;              // ms
+  };
+
+  void notify(const uint8_t* data, uint8_t length) {
+    if (loss > 0 && std::uniform_real_distribution<double>(0, 1)(random) < loss) {
+      ++lost;
+      return;
+    }
+    // The radio holds a few packets, the socket buffer many more: wait instead of dropping.
+    while (send(fd, data, length, MSG_NOSIGNAL) < 0 && errno == EINTR) {
+    }
+    ++sent;
+  }
+
+  void sendBlinkEvent(BlinkEvent& event, uint32_t now) {
+    uint8_t data[PROTOCOL_BLINK_EVENT_SIZE];
+    unsigned long lostBefore = lost;
+    notify(data, protocolEncodeBlinkEvent(data, event.sequence, event.deviceTime));
+    event.delivered += lost == lostBefore;
+    event.sentTime = now;
+    ++event.transmissions;
+  }
+
+  void giveUp(BlinkEvent& event) {
+    ++blinksGivenUp;
+    allLost += event.delivered == 0;
+    event.transmissions = 0;
+  }
+
+  int fd;
+  double loss;
+  float sampleRate;
+  std::mt19937 random;
+  CalibrationEncoder encoder;
+  ProfileReceiver receiver;
+  BlinkEvent events[SIM_BLINK_WINDOW];
+  bool normal;
+  bool calibration;
+  uint8_t blinkSequence;
+};
+
+#endif
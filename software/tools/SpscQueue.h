@@ -0,0 +1,107 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// A ring of Capacity slots (a power of two) with a head index written only by the consumer and a
+// tail index written only by the producer. Each side keeps a cached copy of the other side's
+// index and reloads it only when the queue looks full (producer) or empty (consumer), so in the
+// common case push() and pop() touch no cache line written by the other thread.
+
+#define SPSC_CACHE_LINE 64
+
+template<typename T, size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0 && Capacity >= 2, "Capacity must be a power of two");
+
+public:
+  SpscQueue() : head(0), tailCache(0), tail(0), headCache(0) {
+  }
+
+  /**
+   * Producer: appends value. Returns false if the queue is full.
+   */
+  bool push(const T& value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - headCache == Capacity) {
+      headCache = head.load(std::memory_order_acquire);
+      if (t - headCache == Capacity) {
+        return false;
+      }
+    }
+    slots[t & (Capacity - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer: removes the oldest value. Returns false if the queue is empty.
+   */
+  bool pop(T& value) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tailCache) {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (h == tailCache) {
+        return false;
+      }
+    }
+    value = slots[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Either side: true if the queue was empty at some point during the call.
+   */
+  bool empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+private:
+  // The padding keeps both sides on their own cache lines without over-aligned types, which new
+  // does not support before C++17.
+  char padFront[SPSC_CACHE_LINE];
+
+  // Consumer side.
+  std::atomic<size_t> head;
+  size_t tailCache;
+  char padConsumer[SPSC_CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+  // Producer side.
+  std::atomic<size_t> tail;
+  size_t headCache;
+  char padProducer[SPSC_CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+  T slots[Capacity];
+};
+
+#endif
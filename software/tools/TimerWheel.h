@@ -0,0 +1,309 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hierarchical timer wheel for many deadlines in ms (no blink timers and reply timeouts of many
+// sessions).
+// TIMER_WHEEL_LEVELS levels of 64 slots: level 0 holds the timers due within 64 ms, one slot per
+// ms, level l the timers due within 64^(l+1) ms, one slot per 64^l ms. When the time reaches the
+// start of a slot of a higher level, its timers are moved down (cascaded). Deadlines further away
+// than the range wait in the top level and are placed again.
+// Timers are intrusive list nodes owned by the caller, so arm(), which also rearms, and cancel()
+// are O(1) and never allocate. An occupancy mask per level lets advance() skip empty slots and
+// nextDeadline() find the next tick with work without scanning.
+// Not thread safe: arm, cancel and advance from one thread, the callbacks run inside advance().
+
+#define TIMER_WHEEL_LEVELS      4       // range 64^4 ms = 4.6 h
+#define TIMER_WHEEL_SLOT_BITS   6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE       (1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+#define TIMER_WHEEL_DETACHED    0xFF    // level of a timer which is not in a slot
+
+struct WheelTimer {
+  WheelTimer() : prev(NULL), next(NULL), deadline(0), level(TIMER_WHEEL_DETACHED), slot(0), callback(NULL),
+                 context(NULL) {
+  }
+
+  bool armed() const {
+    return next != NULL;
+  }
+
+  WheelTimer* prev;
+  WheelTimer* next;
+  uint32_t deadline;            // ms
+  uint8_t level;                // TIMER_WHEEL_DETACHED while being fired
+  uint8_t slot;
+
+  // Called by advance() with the tick of the deadline. May arm or cancel any timer.
+  void (*callback)(WheelTimer* timer, uint32_t now);
+  void* context;
+};
+
+class TimerWheel {
+public:
+  explicit TimerWheel(uint32_t now = 0) : current(now), count(0) {
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; ++l) {
+      occupied[l] = 0;
+      for (int s = 0; s < TIMER_WHEEL_SLOTS; ++s) {
+        slots[l][s].prev = &slots[l][s];
+        slots[l][s].next = &slots[l][s];
+      }
+    }
+  }
+
+  /**
+   * Arms or rearms the timer. A deadline which is not after the current tick fires with the next tick.
+   */
+  void arm(WheelTimer& timer, uint32_t deadline) {
+    if (timer.armed()) {
+      unlink(timer);
+    } else {
+      ++count;
+    }
+    timer.deadline = deadline;
+    place(timer, current + 1);
+  }
+
+  void cancel(WheelTimer& timer) {
+    if (timer.armed()) {
+      unlink(timer);
+      --count;
+    }
+  }
+
+  /**
+   * Advances the time to now (ms) and fires the timers due on the way, in the order of their
+   * deadlines. Returns the number of fired timers.
+   */
+  size_t advance(uint32_t now) {
+    size_t fired = 0;
+    while ((int32_t)(now - current) > 0) {
+      uint32_t next = nextTick();
+      if ((int32_t)(next - now) > 0) {
+        current = now;
+        break;
+      }
+      current = next;
+      if ((current & TIMER_WHEEL_SLOT_MASK) == 0) {
+        cascade();
+      }
+      fired += fire(current & TIMER_WHEEL_SLOT_MASK);
+    }
+    return fired;
+  }
+
+  /**
+   * Returns true and the next tick at which advance() has work (a timer fires or timers are
+   * cascaded), false if no timer is armed. Never later than the earliest deadline.
+   */
+  bool nextDeadline(uint32_t& deadline) const {
+    if (count == 0) {
+      return false;
+    }
+    bool found = false;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; ++l) {
+      if (occupied[l] == 0) {
+        continue;
+      }
+      int shift = TIMER_WHEEL_SLOT_BITS * l;
+      uint32_t distance = slotDistance(occupied[l], (current >> shift) & TIMER_WHEEL_SLOT_MASK);
+      uint32_t tick = (((current >> shift) + distance) << shift);
+      if (!found || (int32_t)(tick - deadline) < 0) {
+        deadline = tick;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  uint32_t now() const {
+    return current;
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+private:
+  /**
+   * Puts the timer in the slot of its deadline, relative to the current tick. A deadline before
+   * earliest is treated as earliest (the current tick only while cascading, before it is fired).
+   */
+  void place(WheelTimer& timer, uint32_t earliest) {
+    uint32_t deadline = timer.deadline;
+    if ((int32_t)(deadline - earliest) < 0) {
+      deadline = earliest;
+    }
+    uint32_t delta = deadline - current;
+    if (delta >= TIMER_WHEEL_RANGE) {
+      delta = TIMER_WHEEL_RANGE - 1;
+      deadline = current + delta;
+    }
+    int level = 0;
+    while ((delta >> (TIMER_WHEEL_SLOT_BITS * (level + 1))) != 0) {
+      ++level;
+    }
+    int slot = (deadline >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+    WheelTimer& head = slots[level][slot];
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    timer.level = (uint8_t)level;
+    timer.slot = (uint8_t)slot;
+    occupied[level] |= (uint64_t)1 << slot;
+  }
+
+  void unlink(WheelTimer& timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    if (timer.level != TIMER_WHEEL_DETACHED) {
+      WheelTimer& head = slots[timer.level][timer.slot];
+      if (head.next == &head) {
+        occupied[timer.level] &= ~((uint64_t)1 << timer.slot);
+      }
+    }
+    timer.prev = NULL;
+    timer.next = NULL;
+  }
+
+  /**
+   * The next tick after the current one with a level 0 timer or the start of the next level 1 slot.
+   */
+  uint32_t nextTick() const {
+    uint32_t index = current & TIMER_WHEEL_SLOT_MASK;
+    uint32_t toBoundary = TIMER_WHEEL_SLOTS - index;
+    if (occupied[0] == 0) {
+      return current + toBoundary;
+    }
+    uint32_t distance = slotDistance(occupied[0], index);
+    return current + (distance < toBoundary ? distance : toBoundary);
+  }
+
+  /**
+   * Distance (1 to 64) from slot index to the next occupied slot, going round.
+   */
+  static uint32_t slotDistance(uint64_t mask, uint32_t index) {
+    uint32_t r = (index + 1) & TIMER_WHEEL_SLOT_MASK;
+    uint64_t rotated = r == 0 ? mask : (mask >> r) | (mask << (TIMER_WHEEL_SLOTS - r));
+    return lowestBit(rotated) + 1;
+  }
+
+  static uint32_t lowestBit(uint64_t mask) {
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_ctzll(mask);
+#else
+    uint32_t bit = 0;
+    while ((mask & 1) == 0) {
+      mask >>= 1;
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+
+  /**
+   * The current tick starts a level 1 slot: moves the timers of the slots starting now down,
+   * highest level first.
+   */
+  void cascade() {
+    int top = 1;
+    while (top < TIMER_WHEEL_LEVELS - 1 &&
+           (current & ((1UL << (TIMER_WHEEL_SLOT_BITS * (top + 1))) - 1)) == 0) {
+      ++top;
+    }
+    for (int l = top; l >= 1; --l) {
+      int slot = (current >> (TIMER_WHEEL_SLOT_BITS * l)) & TIMER_WHEEL_SLOT_MASK;
+      WheelTimer pending;
+      if (!detach(l, slot, pending)) {
+        continue;
+      }
+      while (pending.next != &pending) {
+        WheelTimer& timer = *pending.next;
+        unlink(timer);
+        place(timer, current);
+      }
+    }
+  }
+
+  /**
+   * Fires the timers of level 0 slot. A callback may arm or cancel any timer, also one of the
+   * same slot.
+   */
+  size_t fire(int slot) {
+    WheelTimer expired;
+    if (!detach(0, slot, expired)) {
+      return 0;
+    }
+    size_t fired = 0;
+    while (expired.next != &expired) {
+      WheelTimer& timer = *expired.next;
+      unlink(timer);
+      --count;
+      ++fired;
+      if (timer.callback != NULL) {
+        timer.callback(&timer, current);
+      }
+    }
+    return fired;
+  }
+
+  /**
+   * Moves the timers of a slot to the list head (a sentinel on the stack), marked as detached.
+   */
+  bool detach(int level, int slot, WheelTimer& list) {
+    WheelTimer& head = slots[level][slot];
+    if (head.next == &head) {
+      return false;
+    }
+    list.next = head.next;
+    list.prev = head.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head.next = &head;
+    head.prev = &head;
+    occupied[level] &= ~((uint64_t)1 << slot);
+    for (WheelTimer* timer = list.next; timer != &list; timer = timer->next) {
+      timer->level = TIMER_WHEEL_DETACHED;
+    }
+    return true;
+  }
+
+  uint32_t current;             // ms, all timers due at or before it have fired
+  size_t count;                 // armed timers
+  uint64_t occupied[TIMER_WHEEL_LEVELS];
+  WheelTimer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+#endif
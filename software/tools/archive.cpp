@@ -0,0 +1,307 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Tool for sample archives (SampleArchive.h), the recordings of the app and of serialcapture -a.
+ *
+ *   archive -l <archive>                 lists the sessions with time, samples and blinks
+ *   archive [-f s] [-t s] <archive>      prints the samples from -f to -t s after the first sample:
+ *                                        captures with raw counts in the format of serialcapture
+ *                                        (replay -r -), the others as Serial log (replay -)
+ *   archive -b queries [-d s] <archive>  times random time range queries of -d s
+ *   archive -w samples [-r rate] [-s samples] <archive>
+ *                                        appends a synthetic recording at -r samples/s in sessions
+ *                                        of -s samples and reports the write rate and the size
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino -I../cocoa-app/eyeDrops archive.cpp -o archive
+ * Usage:  archive [-l] [-f seconds] [-t seconds] [-b queries] [-d seconds] [-w samples] [-r rate] [-s samples] <archive>
+ *
+ * Exit code is 0 on success, 1 if a query returned wrong samples, 2 on errors.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sys/time.h>
+#include <vector>
+
+#include "SampleArchive.h"
+#include "SerialFrame.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static int64_t wallMicros() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void printTime(int64_t micros) {
+  time_t time = (time_t)(micros / 1000000);
+  char text[32];
+  strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&time));
+  printf("%s.%03d", text, (int)(micros / 1000 % 1000));
+}
+
+/**
+ * Lists the sessions: consecutive chunks with the same session number.
+ */
+static void list(const ArchiveReader& reader) {
+  printf("%u chunks, %u sessions, %.1f MiB mapped\n", reader.chunkCount, reader.header->sessionCount,
+         reader.size / 1048576.0);
+  uint32_t c = 0;
+  while (c < reader.chunkCount) {
+    const ArchiveChunkEntry& first = reader.index[c];
+    uint64_t samples = 0;
+    uint64_t blinks = 0;
+    uint32_t end = c;
+    for (; end < reader.chunkCount && reader.index[end].session == first.session; ++end) {
+      samples += reader.index[end].count;
+      blinks += reader.index[end].blinks;
+    }
+    printf("session %u: ", first.session);
+    printTime(first.firstTime);
+    printf(", %.1f s, %llu samples, %llu blinks, %u chunks\n",
+           (reader.index[end - 1].lastTime - first.firstTime) / 1e6, (unsigned long long)samples,
+           (unsigned long long)blinks, end - c);
+    c = end;
+  }
+}
+
+/**
+ * Prints the samples with from <= time < to.
+ */
+static void print(const ArchiveReader& reader, int64_t from, int64_t to) {
+  uint32_t c = archiveFindChunk(&reader, from);
+  bool raw = c < reader.chunkCount && archiveChunk(&reader, c)->raw[0] != 0;
+  if (raw) {
+    printf("# raw\ttime_us\tfiltered*100\tblink\tlevel\tedge\n");
+  }
+  for (; c < reader.chunkCount && reader.index[c].firstTime < to; ++c) {
+    ArchiveSlice slice;
+    archiveSlice(&reader, c, from, to, &slice);
+    for (uint32_t i = 0; i < slice.count; ++i) {
+      if (raw) {
+        printf("%u\t%lld\t%.4f\t%d\t%d\t%d\n", slice.raw[i], (long long)slice.time[i], slice.filtered[i] * 100,
+               slice.blink[i], (slice.state[i] >> SERIAL_FRAME_STATE_LEVEL) & 3,
+               ((slice.state[i] >> SERIAL_FRAME_STATE_EDGE) & 3) - 1);
+      } else {
+        printf("S%.2f\t%d\n", slice.filtered[i] * 100, slice.blink[i]);
+      }
+    }
+  }
+}
+
+/**
+ * Runs random queries of length s, checks them against a linear count of the index and returns
+ * false if a query returned a sample outside its range or the wrong number of samples.
+ */
+static bool benchmark(const ArchiveReader& reader, size_t queries, double length) {
+  if (reader.chunkCount == 0) {
+    printf("empty archive\n");
+    return true;
+  }
+  int64_t begin = reader.index[0].firstTime;
+  int64_t end = reader.index[reader.chunkCount - 1].lastTime + 1;
+  int64_t span = (int64_t)(length * 1e6);
+  std::mt19937_64 random(1);
+  uint64_t samples = 0;
+  double sum = 0;
+  bool ok = true;
+  std::vector<double> times;
+  for (size_t q = 0; q < queries; ++q) {
+    int64_t from = begin + (int64_t)(random() % (uint64_t)std::max<int64_t>(1, end - begin));
+    int64_t to = from + span;
+    Clock::time_point start = Clock::now();
+    uint64_t count = 0;
+    for (uint32_t c = archiveFindChunk(&reader, from); c < reader.chunkCount && reader.index[c].firstTime < to; ++c) {
+      ArchiveSlice slice;
+      archiveSlice(&reader, c, from, to, &slice);
+      for (uint32_t i = 0; i < slice.count; ++i) {
+        sum += slice.filtered[i];
+      }
+      if (slice.count > 0 && (slice.time[0] < from || slice.time[slice.count - 1] >= to)) {
+        ok = false;
+      }
+      count += slice.count;
+    }
+    times.push_back(seconds(start) * 1e6);
+    samples += count;
+    // Check the first queries against a scan of the chunks around the range.
+    if (q < 100) {
+      uint64_t expected = 0;
+      for (uint32_t c = 0; c < reader.chunkCount; ++c) {
+        if (reader.index[c].lastTime < from || reader.index[c].firstTime >= to) {
+          continue;
+        }
+        const ArchiveChunk* chunk = archiveChunk(&reader, c);
+        for (uint32_t i = 0; i < reader.index[c].count; ++i) {
+          expected += chunk->time[i] >= from && chunk->time[i] < to;
+        }
+      }
+      ok = ok && expected == count;
+    }
+  }
+  std::sort(times.begin(), times.end());
+  printf("%zu queries of %.1f s: %.1f samples per query, 50%% %.1f us, 99%% %.1f us, max %.1f us (checksum %.0f)\n",
+         queries, length, (double)samples / queries, times[times.size() / 2], times[times.size() * 99 / 100],
+         times.back(), sum);
+  printf("queries %s\n", ok ? "correct" : "WRONG");
+  return ok;
+}
+
+/**
+ * Appends a synthetic recording: a noisy distance with a blink every 4 s.
+ */
+static bool write(const char* path, uint64_t samples, double rate, uint64_t sessionSamples) {
+  ArchiveWriter* writer = new ArchiveWriter;
+  int64_t start = wallMicros();
+  if (!archiveOpen(writer, path, start)) {
+    fprintf(stderr, "ERROR: cannot open %s as archive\n", path);
+    delete writer;
+    return false;
+  }
+  if (writer->lastTime > start) {
+    start = writer->lastTime + 1;
+  }
+  std::mt19937 random(2);
+  std::normal_distribution<float> noise(0, 0.05f);
+  bool ok = true;
+  Clock::time_point begin = Clock::now();
+  for (uint64_t i = 0; i < samples && ok; ++i) {
+    if (i % sessionSamples == 0) {
+      ok = archiveBeginSession(writer);
+    }
+    uint64_t phase = i % (uint64_t)(4 * rate);
+    bool blink = phase == (uint64_t)(0.1 * rate);
+    ArchiveSample sample;
+    sample.time = start + (int64_t)(i * 1e6 / rate);
+    sample.filtered = 12.0f + noise(random) + (phase < 0.1 * rate ? 2.0f * sinf(phase / (0.1f * rate) * 3.14159f) : 0);
+    sample.raw = (uint16_t)(68000.0 / pow(sample.filtered, 1.765));
+    sample.blink = blink;
+    sample.state = blink ? SERIAL_FRAME_STATE_BLINK : (1 << SERIAL_FRAME_STATE_EDGE);
+    ok = ok && archiveAppend(writer, &sample);
+  }
+  ok = archiveClose(writer) && ok;
+  double elapsed = seconds(begin);
+  delete writer;
+  struct stat status;
+  stat(path, &status);
+  printf("wrote %llu samples (%.1f h at %.0f samples/s) in %.2f s: %.1f M samples/s, file %.1f MiB, %.1f MiB on disk\n",
+         (unsigned long long)samples, samples / rate / 3600, rate, elapsed, samples / elapsed / 1e6,
+         status.st_size / 1048576.0, status.st_blocks * 512 / 1048576.0);
+  if (!ok) {
+    fprintf(stderr, "ERROR: writing %s failed\n", path);
+  }
+  return ok;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-l] [-f seconds] [-t seconds] [-b queries] [-d seconds] [-w samples] [-r rate] "
+          "[-s samples] <archive>\n", name);
+}
+
+int main(int argc, char** argv) {
+  bool listSessions = false;
+  double from = 0;
+  double to = INFINITY;
+  size_t queries = 0;
+  double length = 10;
+  uint64_t writeSamples = 0;
+  double rate = 1000;
+  uint64_t sessionSamples = 3600000;
+  int opt;
+  while ((opt = getopt(argc, argv, "lf:t:b:d:w:r:s:")) != -1) {
+    switch (opt) {
+      case 'l':
+        listSessions = true;
+        break;
+      case 'f':
+        from = atof(optarg);
+        break;
+      case 't':
+        to = atof(optarg);
+        break;
+      case 'b':
+        queries = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        length = std::max(0.0, atof(optarg));
+        break;
+      case 'w':
+        writeSamples = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        rate = std::max(1.0, atof(optarg));
+        break;
+      case 's':
+        sessionSamples = std::max(1ULL, strtoull(optarg, NULL, 10));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  const char* path = argv[optind];
+
+  if (writeSamples > 0 && !write(path, writeSamples, rate, sessionSamples)) {
+    return 2;
+  }
+  if (writeSamples > 0 && !listSessions && queries == 0) {
+    return 0;
+  }
+
+  ArchiveReader reader;
+  if (!archiveMap(&reader, path)) {
+    fprintf(stderr, "ERROR: %s is no sample archive\n", path);
+    return 2;
+  }
+  bool ok = true;
+  if (listSessions) {
+    list(reader);
+  }
+  if (queries > 0) {
+    ok = benchmark(reader, queries, length);
+  }
+  if (!listSessions && queries == 0 && reader.chunkCount > 0) {
+    int64_t begin = reader.index[0].firstTime;
+    print(reader, begin + (int64_t)(from * 1e6), std::isinf(to) ? INT64_MAX : begin + (int64_t)(to * 1e6));
+  }
+  archiveUnmap(&reader);
+  return ok ? 0 : 1;
+}
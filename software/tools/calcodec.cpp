@@ -0,0 +1,235 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Round trip check and benchmark of the compressed calibration stream (CalibrationCodec.h).
+ *
+ * Builds the calibration stream of a recording (filtered values and blink flags as sent by
+ * the sketch), encodes it into frames, decodes them again and compares the result.
+ * Prints the bytes and frames per sample of the compressed stream compared to the single
+ * sample packages (0x02, 6 bytes per sample) and the float frames (0x04, 19 bytes per 4
+ * samples) and the encode time per sample on this machine.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino calcodec.cpp -o calcodec
+ * Usage:  calcodec [-x] [-r] [-n repeat] <recording>...
+ *   -x  fixed point detector of FIXED_POINT_DETECTION (default: floating point as in the sketch)
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -n  encode the stream n times for the timing (default 100)
+ *
+ * Serial logs already contain the filtered values, proximity captures are run through the
+ * blink detection first.
+ * Exit code is 0 if all streams survive the round trip unchanged, 1 otherwise.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "BlinkDetector.h"
+#include "CalibrationCodec.h"
+#include "Recording.h"
+
+// Same configuration as the sketch (MA_BUFFER, PROX_FILTERED_BUFFER).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> FixedDetector;
+typedef BlinkDetector<float, double, 16, 200> FloatDetector;
+
+struct Stream {
+  std::vector<int32_t> values;    // Q15.16 samples
+  std::vector<bool> blinks;       // blink flag per sample
+  double quantisationError;       // maximal error of the Q15.16 conversion in mm
+};
+
+/**
+ * Converts mm into Q15.16 like sampleToQ16() of the float build.
+ */
+int32_t toQ16(double x) {
+  return (int32_t)(x * 65536.0 + (x < 0 ? -0.5 : 0.5));
+}
+
+/**
+ * Converts a detector sample back into mm (integer types are Q15.16).
+ */
+template<typename T>
+double sampleToMM(T x) {
+  return (T)0.5 == 0 ? x / 65536.0 : (double)x;
+}
+
+/**
+ * Builds the calibration stream of a recording.
+ */
+template<typename Detector>
+Stream buildStream(const Recording& recording) {
+  Stream stream;
+  stream.quantisationError = 0;
+  Detector detector;
+  for (size_t i = 0; i < recording.values.size(); ++i) {
+    double value;
+    bool blink;
+    if (recording.filtered) {
+      value = recording.values[i];
+      blink = recording.blinkColumn[i] != 0;
+    } else {
+      blink = detector.update(Detector::accumFromMM(recording.values[i]));
+      value = sampleToMM(detector.filtered());
+    }
+    int32_t q = toQ16(value);
+    stream.quantisationError = std::max(stream.quantisationError, std::fabs(q / 65536.0 - value));
+    stream.values.push_back(q);
+    stream.blinks.push_back(blink);
+  }
+  return stream;
+}
+
+/**
+ * Encodes the stream into frames (concatenated, frameLengths holds the length of each).
+ */
+void encode(const Stream& stream, std::vector<uint8_t>& frames, std::vector<uint8_t>& frameLengths) {
+  CalibrationEncoder encoder(0x05);
+  frames.clear();
+  frameLengths.clear();
+  for (size_t i = 0; i <= stream.values.size(); ++i) {
+    bool done = i < stream.values.size() ? encoder.add(stream.values[i], stream.blinks[i])
+                                         : encoder.flush();
+    if (done) {
+      frames.insert(frames.end(), encoder.frame(), encoder.frame() + encoder.frameLength());
+      frameLengths.push_back(encoder.frameLength());
+    }
+  }
+}
+
+/**
+ * Decodes the frames and compares them to the stream.
+ * Also checks the sequence numbers. Returns the number of differences.
+ */
+size_t check(const Stream& stream, const std::vector<uint8_t>& frames,
+             const std::vector<uint8_t>& frameLengths) {
+  size_t differences = 0;
+  size_t sample = 0;
+  size_t offset = 0;
+  for (size_t f = 0; f < frameLengths.size(); ++f) {
+    const uint8_t* frame = &frames[offset];
+    offset += frameLengths[f];
+    if (frame[1] != (uint8_t)f) {
+      printf("frame %zu: sequence number %u\n", f, frame[1]);
+      ++differences;
+    }
+    int32_t values[CALIBRATION_CODEC_MAX_SAMPLES];
+    bool blinks[CALIBRATION_CODEC_MAX_SAMPLES];
+    int samples = decodeCalibrationFrame(frame, frameLengths[f], values, blinks);
+    if (samples < 0) {
+      printf("frame %zu: malformed\n", f);
+      ++differences;
+      continue;
+    }
+    for (int i = 0; i < samples; ++i, ++sample) {
+      if (sample >= stream.values.size() || values[i] != stream.values[sample]
+          || blinks[i] != stream.blinks[sample]) {
+        if (differences < 10) {
+          printf("frame %zu: sample %zu differs\n", f, sample);
+        }
+        ++differences;
+      }
+    }
+  }
+  if (sample != stream.values.size()) {
+    printf("%zu samples decoded, %zu expected\n", sample, stream.values.size());
+    ++differences;
+  }
+  return differences;
+}
+
+template<typename Detector>
+size_t run(const char* path, const Recording& recording, int repeat) {
+  Stream stream = buildStream<Detector>(recording);
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> frameLengths;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    encode(stream, frames, frameLengths);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t differences = check(stream, frames, frameLengths);
+
+  double n = stream.values.size();
+  double floatFrames = std::ceil(n / 4);
+  double floatBytes = 3 * floatFrames + 4 * n;
+  printf("%s: %zu samples, %zu frames, %.2f samples/frame, %.2f bytes/sample\n", path,
+         stream.values.size(), frameLengths.size(), n / frameLengths.size(), frames.size() / n);
+  printf("  vs 0x02 (6 bytes/sample): %.2fx bytes, %.2fx packages\n",
+         6 * n / frames.size(), n / frameLengths.size());
+  printf("  vs 0x04 (4 samples/frame): %.2fx bytes, %.2fx packages\n",
+         floatBytes / frames.size(), floatFrames / frameLengths.size());
+  printf("  encode %.1f ns/sample, quantisation error %.7f mm, %zu differences\n",
+         seconds * 1e9 / (n * repeat), stream.quantisationError, differences);
+  return differences;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-x] [-r] [-n repeat] <recording>...\n", name);
+}
+
+int main(int argc, char** argv) {
+  bool useFloat = true;
+  RecordingFormat format = RECORDING_AUTO;
+  int repeat = 100;
+  int opt;
+  while ((opt = getopt(argc, argv, "xrn:")) != -1) {
+    switch (opt) {
+      case 'x':
+        useFloat = false;
+        break;
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'n':
+        repeat = std::max(1, atoi(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  size_t differences = 0;
+  for (int a = optind; a < argc; ++a) {
+    Recording recording;
+    if (!loadRecording(argv[a], format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", argv[a]);
+      return 2;
+    }
+    differences += useFloat ? run<FloatDetector>(argv[a], recording, repeat)
+                            : run<FixedDetector>(argv[a], recording, repeat);
+  }
+  return differences == 0 ? 0 : 1;
+}
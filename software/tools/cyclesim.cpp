@@ -0,0 +1,297 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Simulation of the duty cycled loop of the sketch with a simulated clock and radio.
+ *
+ * Runs the loop() / sleepUntilNextCycle() of blinkDetect_v03_1.ino on a clock in us with the
+ * code of the sketch for the decisions: CycleScheduler.h for the sleep time, SampleClock.h for
+ * the sample slots and VCNL4020Acquisition.h on a simulated sensor (MockWire.h) for the data
+ * ready interrupt path. Simulated are:
+ *   - the radio: a connection event of -r us every -i ms. RFduinoBLE.radioActive is set during
+ *     the event and the SoftDevice preempts the loop (the loop makes no progress meanwhile).
+ *   - the CPU time of the loop: every I2C byte at the bus clock, the detection and the BLE
+ *     update of a sample (-p us) and a loop pass which does not sleep (-l us).
+ *   - RFduino_ULPDelay(): the loop sleeps for the given ms, the radio events still happen
+ *     meanwhile. The data ready interrupt ends the sleep (the INT pin is a wake source).
+ * With -c the calibration mode is on (samples are streamed, sleeping is not safe), with -n
+ * sleeping is switched off (SLEEP_BETWEEN_CYCLES commented out), with -w the data ready interrupt
+ * does not end a sleep.
+ *
+ * Reported are the scheduler statistics as printed by the sketch (slack per cycle, overruns,
+ * busy cycles, slept time), the share of the time asleep, the samples taken and missed, the
+ * delay from the data ready interrupt to the processing of the sample and the radio events
+ * which happened while the loop slept.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino cyclesim.cpp -o cyclesim
+ * Usage:  cyclesim [-s seconds] [-i radio interval ms] [-r radio event us] [-p processing us] [-l loop pass us]
+ *                  [-b I2C kHz] [-g guard ms] [-c] [-n] [-w]
+ *   -s  simulated time (default 60)
+ *   -i  interval of the radio events in ms (default 50, 0: no radio)
+ *   -r  duration of a radio event in us (default 3000)
+ *   -p  CPU time of detection and BLE update per sample in us (default 300)
+ *   -l  CPU time of a loop pass without sample in us (default 20)
+ *   -b  I2C clock in kHz (default 250, as Wire of the RFduino)
+ *   -g  guard of the scheduler in ms (default 1, as the sketch)
+ *   -c  calibration mode
+ *   -n  do not sleep
+ *   -w  sleep through the data ready interrupt
+ *
+ * Exit code is 0 if no sample slot was missed, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+#include "CycleScheduler.h"
+#include "MockWire.h"
+#include "SampleClock.h"
+#include "VCNL4020Acquisition.h"
+
+#define SAMPLE_PERIOD 6000  // same as the sketch
+#define SAMPLE_RING_SIZE 8  // same as the sketch
+
+struct Options {
+  double seconds;
+  uint32_t radioInterval;   // us, 0 without radio
+  uint32_t radioEvent;      // us
+  uint32_t processing;      // us per sample
+  uint32_t loopPass;        // us
+  uint32_t i2cKHz;
+  uint32_t guard;           // ms
+  bool calibration;
+  bool sleep;
+  bool wake;                // the data ready interrupt ends a sleep
+};
+
+/**
+ * Simulated time of the device.
+ * CPU time only passes outside of the radio events, the SoftDevice preempts the loop.
+ */
+class Device {
+public:
+  explicit Device(const Options& options) : options(options), now(1000), sleptUs(0), radioEvents(0), radioEventsAsleep(0) {
+  }
+
+  bool radioActive() const {
+    return options.radioInterval && now % options.radioInterval < options.radioEvent;
+  }
+
+  /**
+   * Spends us of CPU time of the loop.
+   */
+  void run(uint32_t us) {
+    while (us > 0) {
+      if (radioActive()) {
+        countRadioEvent(false);
+        now += options.radioEvent - now % options.radioInterval;
+        continue;
+      }
+      uint32_t untilRadio = options.radioInterval ? options.radioInterval - now % options.radioInterval : us;
+      uint32_t step = std::min(us, untilRadio);
+      now += step;
+      us -= step;
+    }
+  }
+
+  /**
+   * RFduino_ULPDelay(): the loop sleeps, the radio events happen meanwhile.
+   * With a wake source the sleep ends at wakeAt if that comes first.
+   */
+  void sleep(uint32_t ms, bool wake, uint64_t wakeAt) {
+    uint64_t end = now + (uint64_t)ms * 1000;
+    if (wake && wakeAt > now && wakeAt < end) {
+      end = wakeAt;
+    }
+    while (options.radioInterval && now + options.radioInterval - now % options.radioInterval < end) {
+      now += options.radioInterval - now % options.radioInterval;
+      countRadioEvent(true);
+    }
+    sleptUs += end - now;
+    now = end;
+  }
+
+  const Options& options;
+  uint64_t now;             // us
+  uint64_t sleptUs;
+  unsigned long radioEvents;
+  unsigned long radioEventsAsleep;
+
+private:
+  void countRadioEvent(bool asleep) {
+    uint64_t event = now / options.radioInterval;
+    if (event != lastEvent) {
+      lastEvent = event;
+      ++radioEvents;
+      radioEventsAsleep += asleep;
+    }
+  }
+
+  uint64_t lastEvent = (uint64_t)-1;
+};
+
+int simulate(const Options& options) {
+  std::vector<uint16_t> results(1, 2000);
+  MockWire wire(results, 600, 1000, 0);
+  VCNL4020Bus<MockWire> bus(wire, VCNL_ADDRESS);
+  SampleClock clock(SAMPLE_PERIOD);
+  VCNL4020Acquisition<MockWire, SAMPLE_RING_SIZE> acquisition(bus, clock);
+  CycleScheduler scheduler(options.guard);
+  Device device(options);
+
+  wire.now = device.now;
+  acquisition.beginInterrupt();
+  clock.start(device.now);
+
+  bool dataReady = false;
+  uint32_t dataReadyTime = 0;
+  uint64_t delaySum = 0;
+  uint32_t delayMax = 0;
+  unsigned long cycles = 0;
+  const uint64_t end = device.now + (uint64_t)(options.seconds * 1e6);
+  while (device.now < end) {
+    // data ready interrupt, also while the loop was sleeping or preempted
+    wire.now = device.now;
+    if (wire.tick(device.now)) {
+      dataReady = true;
+      dataReadyTime = wire.proxDone;
+    }
+
+    // loop(): updateVCNL4020(), the I2C bytes take their time on the bus
+    unsigned long bytes = wire.bytes;
+    acquisition.update(device.now, dataReady, dataReadyTime);
+    dataReady = false;
+    device.run((wire.bytes - bytes) * 9 * 1000 / options.i2cKHz);
+    uint16_t raw;
+    uint32_t time;
+    bool cycleDone = acquisition.take(raw, time);
+    if (cycleDone) {
+      uint32_t delay = (uint32_t)device.now - time;
+      delaySum += delay;
+      delayMax = std::max(delayMax, delay);
+      ++cycles;
+      device.run(options.processing);
+      int32_t untilSlot = clock.untilNextSlot(device.now);
+      scheduler.endCycle(device.now / 1000, device.now / 1000 + (untilSlot > 0 ? untilSlot / 1000 : 0));
+    }
+
+    // sleepUntilNextCycle()
+    bool busy = !options.sleep || device.radioActive() || options.calibration || acquisition.available();
+    uint32_t millis = device.now / 1000;
+    int32_t untilSlot = clock.untilNextSlot(device.now);
+    uint32_t next = millis + (untilSlot > 0 ? untilSlot / 1000 : 0);
+    uint32_t sleepMs = scheduler.sleepTime(millis, next, busy, cycleDone);
+    if (sleepMs > 0) {
+      uint32_t sleepStart = device.now / 1000;
+      device.sleep(sleepMs, options.wake && wire.proxRunning, wire.proxDone);
+      scheduler.sleptFor(device.now / 1000 - sleepStart);
+    } else {
+      device.run(options.loopPass);
+    }
+  }
+
+  const CycleStatistics& stats = scheduler.statistics();
+  const SampleClockStatistics& samples = clock.statistics();
+  double total = device.now - 1000;
+  printf("%.0f s, radio event %u us every %u ms, %u us per sample, I2C %u kHz%s%s%s\n",
+         options.seconds, options.radioEvent, options.radioInterval / 1000, options.processing, options.i2cKHz,
+         options.calibration ? ", calibration mode" : "", options.sleep ? "" : ", sleeping off",
+         options.wake ? "" : ", no wake on data ready");
+  printf("Cycles: %u\tslack min/avg/max [ms]: %d/%.2f/%d\toverruns: %u\tbusy: %u\tslept [ms]: %u\n",
+         stats.cycles, stats.slackMin, stats.cycles ? (double)stats.slackSum / stats.cycles : 0.0, stats.slackMax,
+         stats.overruns, stats.busy, stats.sleptMs);
+  printf("asleep %.1f %% of the time, %u samples, %u missed, interrupt to processing avg %.0f us max %u us\n",
+         100.0 * device.sleptUs / total, samples.samples, samples.missed,
+         cycles ? (double)delaySum / cycles : 0.0, delayMax);
+  printf("radio events: %lu, %lu of them while the loop slept\n", device.radioEvents, device.radioEventsAsleep);
+  return samples.missed == 0 ? 0 : 1;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-s seconds] [-i radio interval ms] [-r radio event us] [-p processing us] [-l loop pass us] "
+          "[-b I2C kHz] [-g guard ms] [-c] [-n] [-w]\n", name);
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  options.seconds = 60;
+  options.radioInterval = 50000;
+  options.radioEvent = 3000;
+  options.processing = 300;
+  options.loopPass = 20;
+  options.i2cKHz = 250;
+  options.guard = 1;
+  options.calibration = false;
+  options.sleep = true;
+  options.wake = true;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:i:r:p:l:b:g:cnw")) != -1) {
+    switch (opt) {
+      case 's':
+        options.seconds = std::max(1.0, atof(optarg));
+        break;
+      case 'i':
+        options.radioInterval = std::max(0L, atol(optarg)) * 1000;
+        break;
+      case 'r':
+        options.radioEvent = std::max(1L, atol(optarg));
+        break;
+      case 'p':
+        options.processing = std::max(0L, atol(optarg));
+        break;
+      case 'l':
+        options.loopPass = std::max(1L, atol(optarg));
+        break;
+      case 'b':
+        options.i2cKHz = std::max(1L, atol(optarg));
+        break;
+      case 'g':
+        options.guard = std::max(0L, atol(optarg));
+        break;
+      case 'c':
+        options.calibration = true;
+        break;
+      case 'n':
+        options.sleep = false;
+        break;
+      case 'w':
+        options.wake = false;
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc || (options.radioInterval && options.radioEvent >= options.radioInterval)) {
+    usage(argv[0]);
+    return 2;
+  }
+  return simulate(options);
+}
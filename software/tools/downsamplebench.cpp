@@ -0,0 +1,251 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Benchmark of the plot downsampling (PlotDownsampler.h) on long traces.
+ *
+ *   1. Streaming: -n samples of a synthetic trace (noisy slow drift with a blink dip every 4 s at
+ *      200 samples/s) are appended to the pyramid. Every 10^6 samples the whole trace so far is
+ *      downsampled to -w points, like a live plot. Reports ns per appended sample, the memory of
+ *      the pyramid and the time of the live plot queries.
+ *   2. Full range: the whole trace to -w points with the pyramid (MinMaxLTTB), with min/max over
+ *      all samples and with LTTB over all samples.
+ *   3. Zoom: -q random ranges (lengths from 10^3 samples to the whole trace) to -w points. The
+ *      min and max of every column are checked against a scan of the samples.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../cocoa-app/eyeDrops downsamplebench.cpp -o downsamplebench
+ * Usage:  downsamplebench [-n samples] [-w points] [-q queries]
+ *   -n  samples of the trace (default 100000000)
+ *   -w  points of the plot (default 1000, about the width of the plot in pixels)
+ *   -q  zoom queries (default 1000)
+ *
+ * Exit code is 0 if every checked column has the min and max of its samples, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "PlotDownsampler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * percent / 100));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+static size_t pyramidBytes(const MinMaxPyramid& pyramid) {
+  size_t bytes = 0;
+  for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+    bytes += pyramid.levels[level].capacity * sizeof(PyramidBucket);
+  }
+  return bytes;
+}
+
+/**
+ * Checks the min and max of every column against the samples. Returns the number of wrong
+ * columns.
+ */
+static size_t check(const MinMaxPyramid& pyramid, const float* samples, uint64_t from, uint64_t to,
+                    uint32_t columns) {
+  std::vector<PlotPoint> points(2 * columns);
+  uint32_t count = pyramidMinMax(&pyramid, samples, from, to, columns, &points[0]);
+  size_t wrong = 0;
+  uint32_t p = 0;
+  for (uint32_t column = 0; column < columns; ++column) {
+    uint64_t start = from + (to - from) * column / columns;
+    uint64_t end = from + (to - from) * (column + 1) / columns;
+    if (end <= start) {
+      continue;
+    }
+    float min = *std::min_element(samples + start, samples + end);
+    float max = *std::max_element(samples + start, samples + end);
+    uint32_t n = min == max ? 1 : 2;
+    if (p + n > count) {
+      return wrong + 1;
+    }
+    float low = std::min(points[p].value, points[p + n - 1].value);
+    float high = std::max(points[p].value, points[p + n - 1].value);
+    bool inside = points[p].index >= start && points[p + n - 1].index < end && points[p].index <= points[p + n - 1].index;
+    wrong += low != min || high != max || !inside;
+    p += n;
+  }
+  return wrong + (p != count);
+}
+
+/**
+ * Min/max per column over all samples, without the pyramid.
+ */
+static uint32_t scanMinMax(const float* samples, uint64_t from, uint64_t to, uint32_t columns, PlotPoint* points) {
+  uint32_t count = 0;
+  for (uint32_t column = 0; column < columns; ++column) {
+    uint64_t start = from + (to - from) * column / columns;
+    uint64_t end = from + (to - from) * (column + 1) / columns;
+    if (end <= start) {
+      continue;
+    }
+    uint64_t min = start;
+    uint64_t max = start;
+    for (uint64_t i = start + 1; i < end; ++i) {
+      if (samples[i] < samples[min]) {
+        min = i;
+      }
+      if (samples[i] > samples[max]) {
+        max = i;
+      }
+    }
+    points[count].index = std::min(min, max);
+    points[count++].value = samples[std::min(min, max)];
+    points[count].index = std::max(min, max);
+    points[count++].value = samples[std::max(min, max)];
+  }
+  return count;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n samples] [-w points] [-q queries]\n", name);
+}
+
+int main(int argc, char** argv) {
+  uint64_t samples = 100000000;
+  uint32_t width = 1000;
+  size_t queries = 1000;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:q:")) != -1) {
+    switch (opt) {
+      case 'n':
+        samples = std::max(1000ULL, strtoull(optarg, NULL, 10));
+        break;
+      case 'w':
+        width = (uint32_t)std::max(3L, atol(optarg));
+        break;
+      case 'q':
+        queries = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  // The trace: 200 samples/s, a blink every 4 s.
+  std::vector<float> trace(samples);
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0, 0.02f);
+  float drift = 12;
+  for (uint64_t i = 0; i < samples; ++i) {
+    drift += noise(random) * 0.05f;
+    uint64_t phase = i % 800;
+    trace[i] = drift + noise(random) + (phase < 40 ? -1.5f * sinf(phase / 40.0f * 3.14159f) : 0);
+  }
+
+  // 1. Streaming with live plot queries.
+  MinMaxPyramid pyramid;
+  pyramidInit(&pyramid);
+  std::vector<PlotPoint> scratch(4 * width);
+  std::vector<PlotPoint> points(std::max<uint64_t>(width, 2 * width));
+  std::vector<double> liveTimes;
+  double appendSeconds = 0;
+  uint64_t checksum = 0;
+  const uint64_t block = 1000000;
+  for (uint64_t from = 0; from < samples; from += block) {
+    uint64_t to = std::min(samples, from + block);
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = from; i < to; ++i) {
+      pyramidAppend(&pyramid, trace[i]);
+    }
+    appendSeconds += seconds(start);
+    start = Clock::now();
+    checksum += downsample(&pyramid, &trace[0], 0, to, width, &scratch[0], &points[0]);
+    liveTimes.push_back(seconds(start) * 1e6);
+  }
+  printf("append: %.2f ns/sample, pyramid %.1f MiB for %.1f MiB of samples\n", appendSeconds * 1e9 / samples,
+         pyramidBytes(pyramid) / 1048576.0, samples * sizeof(float) / 1048576.0);
+  printf("live plot of the whole trace every %llu samples: 50%% %.0f us, max %.0f us\n", (unsigned long long)block,
+         percentile(liveTimes, 50), percentile(liveTimes, 100));
+
+  // 2. Full range.
+  Clock::time_point start = Clock::now();
+  uint32_t count = downsample(&pyramid, &trace[0], 0, samples, width, &scratch[0], &points[0]);
+  double pyramidSeconds = seconds(start);
+  std::vector<PlotPoint> scanned(2 * width);
+  start = Clock::now();
+  checksum += scanMinMax(&trace[0], 0, samples, width, &scanned[0]);
+  double scanSeconds = seconds(start);
+  std::vector<PlotPoint> all(samples);
+  for (uint64_t i = 0; i < samples; ++i) {
+    all[i].index = i;
+    all[i].value = trace[i];
+  }
+  std::vector<PlotPoint> lttb(width);
+  start = Clock::now();
+  checksum += plotLttb(&all[0], (uint32_t)std::min<uint64_t>(samples, UINT32_MAX), width, &lttb[0]);
+  double lttbSeconds = seconds(start);
+  std::vector<PlotPoint>().swap(all);
+  printf("full range to %u points: pyramid %.0f us (%u points), min/max scan %.1f ms, LTTB of all samples %.1f ms\n",
+         width, pyramidSeconds * 1e6, count, scanSeconds * 1e3, lttbSeconds * 1e3);
+
+  // 3. Zoom.
+  std::vector<double> zoomTimes;
+  size_t wrong = 0;
+  size_t checked = 0;
+  std::uniform_real_distribution<double> exponent(3, log10((double)samples));
+  for (size_t q = 0; q < queries; ++q) {
+    uint64_t length = std::min<uint64_t>(samples, (uint64_t)pow(10, exponent(random)));
+    uint64_t from = length < samples ? random() % (samples - length) : 0;
+    start = Clock::now();
+    checksum += downsample(&pyramid, &trace[0], from, from + length, width, &scratch[0], &points[0]);
+    zoomTimes.push_back(seconds(start) * 1e6);
+    if (q < 200) {
+      wrong += check(pyramid, &trace[0], from, from + length, 2 * width);
+      checked += 2 * width;
+    }
+  }
+  if (queries > 0) {
+    printf("zoom (%zu queries): 50%% %.0f us, 99%% %.0f us, max %.0f us\n", queries, percentile(zoomTimes, 50),
+           percentile(zoomTimes, 99), percentile(zoomTimes, 100));
+  }
+  wrong += check(pyramid, &trace[0], 0, samples, 2 * width) + check(pyramid, &trace[0], 1, samples - 1, 7);
+  printf("checked %zu columns: %zu wrong (checksum %llu)\n", checked + 2 * width + 7, wrong,
+         (unsigned long long)checksum);
+  pyramidFree(&pyramid);
+  return wrong == 0 ? 0 : 1;
+}
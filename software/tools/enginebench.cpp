@@ -0,0 +1,415 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Benchmark of the multi device host engine (SessionEngine.h) with simulated RFDuinos
+ * (SimulatedPeripheral.h).
+ *
+ * For 1, 2, 4, ... up to the maximum number of devices: every device is a socket pair, the
+ * RFDuinos are driven by -t driver threads. The engine runs in its own thread, a consumer thread
+ * takes the events of all devices. A share of the devices (-c) is put into calibration as soon as
+ * its profile is applied and streams compressed calibration frames at the sample rate of the
+ * sketch (-r samples per second, noise of a few um like a resting eye), the others blink at
+ * random (-b blinks per second each). The calibration streams are the load: a blink is a single
+ * message, a calibration stream 10 to 20 messages per second.
+ * Per run the blink latency of the blinking devices (first transmission of the blink event by the
+ * RFDuino until the engine handled it), the throughput of the engine and the calibration samples
+ * decoded by the sessions are reported; the median latency should not grow with the number of
+ * devices as long as the engine keeps up. The driver threads share the CPUs with the engine, so on
+ * few cores the tail also measures how long a simulated RFDuino waited to be scheduled.
+ *
+ * Build:  g++ -O2 -std=c++11 -pthread -I../RFduino -I../cocoa-app/eyeDrops enginebench.cpp -o enginebench
+ * With -w the ms clock of the engine starts that many ms before it wraps at 2^32, so the no blink
+ * timers (-i) and reply timeouts have to work across the wrap: with -b 0 -i 1000 -w 500 the no blink
+ * timer of every blinking device is armed before the wrap and has to fire 0.5 s after it.
+ *
+ * Usage:  enginebench [-n devices] [-b blinks] [-c share] [-r rate] [-i ms] [-w ms] [-d seconds] [-t threads]
+ *                     [-l loss] [-s seed]
+ *   -n  maximum number of devices (default 512)
+ *   -b  blinks per second and blinking device (default 2)
+ *   -c  share of the devices streaming calibration samples, 0 to 1 (default 0.5)
+ *   -r  calibration samples per second and device (default 166.7, SAMPLE_PERIOD of the sketch)
+ *   -i  no blink interval in ms (default 4000)
+ *   -w  start the ms clock of the engine this many ms before its wrap (default: start at 0)
+ *   -d  duration of one run in s (default 2)
+ *   -t  driver threads of the RFDuinos (default 2)
+ *   -l  loss probability of the notifications of the RFDuinos (default 0)
+ *   -s  seed (default 1)
+ *
+ * Exit code is 0 if every device applied its profile, every blink arrived, except blinks whose
+ * transmissions were all lost, and every calibration sample arrived, except the samples of lost
+ * frames and of the last frame, which is not complete yet, and without blinks (-b 0) every
+ * blinking device blurred. 1 otherwise.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "SessionEngine.h"
+#include "SimulatedPeripheral.h"
+
+#define DRAIN_TIME 700  // ms to let the last blink events be acknowledged (more than 5 transmissions)
+#define CALIBRATION_NOISE 0.003 // mm, standard deviation of the simulated calibration samples
+
+static double percentile(std::vector<double> values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * percent / 100));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+/**
+ * Drives the RFDuinos with the given indices: messages of the engine, random blinks,
+ * retransmissions and the calibration samples of the devices in calibration. The device time of
+ * a blink event is the engine time in us of its first transmission, so the consumer can compute
+ * the latency.
+ */
+class Driver {
+public:
+  Driver(const SessionEngine& engine, double blinkRate, double sampleRate, uint32_t seed)
+      : engine(engine), blinkRate(blinkRate), samplePeriod(1e6 / sampleRate), random(seed),
+        epollFd(epoll_create1(0)), blinking(true), stopRequested(false) {
+  }
+
+  ~Driver() {
+    close(epollFd);
+  }
+
+  void add(int fd, SimulatedPeripheral* device) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = fds.size();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    fds.push_back(fd);
+    devices.push_back(device);
+    nextBlink.push_back(0);
+    nextSample.push_back(0);
+  }
+
+  void run() {
+    std::exponential_distribution<double> interval(blinkRate > 0 ? blinkRate / 1e6 : 1);
+    std::normal_distribution<double> noise(0, CALIBRATION_NOISE * 65536);
+    for (size_t i = 0; i < devices.size(); ++i) {
+      nextBlink[i] = engine.micros() + interval(random);
+    }
+    struct epoll_event ready[ENGINE_MAX_WAKEUPS];
+    while (!stopRequested) {
+      int count = epoll_wait(epollFd, ready, ENGINE_MAX_WAKEUPS, 1);
+      for (int i = 0; i < count; ++i) {
+        size_t index = ready[i].data.u64;
+        uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE + 1];
+        ssize_t length;
+        while ((length = recv(fds[index], data, sizeof(data), MSG_DONTWAIT)) > 0) {
+          devices[index]->receive(data, (int)length);
+        }
+      }
+      uint32_t now = engine.micros();
+      for (size_t i = 0; i < devices.size(); ++i) {
+        if (blinking && blinkRate > 0 && (int32_t)(now - (uint32_t)nextBlink[i]) >= 0) {
+          devices[i]->blink(now, now / 1000);
+          nextBlink[i] += interval(random);
+        }
+        if (!devices[i]->calibrating()) {
+          nextSample[i] = now;
+        }
+        // All samples which are due, the loop may have been late.
+        while (devices[i]->calibrating() && (int32_t)(now - (uint32_t)nextSample[i]) >= 0) {
+          devices[i]->calibrationSample((int32_t)noise(random), false);
+          nextSample[i] += samplePeriod;
+        }
+        devices[i]->update(now / 1000);
+      }
+    }
+  }
+
+  void stopBlinking() {
+    blinking = false;
+  }
+
+  void stop() {
+    stopRequested = true;
+  }
+
+private:
+  const SessionEngine& engine;
+  double blinkRate;
+  double samplePeriod;            // us
+  std::mt19937 random;
+  int epollFd;
+  std::vector<int> fds;
+  std::vector<SimulatedPeripheral*> devices;
+  std::vector<double> nextBlink;  // engine time in us
+  std::vector<double> nextSample; // engine time in us
+  std::atomic<bool> blinking;
+  std::atomic<bool> stopRequested;
+};
+
+/**
+ * Takes the events of all devices and starts the calibration of the calibrating devices once
+ * their profile is applied (the consumer is the control thread of the engine as well).
+ */
+struct Consumer {
+  Consumer(SessionEngine& engine, const std::vector<bool>& calibrating)
+      : engine(engine), calibrating(calibrating), handled(engine.deviceCount()), blurs(engine.deviceCount()),
+        profiles(0), stopRequested(false) {
+  }
+
+  void run() {
+    while (!stopRequested) {
+      bool any = false;
+      for (size_t d = 0; d < engine.deviceCount(); ++d) {
+        EngineEvent event;
+        while (engine.nextEvent(d, event)) {
+          any = true;
+          if (event.type == ENGINE_EVENT_BLINK && event.deviceTime != 0) {
+            latencies.push_back(event.time - event.deviceTime);
+            ++handled[d];
+          } else if (event.type == ENGINE_EVENT_START_BLUR) {
+            ++blurs[d];
+          } else if (event.type == ENGINE_EVENT_PROFILE_APPLIED) {
+            ++profiles;
+            if (calibrating[d]) {
+              EngineCommand command;
+              memset(&command, 0, sizeof(command));
+              command.type = ENGINE_COMMAND_START_CALIBRATION;
+              engine.post(d, command);
+            }
+          }
+        }
+      }
+      if (!any) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  SessionEngine& engine;
+  const std::vector<bool>& calibrating;
+  std::vector<double> latencies;        // us
+  std::vector<unsigned long> handled;   // blinks per device
+  std::vector<unsigned long> blurs;     // blurs per device
+  unsigned long profiles;
+  std::atomic<bool> stopRequested;
+};
+
+/**
+ * One run with the given number of devices. Returns false if a profile or a blink is missing.
+ */
+static bool runDevices(size_t count, double blinkRate, double share, double sampleRate, uint32_t interval,
+                       uint32_t startMillis, double seconds, size_t threads, double loss, uint32_t seed) {
+  SessionEngine engine(startMillis);
+  if (!engine.valid()) {
+    fprintf(stderr, "ERROR: no epoll\n");
+    return false;
+  }
+
+  // Default profile of BlinkDetector.h.
+  ProfileParameters profile = { -0.003f, 0.0025f, 0.0002f, -0.02f, 0.02f, { 4, 30 }, { 6, 35 }, { 30, 105 }, 4 };
+
+  std::vector<int> fds;
+  std::vector<std::unique_ptr<SimulatedPeripheral> > devices;
+  std::vector<std::unique_ptr<Driver> > drivers;
+  for (size_t t = 0; t < threads; ++t) {
+    drivers.push_back(std::unique_ptr<Driver>(new Driver(engine, blinkRate, sampleRate, seed + 1000 + (uint32_t)t)));
+  }
+  // Spread the calibrating devices evenly over the indices (and so over the driver threads).
+  std::vector<bool> calibrating(count);
+  for (size_t d = 0; d < count; ++d) {
+    calibrating[d] = (size_t)((d + 1) * share) > (size_t)(d * share);
+  }
+  for (size_t d = 0; d < count; ++d) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) != 0) {
+      perror("socketpair");
+      break;
+    }
+    fds.push_back(pair[0]);
+    fds.push_back(pair[1]);
+    devices.push_back(std::unique_ptr<SimulatedPeripheral>(
+        new SimulatedPeripheral(pair[1], loss, seed + (uint32_t)d, (float)sampleRate)));
+    drivers[d % threads]->add(pair[1], devices.back().get());
+    if (engine.addDevice(pair[0], profile, true, interval) < 0) {
+      perror("epoll_ctl");
+      break;
+    }
+  }
+
+  Consumer consumer(engine, calibrating);
+  std::vector<std::thread> driverThreads;
+  for (size_t t = 0; t < threads; ++t) {
+    driverThreads.push_back(std::thread(&Driver::run, drivers[t].get()));
+  }
+  std::thread consumerThread(&Consumer::run, &consumer);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::thread engineThread(&SessionEngine::run, &engine);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000)));
+  for (size_t t = 0; t < threads; ++t) {
+    drivers[t]->stopBlinking();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_TIME));
+  for (size_t t = 0; t < threads; ++t) {
+    drivers[t]->stop();
+    driverThreads[t].join();
+  }
+  engine.stop();
+  engineThread.join();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  consumer.stopRequested = true;
+  consumerThread.join();
+
+  // The last events may still be queued.
+  for (size_t d = 0; d < engine.deviceCount(); ++d) {
+    EngineEvent event;
+    while (engine.nextEvent(d, event)) {
+      if (event.type == ENGINE_EVENT_BLINK && event.deviceTime != 0) {
+        consumer.latencies.push_back(event.time - event.deviceTime);
+        ++consumer.handled[d];
+      } else if (event.type == ENGINE_EVENT_START_BLUR) {
+        ++consumer.blurs[d];
+      } else if (event.type == ENGINE_EVENT_PROFILE_APPLIED) {
+        ++consumer.profiles;
+      }
+    }
+  }
+
+  unsigned long blinks = 0;
+  unsigned long missing = 0;
+  unsigned long allLost = 0;
+  unsigned long streams = 0;
+  unsigned long samples = 0;
+  unsigned long decoded = 0;
+  unsigned long missingSamples = 0;
+  unsigned long blurs = 0;
+  unsigned long unblurred = 0;  // blinking devices without blur although they did not blink
+  for (size_t d = 0; d < devices.size(); ++d) {
+    blurs += consumer.blurs[d];
+    unblurred += !calibrating[d] && blinkRate == 0 && seconds * 1000 > interval && consumer.blurs[d] == 0;
+    blinks += devices[d]->blinks;
+    allLost += devices[d]->allLost;
+    if (consumer.handled[d] < devices[d]->blinks) {
+      missing += devices[d]->blinks - consumer.handled[d];
+    }
+    const DeviceSession& session = engine.session(d);
+    streams += calibrating[d];
+    samples += devices[d]->calibrationSamples;
+    decoded += session.calibrationSamples;
+    unsigned long excused = (session.lostCalibrationFrames + 1) * CALIBRATION_CODEC_MAX_SAMPLES;
+    if (session.calibrationSamples + excused < devices[d]->calibrationSamples) {
+      missingSamples += devices[d]->calibrationSamples - excused - session.calibrationSamples;
+    }
+  }
+  const EngineStatistics& stats = engine.statistics();
+  printf("%5zu devices (%4lu calibrating): %6lu blinks, %5lu missing, latency 50%% %6.0f us, 99%% %6.0f us, "
+         "max %7.0f us, %8lu calibration samples, %6lu decoded/s, %4lu missing, %7.0f messages/s, "
+         "%.1f messages/wakeup, %lu profiles, %lu blurs, %lu timers, %lu dropped events\n",
+         devices.size(), streams, blinks, missing, percentile(consumer.latencies, 50),
+         percentile(consumer.latencies, 99), percentile(consumer.latencies, 100), samples,
+         (unsigned long)(decoded / elapsed), missingSamples, stats.messages / elapsed,
+         stats.wakeups ? (double)stats.messages / stats.wakeups : 0.0, consumer.profiles,
+         blurs, (unsigned long)stats.timers, (unsigned long)stats.droppedEvents);
+
+  for (size_t i = 0; i < fds.size(); ++i) {
+    close(fds[i]);
+  }
+  return consumer.profiles >= devices.size() && missing <= allLost && missingSamples == 0 && unblurred == 0
+      && devices.size() == count;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n devices] [-b blinks] [-c share] [-r rate] [-i ms] [-w ms] [-d seconds] [-t threads] "
+          "[-l loss] [-s seed]\n", name);
+}
+
+int main(int argc, char** argv) {
+  size_t maxDevices = 512;
+  double blinkRate = 2;
+  double share = 0.5;
+  double sampleRate = 166.7;
+  uint32_t interval = 4000;
+  uint32_t startMillis = 0;
+  double seconds = 2;
+  size_t threads = 2;
+  double loss = 0;
+  uint32_t seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:c:r:i:w:d:t:l:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        maxDevices = std::max(1L, atol(optarg));
+        break;
+      case 'b':
+        blinkRate = std::max(0.0, atof(optarg));
+        break;
+      case 'c':
+        share = std::min(1.0, std::max(0.0, atof(optarg)));
+        break;
+      case 'r':
+        sampleRate = std::max(1.0, atof(optarg));
+        break;
+      case 'i':
+        interval = (uint32_t)std::max(1L, atol(optarg));
+        break;
+      case 'w':
+        startMillis = (uint32_t)0 - (uint32_t)std::max(0L, atol(optarg));
+        break;
+      case 'd':
+        seconds = std::max(0.0, atof(optarg));
+        break;
+      case 't':
+        threads = std::max(1L, atol(optarg));
+        break;
+      case 'l':
+        loss = std::min(1.0, std::max(0.0, atof(optarg)));
+        break;
+      case 's':
+        seed = (uint32_t)atol(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  bool ok = true;
+  for (size_t devices = 1; devices <= maxDevices; devices *= 2) {
+    ok &= runDevices(devices, blinkRate, share, sampleRate, interval, startMillis, seconds, threads, loss, seed);
+  }
+  return ok ? 0 : 1;
+}
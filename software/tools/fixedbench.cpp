@@ -0,0 +1,240 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Check and benchmark of the fixed point blink detection (FIXED_POINT_DETECTION).
+ *
+ * Per recording:
+ *   1. Check: the fixed point detector of the sketch and the floating point detector run on the
+ *      same Q15.16 input with the same Q15.16 profile. Blink decisions, blink levels and edge
+ *      types have to be identical for every sample. The blinks of the floating point detector
+ *      on the unquantised input are listed for comparison (quantising the input is the only
+ *      difference which is left).
+ *   2. Benchmark: ns per sample of both detectors (the best of -n runs after a warm up run) and,
+ *      on x86, time stamp counter ticks per sample.
+ *      The host has a floating point unit, the nRF51822 (Cortex-M0) of the RFduino has not:
+ *      there every float operation is a library call, so the host numbers are a lower bound of
+ *      the saving. On the board the sketch measures it with DETECTOR_TIMING.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino fixedbench.cpp -o fixedbench
+ * Usage:  fixedbench [-r] [-n runs] <recording>...
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -n  benchmark runs per recording (default 20)
+ *
+ * Exit code is 0 if both detectors make the same decisions on all recordings, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FIXEDBENCH_TSC
+#endif
+
+#include "BlinkDetector.h"
+#include "Recording.h"
+
+// Same configurations as the sketch with and without FIXED_POINT_DETECTION (see FixedPoint.h).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> FixedDetector;
+typedef BlinkDetector<float, double, 16, 200> FloatDetector;
+
+/**
+ * Sets the profile of the floating point detector to the exact values of the fixed point profile.
+ */
+void copyProfile(const FixedDetector& fixed, FloatDetector& detector) {
+  const BlinkParameters<int32_t>& from = fixed.params;
+  BlinkParameters<float>& to = detector.params;
+  to.edgePosThresh = from.edgePosThresh / 65536.0f;
+  to.edgeNegThresh = from.edgeNegThresh / 65536.0f;
+  to.hyst = from.hyst / 65536.0f;
+  to.max_max = from.max_max / 65536.0f;
+  to.min_min = from.min_min / 65536.0f;
+  for (int i = 0; i < 2; ++i) {
+    to.t_fall[i] = from.t_fall[i];
+    to.t_rise[i] = from.t_rise[i];
+    to.t_total[i] = from.t_total[i];
+  }
+  to.allowedZeros = from.allowedZeros;
+}
+
+/**
+ * Replays the Q15.16 input through both detectors and returns the number of samples with a
+ * different blink decision, blink level or edge type. 'blinks' is set to the number of blinks.
+ */
+size_t compare(const Recording& recording, const std::vector<int32_t>& input, size_t& blinks) {
+  FixedDetector fixed;
+  FloatDetector floating;
+  copyProfile(fixed, floating);
+  size_t mismatches = 0;
+  blinks = 0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    bool a;
+    bool b;
+    if (recording.filtered) {
+      a = fixed.updateFiltered(input[i]);
+      b = floating.updateFiltered(input[i] / 65536.0f);
+    } else {
+      a = fixed.update(input[i]);
+      b = floating.update(input[i] / 65536.0);
+    }
+    blinks += a;
+    if (a != b || fixed.level() != floating.level() || fixed.edge() != floating.edge()) {
+      if (mismatches == 0) {
+        printf("  first mismatch at sample %zu: blink %d/%d, level %d/%d, edge %d/%d\n",
+               i, a, b, fixed.level(), floating.level(), fixed.edge(), floating.edge());
+      }
+      ++mismatches;
+    }
+  }
+  return mismatches;
+}
+
+struct Timing {
+  double ns;          // per sample
+  double ticks;       // time stamp counter ticks per sample, 0 if not available
+};
+
+inline uint64_t ticks() {
+#ifdef FIXEDBENCH_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Times the detector on the input, the best of 'runs' runs after one warm up run.
+ */
+template<typename Detector, typename Input>
+Timing measure(bool filtered, const std::vector<Input>& input, unsigned runs) {
+  Timing best = {0, 0};
+  size_t blinks = 0;
+  for (unsigned run = 0; run <= runs; ++run) {
+    Detector detector;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startTicks = ticks();
+    if (filtered) {
+      for (size_t i = 0; i < input.size(); ++i) {
+        blinks += detector.updateFiltered(input[i]);
+      }
+    } else {
+      for (size_t i = 0; i < input.size(); ++i) {
+        blinks += detector.update(input[i]);
+      }
+    }
+    uint64_t elapsedTicks = ticks() - startTicks;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (run == 0) {
+      continue; // warm up
+    }
+    Timing timing = {seconds * 1e9 / input.size(), (double)elapsedTicks / input.size()};
+    if (run == 1 || timing.ns < best.ns) {
+      best = timing;
+    }
+  }
+  if (blinks == (size_t)-1) {
+    printf("\n"); // keeps the loops from being optimised away
+  }
+  return best;
+}
+
+void printTiming(const char* title, const Timing& timing) {
+  printf("  %s: %.2f ns/sample", title, timing.ns);
+  if (timing.ticks > 0) {
+    printf(", %.1f TSC ticks/sample", timing.ticks);
+  }
+  printf("\n");
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r] [-n runs] <recording>...\n", name);
+}
+
+int main(int argc, char** argv) {
+  RecordingFormat format = RECORDING_AUTO;
+  unsigned runs = 20;
+  int opt;
+  while ((opt = getopt(argc, argv, "rn:")) != -1) {
+    switch (opt) {
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'n':
+        runs = std::max(1L, atol(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  bool identical = true;
+  for (int a = optind; a < argc; ++a) {
+    Recording recording;
+    if (!loadRecording(argv[a], format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", argv[a]);
+      return 2;
+    }
+    // Q15.16 input of the fixed point detector and the same values for the floating point one.
+    std::vector<int32_t> input(recording.values.size());
+    std::vector<float> filteredInput(input.size());
+    std::vector<double> proximityInput(input.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = recording.filtered ? FixedDetector::fromMM(recording.values[i])
+                                    : FixedDetector::accumFromMM(recording.values[i]);
+      filteredInput[i] = input[i] / 65536.0f;
+      proximityInput[i] = input[i] / 65536.0;
+    }
+
+    printf("%s: %zu samples (%s)\n", argv[a], input.size(), recording.filtered ? "Serial log" : "proximity capture");
+    size_t blinks;
+    size_t mismatches = compare(recording, input, blinks);
+    FloatDetector unquantised;
+    size_t unquantisedBlinks = replayRecording(recording, unquantised).size();
+    printf("  fixed point: %zu blinks, floating point: %s, floating point on unquantised input: %zu blinks\n",
+           blinks, mismatches == 0 ? "same decisions" : "DIFFERENT decisions", unquantisedBlinks);
+    if (mismatches != 0) {
+      printf("  %zu samples differ\n", mismatches);
+      identical = false;
+    }
+
+    Timing fixedTiming = measure<FixedDetector>(recording.filtered, input, runs);
+    Timing floatTiming = recording.filtered ? measure<FloatDetector>(true, filteredInput, runs)
+                                            : measure<FloatDetector>(false, proximityInput, runs);
+    printTiming("fixed point   ", fixedTiming);
+    printTiming("floating point", floatTiming);
+  }
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Simulation of the sample journal (Journal.h) with a link that drops and comes back.
+ *
+ * A recording is run through the blink detection as in the sketch, one sample every 6 ms.
+ * The link is up for -u and down for -d seconds (each +-50 % at random). The simulated
+ * RFduino follows Bluetooth.ino:
+ *   - while disconnected every sample goes into the journal,
+ *   - after a connect the app sets normal mode, then the journal is sent one block every
+ *     JOURNAL_DRAIN_TIME ms, but only while no blink event waits for its acknowledgement,
+ *   - blink events are sent right away.
+ * The link sends up to -p packets per connection event (every -c ms) from a queue of
+ * QUEUE_SIZE packets (a full queue rejects a send). Packets still queued when the link drops
+ * are lost.
+ * The simulated app decodes the journal and compares it to the samples of the outages.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino journalsim.cpp -o journalsim
+ * Usage:  journalsim [-r] [-u up] [-d down] [-c interval] [-p packets] [-s seed] <recording>
+ *   -r  proximity capture contains raw counts instead of mm
+ *   -u  mean time connected in s (default 10)
+ *   -d  mean time disconnected in s (default 5)
+ *   -c  connection interval in ms (default 30)
+ *   -p  packets per connection event (default 4)
+ *   -s  seed (default 1)
+ *
+ * Exit code is 0 if every journaled sample arrived unchanged and every blink of an outage
+ * arrived, unless its block was overwritten or lost with the link, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+#include "Journal.h"
+#include "ProtocolCodec.h"
+#include "Recording.h"
+
+// Same configuration as the sketch.
+#define SAMPLE_PERIOD_MS 6
+#define JOURNAL_BLOCKS 96
+#define JOURNAL_DECIMATION 8
+#define JOURNAL_INTERVAL (JOURNAL_DECIMATION * SAMPLE_PERIOD_MS)
+#define JOURNAL_DRAIN_TIME 30
+#define NORMAL_MODE_DELAY 300     // ms from connect until the app sets normal mode
+#define QUEUE_SIZE 6              // packets the radio can hold
+typedef BlinkDetector<int32_t, int32_t, 16, 200> Detector;
+
+struct Packet {
+  uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE];
+  uint8_t length;
+  uint32_t time;                  // ms the packet was handed to the radio
+};
+
+struct Sample {
+  uint32_t time;
+  int32_t value;                  // Q15.16
+  bool blink;
+  bool connected;
+};
+
+struct Result {
+  size_t outageSamples;           // samples taken while disconnected
+  size_t journalSamples;          // samples decoded from the journal
+  size_t mismatches;              // decoded samples not matching a sample of an outage
+  size_t outageBlinks;
+  size_t recoveredBlinks;
+  size_t journalFrames;
+  size_t lostFrames;              // sequence gaps seen by the app
+  uint32_t droppedBlocks;         // overwritten blocks
+  size_t liveBlinks;
+  double latencySum;              // ms from detection to arrival of live blink events
+  uint32_t latencyMax;
+  size_t drainBlinks;             // live blinks while the journal was sent
+  double drainLatencySum;
+  uint32_t drainLatencyMax;
+};
+
+/**
+ * Runs the recording through the blink detection, one sample every SAMPLE_PERIOD_MS ms.
+ */
+std::vector<Sample> buildSamples(const Recording& recording) {
+  std::vector<Sample> samples;
+  Detector detector;
+  for (size_t i = 0; i < recording.values.size(); ++i) {
+    Sample sample;
+    sample.time = (uint32_t)(i * SAMPLE_PERIOD_MS);
+    if (recording.filtered) {
+      sample.blink = recording.blinkColumn[i] != 0;
+      sample.value = Detector::fromMM(recording.values[i]);
+    } else {
+      sample.blink = detector.update(Detector::accumFromMM(recording.values[i]));
+      sample.value = detector.filtered();
+    }
+    sample.connected = true;
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+/**
+ * Index of the first sample not before time.
+ */
+size_t sampleAt(const std::vector<Sample>& samples, int64_t time) {
+  if (time <= 0) {
+    return 0;
+  }
+  return std::min(samples.size(), (size_t)((time + SAMPLE_PERIOD_MS - 1) / SAMPLE_PERIOD_MS));
+}
+
+/**
+ * Compares a decoded journal block to the samples.
+ */
+void checkBlock(const uint8_t* frame, uint8_t length, const std::vector<Sample>& samples,
+                std::vector<bool>& blinkFound, Result& result) {
+  uint32_t time;
+  int32_t values[JOURNAL_MAX_SAMPLES];
+  bool blinks[JOURNAL_MAX_SAMPLES];
+  int n = decodeJournalBlock(frame + JOURNAL_FRAME_HEADER_SIZE, length - JOURNAL_FRAME_HEADER_SIZE,
+                             &time, values, blinks);
+  if (n < 0) {
+    ++result.mismatches;
+    return;
+  }
+  for (int i = 0; i < n; ++i) {
+    int64_t t = (int64_t)time + (int64_t)i * JOURNAL_INTERVAL;
+    // the sample taken within half an interval of t with this value
+    bool found = false;
+    for (size_t s = sampleAt(samples, t - JOURNAL_INTERVAL / 2);
+         s < samples.size() && samples[s].time <= t + JOURNAL_INTERVAL / 2; ++s) {
+      if (!samples[s].connected && samples[s].value == values[i]) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      if (result.mismatches < 10) {
+        printf("journal sample at %lld ms does not match\n", (long long)t);
+      }
+      ++result.mismatches;
+    }
+    if (blinks[i]) {
+      // the flag is set on the first kept sample at or after the blink
+      for (size_t s = sampleAt(samples, t - JOURNAL_INTERVAL * 3 / 2);
+           s < samples.size() && samples[s].time <= t + JOURNAL_INTERVAL / 2; ++s) {
+        if (samples[s].blink && !samples[s].connected) {
+          blinkFound[s] = true;
+        }
+      }
+    }
+    ++result.journalSamples;
+  }
+}
+
+Result simulate(std::vector<Sample>& samples, double up, double down, uint32_t interval,
+                int packetsPerEvent, unsigned long seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> spread(0.5, 1.5);
+  Result result = Result();
+  Journal<JOURNAL_BLOCKS> journal(JOURNAL_DECIMATION, JOURNAL_INTERVAL);
+  std::deque<Packet> queue;
+  std::vector<bool> blinkFound(samples.size());
+  std::vector<uint32_t> blinkSent;          // detection time of unacknowledged live blinks
+  std::vector<uint32_t> blinkAckTime;       // time their acknowledgement arrives (0: not yet)
+
+  bool connected = true;
+  uint32_t linkChange = (uint32_t)(up * 1000 * spread(random));
+  uint32_t connectTime = 0;
+  bool drain = false;
+  bool flushPending = false;
+  uint32_t journalSentTime = 0;
+  uint32_t nextEvent = interval;
+  int lastSequence = -1;
+
+  // After the recording the link stays up until the journal is sent.
+  for (size_t i = 0; i < samples.size() || journal.blocks() > 0 || !queue.empty() || flushPending; ++i) {
+    bool recorded = i < samples.size();
+    uint32_t now = (uint32_t)(i * SAMPLE_PERIOD_MS);
+    if (!recorded && !connected) {
+      linkChange = now;
+    }
+
+    // link
+    while (now >= linkChange && (recorded || !connected)) {
+      connected = !connected;
+      if (connected) {
+        connectTime = linkChange;
+        flushPending = true;
+        linkChange += (uint32_t)(up * 1000 * spread(random));
+      } else {
+        queue.clear();                      // lost with the link
+        drain = false;
+        blinkSent.clear();
+        blinkAckTime.clear();
+        linkChange += (uint32_t)(down * 1000 * spread(random));
+      }
+    }
+    while (nextEvent <= now) {
+      for (int p = 0; p < packetsPerEvent && connected && !queue.empty(); ++p) {
+        Packet& packet = queue.front();
+        if (packet.data[0] == PROTOCOL_OUT_JOURNAL) {
+          ++result.journalFrames;
+          if (lastSequence >= 0 && (uint8_t)(packet.data[1] - lastSequence - 1) != 0) {
+            result.lostFrames += (uint8_t)(packet.data[1] - lastSequence - 1);
+          }
+          lastSequence = packet.data[1];
+          checkBlock(packet.data, packet.length, samples, blinkFound, result);
+        } else {
+          uint8_t sequence;
+          uint32_t time = 0;
+          protocolDecodeBlinkEvent(packet.data, packet.length, &sequence, &time);
+          uint32_t latency = nextEvent - time;
+          ++result.liveBlinks;
+          result.latencySum += latency;
+          result.latencyMax = std::max(result.latencyMax, latency);
+          if (journal.blocks() > 0 && drain) {
+            ++result.drainBlinks;
+            result.drainLatencySum += latency;
+            result.drainLatencyMax = std::max(result.drainLatencyMax, latency);
+          }
+          // the app acknowledges with a write in the next connection event
+          for (size_t b = 0; b < blinkSent.size(); ++b) {
+            if (blinkSent[b] == time && blinkAckTime[b] == 0) {
+              blinkAckTime[b] = nextEvent + interval;
+            }
+          }
+        }
+        queue.pop_front();
+      }
+      nextEvent += interval;
+    }
+    for (size_t b = 0; b < blinkSent.size();) {
+      if (blinkAckTime[b] != 0 && blinkAckTime[b] <= now) {
+        blinkSent.erase(blinkSent.begin() + b);
+        blinkAckTime.erase(blinkAckTime.begin() + b);
+      } else {
+        ++b;
+      }
+    }
+    if (connected && now - connectTime >= NORMAL_MODE_DELAY) {
+      drain = true;
+    }
+
+    // sketch (updateBLE())
+    Sample idle = Sample();
+    Sample& sample = recorded ? samples[i] : idle;
+    sample.connected = connected;
+    if (!connected) {
+      journal.add(now, sample.value, sample.blink);
+      ++result.outageSamples;
+      result.outageBlinks += sample.blink;
+      continue;
+    }
+    if (sample.blink && queue.size() < QUEUE_SIZE) {
+      Packet packet;
+      packet.length = protocolEncodeBlinkEvent(packet.data, 0, now);
+      packet.time = now;
+      queue.push_back(packet);
+      blinkSent.push_back(now);
+      blinkAckTime.push_back(0);
+    }
+    if (!drain) {
+      continue;
+    }
+    if (flushPending) {
+      flushPending = false;
+      journal.flush();
+    }
+    if (journal.blocks() == 0 || !blinkSent.empty() || now - journalSentTime < JOURNAL_DRAIN_TIME) {
+      continue;
+    }
+    if (queue.size() < QUEUE_SIZE) {
+      Packet packet;
+      packet.length = journal.frame(PROTOCOL_OUT_JOURNAL, packet.data);
+      packet.time = now;
+      queue.push_back(packet);
+      journal.pop();
+    }
+    journalSentTime = now;
+  }
+  result.droppedBlocks = journal.droppedBlocks();
+  for (size_t s = 0; s < samples.size(); ++s) {
+    result.recoveredBlinks += blinkFound[s];
+  }
+  return result;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r] [-u up] [-d down] [-c interval] [-p packets] [-s seed] <recording>\n", name);
+}
+
+int main(int argc, char** argv) {
+  RecordingFormat format = RECORDING_AUTO;
+  double up = 10;
+  double down = 5;
+  uint32_t interval = 30;
+  int packets = 4;
+  unsigned long seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "ru:d:c:p:s:")) != -1) {
+    switch (opt) {
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'u':
+        up = atof(optarg);
+        break;
+      case 'd':
+        down = atof(optarg);
+        break;
+      case 'c':
+        interval = std::max(1, atoi(optarg));
+        break;
+      case 'p':
+        packets = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1 || up <= 0 || down <= 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  Recording recording;
+  if (!loadRecording(argv[optind], format, recording)) {
+    fprintf(stderr, "ERROR: no samples read from %s\n", argv[optind]);
+    return 2;
+  }
+
+  std::vector<Sample> samples = buildSamples(recording);
+  Result r = simulate(samples, up, down, interval, packets, seed);
+  size_t expected = r.outageSamples / JOURNAL_DECIMATION;
+  printf("outages: %zu samples, %zu blinks\n", r.outageSamples, r.outageBlinks);
+  printf("journal: %zu frames, %zu samples (%.1f %% of the kept samples), %.2f samples/frame\n",
+         r.journalFrames, r.journalSamples, expected ? 100.0 * r.journalSamples / expected : 0.0,
+         r.journalFrames ? (double)r.journalSamples / r.journalFrames : 0.0);
+  printf("         %zu mismatches, %zu frames lost with the link, %u blocks overwritten\n",
+         r.mismatches, r.lostFrames, r.droppedBlocks);
+  printf("blinks of the outages: %zu of %zu recovered\n", r.recoveredBlinks, r.outageBlinks);
+  printf("live blinks: %zu, latency avg %.1f ms, max %u ms\n", r.liveBlinks,
+         r.liveBlinks ? r.latencySum / r.liveBlinks : 0.0, r.latencyMax);
+  printf("live blinks while sending the journal: %zu, latency avg %.1f ms, max %u ms\n", r.drainBlinks,
+         r.drainBlinks ? r.drainLatencySum / r.drainBlinks : 0.0, r.drainLatencyMax);
+
+  bool blinksOk = r.recoveredBlinks == r.outageBlinks || r.droppedBlocks > 0 || r.lostFrames > 0;
+  return r.mismatches == 0 && blinksOk ? 0 : 1;
+}
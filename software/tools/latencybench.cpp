@@ -0,0 +1,434 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Worst case latency of the blink detection per sample: incremental extreme value tracking
+ * (BlinkDetector.h) against the original rescan of the history when an edge closes.
+ *
+ * OriginalDetector below is the detection of RTBlinkDetection.ino before the extreme values
+ * were tracked incrementally, unchanged except for being wrapped in a class. Both detectors use
+ * the floating point types of the sketch without FIXED_POINT_DETECTION.
+ *
+ * Every recording is replayed -n times. The latency of a sample is the minimum over the runs
+ * (removes interrupts and cache misses of the first run), reported are the mean, the 99.9th
+ * percentile and the maximum over all samples, and the samples which closed an edge.
+ * A synthetic trace with the longest possible edges (the filtered value stays above the
+ * positive and below the negative threshold for almost PROX_FILTERED_BUFFER samples) is
+ * always included.
+ * The blink decisions of both detectors are compared as well. They differ because the
+ * incremental tracking does not reproduce the quirks of the rescan loops: the sample after a
+ * new maximum was skipped, repeated minima were compared against maxVal, a repeated extreme
+ * value at index 0 was ignored and the wrap-around branch for repeated maxima was unreachable.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino latencybench.cpp -o latencybench
+ * Usage:  latencybench [-r] [-n runs] [<recording>...]
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -n  runs per recording (default 20)
+ *
+ * Exit code is 0 if the worst case of the incremental tracking is below the one of the rescan
+ * on the synthetic trace, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+#include "Recording.h"
+
+#define MA_BUFFER             16
+#define PROX_FILTERED_BUFFER  200
+
+typedef BlinkDetector<float, double, MA_BUFFER, PROX_FILTERED_BUFFER> Detector;
+
+/**
+ * Blink detection of RTBlinkDetection.ino with the rescan of proxFilteredBuffer.
+ */
+class OriginalDetector {
+public:
+  OriginalDetector() {
+    for (int i = 0; i < PROX_FILTERED_BUFFER; ++i) {
+      proxFilteredBuffer[i] = 0;
+    }
+    for (int i = 0; i < MA_BUFFER; ++i) {
+      maBuffer[i] = 0;
+    }
+    edgePosThresh = 0.0025;
+    edgeNegThresh = -0.003;
+    hyst = 0.0002;
+    max_max = 0.02;
+    min_min = -0.02;
+    t_fall[0] = 4;
+    t_fall[1] = 30;
+    t_rise[0] = 6;
+    t_rise[1] = 35;
+    t_total[0] = 30;
+    t_total[1] = 105;
+    allowedZeros = 4;
+  }
+
+  bool update(double proximity) {
+    bool justBlinked = false;
+
+    // 1. Get the differential value to remove DC offset.
+    double diff_prox = -lastProximity + proximity;
+
+    // 2. Apply a moving average filter on the differential values
+    maSum -= maBuffer[iMa];
+    maBuffer[iMa] = diff_prox;
+    maSum += maBuffer[iMa];
+
+    // store value in analysing buffer.
+    proxFilteredBuffer[iP] = maSum / MA_BUFFER;
+
+    // 3. Find zero crossings
+    detectZeroCrossing();
+
+    // 4. Find rising and falling edges
+    performEdgeDetectionAndExtremeValueDetermination();
+
+    // 5. Evaluate current edge and zero crossing situation
+    if (blinkLevel != 0 &&
+        (iP < iBlinkLevel ? iP + PROX_FILTERED_BUFFER - iBlinkLevel : iP - iBlinkLevel) > t_total[1]) {
+      blinkLevel = 0;
+    }
+
+    if (edgeType == -1 && blinkLevel == 0) {
+      if (iZero == iP) {
+        lengths[0] = iMin < iZeroPrev ? iMin + PROX_FILTERED_BUFFER - iZeroPrev : iMin - iZeroPrev;
+      } else {
+        lengths[0] = iMin < iZero ? iMin + PROX_FILTERED_BUFFER - iZero : iMin - iZero;
+      }
+      if (lengths[0] >= t_fall[0] && lengths[0] <= t_fall[1]) {
+        blinkLevel = 1;
+        zeroCount = 0;
+        iBlinkLevel = iP;
+      } else {
+        blinkLevel = 0;
+      }
+    } else if (edgeType == 1 && blinkLevel == 1) {
+      lengths[1] = iMax < iMin ? iMax + PROX_FILTERED_BUFFER - iMin : iMax - iMin;
+      if (lengths[1] >= t_rise[0] && lengths[1] <= t_rise[1] && zeroCount < allowedZeros) {
+        blinkLevel = 2;
+        iBlinkLevel = iP;
+        justBlinked = true;
+      } else {
+        blinkLevel = 0;
+      }
+    } else if (iZero == iP && blinkLevel == 2) {
+      lengths[2] = iP < iMax ? iP + PROX_FILTERED_BUFFER - iMax : iP - iMax;
+      blinkLevel = 0;
+    }
+
+    iMa = (iMa + 1) % MA_BUFFER;
+    iP = (iP + 1) % PROX_FILTERED_BUFFER;
+
+    if (iP == iMin) {
+      iMin = -1;
+    }
+    if (iP == iMax) {
+      iMax = -1;
+    }
+    if (iP == iBlinkLevel) {
+      blinkLevel = 0;
+      iBlinkLevel = iP;
+    }
+    if (iP == iEdgeRisingPos) {
+      iEdgeRisingPos = -1;
+    }
+    if (iP == iEdgeFallingPos) {
+      iEdgeFallingPos = -1;
+    }
+    if (iP == iEdgeRisingNeg) {
+      iEdgeRisingNeg = -1;
+    }
+    if (iP == iEdgeFallingNeg) {
+      iEdgeFallingNeg = -1;
+    }
+    lastProximity = proximity;
+    return justBlinked;
+  }
+
+  int8_t edge() const {
+    return edgeType;
+  }
+
+private:
+  void detectZeroCrossing() {
+    if (lessZero && proxFilteredBuffer[iP] >= 0) {
+      lessZero = false;
+      iZeroPrev = iZero;
+      iZero = iP;
+    } else if (!lessZero && proxFilteredBuffer[iP] <= 0) {
+      lessZero = true;
+      iZeroPrev = iZero;
+      iZero = iP;
+    }
+  }
+
+  void performEdgeDetectionAndExtremeValueDetermination() {
+    edgeType = 0;
+
+    if (!abovePos && proxFilteredBuffer[iP] > edgePosThresh + hyst) {
+      iEdgeRisingPos = iP;
+      abovePos = true;
+    } else if (abovePos && proxFilteredBuffer[iP] < edgePosThresh - hyst) {
+      if (iEdgeRisingPos >= 0) {
+        iEdgeFallingPos = iP;
+
+        int i = iEdgeRisingPos;
+        maxVal = 0;
+        int iAmax = -1; // first max val
+        int iZmax = -1; // last max val
+        while (i != iEdgeFallingPos) {
+          if (proxFilteredBuffer[i] > maxVal) {
+            maxVal = proxFilteredBuffer[i];
+            iAmax = i;
+            iZmax = -1;
+            i = (i + 1) % PROX_FILTERED_BUFFER;
+          } else if (proxFilteredBuffer[i] == maxVal) {
+            iZmax = i;
+          }
+          i = (i + 1 + PROX_FILTERED_BUFFER) % PROX_FILTERED_BUFFER;
+        }
+        if (iZmax > 0) {
+          if (iZmax > iAmax) {
+            iMax = (iZmax + iAmax) / 2;
+          } else if (iZmax > iAmax) {
+            iMax = (iAmax + (iZmax + PROX_FILTERED_BUFFER - iAmax) / 2) % PROX_FILTERED_BUFFER;
+          }
+        } else {
+          iMax = iAmax;
+        }
+        edgeType = 1;
+      }
+      abovePos = false;
+    } else if (!belowNeg && proxFilteredBuffer[iP] < edgeNegThresh - hyst) {
+      iEdgeFallingNeg = iP;
+      belowNeg = true;
+    } else if (belowNeg && proxFilteredBuffer[iP] > edgeNegThresh + hyst) {
+      iEdgeRisingNeg = iP;
+
+      if (iEdgeFallingNeg >= 0) {
+        int i = iEdgeFallingNeg;
+
+        minVal = 0;
+        int iAmin = -1; // first min val
+        int iZmin = -1; // last min val
+        while (i != iEdgeRisingNeg) {
+          if (proxFilteredBuffer[i] < minVal) {
+            minVal = proxFilteredBuffer[i];
+            iAmin = i;
+            iZmin = -1;
+          } else if (proxFilteredBuffer[i] == maxVal) {
+            iZmin = i;
+          }
+          i = (i + 1 + PROX_FILTERED_BUFFER) % PROX_FILTERED_BUFFER;
+        }
+        if (iZmin > 0) {
+          if (iZmin > iAmin) {
+            iMin = (iZmin + iAmin) / 2;
+          } else if (iZmin < iAmin) {
+            iMin = (iAmin + (iZmin + PROX_FILTERED_BUFFER - iAmin) / 2) % PROX_FILTERED_BUFFER;
+          }
+        } else {
+          iMin = iAmin;
+        }
+        edgeType = -1;
+      }
+      belowNeg = false;
+    }
+  }
+
+  float proxFilteredBuffer[PROX_FILTERED_BUFFER];
+  double maBuffer[MA_BUFFER];
+  double maSum = 0;
+  double lastProximity = 0;
+  uint8_t iMa = 0;
+  int iP = 0;
+
+  float edgePosThresh;
+  float edgeNegThresh;
+  float hyst;
+  float max_max;
+  float min_min;
+  uint8_t t_fall[2];
+  uint8_t t_rise[2];
+  uint16_t t_total[2];
+  uint8_t allowedZeros;
+
+  int iZero = 0;
+  int iZeroPrev = 0;
+  int zeroCount = 0;
+  int iEdgeRisingPos = 0;
+  int iEdgeFallingPos = 0;
+  int iEdgeRisingNeg = 0;
+  int iEdgeFallingNeg = 0;
+  int iMax = 0;
+  int iMin = 0;
+  double maxVal = 0;
+  double minVal = 0;
+  int8_t edgeType = 0;
+  bool lessZero = false;
+  bool abovePos = false;
+  bool belowNeg = false;
+  uint8_t blinkLevel = 0;
+  uint8_t iBlinkLevel = 0;
+  int lengths[3] = {0, 0, 0};
+};
+
+struct Latency {
+  double mean;        // ns
+  double p999;        // ns, 99.9th percentile
+  double max;         // ns
+  double maxEdge;     // ns, worst sample which closed an edge
+  size_t blinks;
+};
+
+/**
+ * Replays the proximity values 'runs' times and returns the latency statistics per sample.
+ */
+template<typename T>
+Latency measure(const std::vector<double>& proximity, unsigned runs) {
+  typedef std::chrono::steady_clock Clock;
+  const size_t n = proximity.size();
+  std::vector<double> best(n, 1e30);
+  std::vector<unsigned char> closed(n);
+  Latency latency = {0, 0, 0, 0, 0};
+  for (unsigned run = 0; run <= runs; ++run) {
+    T detector;
+    size_t blinks = 0;
+    for (size_t i = 0; i < n; ++i) {
+      Clock::time_point start = Clock::now();
+      bool blinked = detector.update(proximity[i]);
+      double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+      blinks += blinked;
+      closed[i] = detector.edge() != 0;
+      if (run > 0) {
+        best[i] = std::min(best[i], ns); // run 0 is the warm up
+      }
+    }
+    latency.blinks = blinks;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    latency.mean += best[i] / n;
+    latency.max = std::max(latency.max, best[i]);
+    if (closed[i]) {
+      latency.maxEdge = std::max(latency.maxEdge, best[i]);
+    }
+  }
+  std::sort(best.begin(), best.end());
+  latency.p999 = best[std::min(n - 1, (size_t)(n * 0.999))];
+  return latency;
+}
+
+/**
+ * Replays the proximity values through both detectors and returns the number of samples with a
+ * different blink decision.
+ */
+size_t compare(const std::vector<double>& proximity) {
+  Detector detector;
+  OriginalDetector original;
+  size_t differences = 0;
+  for (size_t i = 0; i < proximity.size(); ++i) {
+    differences += detector.update(proximity[i]) != original.update(proximity[i]);
+  }
+  return differences;
+}
+
+/**
+ * Returns a trace with edges as long as possible: the proximity rises for 180 samples, rests,
+ * falls for 180 samples and rests, so the filtered value stays above the positive (below the
+ * negative) threshold for about 180 + MA_BUFFER samples.
+ */
+std::vector<double> worstCaseTrace(size_t length) {
+  std::vector<double> proximity(length);
+  double value = 10.0;
+  for (size_t i = 0; i < length; ++i) {
+    size_t phase = i % 400;
+    if (phase < 180) {
+      value += 0.01;
+    } else if (phase >= 200 && phase < 380) {
+      value -= 0.01;
+    }
+    proximity[i] = value;
+  }
+  return proximity;
+}
+
+bool report(const char* name, const std::vector<double>& proximity, unsigned runs) {
+  Latency incremental = measure<Detector>(proximity, runs);
+  Latency rescan = measure<OriginalDetector>(proximity, runs);
+  printf("%s: %zu samples, blinks %zu incremental / %zu rescan, %zu samples decide differently\n",
+         name, proximity.size(), incremental.blinks, rescan.blinks, compare(proximity));
+  printf("  incremental: mean %6.1f ns, 99.9%% %6.1f ns, max %7.1f ns, max on edge close %7.1f ns\n",
+         incremental.mean, incremental.p999, incremental.max, incremental.maxEdge);
+  printf("  rescan:      mean %6.1f ns, 99.9%% %6.1f ns, max %7.1f ns, max on edge close %7.1f ns\n",
+         rescan.mean, rescan.p999, rescan.max, rescan.maxEdge);
+  return incremental.maxEdge < rescan.maxEdge;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r] [-n runs] [<recording>...]\n", name);
+}
+
+int main(int argc, char** argv) {
+  RecordingFormat format = RECORDING_AUTO;
+  unsigned runs = 20;
+  int opt;
+  while ((opt = getopt(argc, argv, "rn:")) != -1) {
+    switch (opt) {
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'n':
+        runs = std::max(1L, atol(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  bool ok = report("synthetic worst case", worstCaseTrace(20000), runs);
+  for (int a = optind; a < argc; ++a) {
+    Recording recording;
+    if (!loadRecording(argv[a], format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", argv[a]);
+      return 2;
+    }
+    if (recording.filtered) {
+      fprintf(stderr, "ERROR: %s is a Serial log, the original detector needs proximity values\n", argv[a]);
+      return 2;
+    }
+    report(argv[a], recording.values, runs);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Check and benchmark of the multi channel blink detection (MultiBlinkDetector.h).
+ *
+ * Every channel replays one of the given recordings, starting at a different offset.
+ *   1. Check: the decisions of every channel are compared to a single channel BlinkDetector
+ *      running on the same samples.
+ *   2. Benchmark: throughput of MultiBlinkDetector and of one BlinkDetector per channel
+ *      for 1, 2, 4, ... up to the maximum number of channels.
+ *
+ * Build:  g++ -O3 -march=native -std=c++11 -I../RFduino multibench.cpp -o multibench
+ * Usage:  multibench [-x] [-r] [-c channels] [-m max channels] [-s samples] <recording>...
+ *   -x  fixed point detector of FIXED_POINT_DETECTION (default: floating point as in the sketch)
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -c  number of channels of the check (default 64)
+ *   -m  maximum number of channels of the benchmark (default 4096)
+ *   -s  channel samples per benchmark run (default 20000000)
+ *
+ * Exit code is 0 if all channels match the single channel detector, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "BlinkDetector.h"
+#include "MultiBlinkDetector.h"
+#include "Recording.h"
+
+/**
+ * Builds the input of 'channels' channels for 'length' time steps, time step major
+ * (all channels of one time step next to each other). Channel c replays recording
+ * c % recordings.size() starting at an offset depending on c.
+ */
+template<typename T>
+std::vector<T> buildInput(const std::vector<std::vector<T> >& recordings, size_t channels, size_t length) {
+  std::vector<T> input(channels * length);
+  for (size_t c = 0; c < channels; ++c) {
+    const std::vector<T>& recording = recordings[c % recordings.size()];
+    size_t offset = (c / recordings.size() * 997) % recording.size();
+    for (size_t t = 0; t < length; ++t) {
+      input[t * channels + c] = recording[(offset + t) % recording.size()];
+    }
+  }
+  return input;
+}
+
+template<typename Sample, typename Accum>
+class Bench {
+public:
+  typedef BlinkDetector<Sample, Accum, 16, 200> Detector;
+  typedef MultiBlinkDetector<Sample, Accum, 16, 200> MultiDetector;
+
+  Bench(const std::vector<Recording>& recordings) : filtered(recordings[0].filtered) {
+    for (size_t r = 0; r < recordings.size(); ++r) {
+      std::vector<Accum> converted;
+      for (size_t i = 0; i < recordings[r].values.size(); ++i) {
+        converted.push_back(filtered ? (Accum)Detector::fromMM(recordings[r].values[i])
+                                     : Detector::accumFromMM(recordings[r].values[i]));
+      }
+      data.push_back(converted);
+    }
+    length = 0;
+    for (size_t r = 0; r < data.size(); ++r) {
+      length = std::max(length, data[r].size());
+    }
+  }
+
+  /**
+   * Compares the multi channel detector to single channel detectors.
+   * Returns the number of differing decisions.
+   */
+  size_t check(size_t channels) {
+    std::vector<Accum> input = buildInput(data, channels, length);
+    MultiDetector multi(channels);
+    std::vector<Detector> single(channels);
+    std::vector<uint8_t> justBlinked(channels);
+    std::vector<Sample> filteredInput(channels);
+    size_t blinks = 0;
+    size_t differences = 0;
+    for (size_t t = 0; t < length; ++t) {
+      const Accum* in = &input[t * channels];
+      step(multi, in, &filteredInput[0], &justBlinked[0]);
+      for (size_t c = 0; c < channels; ++c) {
+        bool blinked = filtered ? single[c].updateFiltered((Sample)in[c]) : single[c].update(in[c]);
+        blinks += blinked;
+        if (blinked != (justBlinked[c] != 0)) {
+          if (differences < 10) {
+            printf("difference on channel %zu at sample %zu\n", c, t);
+          }
+          ++differences;
+        }
+      }
+    }
+    printf("check: %zu channels x %zu samples, %zu blinks, %zu differences\n",
+           channels, length, blinks, differences);
+    return differences;
+  }
+
+  /**
+   * Prints the throughput of both detectors for 'channels' channels.
+   */
+  void benchmark(size_t channels, size_t channelSamples) {
+    size_t steps = std::max((size_t)1, std::min(length * 4, channelSamples / channels));
+    std::vector<Accum> input = buildInput(data, channels, steps);
+    std::vector<uint8_t> justBlinked(channels);
+    std::vector<Sample> filteredInput(channels);
+    size_t blinksMulti = 0;
+    size_t blinksSingle = 0;
+
+    MultiDetector multi(channels);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < steps; ++t) {
+      step(multi, &input[t * channels], &filteredInput[0], &justBlinked[0]);
+      for (size_t c = 0; c < channels; ++c) {
+        blinksMulti += justBlinked[c];
+      }
+    }
+    double multiSeconds = seconds(start);
+
+    std::vector<Detector> single(channels);
+    start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < steps; ++t) {
+      const Accum* in = &input[t * channels];
+      for (size_t c = 0; c < channels; ++c) {
+        blinksSingle += filtered ? single[c].updateFiltered((Sample)in[c]) : single[c].update(in[c]);
+      }
+    }
+    double singleSeconds = seconds(start);
+
+    double samples = (double)steps * channels;
+    printf("%6zu channels: multi %7.1f M samples/s, single %7.1f M samples/s, speedup %.2f (%zu / %zu blinks)\n",
+           channels, samples / multiSeconds / 1e6, samples / singleSeconds / 1e6,
+           singleSeconds / multiSeconds, blinksMulti, blinksSingle);
+  }
+
+private:
+  void step(MultiDetector& multi, const Accum* in, Sample* filteredInput, uint8_t* justBlinked) {
+    if (filtered) {
+      for (size_t c = 0; c < multi.channels(); ++c) {
+        filteredInput[c] = (Sample)in[c];
+      }
+      multi.updateFiltered(filteredInput, justBlinked);
+    } else {
+      multi.update(in, justBlinked);
+    }
+  }
+
+  static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  bool filtered;                              // recordings are Serial logs
+  std::vector<std::vector<Accum> > data;      // converted recordings
+  size_t length;                              // length of the longest recording
+};
+
+template<typename Sample, typename Accum>
+int run(const std::vector<Recording>& recordings, size_t checkChannels, size_t maxChannels,
+        size_t channelSamples) {
+  Bench<Sample, Accum> bench(recordings);
+  size_t differences = bench.check(checkChannels);
+  for (size_t channels = 1; channels <= maxChannels; channels *= 2) {
+    bench.benchmark(channels, channelSamples);
+  }
+  return differences == 0 ? 0 : 1;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-x] [-r] [-c channels] [-m max channels] [-s samples] <recording>...\n", name);
+}
+
+int main(int argc, char** argv) {
+  bool useFloat = true;
+  RecordingFormat format = RECORDING_AUTO;
+  size_t checkChannels = 64;
+  size_t maxChannels = 4096;
+  size_t channelSamples = 20000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "xrc:m:s:")) != -1) {
+    switch (opt) {
+      case 'x':
+        useFloat = false;
+        break;
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'c':
+        checkChannels = std::max(1L, atol(optarg));
+        break;
+      case 'm':
+        maxChannels = std::max(1L, atol(optarg));
+        break;
+      case 's':
+        channelSamples = std::max(1L, atol(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Recording> recordings;
+  for (int a = optind; a < argc; ++a) {
+    Recording recording;
+    if (!loadRecording(argv[a], format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", argv[a]);
+      return 2;
+    }
+    if (!recordings.empty() && recording.filtered != recordings[0].filtered) {
+      fprintf(stderr, "ERROR: %s mixes Serial logs and proximity captures\n", argv[a]);
+      return 2;
+    }
+    recordings.push_back(recording);
+  }
+
+  if (useFloat) {
+    // Filtered samples are floats, proximity values doubles (see FixedPoint.h).
+    if (recordings[0].filtered) {
+      return run<float, float>(recordings, checkChannels, maxChannels, channelSamples);
+    }
+    return run<float, double>(recordings, checkChannels, maxChannels, channelSamples);
+  }
+  return run<int32_t, int32_t>(recordings, checkChannels, maxChannels, channelSamples);
+}
@@ -0,0 +1,378 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Latency benchmark of the blink profile upload against a simulated RFduino.
+ *
+ * Compares the two ways the app can upload a profile:
+ *   - per parameter: 12 PROTOCOL_IN_SET_PARAMETER writes, the last one (allowed zeros) is
+ *     answered with PROTOCOL_OUT_PARAMETERS_SET.
+ *   - packed: one checksummed profile in PROFILE_MESSAGE_PARTS writes, answered with
+ *     PROTOCOL_OUT_PROFILE_SET (see ProfileMessage.h).
+ * The app writes with response, i.e. one write per connection event pair. Every packet is
+ * lost with a given probability and then repeated by the link layer in the next connection
+ * event, the connection drops with a given probability per event.
+ * The simulated RFduino decodes the writes with the code of the sketch and runs the blink
+ * detection at the sample rate meanwhile, so the samples processed with a mix of the old and
+ * the new profile are counted as well.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino profilebench.cpp -o profilebench
+ * Usage:  profilebench [-c interval] [-l loss] [-d drop] [-n uploads] [-s seed]
+ *   -c  connection interval in ms (default 30)
+ *   -l  packet loss probability (default 0.05)
+ *   -d  connection drop probability per connection event (default 0.001)
+ *   -n  number of simulated uploads per method (default 10000)
+ *   -s  seed
+ *
+ * Exit code is 0 if every completed upload left the same parameters on the device as the
+ * profile sent, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+#include "ProfileMessage.h"
+#include "ProtocolCodec.h"
+
+#define SAMPLE_RATE 166.67 // samples/s of the sketch (SAMPLE_PERIOD 6000 us)
+
+typedef BlinkParameters<int32_t> Parameters;
+
+/**
+ * Link model: a connection event every 'interval' ms. A write with response takes one event
+ * for the request and one for the response, a notification one event. Each packet is lost
+ * with probability 'loss' and then repeated in the next event.
+ */
+class Link {
+public:
+  Link(double interval, double loss, double drop, unsigned seed)
+    : intervalMs(interval), lossProbability(loss), dropProbability(drop), random(seed) {}
+
+  /**
+   * Transmits one packet starting at 'time' (ms). Returns the time it arrived, or a negative
+   * value if the connection dropped meanwhile.
+   */
+  double transmit(double time) {
+    double event = std::ceil(time / intervalMs) * intervalMs;
+    for (;;) {
+      if (uniform(random) < dropProbability) {
+        return -1;
+      }
+      if (uniform(random) >= lossProbability) {
+        return event;
+      }
+      event += intervalMs;
+    }
+  }
+
+  double interval() const {
+    return intervalMs;
+  }
+
+private:
+  double intervalMs;
+  double lossProbability;
+  double dropProbability;
+  std::mt19937 random;
+  std::uniform_real_distribution<double> uniform;
+};
+
+typedef BlinkDetector<int32_t, int32_t, 16, 200> Detector;
+
+/**
+ * Packs a profile as sent by the app (12 floats in createProfile: order).
+ * The times are converted like setParameter() of the sketch does.
+ */
+ProfileParameters profileOf(const float* profile) {
+  ProfileParameters p;
+  p.edgeNegThresh = profile[0];
+  p.edgePosThresh = profile[1];
+  p.hyst = profile[2];
+  p.min_min = profile[3];
+  p.max_max = profile[4];
+  p.t_fall[0] = (uint8_t)profile[5];
+  p.t_fall[1] = (uint8_t)profile[6];
+  p.t_rise[0] = (uint8_t)profile[7];
+  p.t_rise[1] = (uint8_t)profile[8];
+  p.t_total[0] = (uint16_t)profile[9];
+  p.t_total[1] = (uint16_t)profile[10];
+  p.allowedZeros = (uint8_t)profile[11];
+  return p;
+}
+
+/**
+ * Parameters of the detection like applyPendingProfile() of the sketch sets them.
+ */
+Parameters parametersOf(const ProfileParameters& profile) {
+  Parameters p;
+  p.edgeNegThresh = Detector::fromMM(profile.edgeNegThresh);
+  p.edgePosThresh = Detector::fromMM(profile.edgePosThresh);
+  p.hyst = Detector::fromMM(profile.hyst);
+  p.min_min = Detector::fromMM(profile.min_min);
+  p.max_max = Detector::fromMM(profile.max_max);
+  p.t_fall[0] = profile.t_fall[0];
+  p.t_fall[1] = profile.t_fall[1];
+  p.t_rise[0] = profile.t_rise[0];
+  p.t_rise[1] = profile.t_rise[1];
+  p.t_total[0] = profile.t_total[0];
+  p.t_total[1] = profile.t_total[1];
+  p.allowedZeros = profile.allowedZeros;
+  return p;
+}
+
+Parameters parametersOf(const float* profile) {
+  return parametersOf(profileOf(profile));
+}
+
+bool sameParameters(const Parameters& a, const Parameters& b) {
+  return a.edgeNegThresh == b.edgeNegThresh && a.edgePosThresh == b.edgePosThresh
+      && a.hyst == b.hyst && a.min_min == b.min_min && a.max_max == b.max_max
+      && a.t_fall[0] == b.t_fall[0] && a.t_fall[1] == b.t_fall[1]
+      && a.t_rise[0] == b.t_rise[0] && a.t_rise[1] == b.t_rise[1]
+      && a.t_total[0] == b.t_total[0] && a.t_total[1] == b.t_total[1]
+      && a.allowedZeros == b.allowedZeros;
+}
+
+/**
+ * Sets a single parameter like setParameter() of the sketch.
+ */
+void setParameter(Parameters& p, int index, float f) {
+  float profile[12];
+  // reuse the conversion of parametersOf() for the single value
+  std::fill(profile, profile + 12, 0.0f);
+  profile[index] = f;
+  Parameters single = parametersOf(profile);
+  switch (index) {
+    case 0: p.edgeNegThresh = single.edgeNegThresh; break;
+    case 1: p.edgePosThresh = single.edgePosThresh; break;
+    case 2: p.hyst = single.hyst; break;
+    case 3: p.min_min = single.min_min; break;
+    case 4: p.max_max = single.max_max; break;
+    case 5: p.t_fall[0] = single.t_fall[0]; break;
+    case 6: p.t_fall[1] = single.t_fall[1]; break;
+    case 7: p.t_rise[0] = single.t_rise[0]; break;
+    case 8: p.t_rise[1] = single.t_rise[1]; break;
+    case 9: p.t_total[0] = single.t_total[0]; break;
+    case 10: p.t_total[1] = single.t_total[1]; break;
+    case 11: p.allowedZeros = single.allowedZeros; break;
+  }
+}
+
+struct Result {
+  double latency;         // ms from the first write until the answer arrived, < 0 if dropped
+  double mixedSamples;    // samples processed with a mix of old and new parameters
+  bool halfApplied;       // connection dropped with a mix of old and new parameters left
+  bool correct;           // parameters on the device match the profile (completed uploads)
+};
+
+/**
+ * Upload with one write per parameter.
+ */
+Result uploadPerParameter(Link& link, const float* profile, const Parameters& old) {
+  Result result = {-1, 0, false, true};
+  Parameters device = old;
+  double time = 0;
+  double firstChange = -1;
+  for (int i = 0; i < 12; ++i) {
+    double arrived = link.transmit(time);
+    if (arrived < 0) {
+      result.halfApplied = i > 0;
+      result.mixedSamples = i > 0 ? (time - firstChange) / 1000 * SAMPLE_RATE : 0;
+      return result;
+    }
+    setParameter(device, i, profile[i]);
+    if (firstChange < 0) {
+      firstChange = arrived;
+    }
+    // write response in the next event
+    time = link.transmit(arrived + link.interval());
+    if (time < 0) {
+      result.halfApplied = i < 11;
+      return result;
+    }
+  }
+  // PARAMTERS_SET notification after the last parameter
+  double answer = link.transmit(time);
+  if (answer < 0) {
+    return result;
+  }
+  result.latency = answer;
+  result.mixedSamples = (time - firstChange) / 1000 * SAMPLE_RATE;
+  result.correct = sameParameters(device, parametersOf(profile));
+  return result;
+}
+
+/**
+ * Upload of the packed profile (ProfileMessage.h).
+ */
+Result uploadPacked(Link& link, const float* profile, const Parameters& old, uint8_t transfer) {
+  Result result = {-1, 0, false, true};
+  Parameters device = old;
+  ProfileParameters packedProfile = profileOf(profile);
+  uint8_t packed[PROFILE_MESSAGE_PACKED_SIZE];
+  uint16_t crc = packProfile(&packedProfile, packed);
+
+  ProfileReceiver receiver;
+  profileReceiverReset(&receiver);
+  double time = 0;
+  for (uint8_t part = 0; part < PROFILE_MESSAGE_PARTS; ++part) {
+    uint8_t frame[20];
+    uint8_t length = buildProfileFrame(packed, PROTOCOL_IN_SET_PROFILE, transfer, part, frame);
+    double arrived = link.transmit(time);
+    if (arrived < 0) {
+      return result;
+    }
+    uint8_t status = profileReceiverAdd(&receiver, frame, length);
+    if (status == PROFILE_COMPLETE) {
+      // applyPendingProfile() of the sketch: everything at once
+      ProfileParameters received;
+      unpackProfile(receiver.packed, &received);
+      device = parametersOf(received);
+      result.correct = packedProfileCrc(receiver.packed) == crc;
+    } else if (status != PROFILE_INCOMPLETE) {
+      result.correct = false;
+    }
+    time = link.transmit(arrived + link.interval());
+    if (time < 0) {
+      return result;
+    }
+  }
+  double answer = link.transmit(time);
+  if (answer < 0) {
+    return result;
+  }
+  result.latency = answer;
+  result.correct = result.correct && sameParameters(device, parametersOf(profile));
+  return result;
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, (size_t)(p / 100 * values.size()))];
+}
+
+void report(const char* name, const std::vector<Result>& results, size_t& errors) {
+  std::vector<double> latencies;
+  double mixed = 0;
+  size_t half = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (results[i].latency >= 0) {
+      latencies.push_back(results[i].latency);
+      errors += !results[i].correct;
+    }
+    mixed += results[i].mixedSamples;
+    half += results[i].halfApplied;
+  }
+  double sum = 0;
+  for (size_t i = 0; i < latencies.size(); ++i) {
+    sum += latencies[i];
+  }
+  printf("%-14s completed %5zu/%zu, latency avg %6.1f ms, 50%% %6.1f ms, 99%% %6.1f ms, "
+         "mixed profile %5.1f samples/upload, half applied after drop %zu\n",
+         name, latencies.size(), results.size(), latencies.empty() ? 0 : sum / latencies.size(),
+         percentile(latencies, 50), percentile(latencies, 99), mixed / results.size(), half);
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-c interval] [-l loss] [-d drop] [-n uploads] [-s seed]\n", name);
+}
+
+int main(int argc, char** argv) {
+  double interval = 30;
+  double loss = 0.05;
+  double drop = 0.001;
+  int uploads = 10000;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:l:d:n:s:")) != -1) {
+    switch (opt) {
+      case 'c':
+        interval = atof(optarg);
+        break;
+      case 'l':
+        loss = atof(optarg);
+        break;
+      case 'd':
+        drop = atof(optarg);
+        break;
+      case 'n':
+        uploads = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc || interval <= 0 || loss < 0 || loss >= 1 || drop < 0 || drop >= 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // random profiles within the ranges of the calibration
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> threshold(0.0005f, 0.01f);
+  std::uniform_int_distribution<int> samples(2, 60);
+  const float defaults[12] = {-0.003f, 0.0025f, 0.0002f, -0.02f, 0.02f, 4, 30, 6, 35, 30, 105, 4};
+  Parameters old = parametersOf(defaults);
+  Link perParameterLink(interval, loss, drop, seed);
+  Link packedLink(interval, loss, drop, seed);
+  std::vector<Result> perParameter;
+  std::vector<Result> packed;
+  for (int i = 0; i < uploads; ++i) {
+    float profile[12] = {-threshold(random), threshold(random), threshold(random) / 10,
+                         -threshold(random) * 4, threshold(random) * 4,
+                         (float)samples(random), (float)samples(random) + 30,
+                         (float)samples(random), (float)samples(random) + 30,
+                         (float)samples(random), (float)samples(random) + 100,
+                         (float)(samples(random) % 10)};
+    perParameter.push_back(uploadPerParameter(perParameterLink, profile, old));
+    packed.push_back(uploadPacked(packedLink, profile, old, (uint8_t)i));
+  }
+
+  printf("connection interval %.1f ms, packet loss %.3f, connection drop %.4f per event\n",
+         interval, loss, drop);
+  size_t errors = 0;
+  report("per parameter", perParameter, errors);
+  report("packed", packed, errors);
+  if (errors > 0) {
+    printf("%zu uploads left wrong parameters\n", errors);
+  }
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Micro-benchmark of the message decoding of the app (ProtocolCodec.h, CalibrationCodec.h).
+ *
+ * Decodes a stream of messages as the RFduino sends them during calibration and normal
+ * operation (calibration frames, blink events, timing, battery level and profile answers) and
+ * prints the frames decoded per second:
+ *   - codec: protocolCheckOut() and the decoders of ProtocolCodec.h, reading in place,
+ *   - copy:  every message is copied into a buffer allocated for it and decoded by memcpy,
+ *            like the app (NSData subranges) and the sketch (new char[]) did before.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino protocolbench.cpp -o protocolbench
+ * Usage:  protocolbench [-m messages] [-n repeat] [-s seed]
+ *   -m  messages in the stream (default 100000)
+ *   -n  decode the stream n times (default 100)
+ *   -s  seed of the stream (default 1)
+ *
+ * Exit code is 0 if both decoders agree on the stream, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "CalibrationCodec.h"
+#include "ProtocolCodec.h"
+
+struct Message {
+  uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE];
+  uint8_t length;
+};
+
+/**
+ * Builds the stream: mostly calibration frames (float and compressed), some blink events and
+ * now and then one of the other messages.
+ */
+std::vector<Message> buildStream(size_t messages, unsigned long seed) {
+  std::mt19937 random(seed);
+  std::vector<Message> stream(messages);
+  CalibrationEncoder encoder(PROTOCOL_OUT_CALIBRATION_COMPRESSED);
+  int32_t value = 1 << 16;
+  float values[PROTOCOL_CALIBRATION_MAX_SAMPLES];
+  ProtocolTiming timing = { 166.7f, 10000, 3, 5900, 6000, 6100, 9000 };
+  for (size_t i = 0; i < messages; ++i) {
+    Message& message = stream[i];
+    unsigned kind = random() % 100;
+    if (kind < 40) {
+      for (int s = 0; s < PROTOCOL_CALIBRATION_MAX_SAMPLES; ++s) {
+        values[s] = (float)(random() % 1000) / 100.0f;
+      }
+      message.length = protocolEncodeCalibrationFrame(message.data, (uint8_t)i, random() & 0x0F, values,
+                                                      1 + random() % PROTOCOL_CALIBRATION_MAX_SAMPLES);
+    } else if (kind < 80) {
+      while (!encoder.add(value, random() % 50 == 0)) {
+        value = (int32_t)((uint32_t)value + random() % 201 - 100);
+      }
+      memcpy(message.data, encoder.frame(), encoder.frameLength());
+      message.length = encoder.frameLength();
+    } else if (kind < 95) {
+      message.length = protocolEncodeBlinkEvent(message.data, (uint8_t)i, (uint32_t)random());
+    } else if (kind < 97) {
+      message.length = protocolEncodeTiming(message.data, &timing);
+    } else if (kind < 99) {
+      message.length = protocolEncodeBatteryLevel(message.data, 3.0f + (random() % 100) / 100.0f);
+    } else {
+      message.length = protocolEncodeProfileStatus(message.data, (uint8_t)i, (uint16_t)random(),
+                                                   PROTOCOL_PROFILE_APPLIED);
+    }
+  }
+  return stream;
+}
+
+/**
+ * Decodes a message with ProtocolCodec.h. Returns a sum over the decoded fields,
+ * so the compiler cannot drop the decoding.
+ */
+static inline double decodeCodec(const uint8_t* data, int length) {
+  if (!protocolCheckOut(data, length)) {
+    return -1;
+  }
+  double sum = 0;
+  switch (data[0]) {
+    case PROTOCOL_OUT_CALIBRATION_FRAME: {
+      uint8_t samples = protocolCalibrationSamples(data, length);
+      for (uint8_t i = 0; i < samples; ++i) {
+        sum += protocolCalibrationSample(data, i) + ((data[2] >> i) & 1);
+      }
+      break;
+    }
+    case PROTOCOL_OUT_CALIBRATION_COMPRESSED: {
+      int32_t values[CALIBRATION_CODEC_MAX_SAMPLES];
+      bool blinks[CALIBRATION_CODEC_MAX_SAMPLES];
+      int samples = decodeCalibrationFrame(data, (uint8_t)length, values, blinks);
+      for (int i = 0; i < samples; ++i) {
+        sum += values[i] / 65536.0 + blinks[i];
+      }
+      break;
+    }
+    case PROTOCOL_OUT_BLINK_EVENT: {
+      uint8_t sequence;
+      uint32_t time;
+      if (protocolDecodeBlinkEvent(data, length, &sequence, &time)) {
+        sum += sequence + (double)time;
+      }
+      break;
+    }
+    case PROTOCOL_OUT_TIMING: {
+      ProtocolTiming timing;
+      if (protocolDecodeTiming(data, length, &timing)) {
+        sum += timing.rate + timing.samples + timing.missed + timing.intervalMin + timing.interval50
+             + timing.interval99 + timing.intervalMax;
+      }
+      break;
+    }
+    case PROTOCOL_OUT_BATTERY_LEVEL: {
+      float voltage;
+      if (protocolDecodeBatteryLevel(data, length, &voltage)) {
+        sum += voltage;
+      }
+      break;
+    }
+    case PROTOCOL_OUT_PROFILE_SET: {
+      uint8_t transfer;
+      uint16_t crc;
+      uint8_t status;
+      if (protocolDecodeProfileStatus(data, length, &transfer, &crc, &status)) {
+        sum += transfer + crc + status;
+      }
+      break;
+    }
+  }
+  return sum;
+}
+
+/**
+ * Decodes a message the way it was done before: the message is copied into a new buffer
+ * and the fields are copied out of it.
+ */
+static double decodeCopy(const uint8_t* data, int length) {
+  uint8_t* copy = new uint8_t[length];
+  memcpy(copy, data, length);
+  double sum = 0;
+  switch (copy[0]) {
+    case PROTOCOL_OUT_CALIBRATION_FRAME:
+      for (int i = 0; i < (length - 3) / 4; ++i) {
+        float value;
+        memcpy(&value, copy + 3 + 4 * i, sizeof(float));
+        sum += value + ((copy[2] >> i) & 1);
+      }
+      break;
+    case PROTOCOL_OUT_CALIBRATION_COMPRESSED: {
+      int32_t values[CALIBRATION_CODEC_MAX_SAMPLES];
+      bool blinks[CALIBRATION_CODEC_MAX_SAMPLES];
+      int samples = decodeCalibrationFrame(copy, (uint8_t)length, values, blinks);
+      for (int i = 0; i < samples; ++i) {
+        sum += values[i] / 65536.0 + blinks[i];
+      }
+      break;
+    }
+    case PROTOCOL_OUT_BLINK_EVENT: {
+      uint32_t time;
+      memcpy(&time, copy + 2, sizeof(uint32_t));
+      sum += copy[1] + (double)time;
+      break;
+    }
+    case PROTOCOL_OUT_TIMING: {
+      float rate;
+      uint32_t samples;
+      uint16_t values[5];
+      memcpy(&rate, copy + 1, sizeof(float));
+      memcpy(&samples, copy + 5, sizeof(uint32_t));
+      memcpy(values, copy + 9, sizeof(values));
+      sum += rate + samples + values[0] + values[1] + values[2] + values[3] + values[4];
+      break;
+    }
+    case PROTOCOL_OUT_BATTERY_LEVEL: {
+      float voltage;
+      memcpy(&voltage, copy + 1, sizeof(float));
+      sum += voltage;
+      break;
+    }
+    case PROTOCOL_OUT_PROFILE_SET: {
+      uint16_t crc;
+      memcpy(&crc, copy + 2, sizeof(uint16_t));
+      sum += copy[1] + crc + copy[4];
+      break;
+    }
+  }
+  delete[] copy;
+  return sum;
+}
+
+template<typename Decoder>
+double run(const std::vector<Message>& stream, int repeat, Decoder decoder, double& sum) {
+  sum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) {
+    for (size_t i = 0; i < stream.size(); ++i) {
+      sum += decoder(stream[i].data, stream[i].length);
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-m messages] [-n repeat] [-s seed]\n", name);
+}
+
+int main(int argc, char** argv) {
+  size_t messages = 100000;
+  int repeat = 100;
+  unsigned long seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:s:")) != -1) {
+    switch (opt) {
+      case 'm':
+        messages = std::max(1L, atol(optarg));
+        break;
+      case 'n':
+        repeat = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  std::vector<Message> stream = buildStream(messages, seed);
+  double codecSum;
+  double copySum;
+  double codecSeconds = run(stream, repeat, decodeCodec, codecSum);
+  double copySeconds = run(stream, repeat, decodeCopy, copySum);
+  double frames = (double)messages * repeat;
+  printf("codec: %7.2f M frames/s (%5.1f ns/frame)\n", frames / codecSeconds / 1e6, codecSeconds / frames * 1e9);
+  printf("copy:  %7.2f M frames/s (%5.1f ns/frame)\n", frames / copySeconds / 1e6, copySeconds / frames * 1e9);
+  printf("speedup %.2f\n", copySeconds / codecSeconds);
+  if (codecSum != copySum) {
+    printf("ERROR: decoders disagree (%f / %f)\n", codecSum, copySum);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Fuzz target of the message decoders shared by the sketch and the app (ProtocolCodec.h,
+ * ProfileMessage.h, CalibrationCodec.h, Journal.h) and of the Serial frames (SerialFrame.h).
+ *
+ * Every input is handed to all decoders as one received BLE message. Checks:
+ *   - no decoder reads outside the message (build with AddressSanitizer),
+ *   - a message accepted by a decoder is also accepted by protocolCheckIn() or
+ *     protocolCheckOut() and is encoded to the same bytes again,
+ *   - a compressed calibration frame decodes to the same values after encoding it again.
+ *   - every input is COBS decoded to itself after encoding it, an accepted Serial frame is
+ *     encoded to the same bytes again.
+ *
+ * Build (libFuzzer):  clang++ -g -O1 -std=c++11 -fsanitize=fuzzer,address,undefined -DLIBFUZZER
+ *                     -I../RFduino protocolfuzz.cpp -o protocolfuzz
+ * Build (standalone): g++ -g -O1 -std=c++11 -fsanitize=address,undefined -I../RFduino
+ *                     protocolfuzz.cpp -o protocolfuzz
+ * Usage (standalone): protocolfuzz [-n inputs] [-s seed] [file]...
+ *   -n  number of generated inputs (default 1000000), ignored if files are given
+ *   -s  seed of the generated inputs (default 1)
+ * The standalone runner replays the given files (e.g. a crash found by libFuzzer) or
+ * generates random inputs and mutations of valid messages.
+ *
+ * A failed check aborts, so both runners report it like a crash.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CalibrationCodec.h"
+#include "Journal.h"
+#include "ProfileMessage.h"
+#include "ProtocolCodec.h"
+#include "SerialFrame.h"
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "check failed: %s (line %d)\n", #condition, __LINE__); \
+      abort(); \
+    } \
+  } while (0)
+
+static void checkReencoded(const uint8_t* data, int length, const uint8_t* encoded, uint8_t encodedLength) {
+  CHECK(encodedLength == length);
+  CHECK(memcmp(data, encoded, length) == 0);
+}
+
+static void fuzzProtocol(const uint8_t* data, int length) {
+  uint8_t encoded[PROTOCOL_MAX_MESSAGE_SIZE];
+  int in = protocolCheckIn(data, length);
+  int out = protocolCheckOut(data, length);
+
+  uint8_t parameter;
+  float value;
+  if (protocolDecodeParameter(data, length, &parameter, &value)) {
+    CHECK(in);
+    checkReencoded(data, length, encoded, protocolEncodeParameter(encoded, parameter, value));
+  }
+  uint8_t sequence;
+  if (protocolDecodeBlinkAck(data, length, &sequence)) {
+    CHECK(in);
+    checkReencoded(data, length, encoded, protocolEncodeBlinkAck(encoded, sequence));
+  }
+  uint32_t time;
+  if (protocolDecodeBlinkEvent(data, length, &sequence, &time)) {
+    CHECK(out);
+    checkReencoded(data, length, encoded, protocolEncodeBlinkEvent(encoded, sequence, time));
+  }
+  if (protocolDecodeBatteryLevel(data, length, &value)) {
+    CHECK(out);
+    checkReencoded(data, length, encoded, protocolEncodeBatteryLevel(encoded, value));
+  }
+  uint8_t transfer;
+  uint16_t crc;
+  uint8_t status;
+  if (protocolDecodeProfileStatus(data, length, &transfer, &crc, &status)) {
+    CHECK(out);
+    checkReencoded(data, length, encoded, protocolEncodeProfileStatus(encoded, transfer, crc, status));
+  }
+  ProtocolTiming timing;
+  if (protocolDecodeTiming(data, length, &timing)) {
+    CHECK(out);
+    checkReencoded(data, length, encoded, protocolEncodeTiming(encoded, &timing));
+  }
+  uint8_t samples = protocolCalibrationSamples(data, length);
+  if (samples > 0) {
+    CHECK(out);
+    CHECK(samples <= PROTOCOL_CALIBRATION_MAX_SAMPLES);
+    float values[PROTOCOL_CALIBRATION_MAX_SAMPLES];
+    for (uint8_t i = 0; i < samples; ++i) {
+      values[i] = protocolCalibrationSample(data, i);
+    }
+    checkReencoded(data, length, encoded,
+                   protocolEncodeCalibrationFrame(encoded, data[1], data[2], values, samples));
+  }
+}
+
+static void fuzzCalibrationCodec(const uint8_t* data, int length) {
+  if (length > CALIBRATION_CODEC_FRAME_SIZE) {
+    return;  // longer than a BLE packet, the sketch never sends it
+  }
+  int32_t values[CALIBRATION_CODEC_MAX_SAMPLES];
+  bool blinks[CALIBRATION_CODEC_MAX_SAMPLES];
+  int samples = decodeCalibrationFrame(data, (uint8_t)length, values, blinks);
+  if (samples < 0) {
+    return;
+  }
+  CHECK(samples <= CALIBRATION_CODEC_MAX_SAMPLES);
+  // Encoding may split the samples into several frames (varints of a malformed but accepted
+  // frame can be longer than needed), so compare the decoded values of all frames.
+  CalibrationEncoder encoder(PROTOCOL_OUT_CALIBRATION_COMPRESSED);
+  int32_t decoded[CALIBRATION_CODEC_MAX_SAMPLES];
+  bool decodedBlinks[CALIBRATION_CODEC_MAX_SAMPLES];
+  int total = 0;
+  for (int i = 0; i <= samples; ++i) {
+    bool frameDone = i < samples ? encoder.add(values[i], blinks[i]) : encoder.flush();
+    if (frameDone) {
+      CHECK(protocolCheckOut(encoder.frame(), encoder.frameLength()));
+      int n = decodeCalibrationFrame(encoder.frame(), encoder.frameLength(), decoded, decodedBlinks);
+      CHECK(n > 0 && total + n <= samples);
+      for (int j = 0; j < n; ++j) {
+        CHECK(decoded[j] == values[total + j]);
+        CHECK(decodedBlinks[j] == blinks[total + j]);
+      }
+      total += n;
+    }
+  }
+  CHECK(total == samples);
+}
+
+static void fuzzJournal(const uint8_t* data, int length) {
+  if (length < JOURNAL_FRAME_HEADER_SIZE || length > PROTOCOL_MAX_MESSAGE_SIZE) {
+    return;
+  }
+  uint32_t time;
+  int32_t values[JOURNAL_MAX_SAMPLES];
+  bool blinks[JOURNAL_MAX_SAMPLES];
+  int samples = decodeJournalBlock(data + JOURNAL_FRAME_HEADER_SIZE,
+                                   (uint8_t)(length - JOURNAL_FRAME_HEADER_SIZE), &time, values, blinks);
+  CHECK(samples <= JOURNAL_MAX_SAMPLES);
+  if (samples >= 0 && data[0] == PROTOCOL_OUT_JOURNAL) {
+    CHECK(protocolCheckOut(data, length));
+  }
+}
+
+static void fuzzProfile(const uint8_t* data, int length) {
+  static ProfileReceiver receiver;  // keeps parts of earlier inputs, like the sketch
+  if (length > PROTOCOL_MAX_MESSAGE_SIZE) {
+    return;
+  }
+  uint8_t result = profileReceiverAdd(&receiver, data, (uint8_t)length);
+  CHECK(result <= PROFILE_BAD_FRAME);
+  if (result == PROFILE_COMPLETE) {
+    ProfileParameters profile;
+    uint8_t packed[PROFILE_MESSAGE_PACKED_SIZE];
+    unpackProfile(receiver.packed, &profile);
+    packProfile(&profile, packed);
+    CHECK(memcmp(packed, receiver.packed, PROFILE_MESSAGE_PACKED_SIZE) == 0);
+  }
+}
+
+static void fuzzSerialFrame(const uint8_t* data, int length) {
+  uint8_t encoded[300];
+  uint8_t decoded[300];
+  uint16_t encodedLength = cobsEncode(data, (uint16_t)length, encoded);
+  CHECK(encodedLength <= length + length / 254 + 1);
+  CHECK(memchr(encoded, 0, encodedLength) == NULL);
+  CHECK(cobsDecode(encoded, encodedLength, decoded) == length);
+  CHECK(length == 0 || memcmp(decoded, data, length) == 0);
+
+  SerialSample sample;
+  if (decodeSerialSample(data, (uint16_t)length, &sample)) {
+    uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+    uint8_t frameLength = encodeSerialSample(&sample, frame);
+    CHECK(frameLength == length + 2);
+    CHECK(memcmp(frame + 1, data, length) == 0);
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size > 255) {
+    return 0;
+  }
+  fuzzProtocol(data, (int)size);
+  fuzzCalibrationCodec(data, (int)size);
+  fuzzJournal(data, (int)size);
+  fuzzProfile(data, (int)size);
+  fuzzSerialFrame(data, (int)size);
+  return 0;
+}
+
+#ifndef LIBFUZZER
+
+#include <random>
+#include <unistd.h>
+
+/**
+ * Returns a valid message of a random type, the base of the mutations.
+ */
+static std::vector<uint8_t> validMessage(std::mt19937& random) {
+  uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE];
+  uint8_t length = 0;
+  float values[PROTOCOL_CALIBRATION_MAX_SAMPLES] = { 0.5f, -1.25f, 3.0e-3f, 42.0f };
+  ProtocolTiming timing = { 166.7f, 10000, 3, 5900, 6000, 6100, 9000 };
+  switch (random() % 9) {
+    case 0:
+      length = protocolEncodeParameter(data, PROTOCOL_PARAMETER_THRESH_NEG + random() % 12, -0.25f);
+      break;
+    case 1:
+      length = protocolEncodeBlinkAck(data, (uint8_t)random());
+      break;
+    case 2:
+      length = protocolEncodeBlinkEvent(data, (uint8_t)random(), (uint32_t)random());
+      break;
+    case 3:
+      length = protocolEncodeBatteryLevel(data, 3.1f);
+      break;
+    case 4:
+      length = protocolEncodeProfileStatus(data, (uint8_t)random(), (uint16_t)random(), random() % 3);
+      break;
+    case 5:
+      length = protocolEncodeTiming(data, &timing);
+      break;
+    case 6:
+      length = protocolEncodeCalibrationFrame(data, (uint8_t)random(), random() & 0x0F, values,
+                                              1 + random() % PROTOCOL_CALIBRATION_MAX_SAMPLES);
+      break;
+    case 7: {
+      SerialSample sample = { (uint8_t)random(), (uint32_t)random(), (uint16_t)random(),
+                              (int32_t)random(), (uint8_t)(random() % 32) };
+      uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+      uint8_t frameLength = encodeSerialSample(&sample, frame);
+      // without the delimiting zero bytes
+      return std::vector<uint8_t>(frame + 1, frame + frameLength - 1);
+    }
+    default: {
+      CalibrationEncoder encoder(PROTOCOL_OUT_CALIBRATION_COMPRESSED);
+      int32_t value = (int32_t)random();
+      while (!encoder.add(value, random() % 8 == 0)) {
+        value = (int32_t)((uint32_t)value + random() % 2001 - 1000);
+      }
+      memcpy(data, encoder.frame(), encoder.frameLength());
+      length = encoder.frameLength();
+      break;
+    }
+  }
+  return std::vector<uint8_t>(data, data + length);
+}
+
+static std::vector<uint8_t> generate(std::mt19937& random) {
+  std::vector<uint8_t> input;
+  if (random() % 4 == 0) {
+    input.resize(random() % (PROTOCOL_MAX_MESSAGE_SIZE + 2));
+    for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = (uint8_t)random();
+    }
+    return input;
+  }
+  input = validMessage(random);
+  int mutations = random() % 3;
+  for (int m = 0; m < mutations; ++m) {
+    switch (random() % 3) {
+      case 0:
+        input[random() % input.size()] ^= (uint8_t)(1 << random() % 8);
+        break;
+      case 1:
+        if (input.size() > 1) {
+          input.pop_back();
+        }
+        break;
+      default:
+        input.push_back((uint8_t)random());
+        break;
+    }
+  }
+  return input;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n inputs] [-s seed] [file]...\n", name);
+}
+
+int main(int argc, char** argv) {
+  long inputs = 1000000;
+  unsigned long seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        inputs = atol(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  if (optind < argc) {
+    for (int a = optind; a < argc; ++a) {
+      FILE* file = fopen(argv[a], "rb");
+      if (!file) {
+        fprintf(stderr, "ERROR: cannot open %s\n", argv[a]);
+        return 2;
+      }
+      std::vector<uint8_t> input(256);
+      size_t size = fread(&input[0], 1, input.size(), file);
+      fclose(file);
+      // exact size, so AddressSanitizer catches every read behind the message
+      std::vector<uint8_t> message(input.begin(), input.begin() + size);
+      LLVMFuzzerTestOneInput(message.empty() ? NULL : &message[0], message.size());
+    }
+    printf("%d files ok\n", argc - optind);
+    return 0;
+  }
+
+  std::mt19937 random(seed);
+  for (long i = 0; i < inputs; ++i) {
+    std::vector<uint8_t> input = generate(random);
+    LLVMFuzzerTestOneInput(input.empty() ? NULL : &input[0], input.size());
+  }
+  printf("%ld inputs ok\n", inputs);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Check and benchmark of the raw count to mm conversion table (ProximityTable.h).
+ *
+ *   1. Error of proximityFromRaw() against the exact formula for every raw count 1 .. 65535,
+ *      compared to the bounds documented in ProximityTable.h.
+ *   2. ns per conversion of the exact formula in double (as the sketch computed it before),
+ *      in float and of the table lookup, the best of -n runs after a warm up run.
+ *      The input are the raw counts of the given captures or, without captures, all raw counts.
+ *      The host has a floating point unit, the Cortex-M0 of the RFduino has not: there exp() and
+ *      log() are soft-float library calls, so the host numbers are a lower bound of the saving.
+ *   3. Flash cost of the table.
+ *   4. For every given capture of raw counts: blinks of the fixed point detector of the sketch
+ *      with the exact conversion and with the table.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino proximitybench.cpp -o proximitybench
+ * Usage:  proximitybench [-n runs] [<capture in raw counts>...]
+ *   -n  benchmark runs (default 20)
+ *
+ * Exit code is 0 if the error is within the documented bounds and the table gives the same
+ * blinks as the exact conversion on all captures, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+#include "ProximityTable.h"
+#include "Recording.h"
+
+// Same configuration as the sketch with FIXED_POINT_DETECTION (MA_BUFFER, PROX_FILTERED_BUFFER).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> Detector;
+
+// Bounds documented in ProximityTable.h.
+#define BOUND_RELATIVE        0.00003   // 0.003 %
+#define BOUND_ABSOLUTE_WORN   0.0003    // mm, raw >= 1000
+#define BOUND_ABSOLUTE        0.001     // mm
+
+/**
+ * Checks proximityFromRaw() against the exact formula for every raw count.
+ */
+bool checkError() {
+  double maxRelative = 0;
+  double maxAbsoluteWorn = 0;
+  double maxAbsolute = 0;
+  unsigned worstRaw = 0;
+  for (unsigned raw = 1; raw <= 0xFFFF; ++raw) {
+    double exact = rawToMM(raw);
+    double error = fabs(proximityFromRaw(raw) / 65536.0 - exact);
+    if (error / exact > maxRelative) {
+      maxRelative = error / exact;
+      worstRaw = raw;
+    }
+    maxAbsolute = std::max(maxAbsolute, error);
+    if (raw >= 1000) {
+      maxAbsoluteWorn = std::max(maxAbsoluteWorn, error);
+    }
+  }
+  bool ok = maxRelative < BOUND_RELATIVE && maxAbsoluteWorn < BOUND_ABSOLUTE_WORN && maxAbsolute < BOUND_ABSOLUTE;
+  printf("error against the exact formula (raw 1 .. 65535): %s\n", ok ? "within the bounds" : "BOUNDS EXCEEDED");
+  printf("  relative %.5f %% (raw %u), absolute %.6f mm for raw >= 1000, %.6f mm overall\n",
+         maxRelative * 100, worstRaw, maxAbsoluteWorn, maxAbsolute);
+  return ok;
+}
+
+inline double exactDouble(uint16_t raw) {
+  return exp(log(68000.0 / raw) / 1.765);
+}
+
+inline float exactFloat(uint16_t raw) {
+  return expf(logf(68000.0f / raw) / 1.765f);
+}
+
+/**
+ * Returns the ns per conversion of 'convert', the best of 'runs' runs after one warm up run.
+ * The results are summed in int64_t (in double for float conversions), a sum in the result type
+ * overflows for the Q16 results.
+ */
+template<typename T>
+double measure(T (*convert)(uint16_t), const std::vector<uint16_t>& input, unsigned runs) {
+  typedef typename std::conditional<std::is_floating_point<T>::value, double, int64_t>::type Sum;
+  double best = 0;
+  volatile Sum sink = 0;
+  for (unsigned run = 0; run <= runs; ++run) {
+    Sum sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < input.size(); ++i) {
+      sum += convert(input[i]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = sum;
+    double ns = seconds * 1e9 / input.size();
+    if (run == 1 || (run > 1 && ns < best)) {
+      best = ns;
+    }
+  }
+  (void)sink;
+  return best;
+}
+
+/**
+ * Replays a capture of raw counts with the exact conversion and with the table.
+ * Returns true if both give the same blinks.
+ */
+bool compareBlinks(const char* path, const std::vector<uint16_t>& raw) {
+  Detector exact;
+  Detector table;
+  size_t exactBlinks = 0;
+  size_t tableBlinks = 0;
+  size_t differences = 0;
+  for (size_t i = 0; i < raw.size(); ++i) {
+    bool a = exact.update(Detector::accumFromMM(rawToMM(raw[i])));
+    bool b = table.update(proximityFromRaw(raw[i]));
+    exactBlinks += a;
+    tableBlinks += b;
+    differences += a != b;
+  }
+  printf("%s: %zu samples, %zu blinks with the exact conversion, %zu with the table, %zu samples differ\n",
+         path, raw.size(), exactBlinks, tableBlinks, differences);
+  return differences == 0;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n runs] [<capture in raw counts>...]\n", name);
+}
+
+int main(int argc, char** argv) {
+  unsigned runs = 20;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        runs = std::max(1L, atol(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  std::vector<std::vector<uint16_t> > captures;
+  std::vector<uint16_t> input;
+  for (int a = optind; a < argc; ++a) {
+    FILE* file = fopen(argv[a], "r");
+    if (!file) {
+      fprintf(stderr, "ERROR: cannot read %s\n", argv[a]);
+      return 2;
+    }
+    // first number of every line is the raw count, everything else is skipped
+    std::vector<uint16_t> capture;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+      char* end;
+      long raw = strtol(line, &end, 10);
+      if (end != line && raw > 0 && raw <= 0xFFFF) {
+        capture.push_back((uint16_t)raw);
+      }
+    }
+    fclose(file);
+    if (capture.empty()) {
+      fprintf(stderr, "ERROR: no raw counts read from %s\n", argv[a]);
+      return 2;
+    }
+    captures.push_back(capture);
+    input.insert(input.end(), capture.begin(), capture.end());
+  }
+  if (input.empty()) {
+    for (unsigned raw = 1; raw <= 0xFFFF; ++raw) {
+      input.push_back((uint16_t)raw);
+    }
+  }
+
+  bool ok = checkError();
+
+  printf("ns per conversion (%zu raw counts%s):\n", input.size(), captures.empty() ? ", all values" : "");
+  printf("  exact formula, double: %6.2f\n", measure(exactDouble, input, runs));
+  printf("  exact formula, float:  %6.2f\n", measure(exactFloat, input, runs));
+  printf("  table lookup:          %6.2f\n", measure(proximityFromRaw, input, runs));
+  printf("flash cost of the table: %zu bytes (%zu entries)\n",
+         sizeof(proximityTable), sizeof(proximityTable) / sizeof(proximityTable[0]));
+
+  for (size_t c = 0; c < captures.size(); ++c) {
+    ok = compareBlinks(argv[optind + c], captures[c]) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Offline replay of recorded sensor sessions.
+ *
+ * Streams a recording (see Recording.h) through the blink detection of the sketch
+ * (BlinkDetector.h) as fast as possible and prints the detected blinks. For Serial logs the
+ * detections are compared to the blink column of the log.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino replay.cpp -o replay
+ * Usage:  replay [-x] [-r] [-q] [-t tolerance] [-n repeat] <recording | ->
+ *   -x  fixed point detector of FIXED_POINT_DETECTION (default: floating point as in the sketch)
+ *   -r  proximity capture contains raw counts instead of mm
+ *   -q  do not list the single blinks
+ *   -t  allowed offset in samples between a detected blink and a blink of the log (default 0)
+ *   -n  replay the recording n times to get a stable samples per second figure
+ *
+ * Exit code is 0 if the detections match the log (or there is no blink column), 1 otherwise.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "BlinkDetector.h"
+#include "Recording.h"
+
+// Same configuration as the sketch (MA_BUFFER, PROX_FILTERED_BUFFER).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> FixedDetector;
+typedef BlinkDetector<float, double, 16, 200> FloatDetector;
+
+#define SAMPLE_PERIOD 6000  // us, same as the sketch: the real time factor is relative to 166.7 samples/s
+
+/**
+ * Replays the recording 'repeat' times through a fresh detector.
+ * Returns the blinks of the last run and the time of all runs in seconds.
+ */
+template<typename Detector>
+std::vector<size_t> replay(const Recording& recording, int repeat, double& seconds) {
+  std::vector<size_t> blinks;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    Detector detector;
+    blinks = replayRecording(recording, detector);
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return blinks;
+}
+
+/**
+ * Compares detected blinks to the blinks of the log.
+ * Prints blinks only found in the log ("missing") or only detected ("additional").
+ * Returns the number of differences.
+ */
+size_t compareBlinks(const std::vector<size_t>& detected, const std::vector<size_t>& logged,
+                     size_t tolerance) {
+  size_t matched = 0;
+  size_t differences = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < detected.size() || j < logged.size()) {
+    if (i < detected.size() && j < logged.size() &&
+        detected[i] + tolerance >= logged[j] && detected[i] <= logged[j] + tolerance) {
+      ++matched;
+      ++i;
+      ++j;
+    } else if (j >= logged.size() || (i < detected.size() && detected[i] < logged[j])) {
+      printf("additional %zu\n", detected[i]);
+      ++differences;
+      ++i;
+    } else {
+      printf("missing    %zu\n", logged[j]);
+      ++differences;
+      ++j;
+    }
+  }
+  printf("log blinks: %zu, matched: %zu, differences: %zu\n", logged.size(), matched, differences);
+  return differences;
+}
+
+int main(int argc, char** argv) {
+  bool useFloat = true;
+  bool quiet = false;
+  RecordingFormat format = RECORDING_AUTO;
+  size_t tolerance = 0;
+  int repeat = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "xrqt:n:")) != -1) {
+    switch (opt) {
+      case 'x':
+        useFloat = false;
+        break;
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 't':
+        tolerance = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        repeat = atoi(optarg) > 0 ? atoi(optarg) : 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-x] [-r] [-q] [-t tolerance] [-n repeat] <recording | ->\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-x] [-r] [-q] [-t tolerance] [-n repeat] <recording | ->\n", argv[0]);
+    return 2;
+  }
+
+  Recording recording;
+  if (!loadRecording(argv[optind], format, recording)) {
+    fprintf(stderr, "ERROR: no samples read from %s\n", argv[optind]);
+    return 2;
+  }
+
+  double seconds = 0;
+  std::vector<size_t> blinks = useFloat ? replay<FloatDetector>(recording, repeat, seconds)
+                                        : replay<FixedDetector>(recording, repeat, seconds);
+
+  if (!quiet) {
+    for (size_t i = 0; i < blinks.size(); ++i) {
+      printf("blink %zu\n", blinks[i]);
+    }
+  }
+  double samples = (double)recording.values.size() * repeat;
+  printf("%s, %zu samples, %s detector\n", recording.filtered ? "Serial log" : "proximity capture",
+         recording.values.size(), useFloat ? "floating point" : "fixed point");
+  double rate = 1e6 / SAMPLE_PERIOD;
+  printf("replayed %.0f samples in %.3f s (%.1f M samples/s, %.0fx real time at %.1f samples/s)\n",
+         samples, seconds, samples / seconds / 1e6, samples / rate / seconds, rate);
+  printf("detected blinks: %zu\n", blinks.size());
+
+  if (!recording.blinkColumn.empty()) {
+    return compareBlinks(blinks, recording.logBlinks(), tolerance) == 0 ? 0 : 1;
+  }
+  return 0;
+}
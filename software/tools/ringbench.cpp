@@ -0,0 +1,445 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Benchmark of the calibration sample ring (SampleRing.h) against the former NSNotification
+ * fan-out of the app, where every sample was put into an NSData, posted to every observer, cut out
+ * again with subdataWithRange: and boxed into an NSNumber.
+ *
+ *   1. Cost: -n samples are written and read by -c consumers in one thread, once through the ring
+ *      and once through an emulation of the fan-out (an allocated buffer per sample, a call per
+ *      observer, an allocated subrange and a boxed value per observer). Reports ns and allocations
+ *      per sample and, if the kernel allows perf events, L1 data cache and last level cache misses
+ *      per sample.
+ *   2. Real time: a producer thread writes -r samples per second for -d s, -c consumer threads
+ *      read every -p ms like the plots of the app. Reports the lag of the consumers (samples
+ *      waiting per read) and the overruns.
+ *   3. Stress: the producer writes without pause while the consumers read with tiny buffers, so
+ *      slots are overwritten during the copy. Every sample carries its number, the consumers check
+ *      that they never see a sample out of place.
+ *
+ * Build:  g++ -O2 -std=c++11 -pthread -I../cocoa-app/eyeDrops ringbench.cpp -o ringbench
+ * Usage:  ringbench [-n samples] [-c consumers] [-r rate] [-d seconds] [-p ms] [-s seconds]
+ *   -n  samples of the cost benchmark (default 10000000)
+ *   -c  consumers (default 3: sensor plot, blink plot, recorder)
+ *   -r  samples per second of the real time test (default 1000)
+ *   -d  duration of the real time test in s (default 3)
+ *   -p  read interval of the consumers in ms (default 100, as in the app)
+ *   -s  duration of the stress test in s (default 2)
+ *
+ * Exit code is 0 if no consumer saw a sample out of place, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "SampleRing.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Samples carry their number in the value, exact as long as it fits the 24 bit mantissa.
+static float sampleValue(uint32_t number) {
+  return (float)(number & 0xFFFFFF);
+}
+
+/**
+ * A hardware cache counter of this thread (user space only, allowed with perf_event_paranoid 2).
+ */
+class CacheCounter {
+public:
+  CacheCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~CacheCounter() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool valid() const {
+    return fd >= 0;
+  }
+
+  void start() {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+    return count;
+  }
+
+private:
+  int fd;
+};
+
+struct Cost {
+  double ns;                    // per sample
+  double allocations;           // per sample
+  double l1Misses;              // per sample, < 0 if not available
+  double llcMisses;             // per sample, < 0 if not available
+  double checksum;              // keeps the compiler from dropping the reads
+};
+
+static unsigned long allocations = 0;
+
+/**
+ * Emulation of the fan-out: the receive callback allocates the 5 byte package (NSData) and
+ * posts it, every observer allocates a subrange (subdataWithRange:), boxes the value (NSNumber)
+ * and appends it to its array.
+ */
+class FanOut {
+public:
+  explicit FanOut(size_t consumers) : arrays(consumers) {
+    for (size_t c = 0; c < consumers; ++c) {
+      observers.push_back([this, c](const std::vector<unsigned char>* package) {
+        std::vector<unsigned char>* range = new std::vector<unsigned char>(package->begin(), package->begin() + 4);
+        ++allocations;
+        float value;
+        memcpy(&value, &(*range)[0], sizeof(float));
+        delete range;
+        arrays[c].push_back(new float(value));
+        ++allocations;
+      });
+    }
+  }
+
+  ~FanOut() {
+    clear();
+  }
+
+  void post(float value, bool blink) {
+    std::vector<unsigned char>* package = new std::vector<unsigned char>(sizeof(float) + 1);
+    ++allocations;
+    memcpy(&(*package)[0], &value, sizeof(float));
+    (*package)[sizeof(float)] = blink;
+    for (size_t o = 0; o < observers.size(); ++o) {
+      observers[o](package);
+    }
+    delete package;
+  }
+
+  double checksum() const {
+    double sum = 0;
+    for (size_t c = 0; c < arrays.size(); ++c) {
+      for (size_t i = 0; i < arrays[c].size(); i += 4096) {
+        sum += *arrays[c][i];
+      }
+    }
+    return sum;
+  }
+
+  void clear() {
+    for (size_t c = 0; c < arrays.size(); ++c) {
+      for (size_t i = 0; i < arrays[c].size(); ++i) {
+        delete arrays[c][i];
+      }
+      arrays[c].clear();
+    }
+  }
+
+private:
+  std::vector<std::function<void(const std::vector<unsigned char>*)> > observers;
+  std::vector<std::vector<float*> > arrays;
+};
+
+/**
+ * Ring with consumers which read a batch every 100 samples (100 ms at 1 kHz) into arrays they
+ * reserved before, like the plots of the app.
+ */
+class RingConsumers {
+public:
+  RingConsumers(size_t consumers, size_t samples) : cursors(consumers), arrays(consumers) {
+    ringInit(&ring);
+    for (size_t c = 0; c < consumers; ++c) {
+      ringAttach(&ring, &cursors[c]);
+      arrays[c].reserve(samples);
+    }
+  }
+
+  void post(float value, bool blink) {
+    ringWrite(&ring, value, blink, 0);
+    if ((ringHead(&ring) % 100) == 0) {
+      read();
+    }
+  }
+
+  void read() {
+    RingSample samples[256];
+    for (size_t c = 0; c < cursors.size(); ++c) {
+      uint32_t count;
+      while ((count = ringRead(&ring, &cursors[c], samples, 256)) > 0) {
+        for (uint32_t i = 0; i < count; ++i) {
+          arrays[c].push_back(samples[i].value);
+        }
+      }
+    }
+  }
+
+  double checksum() const {
+    double sum = 0;
+    for (size_t c = 0; c < arrays.size(); ++c) {
+      for (size_t i = 0; i < arrays[c].size(); i += 4096) {
+        sum += arrays[c][i];
+      }
+    }
+    return sum;
+  }
+
+private:
+  SampleRing ring;
+  std::vector<RingCursor> cursors;
+  std::vector<std::vector<float> > arrays;
+};
+
+template<typename Path>
+Cost cost(Path& path, size_t samples) {
+  CacheCounter l1(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  CacheCounter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  unsigned long before = allocations;
+  l1.start();
+  llc.start();
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < samples; ++i) {
+    path.post(sampleValue((uint32_t)i), (i % 50) == 0);
+  }
+  Cost result;
+  result.ns = seconds(start) * 1e9 / samples;
+  uint64_t l1Misses = l1.stop();
+  uint64_t llcMisses = llc.stop();
+  result.allocations = (double)(allocations - before) / samples;
+  result.l1Misses = l1.valid() ? (double)l1Misses / samples : -1;
+  result.llcMisses = llc.valid() ? (double)llcMisses / samples : -1;
+  result.checksum = path.checksum();
+  return result;
+}
+
+static void printCost(const char* name, const Cost& cost) {
+  printf("  %-8s %7.1f ns/sample, %.1f allocations/sample", name, cost.ns, cost.allocations);
+  if (cost.l1Misses >= 0) {
+    printf(", L1d misses %.2f/sample", cost.l1Misses);
+  }
+  if (cost.llcMisses >= 0) {
+    printf(", LLC misses %.3f/sample", cost.llcMisses);
+  }
+  printf("\n");
+}
+
+/**
+ * A consumer thread: reads every interval (0 = without pause) into a buffer of batch samples and
+ * checks the numbers of the samples.
+ */
+struct Consumer {
+  Consumer() : reads(0), samples(0), maxLag(0), lagSum(0), misplaced(0) {
+  }
+
+  void run(const SampleRing* ring, const std::atomic<bool>* running, double interval, uint32_t batch) {
+    std::vector<RingSample> buffer(batch);
+    Clock::time_point next = Clock::now();
+    while (running->load()) {
+      if (interval > 0) {
+        next += std::chrono::microseconds((long)(interval * 1e3));
+        std::this_thread::sleep_until(next);
+      }
+      read(ring, buffer);
+    }
+    read(ring, buffer);
+  }
+
+  void read(const SampleRing* ring, std::vector<RingSample>& buffer) {
+    uint32_t lag = ringAvailable(ring, &cursor);
+    maxLag = std::max(maxLag, lag);
+    lagSum += lag;
+    ++reads;
+    uint32_t count;
+    while ((count = ringRead(ring, &cursor, &buffer[0], (uint32_t)buffer.size())) > 0) {
+      // The copied samples are the last count ones before the new position.
+      uint32_t first = cursor.position - count;
+      for (uint32_t i = 0; i < count; ++i) {
+        if (buffer[i].value != sampleValue(first + i) || buffer[i].blink != ((first + i) % 50 == 0)) {
+          ++misplaced;
+        }
+      }
+      samples += count;
+    }
+  }
+
+  RingCursor cursor;
+  unsigned long reads;
+  unsigned long samples;
+  uint32_t maxLag;
+  double lagSum;
+  unsigned long misplaced;
+};
+
+/**
+ * Runs a producer at rate samples per second (0 = without pause) for duration s against the
+ * consumers. Returns the number of written samples.
+ */
+static uint32_t runThreads(SampleRing* ring, std::vector<Consumer>& consumers, double rate, double duration,
+                           double interval, uint32_t batch) {
+  std::atomic<bool> running(true);
+  ringInit(ring);
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < consumers.size(); ++c) {
+    ringAttach(ring, &consumers[c].cursor);
+    threads.push_back(std::thread(&Consumer::run, &consumers[c], ring, &running, interval, batch));
+  }
+  Clock::time_point start = Clock::now();
+  uint32_t written = 0;
+  while (seconds(start) < duration) {
+    if (rate > 0) {
+      // Write the samples which are due, then sleep until the next one.
+      uint32_t due = (uint32_t)(seconds(start) * rate);
+      for (; written < due; ++written) {
+        ringWrite(ring, sampleValue(written), (written % 50) == 0, 0);
+      }
+      std::this_thread::sleep_until(start + std::chrono::microseconds((long)((written + 1) * 1e6 / rate)));
+    } else {
+      for (int i = 0; i < 1024; ++i, ++written) {
+        ringWrite(ring, sampleValue(written), (written % 50) == 0, 0);
+      }
+    }
+  }
+  running.store(false);
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  return written;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n samples] [-c consumers] [-r rate] [-d seconds] [-p ms] [-s seconds]\n", name);
+}
+
+int main(int argc, char** argv) {
+  size_t samples = 10000000;
+  size_t consumerCount = 3;
+  double rate = 1000;
+  double duration = 3;
+  double interval = 100;
+  double stress = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:r:d:p:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        samples = std::max(1L, atol(optarg));
+        break;
+      case 'c':
+        consumerCount = std::max(1L, atol(optarg));
+        break;
+      case 'r':
+        rate = std::max(1.0, atof(optarg));
+        break;
+      case 'd':
+        duration = std::max(0.0, atof(optarg));
+        break;
+      case 'p':
+        interval = std::max(0.0, atof(optarg));
+        break;
+      case 's':
+        stress = std::max(0.0, atof(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  printf("cost (%zu samples, %zu consumers, ring %zu KiB):\n", samples, consumerCount, sizeof(SampleRing) / 1024);
+  {
+    FanOut fanOut(consumerCount);
+    printCost("fan-out", cost(fanOut, samples));
+  }
+  {
+    RingConsumers* ring = new RingConsumers(consumerCount, samples);
+    printCost("ring", cost(*ring, samples));
+    delete ring;
+  }
+
+  SampleRing* ring = new SampleRing;
+  unsigned long misplaced = 0;
+  if (duration > 0) {
+    std::vector<Consumer> consumers(consumerCount);
+    uint32_t written = runThreads(ring, consumers, rate, duration, interval, 256);
+    printf("real time (%.0f samples/s, %.0f s, read every %.0f ms): %u samples written\n", rate, duration, interval,
+           written);
+    for (size_t c = 0; c < consumers.size(); ++c) {
+      const Consumer& consumer = consumers[c];
+      printf("  consumer %zu: %lu samples, %lu reads, lag avg %.1f max %u samples, %u overruns\n", c, consumer.samples,
+             consumer.reads, consumer.lagSum / consumer.reads, consumer.maxLag, consumer.cursor.overruns);
+      misplaced += consumer.misplaced;
+    }
+  }
+  if (stress > 0) {
+    std::vector<Consumer> consumers(consumerCount);
+    uint32_t written = runThreads(ring, consumers, 0, stress, 0, 7);
+    printf("stress (%.0f s, no pause): %u samples written\n", stress, written);
+    for (size_t c = 0; c < consumers.size(); ++c) {
+      const Consumer& consumer = consumers[c];
+      printf("  consumer %zu: %lu samples read, %u overruns, %lu misplaced\n", c, consumer.samples,
+             consumer.cursor.overruns, consumer.misplaced);
+      misplaced += consumer.misplaced;
+    }
+  }
+  delete ring;
+  return misplaced == 0 ? 0 : 1;
+}
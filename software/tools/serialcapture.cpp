@@ -0,0 +1,374 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Capture of the binary sample stream of the sketch (SERIAL_BINARY_STREAM, see SerialFrame.h).
+ *
+ * Reads the frames from a serial port, a pty or a file, checks the COBS framing, the checksum
+ * and the sequence numbers, and writes one line per sample:
+ *   <raw count>\t<time in us>\t<proxFiltered * 100>\t<blink>\t<blink level>\t<edge type>
+ * The raw count comes first, so the other tools load the capture with -r and run the whole
+ * blink detection on it (e.g. replay -r capture.txt). Text printed by the sketch between the
+ * frames ("Connected", the statistics, ...) is written to stderr.
+ * With -a the samples are also appended to a sample archive (SampleArchive.h) as one session,
+ * the time of the sketch is mapped to the wall clock at the first frame.
+ * Runs until the end of the input, -n frames or Ctrl-C.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino -I../cocoa-app/eyeDrops serialcapture.cpp -o serialcapture
+ * Usage:  serialcapture [-b baud] [-n frames] [-o capture] [-a archive] [-q] <tty>
+ *   -b  baud rate of a serial port (default 115200)
+ *   -n  stop after this many frames
+ *   -o  capture file (default stdout)
+ *   -a  sample archive to append to (created if it does not exist)
+ *   -q  do not print the text of the sketch
+ *
+ * Exit code is 0 if no frame was lost or corrupted, 1 otherwise, 2 on errors.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "SampleArchive.h"
+#include "SerialFrame.h"
+
+#define READ_SIZE 4096
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+  stopRequested = 1;
+}
+
+static int64_t wallMicros() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+struct CaptureStatistics {
+  unsigned long frames;       // valid sample frames
+  unsigned long lost;         // frames missing according to the sequence numbers
+  unsigned long corrupted;    // invalid frames which are not text
+  unsigned long textBytes;    // bytes of text between the frames
+  unsigned long blinks;
+  uint32_t firstTime;         // us
+  uint32_t lastTime;          // us
+  uint32_t intervalMax;       // us
+};
+
+/**
+ * Splits the byte stream at the zero bytes and handles the frames in between.
+ */
+class FrameReader {
+public:
+  FrameReader(FILE* output, ArchiveWriter* archive, bool printText)
+      : output(output), archive(archive), printText(printText), length(0), overflow(false), expected(-1),
+        archiveErrors(0), timeOffset(0) {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  void add(const uint8_t* data, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (data[i] != 0) {
+        if (length < sizeof(frame)) {
+          frame[length++] = data[i];
+        } else {
+          overflow = true;
+          flushText();
+        }
+      } else {
+        endFrame();
+      }
+    }
+  }
+
+  const CaptureStatistics& statistics() const {
+    return stats;
+  }
+
+  unsigned long archiveFailures() const {
+    return archiveErrors;
+  }
+
+private:
+  void endFrame() {
+    SerialSample sample;
+    if (!overflow && length > 0 && decodeSerialSample(frame, (uint16_t)length, &sample)) {
+      addSample(sample);
+    } else if (length > 0) {
+      flushText();
+    }
+    length = 0;
+    overflow = false;
+  }
+
+  void addSample(const SerialSample& sample) {
+    if (expected >= 0) {
+      stats.lost += (uint8_t)(sample.sequence - expected);
+      uint32_t interval = sample.time - stats.lastTime;
+      if (interval > stats.intervalMax) {
+        stats.intervalMax = interval;
+      }
+    } else {
+      stats.firstTime = sample.time;
+      // A capture replayed from a file must not start before the last session of the archive.
+      int64_t start = wallMicros();
+      if (archive && archive->lastTime >= start) {
+        start = archive->lastTime + 1;
+      }
+      timeOffset = start - sample.time;
+    }
+    // micros() of the sketch wraps after 71 minutes.
+    if (expected >= 0 && sample.time < stats.lastTime) {
+      timeOffset += (int64_t)1 << 32;
+    }
+    expected = (uint8_t)(sample.sequence + 1);
+    stats.lastTime = sample.time;
+    ++stats.frames;
+    bool blink = (sample.state & SERIAL_FRAME_STATE_BLINK) != 0;
+    stats.blinks += blink;
+    fprintf(output, "%u\t%u\t%.4f\t%d\t%d\t%d\n", sample.raw, sample.time,
+            sample.filtered / 65536.0 * 100, blink, (sample.state >> SERIAL_FRAME_STATE_LEVEL) & 3,
+            ((sample.state >> SERIAL_FRAME_STATE_EDGE) & 3) - 1);
+    if (archive) {
+      ArchiveSample archived;
+      archived.time = timeOffset + sample.time;
+      archived.filtered = (float)(sample.filtered / 65536.0);
+      archived.raw = sample.raw;
+      archived.blink = blink;
+      archived.state = sample.state;
+      archiveErrors += !archiveAppend(archive, &archived);
+    }
+  }
+
+  /**
+   * Handles the bytes of an invalid frame: printed if they are text, counted otherwise.
+   */
+  void flushText() {
+    bool text = true;
+    for (size_t i = 0; i < length && text; ++i) {
+      text = frame[i] == '\r' || frame[i] == '\n' || frame[i] == '\t' ||
+             (frame[i] >= 0x20 && frame[i] < 0x7F);
+    }
+    if (text) {
+      stats.textBytes += length;
+      if (printText) {
+        fwrite(frame, 1, length, stderr);
+      }
+    } else if (!overflow) {
+      ++stats.corrupted;
+    }
+    length = 0;
+  }
+
+  FILE* output;
+  ArchiveWriter* archive;     // NULL without -a
+  bool printText;
+  uint8_t frame[256];         // bytes since the last zero byte
+  size_t length;
+  bool overflow;              // more than sizeof(frame) bytes since the last zero byte
+  int expected;               // next sequence number, -1 before the first frame
+  unsigned long archiveErrors;
+  int64_t timeOffset;         // wall clock minus micros() of the sketch, in us
+  CaptureStatistics stats;
+};
+
+speed_t baudConstant(long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B0;
+  }
+}
+
+/**
+ * Switches a serial port or pty to raw mode with the given baud rate.
+ * Other files (recorded streams) are left as they are.
+ */
+bool configurePort(int fd, long baud) {
+  if (!isatty(fd)) {
+    return true;
+  }
+  speed_t speed = baudConstant(baud);
+  if (speed == B0) {
+    fprintf(stderr, "ERROR: unsupported baud rate %ld\n", baud);
+    return false;
+  }
+  struct termios options;
+  if (tcgetattr(fd, &options) != 0) {
+    perror("tcgetattr");
+    return false;
+  }
+  cfmakeraw(&options);
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+  options.c_cflag |= CLOCAL | CREAD;
+  options.c_cc[VMIN] = 1;
+  options.c_cc[VTIME] = 0;
+  if (tcsetattr(fd, TCSANOW, &options) != 0) {
+    perror("tcsetattr");
+    return false;
+  }
+  tcflush(fd, TCIFLUSH);
+  return true;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-b baud] [-n frames] [-o capture] [-a archive] [-q] <tty>\n", name);
+}
+
+int main(int argc, char** argv) {
+  long baud = 115200;
+  unsigned long maxFrames = 0;
+  const char* outputPath = NULL;
+  const char* archivePath = NULL;
+  bool printText = true;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:n:o:a:q")) != -1) {
+    switch (opt) {
+      case 'b':
+        baud = atol(optarg);
+        break;
+      case 'n':
+        maxFrames = strtoul(optarg, NULL, 10);
+        break;
+      case 'o':
+        outputPath = optarg;
+        break;
+      case 'a':
+        archivePath = optarg;
+        break;
+      case 'q':
+        printText = false;
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  int fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: cannot open %s: %s\n", argv[optind], strerror(errno));
+    return 2;
+  }
+  if (!configurePort(fd, baud)) {
+    close(fd);
+    return 2;
+  }
+  FILE* output = outputPath ? fopen(outputPath, "w") : stdout;
+  if (!output) {
+    fprintf(stderr, "ERROR: cannot write %s\n", outputPath);
+    close(fd);
+    return 2;
+  }
+  // The capture is written in large blocks, so writing never holds up reading the port.
+  static char outputBuffer[OUTPUT_BUFFER_SIZE];
+  setvbuf(output, outputBuffer, _IOFBF, sizeof(outputBuffer));
+  fprintf(output, "# raw\ttime_us\tfiltered*100\tblink\tlevel\tedge\n");
+
+  // Without SA_RESTART a Ctrl-C interrupts the blocking read.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = requestStop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  ArchiveWriter* archive = NULL;
+  if (archivePath) {
+    archive = new ArchiveWriter;
+    if (!archiveOpen(archive, archivePath, wallMicros()) || !archiveBeginSession(archive)) {
+      fprintf(stderr, "ERROR: cannot open %s as sample archive\n", archivePath);
+      delete archive;
+      close(fd);
+      return 2;
+    }
+  }
+
+  FrameReader reader(output, archive, printText);
+  uint8_t data[READ_SIZE];
+  while (!stopRequested && (maxFrames == 0 || reader.statistics().frames < maxFrames)) {
+    ssize_t n = read(fd, data, sizeof(data));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // A pty returns EIO when the other side is closed.
+      if (errno != EIO) {
+        perror("read");
+      }
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+    reader.add(data, (size_t)n);
+  }
+  close(fd);
+  if (output != stdout) {
+    fclose(output);
+  } else {
+    fflush(output);
+  }
+  bool archived = true;
+  if (archive) {
+    archived = archiveClose(archive) && reader.archiveFailures() == 0;
+    delete archive;
+    if (!archived) {
+      fprintf(stderr, "ERROR: %lu samples could not be archived\n", reader.archiveFailures());
+    }
+  }
+
+  const CaptureStatistics& stats = reader.statistics();
+  double seconds = (stats.lastTime - stats.firstTime) / 1e6;
+  fprintf(stderr, "\nframes: %lu  lost: %lu  corrupted: %lu  text bytes: %lu  blinks: %lu\n",
+          stats.frames, stats.lost, stats.corrupted, stats.textBytes, stats.blinks);
+  if (stats.frames > 1) {
+    fprintf(stderr, "duration: %.1f s  rate: %.1f samples/s  max interval: %u us\n", seconds,
+            (stats.frames - 1) / seconds, stats.intervalMax);
+  }
+  return stats.lost == 0 && stats.corrupted == 0 && archived ? 0 : 1;
+}
@@ -0,0 +1,429 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Load test of the connection logic of the app (DeviceSession.h) against a simulated RFDuino.
+ *
+ * The RFDuino (SimulatedPeripheral.h) runs in its own thread at the other end of a socket pair
+ * (one datagram per BLE packet). Its notifications are lost with probability -l, the writes of the
+ * app with probability -w.
+ * The app side is the DeviceSession with the socket as transport, polled like the BLEDeviceManager
+ * runs it. The run is: connect, profile upload, -d s normal mode with blinking enabled, -c s
+ * calibration, back to normal mode; with -k the calibration is repeated right away, without a
+ * profile upload in between.
+ *
+ * Reported are the blink latency (first transmission of an event by the RFDuino until the session
+ * handled it), the time the session spends per message and the messages handled per second. For
+ * every calibration the samples of the lost frames are compared to the estimate of the session
+ * (lostBefore), which keeps the sample indices of the app in step with the time.
+ *
+ * Build:  g++ -O2 -std=c++11 -pthread -I../RFduino -I../cocoa-app/eyeDrops sessionsim.cpp -o sessionsim
+ * Usage:  sessionsim [-r rate] [-b blinks] [-d seconds] [-c seconds] [-k count] [-l loss] [-w loss] [-t ms] [-s seed]
+ *   -r  samples per second of the RFDuino (default 166.7), 0 as fast as possible
+ *   -b  blinks per second (default 0.5)
+ *   -d  duration of the normal mode in s (default 10)
+ *   -c  duration of the calibration in s (default 5)
+ *   -k  number of calibrations (default 1)
+ *   -l  loss probability of the notifications of the RFDuino (default 0)
+ *   -w  loss probability of the writes of the app (default 0)
+ *   -t  no blink interval in ms (default 4000)
+ *   -s  seed (default 1)
+ *
+ * Exit code is 0 if the profile was applied, every blink arrived, except blinks whose
+ * transmissions were all lost, and the estimated lost samples of every calibration are within
+ * two samples per lost frame of the real ones, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <random>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "DeviceSession.h"
+#include "SimulatedPeripheral.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Lost samples per lost frame the estimate of a calibration may be off: the session only knows the
+// average frame size, the RFDuino sends partial frames when the load changes.
+static const long lostTolerance = 2;
+
+static uint32_t microsSince(Clock::time_point start) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+/**
+ * First transmission of every blink event, indexed by the device time of the event: the simulated
+ * RFDuino numbers its blinks instead of sending millis(), so the app side finds the event.
+ */
+class BlinkLog {
+public:
+  uint32_t add(Clock::time_point time) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sent.push_back(time);
+    return (uint32_t)(sent.size() - 1);
+  }
+
+  bool find(uint32_t id, Clock::time_point& time) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= sent.size()) {
+      return false;
+    }
+    time = sent[id];
+    return true;
+  }
+
+private:
+  std::mutex mutex;
+  std::vector<Clock::time_point> sent;
+};
+
+/**
+ * Runs the simulated RFDuino in its own thread: samples at the given rate, blinks at random.
+ */
+class Peripheral {
+public:
+  Peripheral(int fd, double rate, double blinkRate, double loss, uint32_t seed, BlinkLog& blinkLog)
+      : device(fd, loss, seed, (float)rate), calibrationSamples(0), fd(fd), rate(rate), blinkRate(blinkRate),
+        random(seed + 2), blinkLog(blinkLog), stopRequested(false) {
+  }
+
+  void run() {
+    start = Clock::now();
+    double period = rate > 0 ? 1e6 / rate : 0;
+    double nextSample = 0;
+    while (!stopRequested) {
+      uint32_t now = microsSince(start);
+      int timeout = 0;
+      if (period > 0 && nextSample > now) {
+        timeout = std::min(10, (int)((nextSample - now) / 1000));
+      }
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      if (poll(&pfd, 1, timeout) > 0) {
+        uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE + 1];
+        ssize_t length = recv(fd, data, sizeof(data), 0);
+        if (length <= 0) {
+          break;
+        }
+        device.receive(data, (int)length);
+      }
+      now = microsSince(start);
+      while (now >= nextSample && !stopRequested) {
+        sample(now / 1000);
+        nextSample += period;
+        if (period == 0) {
+          break;
+        }
+      }
+      device.update(now / 1000);
+    }
+  }
+
+  void stop() {
+    stopRequested = true;
+  }
+
+  SimulatedPeripheral device;       // read the counters after the thread ended
+  std::atomic<unsigned long> calibrationSamples; // device.calibrationSamples, readable while running
+
+private:
+  /**
+   * One sample of the sensor: a blink with probability blinkRate / rate, a calibration sample.
+   */
+  void sample(uint32_t now) {
+    bool blink = blinkRate > 0 &&
+                 std::uniform_real_distribution<double>(0, 1)(random) < blinkRate / (rate > 0 ? rate : 1000);
+    if (blink && device.normalMode()) {
+      device.blink(blinkLog.add(Clock::now()), now);
+    }
+    if (device.calibrating()) {
+      device.calibrationSample((int32_t)(std::normal_distribution<double>(0, 0.002)(random) * 65536), blink);
+      ++calibrationSamples;
+    }
+  }
+
+  int fd;
+  double rate;
+  double blinkRate;
+  std::mt19937 random;
+  BlinkLog& blinkLog;
+  Clock::time_point start;
+  std::atomic<bool> stopRequested;
+};
+
+/**
+ * The app side: the session, its transport and the measurements.
+ */
+struct Host {
+  int fd;
+  double loss;
+  std::mt19937 random;
+  uint32_t noBlinkInterval;
+  Clock::time_point start;
+  DeviceSession session;
+  BlinkLog* blinkLog;
+
+  unsigned long writes;
+  unsigned long lostWrites;
+  unsigned long blurs;
+  unsigned long profilesApplied;
+  unsigned long calibrationSamples;
+  unsigned long lostCalibrationSamples; // estimated by the session
+  std::vector<double> latencies;      // us
+  std::vector<bool> handled;          // by blink id
+  double receiveSeconds;              // time spent in sessionReceive()
+
+  uint32_t now() const {
+    return microsSince(start) / 1000;
+  }
+
+  static bool send(void* context, const uint8_t* data, uint8_t length) {
+    Host* host = (Host*)context;
+    ++host->writes;
+    if (std::uniform_real_distribution<double>(0, 1)(host->random) < host->loss) {
+      ++host->lostWrites;
+      return true;   // written, but lost on the way
+    }
+    return ::send(host->fd, data, length, MSG_NOSIGNAL) == length;
+  }
+
+  static void startBlur(void* context) {
+    ++((Host*)context)->blurs;
+  }
+
+  static void profileApplied(void* context) {
+    ++((Host*)context)->profilesApplied;
+  }
+
+  static void calibrationSample(void* context, float, bool, uint32_t lostBefore) {
+    ++((Host*)context)->calibrationSamples;
+    ((Host*)context)->lostCalibrationSamples += lostBefore;
+  }
+
+  static uint32_t interval(void* context) {
+    return ((Host*)context)->noBlinkInterval;
+  }
+
+  /**
+   * Handles the messages of the RFDuino and the timers of the session for the given time.
+   */
+  void run(double seconds) {
+    Clock::time_point end = Clock::now() + std::chrono::microseconds((long)(seconds * 1e6));
+    while (Clock::now() < end) {
+      uint32_t deadline;
+      int timeout = 10;
+      if (sessionNextDeadline(&session, &deadline)) {
+        timeout = std::max(0, std::min(timeout, (int32_t)(deadline - now())));
+      }
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      if (poll(&pfd, 1, timeout) > 0) {
+        uint8_t data[PROTOCOL_MAX_MESSAGE_SIZE + 1];
+        ssize_t length;
+        while ((length = recv(fd, data, sizeof(data), MSG_DONTWAIT)) > 0) {
+          receive(data, (int)length);
+        }
+      }
+      sessionPoll(&session, now());
+    }
+  }
+
+  void receive(const uint8_t* data, int length) {
+    uint32_t blinksBefore = session.blinkCounter;
+    Clock::time_point before = Clock::now();
+    sessionReceive(&session, data, length, now());
+    Clock::time_point after = Clock::now();
+    receiveSeconds += std::chrono::duration<double>(after - before).count();
+    uint8_t sequence;
+    uint32_t id;
+    Clock::time_point sent;
+    if (session.blinkCounter != blinksBefore && protocolDecodeBlinkEvent(data, length, &sequence, &id) &&
+        blinkLog->find(id, sent)) {
+      latencies.push_back(std::chrono::duration<double, std::micro>(after - sent).count());
+      if (id >= handled.size()) {
+        handled.resize(id + 1);
+      }
+      handled[id] = true;
+    }
+  }
+};
+
+static double percentile(std::vector<double> values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * percent / 100));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r rate] [-b blinks] [-d seconds] [-c seconds] [-k count] [-l loss] [-w loss] [-t ms] "
+          "[-s seed]\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  double rate = 166.7;
+  double blinkRate = 0.5;
+  double normalSeconds = 10;
+  double calibrationSeconds = 5;
+  int calibrations = 1;
+  double notificationLoss = 0;
+  double writeLoss = 0;
+  uint32_t noBlinkInterval = 4000;
+  uint32_t seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:b:d:c:k:l:w:t:s:")) != -1) {
+    switch (opt) {
+      case 'r':
+        rate = std::max(0.0, atof(optarg));
+        break;
+      case 'b':
+        blinkRate = std::max(0.0, atof(optarg));
+        break;
+      case 'd':
+        normalSeconds = std::max(0.0, atof(optarg));
+        break;
+      case 'c':
+        calibrationSeconds = std::max(0.0, atof(optarg));
+        break;
+      case 'k':
+        calibrations = std::max(1, atoi(optarg));
+        break;
+      case 'l':
+        notificationLoss = std::min(1.0, std::max(0.0, atof(optarg)));
+        break;
+      case 'w':
+        writeLoss = std::min(1.0, std::max(0.0, atof(optarg)));
+        break;
+      case 't':
+        noBlinkInterval = (uint32_t)std::max(1L, atol(optarg));
+        break;
+      case 's':
+        seed = (uint32_t)atol(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+    perror("socketpair");
+    return 2;
+  }
+
+  BlinkLog blinkLog;
+  Peripheral peripheral(fds[1], rate, blinkRate, notificationLoss, seed, blinkLog);
+  std::thread peripheralThread(&Peripheral::run, &peripheral);
+
+  Host host;
+  host.fd = fds[0];
+  host.loss = writeLoss;
+  host.random.seed(seed + 1);
+  host.noBlinkInterval = noBlinkInterval;
+  host.start = Clock::now();
+  host.blinkLog = &blinkLog;
+  host.writes = host.lostWrites = host.blurs = host.profilesApplied = host.calibrationSamples = 0;
+  host.lostCalibrationSamples = 0;
+  host.receiveSeconds = 0;
+
+  SessionTransport transport = { &host, Host::send };
+  SessionEvents events;
+  memset(&events, 0, sizeof(events));
+  events.context = &host;
+  events.startBlur = Host::startBlur;
+  events.profileApplied = Host::profileApplied;
+  events.calibrationSample = Host::calibrationSample;
+  events.noBlinkInterval = Host::interval;
+  sessionInit(&host.session, &transport, &events);
+
+  // Default profile of BlinkDetector.h.
+  ProfileParameters profile = { -0.003f, 0.0025f, 0.0002f, -0.02f, 0.02f, { 4, 30 }, { 6, 35 }, { 30, 105 }, 4 };
+  sessionSetProfile(&host.session, &profile, host.now());
+  sessionSetBlurring(&host.session, true, host.now());
+  sessionConnected(&host.session);
+  sessionReady(&host.session, host.now());
+
+  Clock::time_point runStart = Clock::now();
+  host.run(normalSeconds);
+  bool estimatesOk = true;
+  for (int k = 0; k < calibrations; ++k) {
+    unsigned long sentBefore = peripheral.calibrationSamples;
+    unsigned long receivedBefore = host.calibrationSamples;
+    unsigned long estimatedBefore = host.lostCalibrationSamples;
+    sessionStartCalibration(&host.session);
+    host.run(calibrationSeconds);
+    sessionStopCalibration(&host.session);
+    sessionCalibrationComplete(&host.session);
+    host.run(0.5);
+    long lost = (long)(peripheral.calibrationSamples - sentBefore) - (long)(host.calibrationSamples - receivedBefore);
+    long estimated = (long)(host.lostCalibrationSamples - estimatedBefore);
+    uint32_t frames = host.session.lostCalibrationFrames;
+    printf("calibration %d: %lu samples sent, %lu received, %u frames lost with %ld samples, estimated %ld\n", k + 1,
+           peripheral.calibrationSamples - sentBefore, host.calibrationSamples - receivedBefore, frames, lost,
+           estimated);
+    estimatesOk &= std::labs(estimated - lost) <= (long)frames * lostTolerance;
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+
+  peripheral.stop();
+  peripheralThread.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  const DeviceSession& session = host.session;
+  const SimulatedPeripheral& device = peripheral.device;
+  unsigned long handled = std::count(host.handled.begin(), host.handled.end(), true);
+  unsigned long missing = device.blinks - handled;
+  printf("profile:     %s after %u uploads, %u reply timeouts\n", host.profilesApplied ? "applied" : "NOT APPLIED",
+         session.stats.profileUploads, session.stats.replyTimeouts);
+  printf("blinks:      %lu sent, %lu handled, %u repetitions dropped, %lu given up (%lu all lost), %lu missing\n",
+         device.blinks, handled, session.stats.repeatedBlinks, device.blinksGivenUp, device.allLost, missing);
+  printf("latency:     50%% %.0f us, 99%% %.0f us, max %.0f us\n", percentile(host.latencies, 50),
+         percentile(host.latencies, 99), percentile(host.latencies, 100));
+  printf("timer:       %lu blurs (no blink for %u ms)\n", host.blurs, noBlinkInterval);
+  printf("messages:    %lu notifications (%lu lost), %lu writes (%lu lost), %u malformed\n", device.sent,
+         device.lost, host.writes, host.lostWrites, session.stats.malformed);
+  printf("session:     %u messages in %.2f s, %.0f messages/s, %.0f ns per message\n", session.stats.messages,
+         seconds, session.stats.messages / seconds,
+         session.stats.messages ? host.receiveSeconds * 1e9 / session.stats.messages : 0.0);
+
+  bool ok = host.profilesApplied > 0 && missing <= device.allLost && session.stats.malformed == 0 && estimatesOk;
+  return ok ? 0 : 1;
+}
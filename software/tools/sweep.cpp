@@ -0,0 +1,360 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Parameter sweep to tune a blink profile on labelled recordings.
+ *
+ * Evaluates random candidate parameter sets (within configurable ranges) with the fixed point
+ * detector of the sketch on all cores and prints the best one in the order of the 12 profile
+ * parameters as stored by createProfile: of the CalibrationWindowController:
+ *   negThresh posThresh hyst minMin maxMax tFallMin tFallMax tRiseMin tRiseMax tTotalMin tTotalMax allowedZeros
+ * The thresholds are in mm (as sent to the RFduino), the times in samples.
+ *
+ * Labels are the blink column of a Serial log or, for proximity captures, a file with one
+ * sample index per line given as <recording>:<labels>.
+ *
+ * Build:  g++ -O2 -std=c++11 -pthread -I../RFduino sweep.cpp -o sweep
+ * Usage:  sweep [-r] [-n candidates] [-j threads] [-t tolerance] [-s seed] [-p name=min:max]... <recording[:labels]>...
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -n  number of candidates (default 4000, the first one is the default profile)
+ *   -j  number of threads (default: all cores)
+ *   -t  allowed offset in samples between a detected and a labelled blink (default 10)
+ *   -s  seed of the random candidates
+ *   -p  search range of a parameter, min == max keeps it constant
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "BlinkDetector.h"
+#include "Recording.h"
+
+// Same configuration as the sketch with FIXED_POINT_DETECTION (MA_BUFFER, PROX_FILTERED_BUFFER).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> Detector;
+
+#define PARAMETER_COUNT 12
+
+// Candidates evaluated together by one thread. The detectors of a batch process the trace
+// chunk by chunk, so every chunk is loaded into the cache once per batch only.
+#define BATCH_SIZE 16
+#define CHUNK_SIZE 4096
+
+struct ParameterRange {
+  const char* name;
+  double min;
+  double max;
+  bool integer;
+};
+
+// Search ranges in createProfile: order. minMin, maxMax and tTotalMin only take effect after
+// the blink has been reported, so they are kept at the default values.
+ParameterRange ranges[PARAMETER_COUNT] = {
+  { "negThresh",    -0.008,  -0.001,  false },
+  { "posThresh",     0.001,   0.008,  false },
+  { "hyst",          0.0,     0.0005, false },
+  { "minMin",       -0.02,   -0.02,   false },
+  { "maxMax",        0.02,    0.02,   false },
+  { "tFallMin",      2,       8,      true  },
+  { "tFallMax",      15,      45,     true  },
+  { "tRiseMin",      3,       10,     true  },
+  { "tRiseMax",      20,      50,     true  },
+  { "tTotalMin",     30,      30,     true  },
+  { "tTotalMax",     60,      150,    true  },
+  { "allowedZeros",  1,       8,      true  }
+};
+
+// Parameters of the default profile (BlinkDetector::reset()).
+const float defaultParameters[PARAMETER_COUNT] = {
+  -0.003f, 0.0025f, 0.0002f, -0.02f, 0.02f, 4, 30, 6, 35, 30, 105, 4
+};
+
+struct Trace {
+  bool filtered;                  // samples are filtered values (Serial log)
+  std::vector<int32_t> samples;   // samples converted for the detector
+  std::vector<size_t> labels;     // sample indices of the labelled blinks
+};
+
+struct Candidate {
+  float parameters[PARAMETER_COUNT];
+  size_t detected;                // detected blinks of all traces
+  size_t matched;                 // detected blinks matching a labelled blink
+};
+
+/**
+ * Sets the detector's parameters to the 12 profile parameters p (createProfile: order).
+ */
+void applyParameters(const float* p, BlinkParameters<int32_t>& params) {
+  params.edgeNegThresh = Detector::fromMM(p[0]);
+  params.edgePosThresh = Detector::fromMM(p[1]);
+  params.hyst = Detector::fromMM(p[2]);
+  params.min_min = Detector::fromMM(p[3]);
+  params.max_max = Detector::fromMM(p[4]);
+  params.t_fall[0] = (uint8_t)p[5];
+  params.t_fall[1] = (uint8_t)p[6];
+  params.t_rise[0] = (uint8_t)p[7];
+  params.t_rise[1] = (uint8_t)p[8];
+  params.t_total[0] = (uint16_t)p[9];
+  params.t_total[1] = (uint16_t)p[10];
+  params.allowedZeros = (uint8_t)p[11];
+}
+
+/**
+ * Evaluates a batch of candidates on all traces.
+ */
+void evaluateBatch(const std::vector<Trace>& traces, Candidate* candidates, size_t count,
+                   size_t tolerance) {
+  Detector detectors[BATCH_SIZE];
+  std::vector<size_t> blinks[BATCH_SIZE];
+  for (size_t k = 0; k < count; ++k) {
+    candidates[k].detected = 0;
+    candidates[k].matched = 0;
+  }
+  for (size_t t = 0; t < traces.size(); ++t) {
+    const Trace& trace = traces[t];
+    for (size_t k = 0; k < count; ++k) {
+      detectors[k].reset();
+      applyParameters(candidates[k].parameters, detectors[k].params);
+      blinks[k].clear();
+    }
+    const size_t n = trace.samples.size();
+    for (size_t start = 0; start < n; start += CHUNK_SIZE) {
+      const size_t end = std::min(n, start + CHUNK_SIZE);
+      for (size_t k = 0; k < count; ++k) {
+        Detector& detector = detectors[k];
+        for (size_t i = start; i < end; ++i) {
+          if (trace.filtered ? detector.updateFiltered(trace.samples[i]) : detector.update(trace.samples[i])) {
+            blinks[k].push_back(i);
+          }
+        }
+      }
+    }
+    for (size_t k = 0; k < count; ++k) {
+      candidates[k].detected += blinks[k].size();
+      candidates[k].matched += countMatches(blinks[k], trace.labels, tolerance);
+    }
+  }
+}
+
+/**
+ * Returns the F1 score (harmonic mean of precision and recall) of a candidate.
+ */
+double f1Score(const Candidate& candidate, size_t labelled) {
+  size_t total = candidate.detected + labelled;
+  return total == 0 ? 0.0 : 2.0 * candidate.matched / total;
+}
+
+void printCandidate(const char* title, const Candidate& candidate, size_t labelled) {
+  double precision = candidate.detected == 0 ? 0.0 : (double)candidate.matched / candidate.detected;
+  double recall = labelled == 0 ? 0.0 : (double)candidate.matched / labelled;
+  printf("%s: precision %.4f, recall %.4f, F1 %.4f (%zu of %zu detected blinks labelled, %zu labels)\n",
+         title, precision, recall, f1Score(candidate, labelled), candidate.matched, candidate.detected,
+         labelled);
+  for (int i = 0; i < PARAMETER_COUNT; ++i) {
+    printf(i == 0 ? "%g" : " %g", candidate.parameters[i]);
+  }
+  printf("\n");
+}
+
+/**
+ * Parses a -p argument "name=min:max" (or "name=value").
+ */
+bool parseRange(const char* arg) {
+  const char* equals = strchr(arg, '=');
+  if (!equals) {
+    return false;
+  }
+  std::string name(arg, equals - arg);
+  for (int i = 0; i < PARAMETER_COUNT; ++i) {
+    if (name == ranges[i].name) {
+      char* end;
+      ranges[i].min = strtod(equals + 1, &end);
+      ranges[i].max = *end == ':' ? strtod(end + 1, NULL) : ranges[i].min;
+      if (ranges[i].min > ranges[i].max) {
+        std::swap(ranges[i].min, ranges[i].max);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Draws a random candidate within the ranges. Min / max pairs are kept in order.
+ */
+void randomCandidate(std::mt19937& random, Candidate& candidate) {
+  for (int i = 0; i < PARAMETER_COUNT; ++i) {
+    if (ranges[i].integer) {
+      std::uniform_int_distribution<int> distribution((int)ranges[i].min, (int)ranges[i].max);
+      candidate.parameters[i] = (float)distribution(random);
+    } else {
+      std::uniform_real_distribution<double> distribution(ranges[i].min, ranges[i].max);
+      candidate.parameters[i] = (float)(ranges[i].min == ranges[i].max ? ranges[i].min : distribution(random));
+    }
+  }
+  for (int i = 5; i <= 9; i += 2) {
+    if (candidate.parameters[i] > candidate.parameters[i + 1]) {
+      std::swap(candidate.parameters[i], candidate.parameters[i + 1]);
+    }
+  }
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r] [-n candidates] [-j threads] [-t tolerance] [-s seed] "
+          "[-p name=min:max]... <recording[:labels]>...\n", name);
+}
+
+int main(int argc, char** argv) {
+  RecordingFormat format = RECORDING_AUTO;
+  size_t candidateCount = 4000;
+  unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+  size_t tolerance = 10;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "rn:j:t:s:p:")) != -1) {
+    switch (opt) {
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'n':
+        candidateCount = std::max(1L, atol(optarg));
+        break;
+      case 'j':
+        threadCount = std::max(1, atoi(optarg));
+        break;
+      case 't':
+        tolerance = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        if (!parseRange(optarg)) {
+          fprintf(stderr, "ERROR: unknown parameter range %s\n", optarg);
+          return 2;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // Load all traces once, they are shared read only by all threads.
+  std::vector<Trace> traces;
+  size_t labelled = 0;
+  size_t samples = 0;
+  for (int a = optind; a < argc; ++a) {
+    std::string path(argv[a]);
+    std::string labelPath;
+    size_t colon = path.rfind(':');
+    if (colon != std::string::npos) {
+      labelPath = path.substr(colon + 1);
+      path = path.substr(0, colon);
+    }
+    Recording recording;
+    if (!loadRecording(path.c_str(), format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", path.c_str());
+      return 2;
+    }
+    Trace trace;
+    trace.filtered = recording.filtered;
+    if (!labelPath.empty()) {
+      if (!loadLabels(labelPath.c_str(), trace.labels)) {
+        fprintf(stderr, "ERROR: could not read labels %s\n", labelPath.c_str());
+        return 2;
+      }
+      std::sort(trace.labels.begin(), trace.labels.end());
+    } else if (!recording.blinkColumn.empty()) {
+      trace.labels = recording.logBlinks();
+    } else {
+      fprintf(stderr, "ERROR: %s has no labels\n", path.c_str());
+      return 2;
+    }
+    trace.samples.reserve(recording.values.size());
+    for (size_t i = 0; i < recording.values.size(); ++i) {
+      trace.samples.push_back(trace.filtered ? Detector::fromMM(recording.values[i])
+                                             : Detector::accumFromMM(recording.values[i]));
+    }
+    labelled += trace.labels.size();
+    samples += trace.samples.size();
+    traces.push_back(trace);
+  }
+
+  std::vector<Candidate> candidates(candidateCount);
+  memcpy(candidates[0].parameters, defaultParameters, sizeof(defaultParameters));
+  std::mt19937 random(seed);
+  for (size_t i = 1; i < candidateCount; ++i) {
+    randomCandidate(random, candidates[i]);
+  }
+
+  // Threads take batches of candidates until all are evaluated.
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<size_t> nextBatch(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < threadCount; ++t) {
+    threads.push_back(std::thread([&]() {
+      size_t first;
+      while ((first = nextBatch.fetch_add(BATCH_SIZE)) < candidateCount) {
+        size_t count = std::min((size_t)BATCH_SIZE, candidateCount - first);
+        evaluateBatch(traces, &candidates[first], count, tolerance);
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Best F1 score, precision decides on equal scores.
+  size_t best = 0;
+  for (size_t i = 1; i < candidateCount; ++i) {
+    double f1 = f1Score(candidates[i], labelled);
+    double bestF1 = f1Score(candidates[best], labelled);
+    if (f1 > bestF1 || (f1 == bestF1 && candidates[i].detected < candidates[best].detected)) {
+      best = i;
+    }
+  }
+
+  printf("%zu candidates on %zu traces (%zu samples) with %u threads in %.2f s (%.1f M samples/s)\n",
+         candidateCount, traces.size(), samples, threadCount, seconds,
+         (double)candidateCount * samples / seconds / 1e6);
+  printCandidate("default profile", candidates[0], labelled);
+  printCandidate("best profile", candidates[best], labelled);
+  return 0;
+}
@@ -0,0 +1,344 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Benchmark of the streaming threshold estimation (ThresholdEstimator.h) on recorded sessions.
+ *
+ * The filtered samples of every recording (Serial logs as logged, proximity captures run through
+ * the filter of the sketch) are added to the estimator one by one, with an estimate after every
+ * sample as the app could show it while the calibration runs. Per recording:
+ *   - ns per sample for adding only and for adding and estimating, compared to one estimate of
+ *     the noise floor by sorting all samples,
+ *   - the proposed amplitude parameters in mm and the sample of the first estimate,
+ *   - median and noise quantiles compared to the sorted samples,
+ *   - precision, recall and F1 of the fixed point detector of the sketch with the default profile
+ *     and with the proposed amplitude parameters (times of the default profile).
+ * The estimate is taken from the first -c samples (the calibration), the detectors run on the
+ * whole recording.
+ * With -p the calibration prompted the blinks (-p 1:2:4 is the schedule of the AnimationView: 4
+ * prompts every 2 s from 1 s on). Then the time windows are estimated as well (TimingEstimator.h)
+ * and the segmented blinks are listed; the detector runs once more with the whole proposed
+ * profile.
+ *
+ * Labels are the blink column of a Serial log or, for proximity captures, a file with one
+ * sample index per line given as <recording>:<labels>.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino -I../cocoa-app/eyeDrops thresholdbench.cpp -o thresholdbench
+ * Usage:  thresholdbench [-r] [-c samples] [-p first:interval:count] [-t tolerance] [-n repeat] <recording[:labels]>...
+ *   -r  proximity captures contain raw counts instead of mm
+ *   -c  samples used for the estimate (default: all)
+ *   -p  prompts of the calibration: first prompt and interval in s after the first sample, count
+ *   -t  allowed offset in samples between a detected and a labelled blink (default 10)
+ *   -n  run the estimation n times for the timing (default 10)
+ *
+ * Exit code is 0 if median and noise quantiles are in the bins of the sorted samples, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "BlinkDetector.h"
+#include "Recording.h"
+#include "ThresholdEstimator.h"
+#include "TimingEstimator.h"
+
+// Same configuration as the sketch with FIXED_POINT_DETECTION (MA_BUFFER, PROX_FILTERED_BUFFER).
+typedef BlinkDetector<int32_t, int32_t, 16, 200> Detector;
+
+struct Schedule {
+  double first;       // s after the first sample
+  double interval;    // s
+  unsigned count;
+};
+
+struct Score {
+  size_t detected;
+  size_t matched;
+};
+
+/**
+ * Replays the recording with the default profile, with the amplitude parameters of the estimate
+ * and the windows of the timing if they are given.
+ */
+Score evaluate(const Recording& recording, const std::vector<size_t>& labels, const ThresholdEstimate* estimate,
+               const TimingEstimate* timing, size_t tolerance) {
+  Detector detector;
+  if (estimate) {
+    detector.params.edgeNegThresh = Detector::fromMM(estimate->negativeThreshold);
+    detector.params.edgePosThresh = Detector::fromMM(estimate->positiveThreshold);
+    detector.params.hyst = Detector::fromMM(estimate->hysteresis);
+    detector.params.min_min = Detector::fromMM(estimate->minValue);
+    detector.params.max_max = Detector::fromMM(estimate->maxValue);
+  }
+  if (timing) {
+    detector.params.t_fall[0] = timing->fall[0];
+    detector.params.t_fall[1] = timing->fall[1];
+    detector.params.t_rise[0] = timing->rise[0];
+    detector.params.t_rise[1] = timing->rise[1];
+    detector.params.t_total[0] = timing->total[0];
+    detector.params.t_total[1] = timing->total[1];
+    detector.params.allowedZeros = timing->closed;
+  }
+  std::vector<size_t> blinks = replayRecording(recording, detector);
+  Score score;
+  score.detected = blinks.size();
+  score.matched = countMatches(blinks, labels, tolerance);
+  return score;
+}
+
+void printScore(const char* title, const Score& score, size_t labelled) {
+  double precision = score.detected == 0 ? 0.0 : (double)score.matched / score.detected;
+  double recall = labelled == 0 ? 0.0 : (double)score.matched / labelled;
+  double f1 = score.detected + labelled == 0 ? 0.0 : 2.0 * score.matched / (score.detected + labelled);
+  printf("  %s: precision %.4f, recall %.4f, F1 %.4f (%zu of %zu detected blinks labelled, %zu labels)\n",
+         title, precision, recall, f1, score.matched, score.detected, labelled);
+}
+
+/**
+ * Returns the filtered samples of a recording in mm, as the app receives them.
+ */
+std::vector<float> filteredSamples(const Recording& recording) {
+  std::vector<float> samples;
+  samples.reserve(recording.values.size());
+  Detector detector;
+  for (size_t i = 0; i < recording.values.size(); ++i) {
+    if (recording.filtered) {
+      samples.push_back((float)recording.values[i]);
+    } else {
+      detector.update(Detector::accumFromMM(recording.values[i]));
+      samples.push_back(detector.filtered() / 65536.0f);
+    }
+  }
+  return samples;
+}
+
+/**
+ * Checks that the quantile q of the estimator's values is in the bin of the sorted samples.
+ */
+size_t checkQuantile(const char* name, const ThresholdEstimator& estimator, const std::vector<float>& sorted,
+                     float q) {
+  const EstimatorHistogram& values = estimator.values;
+  int bin = histogramFind(&values, (uint32_t)(q * (values.total - 1) + 0.5f));
+  int expected = estimatorBin(sorted[(size_t)(q * (sorted.size() - 1) + 0.5f)]);
+  if (bin != expected) {
+    printf("  %s: bin %d, the sorted samples are in bin %d\n", name, bin, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Estimates the time windows from the prompted blinks of the calibration and prints the segments.
+ */
+bool estimateTiming(const std::vector<float>& samples, size_t n, const Schedule& schedule,
+                    const ThresholdEstimate* estimate, TimingEstimate& timing) {
+  std::vector<uint32_t> prompts;
+  for (unsigned k = 0; k < schedule.count; ++k) {
+    prompts.push_back(timingSample(schedule.first + k * schedule.interval));
+  }
+  bool valid = timingEstimate(&samples[0], (uint32_t)n, &prompts[0], (uint32_t)prompts.size(),
+                              estimate ? estimate->negativeThreshold : 0, estimate ? estimate->positiveThreshold : 0,
+                              &timing);
+  printf("  %u of %u prompted blinks, delay %d samples\n", timing.blinks, timing.prompts, timing.latency);
+  for (uint32_t k = 0; k < timing.prompts; ++k) {
+    const BlinkSegment& segment = timing.segments[k];
+    if (segment.valid) {
+      printf("    prompt %u (sample %u): start %u, fall %u, closed %u, rise %u, total %u samples\n", k, segment.prompt,
+             segment.start, segment.minimum - segment.start, segment.opening - segment.closed,
+             segment.maximum - segment.minimum, segment.end - segment.start);
+    } else {
+      printf("    prompt %u (sample %u): no blink\n", k, segment.prompt);
+    }
+  }
+  return valid;
+}
+
+size_t run(const char* path, const Recording& recording, const std::vector<size_t>& labels,
+           size_t calibration, const Schedule& schedule, size_t tolerance, int repeat) {
+  std::vector<float> samples = filteredSamples(recording);
+  size_t n = std::min(calibration, samples.size());
+  ThresholdEstimator* estimator = new ThresholdEstimator;
+  ThresholdEstimate estimate;
+  size_t first = 0;
+  bool valid = false;
+
+  // One untimed pass, so both timings start with the estimator and the samples in the cache.
+  estimatorInit(estimator);
+  for (size_t i = 0; i < n; ++i) {
+    estimatorAdd(estimator, samples[i]);
+    estimatorEstimate(estimator, &estimate);
+  }
+
+  // Adding only.
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) {
+    estimatorInit(estimator);
+    for (size_t i = 0; i < n; ++i) {
+      estimatorAdd(estimator, samples[i]);
+    }
+  }
+  double addSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Adding and estimating after every sample.
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) {
+    estimatorInit(estimator);
+    first = 0;
+    for (size_t i = 0; i < n; ++i) {
+      estimatorAdd(estimator, samples[i]);
+      valid = estimatorEstimate(estimator, &estimate);
+      if (valid && first == 0) {
+        first = i + 1;
+      }
+    }
+  }
+  double estimateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // One estimate of the noise floor by sorting, for comparison.
+  start = std::chrono::steady_clock::now();
+  std::vector<float> sorted(samples.begin(), samples.begin() + n);
+  std::sort(sorted.begin(), sorted.end());
+  double sortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%s: %zu samples, %zu for the estimate, %zu labels\n", path, samples.size(), n, labels.size());
+  printf("  add %.1f ns/sample, add and estimate %.1f ns/sample, sorting the samples once %.1f us\n",
+         addSeconds * 1e9 / ((double)n * repeat), estimateSeconds * 1e9 / ((double)n * repeat), sortSeconds * 1e6);
+  printf("  noise floor: median %.6f mm, sigma %.6f mm, %u positive and %u negative blink peaks\n",
+         estimate.median, estimate.sigma, estimate.positivePeaks, estimate.negativePeaks);
+
+  size_t wrong = 0;
+  if (n >= ESTIMATOR_WARMUP) {
+    wrong += checkQuantile("median", *estimator, sorted, 0.5f);
+    wrong += checkQuantile("lower noise quantile", *estimator, sorted, 0.5f - ESTIMATOR_NOISE_QUANTILE);
+    wrong += checkQuantile("upper noise quantile", *estimator, sorted, 0.5f + ESTIMATOR_NOISE_QUANTILE);
+  }
+
+  printScore("default profile ", evaluate(recording, labels, NULL, NULL, tolerance), labels.size());
+  if (valid) {
+    printf("  estimate from sample %zu on: negThresh %g posThresh %g hyst %g minMin %g maxMax %g\n", first,
+           estimate.negativeThreshold, estimate.positiveThreshold, estimate.hysteresis, estimate.minValue,
+           estimate.maxValue);
+    printScore("estimated profile", evaluate(recording, labels, &estimate, NULL, tolerance), labels.size());
+  } else if (estimate.saturated) {
+    printf("  no estimate: blinks beyond the range of %g mm (%u saturated peaks)\n", ESTIMATOR_RANGE,
+           estimate.saturatedPeaks);
+  } else {
+    printf("  no estimate: too few blink peaks\n");
+  }
+  if (schedule.count > 0 && n > 0) {
+    TimingEstimate timing;
+    if (estimateTiming(samples, n, schedule, valid ? &estimate : NULL, timing)) {
+      printf("  windows: tFall %u..%u tRise %u..%u tTotal %u..%u closed %u\n", timing.fall[0], timing.fall[1],
+             timing.rise[0], timing.rise[1], timing.total[0], timing.total[1], timing.closed);
+      printScore("with windows     ", evaluate(recording, labels, valid ? &estimate : NULL, &timing, tolerance),
+                 labels.size());
+    } else {
+      printf("  no windows: too few prompted blinks\n");
+    }
+  }
+  delete estimator;
+  return wrong;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r] [-c samples] [-p first:interval:count] [-t tolerance] [-n repeat] "
+          "<recording[:labels]>...\n", name);
+}
+
+int main(int argc, char** argv) {
+  RecordingFormat format = RECORDING_AUTO;
+  size_t calibration = (size_t)-1;
+  Schedule schedule = { 0, 0, 0 };
+  size_t tolerance = 10;
+  int repeat = 10;
+  int opt;
+  while ((opt = getopt(argc, argv, "rc:p:t:n:")) != -1) {
+    switch (opt) {
+      case 'r':
+        format = RECORDING_RAW;
+        break;
+      case 'c':
+        calibration = strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        if (sscanf(optarg, "%lf:%lf:%u", &schedule.first, &schedule.interval, &schedule.count) != 3) {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 't':
+        tolerance = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        repeat = std::max(1, atoi(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  size_t wrong = 0;
+  for (int a = optind; a < argc; ++a) {
+    std::string path(argv[a]);
+    std::string labelPath;
+    size_t colon = path.rfind(':');
+    if (colon != std::string::npos) {
+      labelPath = path.substr(colon + 1);
+      path = path.substr(0, colon);
+    }
+    Recording recording;
+    if (!loadRecording(path.c_str(), format, recording)) {
+      fprintf(stderr, "ERROR: no samples read from %s\n", path.c_str());
+      return 2;
+    }
+    std::vector<size_t> labels;
+    if (!labelPath.empty()) {
+      if (!loadLabels(labelPath.c_str(), labels)) {
+        fprintf(stderr, "ERROR: could not read labels %s\n", labelPath.c_str());
+        return 2;
+      }
+      std::sort(labels.begin(), labels.end());
+    } else if (!recording.blinkColumn.empty()) {
+      labels = recording.logBlinks();
+    } else {
+      fprintf(stderr, "ERROR: %s has no labels\n", path.c_str());
+      return 2;
+    }
+    wrong += run(path.c_str(), recording, labels, calibration, schedule, tolerance, repeat);
+  }
+  return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Benchmark of the timer wheel (TimerWheel.h) for the no blink timers of many users.
+ *
+ *   1. Rearm: cost of moving a timer to a new deadline, as every blink does, for the wheel, a
+ *      min-heap with lazy deletion (push a new entry, skip outdated ones) and a std::multimap
+ *      (erase and insert, one allocation per rearm like a new NSTimer).
+ *   2. Workload: -u users blink at random (-b per minute), every blink rearms the user's timer to
+ *      now + -i ms, an expired timer stays off until the next blink. -s s are simulated in 1 ms
+ *      ticks without waiting. All three structures must fire the same timers at their deadlines.
+ *   3. Jitter: -m timers in real time, each rearmed at random when it fires, for -j s. The loop
+ *      sleeps until nextDeadline() and reports how late the callbacks ran.
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino timerbench.cpp -o timerbench
+ * Usage:  timerbench [-u users] [-b blinks] [-i ms] [-s seconds] [-r rearms] [-m timers] [-j seconds]
+ *   -u  users of the workload (default 10000)
+ *   -b  blinks per minute and user (default 18)
+ *   -i  no blink interval in ms (default 4000)
+ *   -s  simulated seconds of the workload (default 600)
+ *   -r  rearms of the rearm benchmark (default 10000000)
+ *   -m  timers of the jitter test (default 1000)
+ *   -j  duration of the jitter test in s (default 3)
+ *
+ * Exit code is 0 if the three structures fired the same timers, each exactly at its deadline,
+ * 1 otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TimerWheel.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * percent / 100));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+/**
+ * The three deadline structures with the same interface: rearm(user, deadline) and
+ * advance(now, fired) which appends the users whose timers expired.
+ */
+class WheelTimers {
+public:
+  explicit WheelTimers(size_t users) : late(0), timers(users) {
+    for (size_t u = 0; u < users; ++u) {
+      timers[u].callback = onTimer;
+      timers[u].context = this;
+    }
+  }
+
+  void rearm(size_t user, uint32_t deadline) {
+    wheel.arm(timers[user], deadline);
+  }
+
+  void advance(uint32_t now, std::vector<uint32_t>& fired) {
+    this->fired = &fired;
+    wheel.advance(now);
+  }
+
+  unsigned long late;           // timers fired at another tick than their deadline
+
+private:
+  static void onTimer(WheelTimer* timer, uint32_t now) {
+    WheelTimers* self = (WheelTimers*)timer->context;
+    self->late += now != timer->deadline;
+    self->fired->push_back((uint32_t)(timer - &self->timers[0]));
+  }
+
+  TimerWheel wheel;
+  std::vector<WheelTimer> timers;
+  std::vector<uint32_t>* fired;
+};
+
+class HeapTimers {
+public:
+  explicit HeapTimers(size_t users) : deadlines(users), armed(users) {
+  }
+
+  void rearm(size_t user, uint32_t deadline) {
+    deadlines[user] = deadline;
+    armed[user] = true;
+    heap.push(Entry(deadline, (uint32_t)user));
+  }
+
+  void advance(uint32_t now, std::vector<uint32_t>& fired) {
+    while (!heap.empty() && (int32_t)(now - heap.top().first) >= 0) {
+      Entry entry = heap.top();
+      heap.pop();
+      if (armed[entry.second] && deadlines[entry.second] == entry.first) {
+        armed[entry.second] = false;
+        fired.push_back(entry.second);
+      }
+    }
+  }
+
+private:
+  typedef std::pair<uint32_t, uint32_t> Entry;  // deadline, user
+  std::vector<uint32_t> deadlines;
+  std::vector<bool> armed;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+};
+
+class MapTimers {
+public:
+  explicit MapTimers(size_t users) : entries(users), armed(users) {
+  }
+
+  void rearm(size_t user, uint32_t deadline) {
+    if (armed[user]) {
+      timers.erase(entries[user]);
+    }
+    entries[user] = timers.insert(std::make_pair(deadline, (uint32_t)user));
+    armed[user] = true;
+  }
+
+  void advance(uint32_t now, std::vector<uint32_t>& fired) {
+    while (!timers.empty() && (int32_t)(now - timers.begin()->first) >= 0) {
+      armed[timers.begin()->second] = false;
+      fired.push_back(timers.begin()->second);
+      timers.erase(timers.begin());
+    }
+  }
+
+private:
+  typedef std::multimap<uint32_t, uint32_t> Timers;
+  Timers timers;
+  std::vector<Timers::iterator> entries;
+  std::vector<bool> armed;
+};
+
+/**
+ * Rearms random timers to deadlines within the no blink interval. Returns ns per rearm.
+ */
+template<typename Timers>
+double rearmCost(size_t users, size_t rearms, uint32_t interval, uint32_t seed) {
+  Timers timers(users);
+  std::mt19937 random(seed);
+  std::vector<uint32_t> user(1 << 16);
+  std::vector<uint32_t> deadline(1 << 16);
+  for (size_t i = 0; i < user.size(); ++i) {
+    user[i] = random() % users;
+    deadline[i] = 1 + random() % interval;
+  }
+  for (size_t u = 0; u < users; ++u) {
+    timers.rearm(u, 1 + random() % interval);
+  }
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < rearms; ++i) {
+    timers.rearm(user[i & (user.size() - 1)], deadline[i & (deadline.size() - 1)]);
+  }
+  return seconds(start) * 1e9 / rearms;
+}
+
+struct Blink {
+  uint32_t time;                // ms
+  uint32_t user;
+
+  bool operator<(const Blink& other) const {
+    return time < other.time;
+  }
+};
+
+/**
+ * Runs the workload. Returns the fired timers (tick * users + user, in firing order per tick)
+ * and the run time in s.
+ */
+template<typename Timers>
+double workload(Timers& timers, size_t users, const std::vector<Blink>& blinks, uint32_t interval, uint32_t ticks,
+                std::vector<uint64_t>& fires) {
+  std::vector<uint32_t> fired;
+  size_t next = 0;
+  Clock::time_point start = Clock::now();
+  for (uint32_t now = 1; now <= ticks; ++now) {
+    for (; next < blinks.size() && blinks[next].time == now; ++next) {
+      timers.rearm(blinks[next].user, now + interval);
+    }
+    fired.clear();
+    timers.advance(now, fired);
+    std::sort(fired.begin(), fired.end());
+    for (size_t i = 0; i < fired.size(); ++i) {
+      fires.push_back((uint64_t)now * users + fired[i]);
+    }
+  }
+  return seconds(start);
+}
+
+/**
+ * Real time test of the wheel: returns the lateness of the callbacks in us.
+ */
+struct JitterTest {
+  JitterTest(size_t count, uint32_t seed) : timers(count), random(seed), start(Clock::now()) {
+  }
+
+  std::vector<double> run(double duration) {
+    for (size_t i = 0; i < timers.size(); ++i) {
+      timers[i].callback = onTimer;
+      timers[i].context = this;
+      wheel.arm(timers[i], 1 + random() % 2000);
+    }
+    uint32_t end = (uint32_t)(duration * 1000);
+    while (wheel.now() < end) {
+      uint32_t deadline = end;
+      if (wheel.nextDeadline(deadline) && (int32_t)(deadline - end) > 0) {
+        deadline = end;
+      }
+      std::this_thread::sleep_until(start + std::chrono::milliseconds(deadline));
+      wheel.advance((uint32_t)(seconds(start) * 1000));
+    }
+    return lateness;
+  }
+
+  static void onTimer(WheelTimer* timer, uint32_t now) {
+    JitterTest* self = (JitterTest*)timer->context;
+    self->lateness.push_back(seconds(self->start) * 1e6 - timer->deadline * 1000.0);
+    self->wheel.arm(*timer, now + 1 + self->random() % 2000);
+  }
+
+  TimerWheel wheel;
+  std::vector<WheelTimer> timers;
+  std::mt19937 random;
+  Clock::time_point start;
+  std::vector<double> lateness;
+};
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-u users] [-b blinks] [-i ms] [-s seconds] [-r rearms] [-m timers] [-j seconds]\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  size_t users = 10000;
+  double blinksPerMinute = 18;
+  uint32_t interval = 4000;
+  double simulated = 600;
+  size_t rearms = 10000000;
+  size_t jitterTimers = 1000;
+  double jitterSeconds = 3;
+  int opt;
+  while ((opt = getopt(argc, argv, "u:b:i:s:r:m:j:")) != -1) {
+    switch (opt) {
+      case 'u':
+        users = std::max(1L, atol(optarg));
+        break;
+      case 'b':
+        blinksPerMinute = std::max(0.0, atof(optarg));
+        break;
+      case 'i':
+        interval = (uint32_t)std::max(1L, atol(optarg));
+        break;
+      case 's':
+        simulated = std::max(0.001, atof(optarg));
+        break;
+      case 'r':
+        rearms = std::max(1L, atol(optarg));
+        break;
+      case 'm':
+        jitterTimers = std::max(1L, atol(optarg));
+        break;
+      case 'j':
+        jitterSeconds = std::max(0.0, atof(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  printf("rearm (%zu timers): wheel %.1f ns, heap %.1f ns, map %.1f ns\n", users,
+         rearmCost<WheelTimers>(users, rearms, interval, 1), rearmCost<HeapTimers>(users, rearms, interval, 1),
+         rearmCost<MapTimers>(users, rearms, interval, 1));
+
+  // Blinks of every user as a Poisson process.
+  uint32_t ticks = (uint32_t)(simulated * 1000);
+  std::vector<Blink> blinks;
+  std::mt19937 random(2);
+  if (blinksPerMinute > 0) {
+    std::exponential_distribution<double> pause(blinksPerMinute / 60000);
+    for (size_t u = 0; u < users; ++u) {
+      for (double t = pause(random); t < ticks; t += pause(random)) {
+        Blink blink = { (uint32_t)t + 1, (uint32_t)u };
+        blinks.push_back(blink);
+      }
+    }
+  }
+  std::sort(blinks.begin(), blinks.end());
+
+  WheelTimers wheel(users);
+  HeapTimers heap(users);
+  MapTimers map(users);
+  std::vector<uint64_t> wheelFires, heapFires, mapFires;
+  double wheelSeconds = workload(wheel, users, blinks, interval, ticks, wheelFires);
+  double heapSeconds = workload(heap, users, blinks, interval, ticks, heapFires);
+  double mapSeconds = workload(map, users, blinks, interval, ticks, mapFires);
+  bool same = wheelFires == heapFires && wheelFires == mapFires && wheel.late == 0;
+  printf("workload (%zu users, %.0f s, %zu blinks, %zu expirations): wheel %.1f ms, heap %.1f ms, map %.1f ms, %s\n",
+         users, simulated, blinks.size(), wheelFires.size(), wheelSeconds * 1e3, heapSeconds * 1e3, mapSeconds * 1e3,
+         same ? "same expirations" : "EXPIRATIONS DIFFER");
+
+  if (jitterSeconds > 0) {
+    JitterTest jitter(jitterTimers, 3);
+    std::vector<double> lateness = jitter.run(jitterSeconds);
+    printf("jitter (%zu timers, %zu callbacks): 50%% %.0f us, 99%% %.0f us, max %.0f us\n", jitterTimers,
+           lateness.size(), percentile(lateness, 50), percentile(lateness, 99), percentile(lateness, 100));
+  }
+  return same ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 University of Freiburg im Breisgau, Germany,
+ * Marlene Fiedler <fiedlerm@informatik.uni-freiburg.de>,
+ * Lorenz Miething <miethinl@informatik.uni-freiburg.de>,
+ * Benjamin Thiemann <benjamin.thiemann@neptun.uni-freiburg.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Test of the VCNL4020 acquisition (VCNL4020Acquisition.h) against a mock Wire.
+ *
+ * MockWire (MockWire.h) simulates the sensor behind the I2C bus. The proximity results are the
+ * raw counts of a capture (or a synthetic signal), one per measurement.
+ *
+ * The loop of the sketch is simulated with a clock in us: every -l us the acquisition runs once
+ * and the samples are taken out of the ring, for both paths of the sketch:
+ *   - interrupt: VCNL_INTERRUPT, update() with the data ready interrupt of the mock,
+ *   - polling:   without VCNL_INTERRUPT, poll() in continuous mode (proximity and ambient light).
+ * Per path it reports the I2C transactions per sample (counted by the mock, compared to the
+ * count of VCNL4020Bus), the bytes on the bus per sample, the samples taken, missed and dropped,
+ * and checks that the samples are the measured values in the measured order.
+ * With -x every n-th data ready interrupt gets lost, which exercises the recovery of update().
+ *
+ * Build:  g++ -O2 -std=c++11 -I../RFduino vcnlbench.cpp -o vcnlbench
+ * Usage:  vcnlbench [-s samples] [-l loop us] [-c conversion us] [-a ambient conversion us] [-x n] [<capture in raw counts>]
+ *   -s  sample slots to simulate (default 10000)
+ *   -l  time between two loop passes in us (default 250)
+ *   -c  conversion time of a proximity measurement in us (default 600)
+ *   -a  conversion time of an ambient light measurement in us (default 1000)
+ *   -x  lose every n-th data ready interrupt (default 0: none)
+ *
+ * Exit code is 0 if both paths deliver the measured values in order and the transaction counts
+ * of the mock and VCNL4020Bus agree, 1 otherwise.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "MockWire.h"
+#include "VCNL4020Acquisition.h"
+
+#define SAMPLE_PERIOD 6000  // same as the sketch
+#define SAMPLE_RING_SIZE 8  // same as the sketch
+
+struct Result {
+  unsigned long samples;
+  unsigned long missed;
+  unsigned long overflows;
+  unsigned long transactions;
+  unsigned long bytes;
+  unsigned long loopPasses;
+  unsigned long outOfOrder;     // samples which are not the next measured value
+  unsigned long lostInterrupts;
+  bool countsAgree;
+  uint32_t intervalMin;
+  uint32_t intervalMax;
+};
+
+/**
+ * Simulates 'slots' sample slots of the sketch loop.
+ */
+Result simulate(bool interrupt, const std::vector<uint16_t>& results, size_t slots, uint32_t loopStep,
+                uint32_t proxConversion, uint32_t alsConversion, unsigned loseEvery) {
+  MockWire wire(results, proxConversion, alsConversion, loseEvery);
+  VCNL4020Bus<MockWire> bus(wire, VCNL_ADDRESS);
+  SampleClock clock(SAMPLE_PERIOD);
+  VCNL4020Acquisition<MockWire, SAMPLE_RING_SIZE> acquisition(bus, clock);
+
+  uint32_t now = 1000;
+  wire.now = now;
+  if (interrupt) {
+    acquisition.beginInterrupt();
+  } else {
+    acquisition.setContinuous(true);
+    acquisition.trigger();
+  }
+  clock.start(now);
+  const unsigned long setupTransactions = wire.transactions;
+  const unsigned long setupBytes = wire.bytes;
+
+  Result result;
+  memset(&result, 0, sizeof(result));
+  bool dataReady = false;
+  uint32_t dataReadyTime = 0;
+  size_t next = 0;              // index of the next expected measurement
+  const uint32_t end = now + slots * SAMPLE_PERIOD;
+  for (; (int32_t)(now - end) < 0; now += loopStep) {
+    wire.now = now;
+    if (wire.tick(now)) {
+      // interrupt service routine of the sketch
+      dataReady = true;
+      dataReadyTime = now;
+    }
+    if (interrupt) {
+      acquisition.update(now, dataReady, dataReadyTime);
+      dataReady = false;
+    } else {
+      acquisition.poll(now);
+    }
+    uint16_t raw;
+    uint32_t time;
+    while (acquisition.take(raw, time)) {
+      // a sample may only skip measurements which were lost, never go back
+      size_t index = next;
+      while (index < wire.measurements && results[index % results.size()] != raw) {
+        ++index;
+      }
+      if (index >= wire.measurements) {
+        ++result.outOfOrder;
+      } else {
+        next = index + 1;
+      }
+    }
+    ++result.loopPasses;
+  }
+
+  const SampleClockStatistics& stats = clock.statistics();
+  result.samples = stats.samples;
+  result.missed = stats.missed;
+  result.overflows = acquisition.overflows();
+  result.transactions = wire.transactions - setupTransactions;
+  result.bytes = wire.bytes - setupBytes;
+  result.lostInterrupts = wire.lostInterrupts;
+  result.countsAgree = bus.transactions() == wire.transactions && wire.errors == 0;
+  result.intervalMin = stats.intervalMin;
+  result.intervalMax = stats.intervalMax;
+  return result;
+}
+
+bool report(const char* name, const Result& result) {
+  double samples = std::max(1UL, result.samples);
+  printf("%s: %lu samples, %lu missed, %lu dropped (ring full), %lu out of order",
+         name, result.samples, result.missed, result.overflows, result.outOfOrder);
+  if (result.samples > 1) {
+    printf(", interval %u .. %u us", result.intervalMin, result.intervalMax);
+  }
+  printf("\n");
+  printf("  %.2f I2C transactions and %.1f bytes per sample (%lu loop passes, %lu transactions)%s\n",
+         result.transactions / samples, result.bytes / samples, result.loopPasses, result.transactions,
+         result.countsAgree ? "" : ", COUNT OF VCNL4020Bus DIFFERS");
+  if (result.lostInterrupts) {
+    printf("  %lu data ready interrupts lost\n", result.lostInterrupts);
+  }
+  return result.countsAgree && result.outOfOrder == 0 && result.samples > 0;
+}
+
+void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-s samples] [-l loop us] [-c conversion us] [-a ambient conversion us] [-x n] [<capture in raw counts>]\n", name);
+}
+
+int main(int argc, char** argv) {
+  size_t slots = 10000;
+  uint32_t loopStep = 250;
+  uint32_t proxConversion = 600;
+  uint32_t alsConversion = 1000;
+  unsigned loseEvery = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:l:c:a:x:")) != -1) {
+    switch (opt) {
+      case 's':
+        slots = std::max(1L, atol(optarg));
+        break;
+      case 'l':
+        loopStep = std::max(1L, atol(optarg));
+        break;
+      case 'c':
+        proxConversion = std::max(1L, atol(optarg));
+        break;
+      case 'a':
+        alsConversion = std::max(1L, atol(optarg));
+        break;
+      case 'x':
+        loseEvery = std::max(0L, atol(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (argc - optind > 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<uint16_t> results;
+  if (optind < argc) {
+    FILE* file = fopen(argv[optind], "r");
+    if (!file) {
+      fprintf(stderr, "ERROR: cannot read %s\n", argv[optind]);
+      return 2;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+      char* end;
+      long raw = strtol(line, &end, 10);
+      if (end != line && raw > 0 && raw <= 0xFFFF) {
+        results.push_back((uint16_t)raw);
+      }
+    }
+    fclose(file);
+  } else {
+    for (size_t i = 0; i < 1000; ++i) {
+      results.push_back((uint16_t)(2000 + 500 * sin(i * 0.05)));
+    }
+  }
+  if (results.empty()) {
+    fprintf(stderr, "ERROR: no raw counts read from %s\n", argv[optind]);
+    return 2;
+  }
+
+  printf("%zu slots of %u us, loop every %u us, conversion %u us (ambient light %u us)\n",
+         slots, SAMPLE_PERIOD, loopStep, proxConversion, alsConversion);
+  bool ok = report("interrupt", simulate(true, results, slots, loopStep, proxConversion, alsConversion, loseEvery));
+  ok = report("polling  ", simulate(false, results, slots, loopStep, proxConversion, alsConversion, 0)) && ok;
+  return ok ? 0 : 1;
+}